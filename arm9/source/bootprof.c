@@ -0,0 +1,141 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include "bootprof.h"
+#include "utils.h"
+#include "fs.h"
+#include "fmt.h"
+#include "memory.h"
+#include "patches.h"
+#include "config.h"
+
+//Longest line is "firm decrypt: 4294967295 us (+4294967295)\n"
+#define BOOT_TIMELINE_LINE_SIZE 48
+#define BOOT_PROFILE_LOG_SIZE   0x1800
+
+static const char *stageNames[BOOTSTAGE_COUNT] = {
+    "mount",
+    "config",
+    "menu",
+    "emunand",
+    "firm read",
+    "firm decrypt",
+    "firm check",
+    "firm load",
+    "patch",
+    "launch"
+};
+
+static BootTimeline timeline;
+static BootTimeline *handoff;
+static u64 startTicks;
+
+static struct
+{
+    const char *name;
+    u32 failures;
+    u32 duration;
+} patches[BOOT_PROFILE_MAX_PATCHES];
+static u32 patchCount;
+static u64 patchStartTicks;
+
+static u32 ticksToUs(u64 ticks)
+{
+    return (u32)((ticks * 1000000ULL) / TICKS_PER_SEC);
+}
+
+void bootProfStart(void)
+{
+    startChrono();
+    startTicks = chronoTicks();
+}
+
+void bootProfMark(BootStage stage)
+{
+    timeline.stageEnd[stage] = ticksToUs(chronoTicks() - startTicks);
+    timeline.reachedStages |= 1 << stage;
+}
+
+void bootProfSetHandoff(BootTimeline *dst)
+{
+    handoff = dst;
+}
+
+void bootProfPatchBegin(void)
+{
+    patchStartTicks = chronoTicks();
+}
+
+u32 bootProfPatchEnd(const char *name, u32 failures)
+{
+    if(patchCount < BOOT_PROFILE_MAX_PATCHES)
+    {
+        patches[patchCount].name = name;
+        patches[patchCount].failures = failures;
+        patches[patchCount].duration = ticksToUs(chronoTicks() - patchStartTicks);
+        patchCount++;
+    }
+
+    return failures;
+}
+
+u32 bootProfFormat(char *out, const BootTimeline *timeline)
+{
+    char *pos = out;
+    u32 previousEnd = 0;
+
+    for(u32 stage = 0; stage < BOOTSTAGE_COUNT; stage++)
+    {
+        if(!(timeline->reachedStages & (1 << stage))) continue;
+
+        u32 end = timeline->stageEnd[stage];
+        pos += sprintf(pos, "%s: %lu us (+%lu)\n", stageNames[stage], end, end - previousEnd);
+        previousEnd = end;
+    }
+
+    return pos - out;
+}
+
+void bootProfFinish(void)
+{
+    bootProfMark(BOOTSTAGE_LAUNCH);
+
+    if(handoff != NULL) memcpy(handoff, &timeline, sizeof(BootTimeline));
+
+    //Opt-in, and never written to CTRNAND
+    if(!isSdMode || !CONFIG(WRITEBOOTTIMELOG)) return;
+
+    static char log[BOOT_PROFILE_LOG_SIZE];
+    char *pos = log + bootProfFormat(log, &timeline);
+
+    //Per-patch results and the patch sites found, to compare FIRM versions and builds
+    for(u32 i = 0; i < patchCount; i++)
+        pos += sprintf(pos, "%s: %lu failed, %lu us\n", patches[i].name, patches[i].failures, patches[i].duration);
+
+    pos += formatSignatureOffsets(pos, log + sizeof(log) - pos);
+
+    fileWrite(log, BOOT_TIMELINE_FILE, pos - log);
+}
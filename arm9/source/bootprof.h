@@ -0,0 +1,64 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#pragma once
+
+#include "types.h"
+
+#define BOOT_TIMELINE_MAX_STAGES    16
+#define BOOT_TIMELINE_FILE          "boottime.log"
+#define BOOT_PROFILE_MAX_PATCHES    32
+
+//Each stage is timestamped when it ends
+typedef enum BootStage
+{
+    BOOTSTAGE_MOUNT = 0,
+    BOOTSTAGE_CONFIG,
+    BOOTSTAGE_MENU,         //PIN, config menu, splash and payload selection
+    BOOTSTAGE_EMUNAND,
+    BOOTSTAGE_FIRM_READ,
+    BOOTSTAGE_FIRM_DECRYPT,
+    BOOTSTAGE_FIRM_CHECK,
+    BOOTSTAGE_FIRM_LOAD,    //External FIRM and console checks
+    BOOTSTAGE_PATCH,
+    BOOTSTAGE_LAUNCH,
+    BOOTSTAGE_COUNT
+} BootStage;
+
+//Also handed to k11_extension through CfwInfo, keep in sync
+typedef struct BootTimeline
+{
+    u32 reachedStages;                          //Bitmask of BootStage
+    u32 stageEnd[BOOT_TIMELINE_MAX_STAGES];     //In microseconds since the start of main
+} BootTimeline;
+
+void bootProfStart(void);
+void bootProfMark(BootStage stage);
+void bootProfSetHandoff(BootTimeline *dst);
+void bootProfPatchBegin(void);
+u32 bootProfPatchEnd(const char *name, u32 failures);
+u32 bootProfFormat(char *out, const BootTimeline *timeline);
+void bootProfFinish(void);
@@ -35,34 +35,59 @@
 #include "pin.h"
 
 CfgData configData;
+EmuNandLayouts emuNandLayouts;
 ConfigurationStatus needConfig;
 static CfgData oldConfig;
+static EmuNandLayouts oldEmuNandLayouts;
+
+typedef struct __attribute__((packed, aligned(4)))
+{
+    CfgData configData;
+    EmuNandLayouts emuNandLayouts;
+} ConfigFile;
 
 bool readConfig(void)
 {
     bool ret;
+    ConfigFile file;
+
+    //Rosalina only saves CfgData, the EmuNAND layouts are probed again then
+    u32 size = fileRead(&file, CONFIG_FILE, sizeof(ConfigFile));
 
-    if(fileRead(&configData, CONFIG_FILE, sizeof(CfgData)) != sizeof(CfgData) ||
-       memcmp(configData.magic, "CONF", 4) != 0 ||
-       configData.formatVersionMajor != CONFIG_VERSIONMAJOR ||
-       configData.formatVersionMinor != CONFIG_VERSIONMINOR)
+    if((size != sizeof(CfgData) && size != sizeof(ConfigFile)) ||
+       memcmp(file.configData.magic, "CONF", 4) != 0 ||
+       file.configData.formatVersionMajor != CONFIG_VERSIONMAJOR ||
+       file.configData.formatVersionMinor != CONFIG_VERSIONMINOR)
     {
         memset(&configData, 0, sizeof(CfgData));
+        memset(&emuNandLayouts, 0, sizeof(EmuNandLayouts));
 
         ret = false;
     }
-    else ret = true;
+    else
+    {
+        configData = file.configData;
+        if(size == sizeof(ConfigFile)) emuNandLayouts = file.emuNandLayouts;
+        else memset(&emuNandLayouts, 0, sizeof(EmuNandLayouts));
+
+        ret = true;
+    }
 
     oldConfig = configData;
+    oldEmuNandLayouts = emuNandLayouts;
 
     return ret;
 }
 
 void writeConfig(bool isConfigOptions)
 {
+    bool optionsChanged = needConfig == CREATE_CONFIGURATION ||
+                          (isConfigOptions && (configData.config != oldConfig.config || configData.multiConfig != oldConfig.multiConfig)) ||
+                          (!isConfigOptions && configData.bootConfig != oldConfig.bootConfig),
+         layoutsChanged = memcmp(&emuNandLayouts, &oldEmuNandLayouts, sizeof(EmuNandLayouts)) != 0;
+
     //If the configuration is different from previously, overwrite it.
-    if(needConfig != CREATE_CONFIGURATION && ((isConfigOptions && configData.config == oldConfig.config && configData.multiConfig == oldConfig.multiConfig) ||
-                                              (!isConfigOptions && configData.bootConfig == oldConfig.bootConfig))) return;
+    if(!optionsChanged && !layoutsChanged) return;
 
     if(needConfig == CREATE_CONFIGURATION)
     {
@@ -73,8 +98,13 @@ void writeConfig(bool isConfigOptions)
         needConfig = MODIFY_CONFIGURATION;
     }
 
-    if(!fileWrite(&configData, CONFIG_FILE, sizeof(CfgData)))
+    ConfigFile file = {configData, emuNandLayouts};
+
+    //Failing to save the EmuNAND layouts alone only costs a probe on the next boot
+    if(!fileWrite(&file, CONFIG_FILE, sizeof(ConfigFile)) && optionsChanged)
         error("Error writing the configuration file");
+
+    oldEmuNandLayouts = emuNandLayouts;
 }
 
 void configMenu(bool oldPinStatus, u32 oldPinMode)
@@ -96,6 +126,8 @@ void configMenu(bool oldPinStatus, u32 oldPinMode)
                                                "( ) Set developer UNITINFO",
                                                "( ) Cut 3DS Wifi in sleep mode",
                                                "( ) Enable Rosalina on SAFE_FIRM",
+                                               "( ) Cache the decrypted FIRM on the SD",
+                                               "( ) Write a boot timing log to the SD",
                                              };
 
     static const char *optionsDescription[]  = { "Select the default EmuNAND.\n\n"
@@ -204,6 +236,18 @@ void configMenu(bool oldPinStatus, u32 oldPinMode)
                                                  "New 2DS XL consoles.\n\n"
                                                  "Only select this if you know what you\n"
                                                  "are doing!",
+
+                                                 "Keep a copy of the decrypted CTRNAND\n"
+                                                 "FIRM in /luma/cache to boot faster.\n\n"
+                                                 "It is checked against the CTRNAND\n"
+                                                 "content on every boot and replaced\n"
+                                                 "after a system update.",
+
+                                                 "Record how long each boot stage\n"
+                                                 "and FIRM patch takes in\n"
+                                                 "/luma/boottime.log.\n\n"
+                                                 "Only useful to troubleshoot slow\n"
+                                                 "boots.",
                                                };
 
     FirmwareSource nandType = FIRMWARE_SYSNAND;
@@ -241,6 +285,8 @@ void configMenu(bool oldPinStatus, u32 oldPinMode)
         { .visible = true },
         { .visible = false },
         { .visible  = ISN3DS },
+        { .visible = isSdMode },
+        { .visible = isSdMode },
     };
 
     //Calculate the amount of the various kinds of options and pre-select the first single one
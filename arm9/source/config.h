@@ -62,6 +62,8 @@ enum singleOptions
     PATCHUNITINFO,
     CUTSLEEPWIFI,
     ENABLESAFEFIRMROSALINA,
+    CACHEDECRYPTEDFIRM,
+    WRITEBOOTTIMELOG,
 };
 
 typedef enum ConfigurationStatus
@@ -72,6 +74,7 @@ typedef enum ConfigurationStatus
 } ConfigurationStatus;
 
 extern CfgData configData;
+extern EmuNandLayouts emuNandLayouts;
 
 bool readConfig(void);
 void writeConfig(bool isConfigOptions);
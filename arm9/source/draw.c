@@ -37,22 +37,44 @@
 #include "fmt.h"
 #include "font.h"
 #include "config.h"
+#include "lz4.h"
+
+//Compressed splashes are read there first, the FIRM is only loaded later on
+#define SPLASH_LZ4_BUFFER ((u8 *)0x20001000)
+
+static u32 getSplashSize(const char *path, u32 fbSize)
+{
+    u32 size = getFileSize(path);
+
+    //Anything smaller than a raw framebuffer dump has to be an LZ4 frame
+    return size <= fbSize ? size : 0;
+}
+
+static bool readSplash(u8 *fb, const char *path, u32 fbSize, u32 size)
+{
+    if(size == fbSize) return fileRead(fb, path, fbSize) == fbSize;
+
+    return fileRead(SPLASH_LZ4_BUFFER, path, size) == size && lz4DecompressFrame(fb, fbSize, SPLASH_LZ4_BUFFER, size) == fbSize;
+}
 
 bool loadSplash(void)
 {
     static const char *topSplashFile = "splash.bin",
                       *bottomSplashFile = "splashbottom.bin";
 
-    bool isTopSplashValid = getFileSize(topSplashFile) == SCREEN_TOP_FBSIZE,
-         isBottomSplashValid = getFileSize(bottomSplashFile) == SCREEN_BOTTOM_FBSIZE;
+    u32 topSplashSize = getSplashSize(topSplashFile, SCREEN_TOP_FBSIZE),
+        bottomSplashSize = getSplashSize(bottomSplashFile, SCREEN_BOTTOM_FBSIZE);
+
+    bool isTopSplashValid = topSplashSize != 0,
+         isBottomSplashValid = bottomSplashSize != 0;
 
     //Don't delay boot nor init the screens if no splash images or invalid splash images are on the SD
     if(!isTopSplashValid && !isBottomSplashValid) return false;
 
     initScreens();
 
-    if(isTopSplashValid) isTopSplashValid = fileRead(fbs[1].top_left, topSplashFile, SCREEN_TOP_FBSIZE) == SCREEN_TOP_FBSIZE;
-    if(isBottomSplashValid) isBottomSplashValid = fileRead(fbs[1].bottom, bottomSplashFile, SCREEN_BOTTOM_FBSIZE) == SCREEN_BOTTOM_FBSIZE;
+    if(isTopSplashValid) isTopSplashValid = readSplash(fbs[1].top_left, topSplashFile, SCREEN_TOP_FBSIZE, topSplashSize);
+    if(isBottomSplashValid) isBottomSplashValid = readSplash(fbs[1].bottom, bottomSplashFile, SCREEN_BOTTOM_FBSIZE, bottomSplashSize);
 
     if(!isTopSplashValid && !isBottomSplashValid) return false;
 
@@ -34,10 +34,24 @@
 #include "utils.h"
 #include "fatfs/sdmmc/sdmmc.h"
 #include "large_patches.h"
+#include "config.h"
 
 u32 emuOffset,
     emuHeader;
 
+static void setEmuNand(FirmwareSource nandType, u32 offset, u32 header)
+{
+    u32 index = (u32)nandType - 1;
+
+    emuOffset = offset;
+    emuHeader = header;
+
+    //Remember the layout, it gets saved along with the configuration
+    emuNandLayouts.layouts[index].offset = offset;
+    emuNandLayouts.layouts[index].header = header;
+    emuNandLayouts.knownLayouts |= 1 << index;
+}
+
 void locateEmuNand(FirmwareSource *nandType)
 {
     static u8 __attribute__((aligned(4))) temp[0x200];
@@ -49,6 +63,35 @@ void locateEmuNand(FirmwareSource *nandType)
         nandSize = getMMCDevice(0)->total_size;
         sdmmc_sdcard_readsectors(0, 1, temp);
         fatStart = *(u32 *)(temp + 0x1C6); //First sector of the FAT partition
+
+        //Drop the saved layouts if the SD card or its partitioning changed
+        u32 sdCid[4];
+        sdmmc_get_cid(false, sdCid);
+
+        if(memcmp(emuNandLayouts.sdCid, sdCid, sizeof(sdCid)) != 0 || emuNandLayouts.nandSize != nandSize || emuNandLayouts.fatStart != fatStart)
+        {
+            memset(&emuNandLayouts, 0, sizeof(EmuNandLayouts));
+            memcpy(emuNandLayouts.sdCid, sdCid, sizeof(sdCid));
+            emuNandLayouts.nandSize = nandSize;
+            emuNandLayouts.fatStart = fatStart;
+        }
+    }
+
+    //A single read is enough to confirm a known layout
+    u32 index = (u32)*nandType - 1;
+    if(emuNandLayouts.knownLayouts & (1 << index))
+    {
+        u32 offset = emuNandLayouts.layouts[index].offset,
+            header = emuNandLayouts.layouts[index].header;
+
+        if(!sdmmc_sdcard_readsectors(offset + header, 1, temp) && memcmp(temp + 0x100, "NCSD", 4) == 0)
+        {
+            emuOffset = offset;
+            emuHeader = header;
+            return;
+        }
+
+        emuNandLayouts.knownLayouts &= ~(1 << index);
     }
 
     for(u32 i = 0; i < 3; i++)
@@ -76,16 +119,14 @@ void locateEmuNand(FirmwareSource *nandType)
             //Check for RedNAND
             if(!sdmmc_sdcard_readsectors(nandOffset + 1, 1, temp) && memcmp(temp + 0x100, "NCSD", 4) == 0)
             {
-                emuOffset = nandOffset + 1;
-                emuHeader = 0;
+                setEmuNand(*nandType, nandOffset + 1, 0);
                 return;
             }
 
             //Check for Gateway EmuNAND
             else if(i != 2 && !sdmmc_sdcard_readsectors(nandOffset + nandSize, 1, temp) && memcmp(temp + 0x100, "NCSD", 4) == 0)
             {
-                emuOffset = nandOffset;
-                emuHeader = nandSize;
+                setEmuNand(*nandType, nandOffset, nandSize);
                 return;
             }
         }
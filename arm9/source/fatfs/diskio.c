@@ -11,11 +11,154 @@
 #include "sdmmc/sdmmc.h"
 #include "../crypto.h"
 #include "../i2c.h"
+#include "../memory.h"
+#include "ffconf.h"
 
 /* Definitions of physical drive number for each media */
 #define SDCARD        0
 #define CTRNAND       1
 
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+/* FatFs only keeps a single sector window per volume, so walking a FAT  */
+/* chain or a directory hits the card once per sector, and every CTRNAND */
+/* access is also an AES-CTR pass. Single-sector reads are served from   */
+/* small LRU pools of aligned multi-sector lines instead, which doubles  */
+/* as read-ahead. FAT, directory and file data use separate pools so a   */
+/* file read can't evict the metadata needed to locate the next file.    */
+/* Multi-sector reads bypass the cache; writes are write-through.        */
+
+#define CACHE_LINE_SECTORS  8
+#define CACHE_LINE_SIZE     (CACHE_LINE_SECTORS * FF_MAX_SS)
+
+#define FAT_CACHE_LINES     4
+#define DIR_CACHE_LINES     4
+#define DATA_CACHE_LINES    2
+
+typedef struct CacheLine {
+    BYTE data[CACHE_LINE_SIZE] __attribute__((aligned(4)));
+    DWORD sector;           /* First sector of the line */
+    DWORD lastUse;
+    BYTE pdrv;
+    BYTE valid;
+} CacheLine;
+
+typedef struct CachePool {
+    CacheLine *lines;
+    UINT count;
+} CachePool;
+
+typedef struct CacheLayout {
+    const BYTE *win;        /* FatFs window of the mounted volume */
+    DWORD fatStart;
+    DWORD fatEnd;
+} CacheLayout;
+
+static CacheLine fatLines[FAT_CACHE_LINES],
+                 dirLines[DIR_CACHE_LINES],
+                 dataLines[DATA_CACHE_LINES];
+
+static CachePool pools[] = {
+    {fatLines, FAT_CACHE_LINES},
+    {dirLines, DIR_CACHE_LINES},
+    {dataLines, DATA_CACHE_LINES}
+};
+
+static CacheLayout layouts[FF_VOLUMES];
+static DWORD cacheClock;
+
+static DRESULT readSectors(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    return ((pdrv == SDCARD && !sdmmc_sdcard_readsectors(sector, count, buff)) ||
+            (pdrv == CTRNAND && !ctrNandRead(sector, count, buff))) ? RES_OK : RES_PARERR;
+}
+
+static CachePool *getCachePool(BYTE pdrv, const BYTE *buff, DWORD sector)
+{
+    const CacheLayout *layout = &layouts[pdrv];
+
+    /* Anything FatFs reads into its window is either FAT or directory data */
+    if(layout->win == NULL || buff != layout->win) return &pools[2];
+
+    return sector >= layout->fatStart && sector < layout->fatEnd ? &pools[0] : &pools[1];
+}
+
+static CacheLine *getCacheLine(BYTE pdrv, const BYTE *buff, DWORD sector)
+{
+    CachePool *pool = getCachePool(pdrv, buff, sector);
+    DWORD lineSector = sector & ~(CACHE_LINE_SECTORS - 1);
+    CacheLine *victim = &pool->lines[0];
+
+    for(UINT i = 0; i < pool->count; i++)
+    {
+        CacheLine *line = &pool->lines[i];
+
+        if(line->valid && line->pdrv == pdrv && line->sector == lineSector)
+        {
+            line->lastUse = ++cacheClock;
+            return line;
+        }
+
+        if(!line->valid || (victim->valid && line->lastUse < victim->lastUse)) victim = line;
+    }
+
+    /* The line may extend past the end of the medium, let the caller fall back */
+    victim->valid = 0;
+    if(readSectors(pdrv, victim->data, lineSector, CACHE_LINE_SECTORS) != RES_OK) return NULL;
+
+    victim->pdrv = pdrv;
+    victim->sector = lineSector;
+    victim->lastUse = ++cacheClock;
+    victim->valid = 1;
+
+    return victim;
+}
+
+static void updateCache(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count, BYTE success)
+{
+    for(UINT i = 0; i < sizeof(pools) / sizeof(pools[0]); i++)
+        for(UINT j = 0; j < pools[i].count; j++)
+        {
+            CacheLine *line = &pools[i].lines[j];
+
+            if(!line->valid || line->pdrv != pdrv ||
+               line->sector >= sector + count || line->sector + CACHE_LINE_SECTORS <= sector) continue;
+
+            if(!success)
+            {
+                line->valid = 0;
+                continue;
+            }
+
+            DWORD start = line->sector > sector ? line->sector : sector,
+                  end = line->sector + CACHE_LINE_SECTORS < sector + count ? line->sector + CACHE_LINE_SECTORS : sector + count;
+
+            memcpy(line->data + (start - line->sector) * FF_MAX_SS, buff + (start - sector) * FF_MAX_SS, (end - start) * FF_MAX_SS);
+        }
+}
+
+static void invalidateCache(BYTE pdrv)
+{
+    for(UINT i = 0; i < sizeof(pools) / sizeof(pools[0]); i++)
+        for(UINT j = 0; j < pools[i].count; j++)
+            if(pools[i].lines[j].pdrv == pdrv) pools[i].lines[j].valid = 0;
+
+    layouts[pdrv].win = NULL;
+}
+
+void disk_setlayout (
+    BYTE pdrv,			/* Physical drive nmuber to identify the drive */
+    const BYTE *win,	/* FatFs window of the volume mounted on the drive */
+    DWORD fatStart,		/* First sector of the FATs */
+    DWORD fatSectors	/* Total size of the FATs in sectors */
+)
+{
+    layouts[pdrv].win = win;
+    layouts[pdrv].fatStart = fatStart;
+    layouts[pdrv].fatEnd = fatStart + fatSectors;
+}
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -42,6 +185,9 @@ DSTATUS disk_initialize (
 
         if(sdmmcInitResult == 4) sdmmcInitResult = sdmmc_sdcard_init();
 
+        /* CTRNAND can be remounted from a different NAND, drop anything cached */
+        invalidateCache(pdrv);
+
     return ((pdrv == SDCARD && !(sdmmcInitResult & 2)) ||
             (pdrv == CTRNAND && !(sdmmcInitResult & 1) && !ctrNandInit())) ? 0 : STA_NOINIT;
 }
@@ -59,8 +205,18 @@ DRESULT disk_read (
     UINT count		/* Number of sectors to read */
 )
 {
-    return ((pdrv == SDCARD && !sdmmc_sdcard_readsectors(sector, count, buff)) ||
-            (pdrv == CTRNAND && !ctrNandRead(sector, count, buff))) ? RES_OK : RES_PARERR;
+    if(count >= CACHE_LINE_SECTORS) return readSectors(pdrv, buff, sector, count);
+
+    for(UINT i = 0; i < count; i++)
+    {
+        CacheLine *line = getCacheLine(pdrv, buff, sector + i);
+
+        if(line == NULL) return readSectors(pdrv, buff, sector, count);
+
+        memcpy(buff + i * FF_MAX_SS, line->data + ((sector + i) - line->sector) * FF_MAX_SS, FF_MAX_SS);
+    }
+
+    return RES_OK;
 }
 
 
@@ -77,8 +233,12 @@ DRESULT disk_write (
     UINT count			/* Number of sectors to write */
 )
 {
-    return ((pdrv == SDCARD && (*(vu16 *)(SDMMC_BASE + REG_SDSTATUS0) & TMIO_STAT0_WRPROTECT) != 0 && !sdmmc_sdcard_writesectors(sector, count, buff)) ||
-            (pdrv == CTRNAND && !ctrNandWrite(sector, count, buff))) ? RES_OK : RES_PARERR;
+    DRESULT res = ((pdrv == SDCARD && (*(vu16 *)(SDMMC_BASE + REG_SDSTATUS0) & TMIO_STAT0_WRPROTECT) != 0 && !sdmmc_sdcard_writesectors(sector, count, buff)) ||
+                   (pdrv == CTRNAND && !ctrNandWrite(sector, count, buff))) ? RES_OK : RES_PARERR;
+
+    updateCache(pdrv, buff, sector, count, res == RES_OK);
+
+    return res;
 }
 #endif
 
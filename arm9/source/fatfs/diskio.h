@@ -37,6 +37,7 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+void disk_setlayout (BYTE pdrv, const BYTE* win, DWORD fatStart, DWORD fatSectors);
 
 DWORD get_fattime( void ); // not a disk control function, but fits here
 
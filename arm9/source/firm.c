@@ -37,9 +37,25 @@
 #include "screen.h"
 #include "fmt.h"
 #include "chainloader.h"
+#include "bootprof.h"
 
 static Firm *firm = (Firm *)0x20001000;
 
+//Times each patch and records its result in the boot profile
+#define APPLY_PATCH(func, ...) (bootProfPatchBegin(), bootProfPatchEnd(#func, func(__VA_ARGS__)))
+
+//Appended to the decrypted FIRM in the SD cache: the CTRNAND content it was decrypted from, and its section hashes
+typedef struct FirmCacheFooter
+{
+    char magic[4];
+    u32 contentId;
+    u32 contentSize;
+    u16 titleVersion;
+    u16 reserved;
+    u32 firmSize;
+    u8 sectionHashes[4][0x20];
+} FirmCacheFooter;
+
 static __attribute__((noinline)) bool overlaps(u32 as, u32 ae, u32 bs, u32 be)
 {
     if(as <= bs && bs <= ae)
@@ -149,24 +165,88 @@ static inline u32 loadFirmFromStorage(FirmwareType firmType)
     return firmSize;
 }
 
+static void getFirmCachePath(char *path, FirmwareType firmType)
+{
+    static const char *firmNames[] = {"native", "twl", "agb", "safe", "sysupdater"};
+
+    sprintf(path, "cache/%s.firm", firmNames[(u32)firmType]);
+}
+
+//The caller still has to check the sections against the hashes with checkFirm()
+static u32 loadCachedFirm(FirmwareType firmType, const FirmContent *content)
+{
+    char path[32];
+    getFirmCachePath(path, firmType);
+
+    u32 size = fileRead(firm, path, 0x400000 + sizeof(FirmCacheFooter));
+    if(size <= sizeof(FirmCacheFooter) + 0x200) return 0;
+
+    //The content ID and the title version change with every FIRM title update
+    const FirmCacheFooter *footer = (const FirmCacheFooter *)((u8 *)firm + size - sizeof(FirmCacheFooter));
+    if(memcmp(footer->magic, "FCC2", 4) != 0 || footer->contentId != content->id || footer->contentSize != content->size ||
+       footer->titleVersion != content->titleVersion || footer->firmSize != size - sizeof(FirmCacheFooter)) return 0;
+
+    if(memcmp(firm, "FIRM", 4) != 0) return 0;
+
+    //A header that doesn't have the hashes of the FIRM that was cached doesn't go with its sections
+    for(u32 i = 0; i < 4; i++)
+        if(memcmp(firm->section[i].hash, footer->sectionHashes[i], 0x20) != 0) return 0;
+
+    return footer->firmSize;
+}
+
+static void saveCachedFirm(FirmwareType firmType, const FirmContent *content, u32 firmSize)
+{
+    char path[32];
+    getFirmCachePath(path, firmType);
+
+    //There is always room after the FIRM, it was decrypted from the larger CXI
+    FirmCacheFooter *footer = (FirmCacheFooter *)((u8 *)firm + firmSize);
+    memcpy(footer->magic, "FCC2", 4);
+    footer->contentId = content->id;
+    footer->contentSize = content->size;
+    footer->titleVersion = content->titleVersion;
+    footer->reserved = 0;
+    footer->firmSize = firmSize;
+    for(u32 i = 0; i < 4; i++)
+        memcpy(footer->sectionHashes[i], firm->section[i].hash, 0x20);
+
+    //Failing to cache isn't fatal
+    fileWrite(firm, path, firmSize + sizeof(FirmCacheFooter));
+}
+
 u32 loadNintendoFirm(FirmwareType *firmType, FirmwareSource nandType, bool loadFromStorage, bool isSafeMode)
 {
     u32 firmVersion,
         firmSize;
+    FirmContent content;
 
-    bool ctrNandError = isSdMode && !mountFs(false, false);
+    bool ctrNandError = isSdMode && !mountFs(false, false),
+         useFirmCache = isSdMode && CONFIG(CACHEDECRYPTEDFIRM);
 
     if(!ctrNandError)
     {
-        //Load FIRM from CTRNAND
-        firmVersion = firmRead(firm, (u32)*firmType);
+        //Only locate the FIRM content first, it might not need to be read
+        firmVersion = firmLocate(&content, (u32)*firmType) ? content.id : 0xFFFFFFFF;
 
         if(firmVersion == 0xFFFFFFFF) ctrNandError = true;
+
+        //A corrupted cached FIRM fails the hash checks and gets replaced
+        else if(useFirmCache && (firmSize = loadCachedFirm(*firmType, &content)) != 0 && checkFirm(firmSize))
+            bootProfMark(BOOTSTAGE_FIRM_CHECK);
+
+        //Load FIRM from CTRNAND
+        else if(fileRead(firm, content.path, 0x400000 + sizeof(Cxi) + 0x200) != content.size) ctrNandError = true;
         else
         {
+            bootProfMark(BOOTSTAGE_FIRM_READ);
+
             firmSize = decryptExeFs((Cxi *)firm);
+            bootProfMark(BOOTSTAGE_FIRM_DECRYPT);
 
             if(!firmSize || !checkFirm(firmSize)) ctrNandError = true;
+            else if(useFirmCache) saveCachedFirm(*firmType, &content, firmSize);
+            bootProfMark(BOOTSTAGE_FIRM_CHECK);
         }
     }
 
@@ -232,6 +312,8 @@ u32 loadNintendoFirm(FirmwareType *firmType, FirmwareSource nandType, bool loadF
         }
     }
 
+    bootProfMark(BOOTSTAGE_FIRM_LOAD);
+
     return firmVersion;
 }
 
@@ -367,6 +449,12 @@ u32 patchNativeFirm(u32 firmVersion, FirmwareSource nandType, bool loadFromStora
         process9MemAddr;
     u8 *process9Offset = getProcess9Info(arm9Section, firm->section[2].size, &process9Size, &process9MemAddr);
 
+    u32 kernel9Size = (u32)(process9Offset - arm9Section) - sizeof(Cxi) - 0x200,
+        ret = 0;
+
+    //Take the patch sites from the cache if this FIRM has been patched the same way before
+    loadSignatureCache(firm, NATIVE_FIRM);
+
     //Find the Kernel11 SVC table and handler, exceptions page and free space locations
     u32 baseK11VA;
     u8 *freeK11Space;
@@ -374,58 +462,57 @@ u32 patchNativeFirm(u32 firmVersion, FirmwareSource nandType, bool loadFromStora
         *arm11ExceptionsPage,
         *arm11SvcTable = getKernel11Info(arm11Section1, firm->section[1].size, &baseK11VA, &freeK11Space, &arm11SvcHandler, &arm11ExceptionsPage);
 
-    u32 kernel9Size = (u32)(process9Offset - arm9Section) - sizeof(Cxi) - 0x200,
-        ret = 0;
-
     //Skip on FIRMs < 4.0
     if(ISN3DS || firmVersion >= 0x1D)
     {
-        ret += installK11Extension(arm11Section1, firm->section[1].size, needToInitSd, baseK11VA, arm11ExceptionsPage, &freeK11Space);
-        ret += patchKernel11(arm11Section1, firm->section[1].size, baseK11VA, arm11SvcTable, arm11ExceptionsPage);
+        ret += APPLY_PATCH(installK11Extension, arm11Section1, firm->section[1].size, needToInitSd, baseK11VA, arm11ExceptionsPage, &freeK11Space);
+        ret += APPLY_PATCH(patchKernel11, arm11Section1, firm->section[1].size, baseK11VA, arm11SvcTable, arm11ExceptionsPage);
     }
 
     //Apply signature patches
-    ret += patchSignatureChecks(process9Offset, process9Size);
+    ret += APPLY_PATCH(patchSignatureChecks, process9Offset, process9Size);
 
     //Apply EmuNAND patches
-    if(nandType != FIRMWARE_SYSNAND) ret += patchEmuNand(arm9Section, kernel9Size, process9Offset, process9Size, firm->section[2].address, firmVersion);
+    if(nandType != FIRMWARE_SYSNAND) ret += APPLY_PATCH(patchEmuNand, arm9Section, kernel9Size, process9Offset, process9Size, firm->section[2].address, firmVersion);
 
     //Apply FIRM0/1 writes patches on SysNAND to protect A9LH
-    else if(isFirmProtEnabled) ret += patchFirmWrites(process9Offset, process9Size);
+    else if(isFirmProtEnabled) ret += APPLY_PATCH(patchFirmWrites, process9Offset, process9Size);
 
     //Apply firmlaunch patches
-    ret += patchFirmlaunches(process9Offset, process9Size, process9MemAddr);
+    ret += APPLY_PATCH(patchFirmlaunches, process9Offset, process9Size, process9MemAddr);
 
     //Apply dev unit check patches related to NCCH encryption
     if(!ISDEVUNIT)
     {
-        ret += patchZeroKeyNcchEncryptionCheck(process9Offset, process9Size);
-        ret += patchNandNcchEncryptionCheck(process9Offset, process9Size);
+        ret += APPLY_PATCH(patchZeroKeyNcchEncryptionCheck, process9Offset, process9Size);
+        ret += APPLY_PATCH(patchNandNcchEncryptionCheck, process9Offset, process9Size);
     }
 
     //Apply anti-anti-DG patches on 11.0+
-    if(firmVersion >= (ISN3DS ? 0x21 : 0x52)) ret += patchTitleInstallMinVersionChecks(process9Offset, process9Size, firmVersion);
+    if(firmVersion >= (ISN3DS ? 0x21 : 0x52)) ret += APPLY_PATCH(patchTitleInstallMinVersionChecks, process9Offset, process9Size, firmVersion);
 
     //Patch P9 AM ticket wrapper on 11.8+ to use 0 Key and IV, only with UNITINFO patch on to prevent NIM from actually sending any
-    if(doUnitinfoPatch && firmVersion >= (ISN3DS ? 0x35 : 0x64)) ret += patchP9AMTicketWrapperZeroKeyIV(process9Offset, process9Size, firmVersion);
+    if(doUnitinfoPatch && firmVersion >= (ISN3DS ? 0x35 : 0x64)) ret += APPLY_PATCH(patchP9AMTicketWrapperZeroKeyIV, process9Offset, process9Size, firmVersion);
 
     //Apply UNITINFO patches
     if(doUnitinfoPatch)
     {
-        ret += patchUnitInfoValueSet(arm9Section, kernel9Size);
-        if(!ISDEVUNIT) ret += patchCheckForDevCommonKey(process9Offset, process9Size);
+        ret += APPLY_PATCH(patchUnitInfoValueSet, arm9Section, kernel9Size);
+        if(!ISDEVUNIT) ret += APPLY_PATCH(patchCheckForDevCommonKey, process9Offset, process9Size);
     }
 
     //Arm9 exception handlers
-    ret += patchArm9ExceptionHandlersInstall(arm9Section, kernel9Size);
-    ret += patchSvcBreak9(arm9Section, kernel9Size, (u32)firm->section[2].address);
-    ret += patchKernel9Panic(arm9Section, kernel9Size);
+    ret += APPLY_PATCH(patchArm9ExceptionHandlersInstall, arm9Section, kernel9Size);
+    ret += APPLY_PATCH(patchSvcBreak9, arm9Section, kernel9Size, (u32)firm->section[2].address);
+    ret += APPLY_PATCH(patchKernel9Panic, arm9Section, kernel9Size);
 
-    ret += patchP9AccessChecks(process9Offset, process9Size);
+    ret += APPLY_PATCH(patchP9AccessChecks, process9Offset, process9Size);
 
     mergeSection0(NATIVE_FIRM, firmVersion, loadFromStorage);
     firm->section[0].size = 0;
 
+    saveSignatureCache();
+
     return ret;
 }
 
@@ -452,16 +539,19 @@ u32 patchTwlFirm(u32 firmVersion, bool loadFromStorage, bool doUnitinfoPatch)
     u32 kernel9Size = (u32)(process9Offset - arm9Section) - sizeof(Cxi) - 0x200,
         ret = 0;
 
-    ret += patchLgySignatureChecks(process9Offset, process9Size);
-    ret += patchTwlInvalidSignatureChecks(process9Offset, process9Size);
-    ret += patchTwlNintendoLogoChecks(process9Offset, process9Size);
-    ret += patchTwlWhitelistChecks(process9Offset, process9Size);
-    if(ISN3DS || firmVersion > 0x11) ret += patchTwlFlashcartChecks(process9Offset, process9Size, firmVersion);
-    else if(!ISN3DS && firmVersion == 0x11) ret += patchOldTwlFlashcartChecks(process9Offset, process9Size);
-    ret += patchTwlShaHashChecks(process9Offset, process9Size);
+    //Take the patch sites from the cache if this FIRM has been patched the same way before
+    loadSignatureCache(firm, TWL_FIRM);
+
+    ret += APPLY_PATCH(patchLgySignatureChecks, process9Offset, process9Size);
+    ret += APPLY_PATCH(patchTwlInvalidSignatureChecks, process9Offset, process9Size);
+    ret += APPLY_PATCH(patchTwlNintendoLogoChecks, process9Offset, process9Size);
+    ret += APPLY_PATCH(patchTwlWhitelistChecks, process9Offset, process9Size);
+    if(ISN3DS || firmVersion > 0x11) ret += APPLY_PATCH(patchTwlFlashcartChecks, process9Offset, process9Size, firmVersion);
+    else if(!ISN3DS && firmVersion == 0x11) ret += APPLY_PATCH(patchOldTwlFlashcartChecks, process9Offset, process9Size);
+    ret += APPLY_PATCH(patchTwlShaHashChecks, process9Offset, process9Size);
 
     //Apply UNITINFO patch
-    if(doUnitinfoPatch) ret += patchUnitInfoValueSet(arm9Section, kernel9Size);
+    if(doUnitinfoPatch) ret += APPLY_PATCH(patchUnitInfoValueSet, arm9Section, kernel9Size);
 
     if(loadFromStorage)
     {
@@ -469,6 +559,8 @@ u32 patchTwlFirm(u32 firmVersion, bool loadFromStorage, bool doUnitinfoPatch)
         firm->section[0].size = 0;
     }
 
+    saveSignatureCache();
+
     return ret;
 }
 
@@ -491,11 +583,14 @@ u32 patchAgbFirm(bool loadFromStorage, bool doUnitinfoPatch)
     u32 kernel9Size = (u32)(process9Offset - arm9Section) - sizeof(Cxi) - 0x200,
         ret = 0;
 
-    ret += patchLgySignatureChecks(process9Offset, process9Size);
-    if(CONFIG(SHOWGBABOOT)) ret += patchAgbBootSplash(process9Offset, process9Size);
+    //Take the patch sites from the cache if this FIRM has been patched the same way before
+    loadSignatureCache(firm, AGB_FIRM);
+
+    ret += APPLY_PATCH(patchLgySignatureChecks, process9Offset, process9Size);
+    if(CONFIG(SHOWGBABOOT)) ret += APPLY_PATCH(patchAgbBootSplash, process9Offset, process9Size);
 
     //Apply UNITINFO patch
-    if(doUnitinfoPatch) ret += patchUnitInfoValueSet(arm9Section, kernel9Size);
+    if(doUnitinfoPatch) ret += APPLY_PATCH(patchUnitInfoValueSet, arm9Section, kernel9Size);
 
     if(loadFromStorage)
     {
@@ -503,6 +598,8 @@ u32 patchAgbFirm(bool loadFromStorage, bool doUnitinfoPatch)
         firm->section[0].size = 0;
     }
 
+    saveSignatureCache();
+
     return ret;
 }
 
@@ -525,13 +622,13 @@ u32 patch1x2xNativeAndSafeFirm(void)
     u32 kernel9Size = (u32)(process9Offset - arm9Section) - sizeof(Cxi) - 0x200,
         ret = 0;
 
-    ret += ISN3DS ? patchFirmWrites(process9Offset, process9Size) : patchOldFirmWrites(process9Offset, process9Size);
+    ret += ISN3DS ? APPLY_PATCH(patchFirmWrites, process9Offset, process9Size) : APPLY_PATCH(patchOldFirmWrites, process9Offset, process9Size);
 
-    ret += ISN3DS ? patchSignatureChecks(process9Offset, process9Size) : patchOldSignatureChecks(process9Offset, process9Size);
+    ret += ISN3DS ? APPLY_PATCH(patchSignatureChecks, process9Offset, process9Size) : APPLY_PATCH(patchOldSignatureChecks, process9Offset, process9Size);
 
     //Arm9 exception handlers
-    ret += patchArm9ExceptionHandlersInstall(arm9Section, kernel9Size);
-    ret += patchSvcBreak9(arm9Section, kernel9Size, (u32)firm->section[2].address);
+    ret += APPLY_PATCH(patchArm9ExceptionHandlersInstall, arm9Section, kernel9Size);
+    ret += APPLY_PATCH(patchSvcBreak9, arm9Section, kernel9Size, (u32)firm->section[2].address);
 
     //Apply firmlaunch patches
     //Doesn't work here if Luma is on SD. If you want to use SAFE_FIRM on 1.0, use Luma from NAND & uncomment this line:
@@ -547,13 +644,13 @@ u32 patch1x2xNativeAndSafeFirm(void)
             *arm11ExceptionsPage,
             *arm11SvcTable = getKernel11Info(arm11Section1, firm->section[1].size, &baseK11VA, &freeK11Space, &arm11SvcHandler, &arm11ExceptionsPage);
 
-        ret += installK11Extension(arm11Section1, firm->section[1].size, false, baseK11VA, arm11ExceptionsPage, &freeK11Space);
-        ret += patchKernel11(arm11Section1, firm->section[1].size, baseK11VA, arm11SvcTable, arm11ExceptionsPage);
+        ret += APPLY_PATCH(installK11Extension, arm11Section1, firm->section[1].size, false, baseK11VA, arm11ExceptionsPage, &freeK11Space);
+        ret += APPLY_PATCH(patchKernel11, arm11Section1, firm->section[1].size, baseK11VA, arm11SvcTable, arm11ExceptionsPage);
 
         // Add some other patches to the mix, as we can now launch homebrew on SAFE_FIRM:
 
-        ret += patchKernel9Panic(arm9Section, kernel9Size);
-        ret += patchP9AccessChecks(process9Offset, process9Size);
+        ret += APPLY_PATCH(patchKernel9Panic, arm9Section, kernel9Size);
+        ret += APPLY_PATCH(patchP9AccessChecks, process9Offset, process9Size);
 
         mergeSection0(NATIVE_FIRM, 0x45, false); // may change in the future
         firm->section[0].size = 0;
@@ -33,11 +33,18 @@
 #include "draw.h"
 #include "utils.h"
 #include "fatfs/ff.h"
+#include "fatfs/diskio.h"
 #include "buttons.h"
 #include "firm.h"
 #include "crypto.h"
 #include "strings.h"
 
+//Files at least this big are read one contiguous extent at a time
+#define EXTENT_READ_MIN_SIZE    0x10000
+#define EXTENT_MAP_SIZE         64
+//The SDMMC block count register is 16-bit
+#define EXTENT_MAX_SECTORS      0xFFFF
+
 static FATFS sdFs,
              nandFs;
 
@@ -56,10 +63,59 @@ static bool switchToMainDir(bool isSd)
     }
 }
 
+static bool mountVolume(FATFS *fs, const char *path)
+{
+    if(f_mount(fs, path, 1) != FR_OK) return false;
+
+    //Let the disk layer tell FAT and directory sectors apart for its cache
+    disk_setlayout(fs->pdrv, fs->win, fs->fatbase, fs->n_fats * fs->fsize);
+
+    return true;
+}
+
 bool mountFs(bool isSd, bool switchToCtrNand)
 {
-    return isSd ? f_mount(&sdFs, "0:", 1) == FR_OK && switchToMainDir(true) :
-                  f_mount(&nandFs, "1:", 1) == FR_OK && (!switchToCtrNand || (f_chdrive("1:") == FR_OK && switchToMainDir(false)));
+    return isSd ? mountVolume(&sdFs, "0:") && switchToMainDir(true) :
+                  mountVolume(&nandFs, "1:") && (!switchToCtrNand || (f_chdrive("1:") == FR_OK && switchToMainDir(false)));
+}
+
+static u32 readExtents(FIL *file, DWORD *linkMap, u8 *dest, u32 size)
+{
+    FATFS *fs = file->obj.fs;
+    u32 sectorCount = size / FF_MAX_SS,
+        readCount = 0;
+
+    //Build the cluster link map once instead of following the FAT cluster by cluster
+    linkMap[0] = EXTENT_MAP_SIZE;
+    file->cltbl = linkMap;
+    if(f_lseek(file, CREATE_LINKMAP) != FR_OK)
+    {
+        //Too fragmented, let FatFs handle it
+        file->cltbl = NULL;
+        return 0;
+    }
+
+    for(const DWORD *extent = linkMap + 1; extent[0] != 0 && readCount < sectorCount; extent += 2)
+    {
+        DWORD sector = fs->database + (extent[1] - 2) * fs->csize;
+        u32 extentCount = extent[0] * fs->csize;
+
+        if(extentCount > sectorCount - readCount) extentCount = sectorCount - readCount;
+
+        while(extentCount != 0)
+        {
+            u32 count = extentCount < EXTENT_MAX_SECTORS ? extentCount : EXTENT_MAX_SECTORS;
+
+            if(disk_read(fs->pdrv, dest + readCount * FF_MAX_SS, sector, count) != RES_OK) return 0;
+
+            sector += count;
+            readCount += count;
+            extentCount -= count;
+        }
+    }
+
+    //Any partial trailing sector goes through FatFs
+    return f_lseek(file, readCount * FF_MAX_SS) == FR_OK ? readCount * FF_MAX_SS : 0;
 }
 
 u32 fileRead(void *dest, const char *path, u32 maxSize)
@@ -73,7 +129,14 @@ u32 fileRead(void *dest, const char *path, u32 maxSize)
     u32 size = f_size(&file);
     if(dest == NULL) ret = size;
     else if(size <= maxSize)
-        result = f_read(&file, dest, size, (unsigned int *)&ret);
+    {
+        //f_read keeps using the link map once it is set up
+        DWORD linkMap[EXTENT_MAP_SIZE];
+        u32 extentSize = size >= EXTENT_READ_MIN_SIZE ? readExtents(&file, linkMap, (u8 *)dest, size) : 0;
+
+        result = f_read(&file, (u8 *)dest + extentSize, size - extentSize, (unsigned int *)&ret);
+        ret += extentSize;
+    }
     result |= f_close(&file);
 
     return result == FR_OK ? ret : 0;
@@ -249,7 +312,22 @@ bool payloadMenu(char *path, bool *hasDisplayedMenu)
     return false;
 }
 
-u32 firmRead(void *dest, u32 firmType)
+static u16 readTmdTitleVersion(const char *path)
+{
+    FIL file;
+    u8 version[2];
+    unsigned int read = 0;
+
+    if(f_open(&file, path, FA_READ) != FR_OK) return 0xFFFF;
+
+    //Big-endian, after the RSA-2048 signature of system title TMDs
+    bool ok = f_lseek(&file, 0x1DC) == FR_OK && f_read(&file, version, sizeof(version), &read) == FR_OK && read == sizeof(version);
+    f_close(&file);
+
+    return ok ? (version[0] << 8) | version[1] : 0xFFFF;
+}
+
+bool firmLocate(FirmContent *content, u32 firmType)
 {
     static const char *firmFolders[][2] = {{"00000002", "20000002"},
                                            {"00000102", "20000102"},
@@ -257,39 +335,47 @@ u32 firmRead(void *dest, u32 firmType)
                                            {"00000003", "20000003"},
                                            {"00000001", "20000001"}};
 
-    char folderPath[35],
-         path[48];
+    char folderPath[35];
 
     sprintf(folderPath, "1:/title/00040138/%s/content", firmFolders[firmType][ISN3DS ? 1 : 0]);
 
     DIR dir;
-    u32 firmVersion = 0xFFFFFFFF;
+    u32 firmVersion = 0xFFFFFFFF,
+        tmdId = 0xFFFFFFFF;
 
-    if(f_opendir(&dir, folderPath) != FR_OK) goto exit;
+    if(f_opendir(&dir, folderPath) != FR_OK) return false;
 
     FILINFO info;
 
     //Parse the target directory
     while(f_readdir(&dir, &info) == FR_OK && info.fname[0] != 0)
     {
-        //Not a cxi
-        if(info.fname[9] != 'a' || strlen(info.fname) != 12) continue;
+        if(strlen(info.fname) != 12) continue;
 
         u32 tempVersion = hexAtoi(info.altname, 8);
 
         //Found an older cxi
-        if(tempVersion < firmVersion) firmVersion = tempVersion;
+        if(info.fname[9] == 'a' && tempVersion < firmVersion) firmVersion = tempVersion;
+
+        //And the TMD
+        else if(info.fname[9] == 't' && tempVersion < tmdId) tmdId = tempVersion;
     }
 
-    if(f_closedir(&dir) != FR_OK || firmVersion == 0xFFFFFFFF) goto exit;
+    if(f_closedir(&dir) != FR_OK || firmVersion == 0xFFFFFFFF) return false;
 
-    //Complete the string with the .app name
-    sprintf(path, "%s/%08lx.app", folderPath, firmVersion);
+    //Complete the string with the .tmd name, then the .app one
+    content->titleVersion = 0xFFFF;
+    if(tmdId != 0xFFFFFFFF)
+    {
+        sprintf(content->path, "%s/%08lx.tmd", folderPath, tmdId);
+        content->titleVersion = readTmdTitleVersion(content->path);
+    }
 
-    if(fileRead(dest, path, 0x400000 + sizeof(Cxi) + 0x200) <= sizeof(Cxi) + 0x400) firmVersion = 0xFFFFFFFF;
+    sprintf(content->path, "%s/%08lx.app", folderPath, firmVersion);
+    content->id = firmVersion;
+    content->size = getFileSize(content->path);
 
-exit:
-    return firmVersion;
+    return content->size > sizeof(Cxi) + 0x400;
 }
 
 void findDumpFile(const char *folderPath, char *fileName)
@@ -30,6 +30,15 @@
 
 #define PATTERN(a) a "_*.firm"
 
+//A FIRM title content in CTRNAND
+typedef struct FirmContent
+{
+    char path[48];
+    u32 id;             //The .app name
+    u32 size;
+    u16 titleVersion;   //From the TMD, 0xFFFF if it couldn't be read
+} FirmContent;
+
 bool mountFs(bool isSd, bool switchToCtrNand);
 u32 fileRead(void *dest, const char *path, u32 maxSize);
 u32 getFileSize(const char *path);
@@ -37,5 +46,5 @@ bool fileWrite(const void *buffer, const char *path, u32 size);
 bool fileDelete(const char *path);
 bool findPayload(char *path, u32 pressed);
 bool payloadMenu(char *path, bool *hasDisplayedMenu);
-u32 firmRead(void *dest, u32 firmType);
+bool firmLocate(FirmContent *content, u32 firmType);
 void findDumpFile(const char *folderPath, char *fileName);
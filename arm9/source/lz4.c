@@ -0,0 +1,161 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   LZ4 frame decoder, as produced by the reference "lz4" tool
+*   https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+*   Checksums are skipped, dictionaries aren't supported
+*/
+
+#include "lz4.h"
+#include "memory.h"
+
+#define LZ4_FRAME_MAGIC 0x184D2204
+
+static inline u32 read32(const u8 *src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((u32)src[3] << 24);
+}
+
+static bool readLength(const u8 **src, const u8 *srcEnd, u32 *length)
+{
+    u8 b;
+
+    do
+    {
+        if(*src >= srcEnd) return false;
+        b = *(*src)++;
+        *length += b;
+    }
+    while(b == 0xFF);
+
+    return true;
+}
+
+static bool decompressBlock(u8 *dst, u32 *dstPos, u32 dstSize, const u8 *src, u32 srcSize)
+{
+    const u8 *srcEnd = src + srcSize;
+    u32 pos = *dstPos;
+
+    while(src < srcEnd)
+    {
+        u8 token = *src++;
+
+        u32 length = token >> 4;
+        if(length == 0xF && !readLength(&src, srcEnd, &length)) return false;
+
+        if(length > (u32)(srcEnd - src) || length > dstSize - pos) return false;
+
+        memcpy(dst + pos, src, length);
+        src += length;
+        pos += length;
+
+        //The last sequence only has literals
+        if(src == srcEnd) break;
+
+        if(srcEnd - src < 2) return false;
+
+        u32 offset = src[0] | (src[1] << 8);
+        src += 2;
+
+        //Matches can reach back into the previous blocks
+        if(offset == 0 || offset > pos) return false;
+
+        length = token & 0xF;
+        if(length == 0xF && !readLength(&src, srcEnd, &length)) return false;
+        length += 4;
+
+        if(length > dstSize - pos) return false;
+
+        u8 *match = dst + pos - offset;
+
+        //Short offsets repeat the output being written
+        if(offset >= length) memcpy(dst + pos, match, length);
+        else for(u32 i = 0; i < length; i++) dst[pos + i] = match[i];
+
+        pos += length;
+    }
+
+    *dstPos = pos;
+
+    return true;
+}
+
+u32 lz4DecompressFrame(u8 *dst, u32 dstSize, const u8 *src, u32 srcSize)
+{
+    const u8 *srcEnd = src + srcSize;
+
+    if(srcSize < 7 || read32(src) != LZ4_FRAME_MAGIC) return 0;
+
+    u8 flags = src[4];
+
+    //Version 01, no dictionary
+    if((flags >> 6) != 1 || (flags & 1)) return 0;
+
+    //Magic, FLG, BD, optional content size, header checksum
+    u32 headerSize = 7 + ((flags & 8) ? 8 : 0);
+    bool hasBlockChecksums = (flags & 0x10) != 0;
+
+    if(srcSize < headerSize) return 0;
+    src += headerSize;
+
+    u32 pos = 0;
+
+    while(true)
+    {
+        if(srcEnd - src < 4) return 0;
+
+        u32 blockSize = read32(src);
+        src += 4;
+
+        //End mark, an optional content checksum follows
+        if(blockSize == 0) break;
+
+        bool isUncompressed = (blockSize >> 31) != 0;
+        blockSize &= 0x7FFFFFFF;
+
+        if(blockSize > (u32)(srcEnd - src)) return 0;
+
+        if(isUncompressed)
+        {
+            if(blockSize > dstSize - pos) return 0;
+
+            memcpy(dst + pos, src, blockSize);
+            pos += blockSize;
+        }
+        else if(!decompressBlock(dst, &pos, dstSize, src, blockSize)) return 0;
+
+        src += blockSize;
+
+        if(hasBlockChecksums)
+        {
+            if(srcEnd - src < 4) return 0;
+            src += 4;
+        }
+    }
+
+    return pos;
+}
@@ -37,6 +37,7 @@
 #include "memory.h"
 #include "screen.h"
 #include "i2c.h"
+#include "bootprof.h"
 #include "fatfs/sdmmc/sdmmc.h"
 
 extern u8 __itcm_start__[], __itcm_lma__[], __itcm_bss_start__[], __itcm_end__[];
@@ -63,6 +64,8 @@ void main(int argc, char **argv, u32 magicWord)
     const vu32 *bootPartitionsStatus = (const vu32 *)0x1FFFE010;
     u32 firmlaunchTidLow = 0;
 
+    bootProfStart();
+
     //Shell closed, no error booting NTRCARD, NAND paritions not even considered
     isNtrBoot = bootMediaStatus[3] == 2 && !bootMediaStatus[1] && !bootPartitionsStatus[0] && !bootPartitionsStatus[1];
 
@@ -156,10 +159,13 @@ void main(int argc, char **argv, u32 magicWord)
         error("Launched from an unsupported location: %s.", mountPoint);
     }
 
+    bootProfMark(BOOTSTAGE_MOUNT);
+
     detectAndProcessExceptionDumps();
 
     //Attempt to read the configuration file
     needConfig = readConfig() ? MODIFY_CONFIGURATION : CREATE_CONFIGURATION;
+    bootProfMark(BOOTSTAGE_CONFIG);
 
     //Determine if this is a firmlaunch boot
     if(bootType == FIRMLAUNCH)
@@ -338,6 +344,7 @@ void main(int argc, char **argv, u32 magicWord)
     }
 
 boot:
+    bootProfMark(BOOTSTAGE_MENU);
 
     //If we need to boot EmuNAND, make sure it exists
     if(nandType != FIRMWARE_SYSNAND)
@@ -352,6 +359,8 @@ boot:
     else if(firmSource != FIRMWARE_SYSNAND)
         locateEmuNand(&firmSource);
 
+    bootProfMark(BOOTSTAGE_EMUNAND);
+
     if(bootType != FIRMLAUNCH)
     {
         configData.bootConfig = ((bootType == NTR ? 1 : 0) << 7) | ((u32)isNoForceFlagSet << 6) | ((u32)firmSource << 3) | (u32)nandType;
@@ -383,6 +392,9 @@ boot:
 
     if(res != 0) error("Failed to apply %u FIRM patch(es).", res);
 
+    bootProfMark(BOOTSTAGE_PATCH);
+
     if(bootType != FIRMLAUNCH) deinitScreens();
+    bootProfFinish();
     launchFirm(0, NULL);
 }
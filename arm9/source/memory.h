@@ -24,13 +24,8 @@
 *         reasonable ways as different from the original version.
 */
 
-/*
-*   Boyer-Moore Horspool algorithm adapted from http://www-igm.univ-mlv.fr/~lecroq/string/node18.html#SECTION00180
-*/
-
 #pragma once
 
 #include <string.h>
 #include "types.h"
-
-u8 *memsearch(u8 *startPos, const void *pattern, u32 size, u32 patternSize);
+#include "memsearch.h"
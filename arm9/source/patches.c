@@ -41,9 +41,344 @@
 #include "utils.h"
 #include "arm9_exception_handlers.h"
 #include "large_patches.h"
+#include "fmt.h"
+#include "bootprof.h"
+#include "kernel11SymbolHints.h"
 
 #define K11EXT_VA         0x70000000
 
+//Kernel11 signatures
+static const u8 k11ExceptionsPagePattern[] = {0x00, 0xB0, 0x9C, 0xE5},
+                k11MmuSetupHookPattern[] = {0x02, 0xC2, 0xA0, 0xE3, 0xFF},
+                k11FcramLayoutHookPattern[] = {0x08, 0x00, 0xA4, 0xE5, 0x02, 0x10, 0x80, 0xE0, 0x08, 0x10, 0x84, 0xE5},
+                k11Sgi0SetupHookPattern[] = {0x00, 0x00, 0xA0, 0xE1, 0x03, 0xF0, 0x20, 0xE3, 0xFD, 0xFF, 0xFF, 0xEA},
+                k11PanicPattern[] = {0x02, 0x0B, 0x44, 0xE2},
+                k11ThreadDebugReschedulePattern[] = {0x34, 0x20, 0xD4, 0xE5, 0x00, 0x00, 0x55, 0xE3, 0x80, 0x00, 0xA0, 0x13},
+                k11ModuleLoadingPattern[] = {0xE2, 0x05, 0x00, 0x57},
+                k11ModulePidPattern[] = {0x06, 0xA0, 0xE1, 0xF2}; //GetSystemInfo
+
+//Kernel9 signatures
+static const u8 k9UnitInfoValueSetPattern[] = {0x01, 0x10, 0xA0, 0x13},
+                k9ExceptionHandlersInstallPattern[] = {0x80, 0xE5, 0x40, 0x1C},
+                k9SvcHandlerPattern[] = {0x00, 0xE0, 0x4F, 0xE1}, //mrs lr, spsr
+                k9PanicPattern[] = {0x00, 0x20, 0x92, 0x15};
+
+//Process9 signatures
+static const u8 p9SignatureChecksPattern[] = {0xC0, 0x1C, 0x76, 0xE7},
+                p9SignatureChecksPattern2[] = {0xB5, 0x22, 0x4D, 0x0C},
+                p9OldSignatureChecksPattern[] = {0xC0, 0x1C, 0xBD, 0xE7},
+                p9OldSignatureChecksPattern2[] = {0xB5, 0x23, 0x4E, 0x0C},
+                p9FirmlaunchPattern[] = {0xE2, 0x20, 0x20, 0x90},
+                p9FirmWritesPattern[] = {'e', 'x', 'e', ':'},
+                p9OldFirmWritesPattern[] = {0x04, 0x1E, 0x1D, 0xDB},
+                p9TitleInstallMinVersionPattern[] = {0xFF, 0x00, 0x00, 0x02},
+                p9ZeroKeyNcchEncryptionPattern[] = {0x28, 0x2A, 0xD0, 0x08},
+                p9NandNcchEncryptionPattern[] = {0x07, 0xD1, 0x28, 0x7A},
+                p9DevCommonKeyPattern[] = {0x03, 0x7C, 0x28, 0x00},
+                p9AccessChecksPattern[] = {0x00, 0x08, 0x49, 0x68},
+                p9RtMemclrPattern[] = {0x00, 0x20, 0xA0, 0xE3, 0x04, 0x00, 0x51, 0xE3, 0x07, 0x00, 0x00, 0x3A},
+                p9TicketWrapperPattern[] = {0x20, 0x21, 0xA6, 0xA8},
+                p9LgySignatureChecksPattern[] = {0x47, 0xC1, 0x17, 0x49},
+                p9TwlInvalidSignatureChecksPattern[] = {0x20, 0xF6, 0xE7, 0x7F},
+                p9TwlNintendoLogoChecksPattern[] = {0xC0, 0x30, 0x06, 0xF0},
+                p9TwlWhitelistChecksPattern[] = {0x22, 0x00, 0x20, 0x30},
+                p9TwlFlashcartChecksPattern[] = {0x25, 0x20, 0x00, 0x0E},
+                p9OldTwlFlashcartChecksPattern[] = {0x06, 0xF0, 0xA0, 0xFD},
+                p9TwlShaHashChecksPattern[] = {0x10, 0xB5, 0x14, 0x22},
+                p9AgbBootSplashPattern[] = {0x00, 0x00, 0x01, 0xEF};
+
+#define SIGNATURE(a) {(a), sizeof(a)}
+
+//Every pattern looked for with findSignature(), the signature cache refers to them by index
+static const struct
+{
+    const u8 *pattern;
+    u32 size;
+} signatures[] = {
+    SIGNATURE(k11ExceptionsPagePattern),
+    SIGNATURE(k11MmuSetupHookPattern),
+    SIGNATURE(k11FcramLayoutHookPattern),
+    SIGNATURE(k11Sgi0SetupHookPattern),
+    SIGNATURE(k11PanicPattern),
+    SIGNATURE(k11ThreadDebugReschedulePattern),
+    SIGNATURE(k11ModuleLoadingPattern),
+    SIGNATURE(k11ModulePidPattern),
+    SIGNATURE(k9UnitInfoValueSetPattern),
+    SIGNATURE(k9ExceptionHandlersInstallPattern),
+    SIGNATURE(k9SvcHandlerPattern),
+    SIGNATURE(k9PanicPattern),
+    SIGNATURE(p9SignatureChecksPattern),
+    SIGNATURE(p9SignatureChecksPattern2),
+    SIGNATURE(p9OldSignatureChecksPattern),
+    SIGNATURE(p9OldSignatureChecksPattern2),
+    SIGNATURE(p9FirmlaunchPattern),
+    SIGNATURE(p9FirmWritesPattern),
+    SIGNATURE(p9OldFirmWritesPattern),
+    SIGNATURE(p9TitleInstallMinVersionPattern),
+    SIGNATURE(p9ZeroKeyNcchEncryptionPattern),
+    SIGNATURE(p9NandNcchEncryptionPattern),
+    SIGNATURE(p9DevCommonKeyPattern),
+    SIGNATURE(p9AccessChecksPattern),
+    SIGNATURE(p9RtMemclrPattern),
+    SIGNATURE(p9TicketWrapperPattern),
+    SIGNATURE(p9LgySignatureChecksPattern),
+    SIGNATURE(p9TwlInvalidSignatureChecksPattern),
+    SIGNATURE(p9TwlNintendoLogoChecksPattern),
+    SIGNATURE(p9TwlWhitelistChecksPattern),
+    SIGNATURE(p9TwlFlashcartChecksPattern),
+    SIGNATURE(p9OldTwlFlashcartChecksPattern),
+    SIGNATURE(p9TwlShaHashChecksPattern),
+    SIGNATURE(p9AgbBootSplashPattern)
+};
+
+#undef SIGNATURE
+
+//The signature lookups of a boot are cached on the SD card in the order the patches make them, so that the searches are only done
+//once per FIRM. As long as a boot makes the same lookups as the one that wrote the cache, the image is in the same state at each
+//of them and the cached results can be used; from the first difference on (other options), they're searched for again
+typedef struct SignatureLookup
+{
+    u32 signature;                      //Index in signatures[]
+    u32 regionOffset;                   //Of the searched region, from the start of the FIRM
+    u32 regionSize;
+    u32 result;                         //Offset in the region, 0xFFFFFFFF if not found
+} SignatureLookup;
+
+typedef struct SignatureCacheHeader
+{
+    char magic[4];
+    u32 commitHash;
+    u8 sectionHashes[4][0x20];
+    u32 nbLookups;
+    u32 symbolHintsLookup;              //Lookups made before the Kernel11 symbol hints were resolved, 0xFFFFFFFF if they weren't
+    Kernel11SymbolHints symbolHints;
+} SignatureCacheHeader;
+
+#define SIGNATURE_CACHE_MAX_LOOKUPS 64
+
+static struct
+{
+    const Firm *firm;                   //NULL outside of loadSignatureCache()/saveSignatureCache()
+    FirmwareType firmType;
+    u32 nbLookups,
+        nbCachedLookups;                //That can still be used, this boot matches the cached one up to there
+    bool modified;
+
+    //Laid out as in the cache file
+    SignatureCacheHeader header;
+    SignatureLookup lookups[SIGNATURE_CACHE_MAX_LOOKUPS];
+} signatureCache;
+
+static void getSignatureCachePath(char *path, FirmwareType firmType)
+{
+    static const char *firmNames[] = {"native", "twl", "agb", "safe", "sysupdater", "native1x2x"};
+
+    sprintf(path, "cache/%s_signatures.bin", firmNames[(u32)firmType]);
+}
+
+void loadSignatureCache(const Firm *firm, FirmwareType firmType)
+{
+    SignatureCacheHeader *header = &signatureCache.header;
+
+    signatureCache.firm = firm;
+    signatureCache.firmType = firmType;
+    signatureCache.nbLookups = signatureCache.nbCachedLookups = 0;
+    signatureCache.modified = false;
+
+    //The cache only lives on the SD, never write to CTRNAND
+    if(isSdMode)
+    {
+        char path[32];
+        getSignatureCachePath(path, firmType);
+
+        u32 size = fileRead(header, path, sizeof(SignatureCacheHeader) + sizeof(signatureCache.lookups));
+
+        if(size >= sizeof(SignatureCacheHeader) && memcmp(header->magic, "SIGC", 4) == 0 && header->commitHash == COMMIT_HASH &&
+           header->nbLookups <= SIGNATURE_CACHE_MAX_LOOKUPS && size == sizeof(SignatureCacheHeader) + header->nbLookups * sizeof(SignatureLookup))
+        {
+            u32 i;
+            for(i = 0; i < 4 && memcmp(header->sectionHashes[i], firm->section[i].hash, 0x20) == 0; i++);
+
+            if(i == 4)
+            {
+                signatureCache.nbCachedLookups = header->nbLookups;
+                return;
+            }
+        }
+    }
+
+    memcpy(header->magic, "SIGC", 4);
+    header->commitHash = COMMIT_HASH;
+    for(u32 i = 0; i < 4; i++)
+        memcpy(header->sectionHashes[i], firm->section[i].hash, 0x20);
+    header->nbLookups = 0;
+    header->symbolHintsLookup = 0xFFFFFFFF;
+    memset(&header->symbolHints, 0, sizeof(Kernel11SymbolHints));
+}
+
+void saveSignatureCache(void)
+{
+    SignatureCacheHeader *header = &signatureCache.header;
+
+    if(signatureCache.firm == NULL) return;
+
+    //Nothing to write if the whole boot came from the cache. If it made too many lookups, the next boot will search again
+    if(isSdMode && (signatureCache.modified || signatureCache.nbLookups != header->nbLookups) && signatureCache.nbLookups <= SIGNATURE_CACHE_MAX_LOOKUPS)
+    {
+        char path[32];
+        getSignatureCachePath(path, signatureCache.firmType);
+
+        header->nbLookups = signatureCache.nbLookups;
+        if(header->symbolHintsLookup > signatureCache.nbLookups) header->symbolHintsLookup = 0xFFFFFFFF;
+
+        //Not being able to write the cache only means the next boot will search again
+        fileWrite(header, path, sizeof(SignatureCacheHeader) + header->nbLookups * sizeof(SignatureLookup));
+    }
+
+    signatureCache.firm = NULL;
+}
+
+u32 formatSignatureOffsets(char *out, u32 size)
+{
+    char *pos = out;
+
+    for(u32 i = 0; i < signatureCache.nbLookups && i < SIGNATURE_CACHE_MAX_LOOKUPS; i++)
+    {
+        //Longest line is "signature 63: not found\n"
+        if(size - (u32)(pos - out) < 32) break;
+
+        const SignatureLookup *lookup = &signatureCache.lookups[i];
+
+        if(lookup->result == 0xFFFFFFFF) pos += sprintf(pos, "signature %lu: not found\n", lookup->signature);
+        else pos += sprintf(pos, "signature %lu: 0x%08lX\n", lookup->signature, lookup->regionOffset + lookup->result);
+    }
+
+    return pos - out;
+}
+
+//memsearch(), with the result taken from the signature cache when this boot still matches it
+static u8 *findSignature(u8 *pos, const u8 *pattern, u32 size, u32 patternSize)
+{
+    if(signatureCache.firm == NULL) return memsearch(pos, pattern, size, patternSize);
+
+    u32 signature,
+        n = signatureCache.nbLookups++,
+        regionOffset = (u32)(pos - (const u8 *)signatureCache.firm);
+
+    for(signature = 0; signature < sizeof(signatures) / sizeof(*signatures) && signatures[signature].pattern != pattern; signature++);
+
+    if(n < signatureCache.nbCachedLookups)
+    {
+        const SignatureLookup *lookup = &signatureCache.lookups[n];
+
+        //Only use found locations that still hold the pattern
+        if(lookup->signature == signature && lookup->regionOffset == regionOffset && lookup->regionSize == size &&
+           (lookup->result == 0xFFFFFFFF ||
+            (patternSize <= size && lookup->result <= size - patternSize && memcmp(pos + lookup->result, pattern, patternSize) == 0)))
+            return lookup->result == 0xFFFFFFFF ? NULL : pos + lookup->result;
+
+        signatureCache.nbCachedLookups = n;
+        if(signatureCache.header.symbolHintsLookup > n) signatureCache.header.symbolHintsLookup = 0xFFFFFFFF;
+    }
+
+    u8 *result = memsearch(pos, pattern, size, patternSize);
+
+    if(n < SIGNATURE_CACHE_MAX_LOOKUPS)
+    {
+        SignatureLookup *lookup = &signatureCache.lookups[n];
+
+        lookup->signature = signature;
+        lookup->regionOffset = regionOffset;
+        lookup->regionSize = size;
+        lookup->result = result == NULL ? 0xFFFFFFFF : (u32)(result - pos);
+        signatureCache.modified = true;
+    }
+
+    return result;
+}
+
+//Kernel11 VA base and SVC handler, from the SVC vector of the exceptions page
+static u32 *getKernel11SvcHandler(u8 *pos, u32 *arm11ExceptionsPage, u32 *baseK11VA)
+{
+    u32 svcOffset = (-((arm11ExceptionsPage[2] & 0xFFFFFF) << 2) & (0xFFFFFF << 2)) - 8; //Branch offset + 8 for prefetch
+    u32 pointedInstructionVA = 0xFFFF0008 - svcOffset;
+    *baseK11VA = pointedInstructionVA & 0xFFFF0000; //This assumes that the pointed instruction has an offset < 0x10000, iirc that's always the case
+
+    return (u32 *)(pos + *(u32 *)(pos + pointedInstructionVA - *baseK11VA + 8) - *baseK11VA); //SVC handler address
+}
+
+//Same searches as findUsefulSymbols() in k11_extension/source/main.c, on the FIRM image instead of the running kernel
+static void resolveKernel11SymbolHints(Kernel11SymbolHints *hints, u8 *pos, u32 size, u32 *arm11ExceptionsPage)
+{
+    u32 baseK11VA;
+    u32 *arm11SvcTable = getKernel11SvcHandler(pos, arm11ExceptionsPage, &baseK11VA);
+    u32 *end = (u32 *)(pos + size) - 5,
+        *off;
+
+    while(*arm11SvcTable) arm11SvcTable++;
+
+    memset(hints, 0, sizeof(Kernel11SymbolHints));
+
+    //Everything is looked for in .text, which is mapped at baseK11VA
+    #define K11_VA(ptr) (baseK11VA + (u32)((u8 *)(ptr) - pos))
+
+    //InterruptManager instance, from svcBindInterrupt
+    u32 interruptManager = 0;
+    for(off = (u32 *)(pos + arm11SvcTable[0x50] - baseK11VA); off < end && (off[0] != 0xE1A05000 || off[1] != 0xE2100102 || off[2] != 0x5A00000B); off++);
+    if(off < end)
+    {
+        off--;
+        interruptManager = *(off - 4 + (off[-6] & 0xFFF) / 4);
+    }
+
+    //.text is followed by .rodata, then by .data where the InterruptManager lives. The kernel finds where .rodata starts
+    //(it can't be told from the image) and ignores the hints past that, so the only requirement here is not to stop before it
+    u32 *textEnd = arm11ExceptionsPage;
+    if(interruptManager > baseK11VA && interruptManager - baseK11VA < (u32)((u8 *)textEnd - pos))
+        textEnd = (u32 *)(pos + ((interruptManager - baseK11VA) & ~0xFFF));
+
+    for(off = (u32 *)pos; off < textEnd - 5; off++)
+        if((off[0] >> 16) == 0xE59F && (off[1] >> 16) == 0xE3A0 && (off[2] >> 16) == 0xE3A0 && (off[3] >> 16) == 0xE1A0 && (off[4] >> 16) == 0xEB00)
+        {
+            hints->fcramDescriptorLoad = K11_VA(off);
+            break;
+        }
+
+    //The kernel takes the last match of each of these in its .text section
+    for(off = (u32 *)pos; off < textEnd - 3; off++)
+    {
+        if(off[0] == 0xE5D13034 && off[1] == 0xE1530002)
+            hints->schedulerAdjustThread = K11_VA(off);
+        else if(interruptManager != 0 && off[0] == interruptManager && off[1] == 0xFFFF9000) //&currentCoreContext->objectContext
+            hints->attemptSwitchingThreadContextLiterals = K11_VA(off);
+        else if(off[0] == 0xE3510B1A && off[1] == 0xE3A06000)
+            hints->invalidateInstructionCacheRangeBody = K11_VA(off);
+    }
+
+    #undef K11_VA
+}
+
+//Like the signatures, from the cache when this boot still matches it
+static void getKernel11SymbolHints(Kernel11SymbolHints *hints, u8 *pos, u32 size, u32 *arm11ExceptionsPage)
+{
+    SignatureCacheHeader *header = &signatureCache.header;
+
+    if(signatureCache.firm != NULL && header->symbolHintsLookup == signatureCache.nbLookups && signatureCache.nbLookups <= signatureCache.nbCachedLookups)
+    {
+        memcpy(hints, &header->symbolHints, sizeof(Kernel11SymbolHints));
+        return;
+    }
+
+    resolveKernel11SymbolHints(hints, pos, size, arm11ExceptionsPage);
+
+    if(signatureCache.firm != NULL)
+    {
+        header->symbolHintsLookup = signatureCache.nbLookups;
+        memcpy(&header->symbolHints, hints, sizeof(Kernel11SymbolHints));
+        signatureCache.modified = true;
+    }
+}
+
 u8 *getProcess9Info(u8 *pos, u32 size, u32 *process9Size, u32 *process9MemAddr)
 {
     u8 *temp = memsearch(pos, "NCCH", size, 4);
@@ -60,18 +395,14 @@ u8 *getProcess9Info(u8 *pos, u32 size, u32 *process9Size, u32 *process9MemAddr)
 
 u32 *getKernel11Info(u8 *pos, u32 size, u32 *baseK11VA, u8 **freeK11Space, u32 **arm11SvcHandler, u32 **arm11ExceptionsPage)
 {
-    static const u8 pattern[] = {0x00, 0xB0, 0x9C, 0xE5};
-    *arm11ExceptionsPage = (u32 *)memsearch(pos, pattern, size, sizeof(pattern));
+    *arm11ExceptionsPage = (u32 *)findSignature(pos, k11ExceptionsPagePattern, size, sizeof(k11ExceptionsPagePattern));
 
     if(*arm11ExceptionsPage == NULL) error("Failed to get Kernel11 data.");
 
     u32 *arm11SvcTable;
 
     *arm11ExceptionsPage -= 0xB;
-    u32 svcOffset = (-(((*arm11ExceptionsPage)[2] & 0xFFFFFF) << 2) & (0xFFFFFF << 2)) - 8; //Branch offset + 8 for prefetch
-    u32 pointedInstructionVA = 0xFFFF0008 - svcOffset;
-    *baseK11VA = pointedInstructionVA & 0xFFFF0000; //This assumes that the pointed instruction has an offset < 0x10000, iirc that's always the case
-    arm11SvcTable = *arm11SvcHandler = (u32 *)(pos + *(u32 *)(pos + pointedInstructionVA - *baseK11VA + 8) - *baseK11VA); //SVC handler address
+    arm11SvcTable = *arm11SvcHandler = getKernel11SvcHandler(pos, *arm11ExceptionsPage, baseK11VA);
     while(*arm11SvcTable) arm11SvcTable++; //Look for SVC0 (NULL)
 
     u32 *freeSpace;
@@ -132,12 +463,16 @@ u32 installK11Extension(u8 *pos, u32 size, bool needToInitSd, u32 baseK11VA, u32
             u64 hbldr3dsxTitleId;
             u32 rosalinaMenuCombo;
             u32 rosalinaFlags;
+
+            BootTimeline bootTimeline;
         } info;
+
+        Kernel11SymbolHints symbolHints;
     };
 
-    static const u8 patternHook1[] = {0x02, 0xC2, 0xA0, 0xE3, 0xFF}; //MMU setup hook
-    static const u8 patternHook2[] = {0x08, 0x00, 0xA4, 0xE5, 0x02, 0x10, 0x80, 0xE0, 0x08, 0x10, 0x84, 0xE5}; //FCRAM layout setup hook
-    static const u8 patternHook3_4[] = {0x00, 0x00, 0xA0, 0xE1, 0x03, 0xF0, 0x20, 0xE3, 0xFD, 0xFF, 0xFF, 0xEA}; //SGI0 setup code, etc.
+    //Before anything in Kernel11 is changed
+    Kernel11SymbolHints symbolHints;
+    getKernel11SymbolHints(&symbolHints, pos, size, arm11ExceptionsPage);
 
     //Our kernel11 extension is initially loaded in VRAM
     u32 kextTotalSize = *(u32 *)0x18000020 - K11EXT_VA;
@@ -159,19 +494,19 @@ u32 installK11Extension(u8 *pos, u32 size, bool needToInitSd, u32 baseK11VA, u32
     (*freeK11Space) += 32;
 
     //MMU setup hook
-    u32 *off = (u32 *)memsearch(pos, patternHook1, size, sizeof(patternHook1));
+    u32 *off = (u32 *)findSignature(pos, k11MmuSetupHookPattern, size, sizeof(k11MmuSetupHookPattern));
     if(off == NULL) return 1;
     *off = MAKE_BRANCH_LINK(off, hookVeneers);
 
     //Most important hook: FCRAM layout setup hook
-    off = (u32 *)memsearch(pos, patternHook2, size, sizeof(patternHook2));
+    off = (u32 *)findSignature(pos, k11FcramLayoutHookPattern, size, sizeof(k11FcramLayoutHookPattern));
     if(off == NULL) return 1;
     off += 2;
     *off = MAKE_BRANCH_LINK(baseK11VA + ((u8 *)off - pos), relocBase + 8);
 
     //Bind SGI0 hook
     //Look for cpsie i and place our hook in the nop 2 instructions before
-    off = (u32 *)memsearch(pos, patternHook3_4, size, 12);
+    off = (u32 *)findSignature(pos, k11Sgi0SetupHookPattern, size, sizeof(k11Sgi0SetupHookPattern));
     if(off == NULL) return 1;
     for(; *off != 0xF1080080; off--);
     off -= 2;
@@ -214,14 +549,16 @@ u32 installK11Extension(u8 *pos, u32 size, bool needToInitSd, u32 baseK11VA, u32
     if(needToInitSd) info->flags |= 1 << 5;
     if(isSdMode) info->flags |= 1 << 6;
 
+    //Filled right before launching the FIRM, once every stage has been timed
+    bootProfSetHandoff(&info->bootTimeline);
+
+    memcpy(&p->symbolHints, &symbolHints, sizeof(Kernel11SymbolHints));
+
     return 0;
 }
 
 u32 patchKernel11(u8 *pos, u32 size, u32 baseK11VA, u32 *arm11SvcTable, u32 *arm11ExceptionsPage)
 {
-    static const u8 patternKPanic[] = {0x02, 0x0B, 0x44, 0xE2};
-    static const u8 patternKThreadDebugReschedule[] = {0x34, 0x20, 0xD4, 0xE5, 0x00, 0x00, 0x55, 0xE3, 0x80, 0x00, 0xA0, 0x13};
-
     //Assumption: ControlMemory, DebugActiveProcess and KernelSetState are in the first 0x20000 bytes
     //Patch ControlMemory
     u8 *instrPos = pos + (arm11SvcTable[1] + 20 - baseK11VA);
@@ -250,7 +587,7 @@ u32 patchKernel11(u8 *pos, u32 size, u32 baseK11VA, u32 *arm11SvcTable, u32 *arm
     off[2] = 0xE1A00000; // in case 6: beq -> nop
 
     //Patch kernelpanic
-    off = (u32 *)memsearch(pos, patternKPanic, size, sizeof(patternKPanic));
+    off = (u32 *)findSignature(pos, k11PanicPattern, size, sizeof(k11PanicPattern));
     if(off == NULL)
         return 1;
 
@@ -260,7 +597,7 @@ u32 patchKernel11(u8 *pos, u32 size, u32 baseK11VA, u32 *arm11SvcTable, u32 *arm
     for(off = arm11ExceptionsPage; *off != 0x96007F9; off++);
     off[1] = K11EXT_VA + 0x28;
 
-    off = (u32 *)memsearch(pos, patternKThreadDebugReschedule, size, sizeof(patternKThreadDebugReschedule));
+    off = (u32 *)findSignature(pos, k11ThreadDebugReschedulePattern, size, sizeof(k11ThreadDebugReschedulePattern));
     if(off == NULL)
         return 1;
 
@@ -273,11 +610,8 @@ u32 patchKernel11(u8 *pos, u32 size, u32 baseK11VA, u32 *arm11SvcTable, u32 *arm
 u32 patchSignatureChecks(u8 *pos, u32 size)
 {
     //Look for signature checks
-    static const u8 pattern[] = {0xC0, 0x1C, 0x76, 0xE7},
-                    pattern2[] = {0xB5, 0x22, 0x4D, 0x0C};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
-    u8 *temp = memsearch(pos, pattern2, size, sizeof(pattern2));
+    u16 *off = (u16 *)findSignature(pos, p9SignatureChecksPattern, size, sizeof(p9SignatureChecksPattern));
+    u8 *temp = findSignature(pos, p9SignatureChecksPattern2, size, sizeof(p9SignatureChecksPattern2));
 
     if(off == NULL || temp == NULL) return 1;
 
@@ -291,11 +625,8 @@ u32 patchSignatureChecks(u8 *pos, u32 size)
 u32 patchOldSignatureChecks(u8 *pos, u32 size)
 {
     // Look for signature checks
-    static const u8 pattern[] = {0xC0, 0x1C, 0xBD, 0xE7},
-                    pattern2[] = {0xB5, 0x23, 0x4E, 0x0C};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
-    u8 *temp = memsearch(pos, pattern2, size, sizeof(pattern2));
+    u16 *off = (u16 *)findSignature(pos, p9OldSignatureChecksPattern, size, sizeof(p9OldSignatureChecksPattern));
+    u8 *temp = findSignature(pos, p9OldSignatureChecksPattern2, size, sizeof(p9OldSignatureChecksPattern2));
 
     if(off == NULL || temp == NULL) return 1;
 
@@ -308,15 +639,13 @@ u32 patchOldSignatureChecks(u8 *pos, u32 size)
 
 u32 patchFirmlaunches(u8 *pos, u32 size, u32 process9MemAddr)
 {
-    //Look for firmlaunch code
-    static const u8 pattern[] = {0xE2, 0x20, 0x20, 0x90};
-
     u32 pathLen;
     for(pathLen = 0; pathLen < sizeof(launchedPath)/2 && launchedPath[pathLen] != 0; pathLen++);
 
     if(launchedPath[pathLen] != 0) return 1;
 
-    u8 *off = memsearch(pos, pattern, size, sizeof(pattern));
+    //Look for firmlaunch code
+    u8 *off = findSignature(pos, p9FirmlaunchPattern, size, sizeof(p9FirmlaunchPattern));
 
     if(off == NULL) return 1;
 
@@ -340,7 +669,7 @@ u32 patchFirmlaunches(u8 *pos, u32 size, u32 process9MemAddr)
 u32 patchFirmWrites(u8 *pos, u32 size)
 {
     //Look for FIRM writing code
-    u8 *off = memsearch(pos, "exe:", size, 4);
+    u8 *off = findSignature(pos, p9FirmWritesPattern, size, sizeof(p9FirmWritesPattern));
 
     if(off == NULL) return 1;
 
@@ -359,9 +688,7 @@ u32 patchFirmWrites(u8 *pos, u32 size)
 u32 patchOldFirmWrites(u8 *pos, u32 size)
 {
     //Look for FIRM writing code
-    static const u8 pattern[] = {0x04, 0x1E, 0x1D, 0xDB};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u16 *off = (u16 *)findSignature(pos, p9OldFirmWritesPattern, size, sizeof(p9OldFirmWritesPattern));
 
     if(off == NULL) return 1;
 
@@ -373,9 +700,7 @@ u32 patchOldFirmWrites(u8 *pos, u32 size)
 
 u32 patchTitleInstallMinVersionChecks(u8 *pos, u32 size, u32 firmVersion)
 {
-    static const u8 pattern[] = {0xFF, 0x00, 0x00, 0x02};
-
-    u8 *off = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *off = findSignature(pos, p9TitleInstallMinVersionPattern, size, sizeof(p9TitleInstallMinVersionPattern));
 
     if(off == NULL) return firmVersion == 0xFFFFFFFF ? 0 : 1;
 
@@ -389,9 +714,7 @@ u32 patchTitleInstallMinVersionChecks(u8 *pos, u32 size, u32 firmVersion)
 
 u32 patchZeroKeyNcchEncryptionCheck(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x28, 0x2A, 0xD0, 0x08};
-
-    u8 *temp = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *temp = findSignature(pos, p9ZeroKeyNcchEncryptionPattern, size, sizeof(p9ZeroKeyNcchEncryptionPattern));
 
     if(temp == NULL) return 1;
 
@@ -403,9 +726,7 @@ u32 patchZeroKeyNcchEncryptionCheck(u8 *pos, u32 size)
 
 u32 patchNandNcchEncryptionCheck(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x07, 0xD1, 0x28, 0x7A};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u16 *off = (u16 *)findSignature(pos, p9NandNcchEncryptionPattern, size, sizeof(p9NandNcchEncryptionPattern));
 
     if(off == NULL) return 1;
 
@@ -417,9 +738,7 @@ u32 patchNandNcchEncryptionCheck(u8 *pos, u32 size)
 
 u32 patchCheckForDevCommonKey(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x03, 0x7C, 0x28, 0x00};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u16 *off = (u16 *)findSignature(pos, p9DevCommonKeyPattern, size, sizeof(p9DevCommonKeyPattern));
 
     if(off == NULL) return 1;
 
@@ -430,10 +749,7 @@ u32 patchCheckForDevCommonKey(u8 *pos, u32 size)
 
 u32 patchK11ModuleLoading(u32 section0size, u32 modulesSize, u8 *pos, u32 size)
 {
-    static const u8 moduleLoadingPattern[]  = {0xE2, 0x05, 0x00, 0x57},
-                    modulePidPattern[] = {0x06, 0xA0, 0xE1, 0xF2}; //GetSystemInfo
-
-    u8 *off = memsearch(pos, moduleLoadingPattern, size, 4);
+    u8 *off = findSignature(pos, k11ModuleLoadingPattern, size, sizeof(k11ModuleLoadingPattern));
 
     if(off == NULL) return 1;
 
@@ -446,7 +762,7 @@ u32 patchK11ModuleLoading(u32 section0size, u32 modulesSize, u8 *pos, u32 size)
     for(; *off32 != section0size; off32++);
     *off32 = ((modulesSize + 0x1FF) >> 9) << 9;
 
-    off = memsearch(pos, modulePidPattern, size, 4);
+    off = findSignature(pos, k11ModulePidPattern, size, sizeof(k11ModulePidPattern)); //GetSystemInfo
 
     if(off == NULL) return 1;
 
@@ -457,9 +773,7 @@ u32 patchK11ModuleLoading(u32 section0size, u32 modulesSize, u8 *pos, u32 size)
 
 u32 patchArm9ExceptionHandlersInstall(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x80, 0xE5, 0x40, 0x1C};
-
-    u8 *temp = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *temp = findSignature(pos, k9ExceptionHandlersInstallPattern, size, sizeof(k9ExceptionHandlersInstallPattern));
 
     if(temp == NULL) return 1;
 
@@ -493,9 +807,7 @@ u32 patchSvcBreak9(u8 *pos, u32 size, u32 kernel9Address)
     //Stub svcBreak with "bkpt 65535" so we can debug the panic
 
     //Look for the svc handler
-    static const u8 pattern[] = {0x00, 0xE0, 0x4F, 0xE1}; //mrs lr, spsr
-
-    u32 *arm9SvcTable = (u32 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u32 *arm9SvcTable = (u32 *)findSignature(pos, k9SvcHandlerPattern, size, sizeof(k9SvcHandlerPattern));
 
     if(arm9SvcTable == NULL) return 1;
 
@@ -517,9 +829,7 @@ u32 patchSvcBreak9(u8 *pos, u32 size, u32 kernel9Address)
 
 u32 patchKernel9Panic(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x00, 0x20, 0x92, 0x15};
-
-    u8 *temp = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *temp = findSignature(pos, k9PanicPattern, size, sizeof(k9PanicPattern));
 
     if(temp == NULL) return 1;
 
@@ -531,9 +841,7 @@ u32 patchKernel9Panic(u8 *pos, u32 size)
 
 u32 patchP9AccessChecks(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x00, 0x08, 0x49, 0x68};
-
-    u8 *temp = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *temp = findSignature(pos, p9AccessChecksPattern, size, sizeof(p9AccessChecksPattern));
 
     if(temp == NULL) return 1;
 
@@ -547,9 +855,7 @@ u32 patchP9AccessChecks(u8 *pos, u32 size)
 u32 patchUnitInfoValueSet(u8 *pos, u32 size)
 {
     //Look for UNITINFO value being set during kernel sync
-    static const u8 pattern[] = {0x01, 0x10, 0xA0, 0x13};
-
-    u8 *off = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *off = findSignature(pos, k9UnitInfoValueSetPattern, size, sizeof(k9UnitInfoValueSetPattern));
 
     if(off == NULL) return 1;
 
@@ -561,11 +867,8 @@ u32 patchUnitInfoValueSet(u8 *pos, u32 size)
 
 u32 patchP9AMTicketWrapperZeroKeyIV(u8 *pos, u32 size, u32 firmVersion)
 {
-    static const u8 __rt_memclr_pattern[] = {0x00, 0x20, 0xA0, 0xE3, 0x04, 0x00, 0x51, 0xE3, 0x07, 0x00, 0x00, 0x3A};
-    static const u8 pattern[] = {0x20, 0x21, 0xA6, 0xA8};
-
-    u32 function = (u32)memsearch(pos, __rt_memclr_pattern, size, sizeof(__rt_memclr_pattern));
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u32 function = (u32)findSignature(pos, p9RtMemclrPattern, size, sizeof(p9RtMemclrPattern));
+    u16 *off = (u16 *)findSignature(pos, p9TicketWrapperPattern, size, sizeof(p9TicketWrapperPattern));
 
     if(function == 0 || off == NULL) return firmVersion == 0xFFFFFFFF ? 0 : 1;
 
@@ -589,9 +892,7 @@ u32 patchP9AMTicketWrapperZeroKeyIV(u8 *pos, u32 size, u32 firmVersion)
 
 u32 patchLgySignatureChecks(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x47, 0xC1, 0x17, 0x49};
-
-    u8 *temp = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *temp = findSignature(pos, p9LgySignatureChecksPattern, size, sizeof(p9LgySignatureChecksPattern));
 
     if(temp == NULL) return 1;
 
@@ -605,9 +906,7 @@ u32 patchLgySignatureChecks(u8 *pos, u32 size)
 
 u32 patchTwlInvalidSignatureChecks(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x20, 0xF6, 0xE7, 0x7F};
-
-    u8 *temp = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *temp = findSignature(pos, p9TwlInvalidSignatureChecksPattern, size, sizeof(p9TwlInvalidSignatureChecksPattern));
 
     if(temp == NULL) return 1;
 
@@ -619,9 +918,7 @@ u32 patchTwlInvalidSignatureChecks(u8 *pos, u32 size)
 
 u32 patchTwlNintendoLogoChecks(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0xC0, 0x30, 0x06, 0xF0};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u16 *off = (u16 *)findSignature(pos, p9TwlNintendoLogoChecksPattern, size, sizeof(p9TwlNintendoLogoChecksPattern));
 
     if(off == NULL) return 1;
 
@@ -633,9 +930,7 @@ u32 patchTwlNintendoLogoChecks(u8 *pos, u32 size)
 
 u32 patchTwlWhitelistChecks(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x22, 0x00, 0x20, 0x30};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u16 *off = (u16 *)findSignature(pos, p9TwlWhitelistChecksPattern, size, sizeof(p9TwlWhitelistChecksPattern));
 
     if(off == NULL) return 1;
 
@@ -647,9 +942,7 @@ u32 patchTwlWhitelistChecks(u8 *pos, u32 size)
 
 u32 patchTwlFlashcartChecks(u8 *pos, u32 size, u32 firmVersion)
 {
-    static const u8 pattern[] = {0x25, 0x20, 0x00, 0x0E};
-
-    u8 *temp = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *temp = findSignature(pos, p9TwlFlashcartChecksPattern, size, sizeof(p9TwlFlashcartChecksPattern));
 
     if(temp == NULL)
     {
@@ -667,9 +960,7 @@ u32 patchTwlFlashcartChecks(u8 *pos, u32 size, u32 firmVersion)
 
 u32 patchOldTwlFlashcartChecks(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x06, 0xF0, 0xA0, 0xFD};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u16 *off = (u16 *)findSignature(pos, p9OldTwlFlashcartChecksPattern, size, sizeof(p9OldTwlFlashcartChecksPattern));
 
     if(off == NULL) return 1;
 
@@ -681,9 +972,7 @@ u32 patchOldTwlFlashcartChecks(u8 *pos, u32 size)
 
 u32 patchTwlShaHashChecks(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x10, 0xB5, 0x14, 0x22};
-
-    u16 *off = (u16 *)memsearch(pos, pattern, size, sizeof(pattern));
+    u16 *off = (u16 *)findSignature(pos, p9TwlShaHashChecksPattern, size, sizeof(p9TwlShaHashChecksPattern));
 
     if(off == NULL) return 1;
 
@@ -695,9 +984,7 @@ u32 patchTwlShaHashChecks(u8 *pos, u32 size)
 
 u32 patchAgbBootSplash(u8 *pos, u32 size)
 {
-    static const u8 pattern[] = {0x00, 0x00, 0x01, 0xEF};
-
-    u8 *off = memsearch(pos, pattern, size, sizeof(pattern));
+    u8 *off = findSignature(pos, p9AgbBootSplashPattern, size, sizeof(p9AgbBootSplashPattern));
 
     if(off == NULL) return 1;
 
@@ -37,6 +37,9 @@
 
 #include "types.h"
 
+void loadSignatureCache(const Firm *firm, FirmwareType firmType);
+void saveSignatureCache(void);
+u32 formatSignatureOffsets(char *out, u32 size);
 u8 *getProcess9Info(u8 *pos, u32 size, u32 *process9Size, u32 *process9MemAddr);
 u32 *getKernel11Info(u8 *pos, u32 size, u32 *baseK11VA, u8 **freeK11Space, u32 **arm11SvcHandler, u32 **arm11ExceptionsPage);
 u32 installK11Extension(u8 *pos, u32 size, bool needToInitSd, u32 baseK11VA, u32 *arm11ExceptionsPage, u8 **freeK11Space);
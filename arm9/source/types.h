@@ -72,6 +72,18 @@ typedef struct __attribute__((packed, aligned(4)))
     u32 rosalinaFlags;
 } CfgData;
 
+//Optionally stored after CfgData in the configuration file
+typedef struct __attribute__((packed, aligned(4)))
+{
+    u32 sdCid[4];
+    u32 nandSize, fatStart;
+    u32 knownLayouts; //Bitmask of EmuNAND indexes
+    struct
+    {
+        u32 offset, header;
+    } layouts[4];
+} EmuNandLayouts;
+
 typedef struct
 {
     char magic[4];
@@ -38,7 +38,7 @@
 #include "memory.h"
 #include "fs.h"
 
-static void startChrono(void)
+void startChrono(void)
 {
     static bool isChronoStarted = false;
 
@@ -55,16 +55,19 @@ static void startChrono(void)
     isChronoStarted = true;
 }
 
-static u64 chrono(void)
+u64 chronoTicks(void)
 {
     u64 res = 0;
-    for(u32 i = 0; i < 4; i++) res |= REG_TIMER_VAL(i) << (16 * i);
-
-    res /= (TICKS_PER_SEC / 1000);
+    for(u32 i = 0; i < 4; i++) res |= (u64)REG_TIMER_VAL(i) << (16 * i);
 
     return res;
 }
 
+static u64 chrono(void)
+{
+    return chronoTicks() / (TICKS_PER_SEC / 1000);
+}
+
 u32 waitInput(bool isMenu)
 {
     static u64 dPadDelay = 0ULL;
@@ -39,6 +39,8 @@
 #define MAKE_BRANCH(src,dst)      (0xEA000000 | ((u32)((((u8 *)(dst) - (u8 *)(src)) >> 2) - 2) & 0xFFFFFF))
 #define MAKE_BRANCH_LINK(src,dst) (0xEB000000 | ((u32)((((u8 *)(dst) - (u8 *)(src)) >> 2) - 2) & 0xFFFFFF))
 
+void startChrono(void);
+u64 chronoTicks(void);
 u32 waitInput(bool isMenu);
 void mcuPowerOff(void);
 void wait(u64 amount);
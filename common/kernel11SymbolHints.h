@@ -0,0 +1,43 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Handed over by arm9 to k11_extension, along with the other kernel extension parameters
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+//Locations (VAs) of what k11_extension otherwise has to find with its slowest, unanchored scans, 0 if not found.
+//They're only hints: the kernel checks that they're within its .text and the instructions there, and falls back to scanning otherwise
+typedef struct Kernel11SymbolHints
+{
+    uint32_t fcramDescriptorLoad;           //ldr rX, =fcramDescriptor; mov; mov; mov; bl
+    uint32_t schedulerAdjustThread;
+    uint32_t attemptSwitchingThreadContextLiterals;
+    uint32_t invalidateInstructionCacheRangeBody;
+} Kernel11SymbolHints;
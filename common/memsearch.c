@@ -0,0 +1,112 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Boyer-Moore Horspool algorithm adapted from http://www-igm.univ-mlv.fr/~lecroq/string/node18.html#SECTION00180
+*/
+
+#include "memsearch.h"
+
+void memsearchCompile(MemsearchPattern *compiled, const void *pattern, uint32_t patternSize)
+{
+    const uint8_t *patternc = (const uint8_t *)pattern;
+
+    compiled->pattern = patternc;
+    compiled->patternSize = patternSize;
+
+    for(uint32_t i = 0; i < 256; i++)
+        compiled->table[i] = patternSize;
+    for(uint32_t i = 0; i + 1 < patternSize; i++)
+        compiled->table[patternc[i]] = patternSize - i - 1;
+}
+
+uint8_t *memsearchCompiled(uint8_t *startPos, uint32_t size, const MemsearchPattern *compiled)
+{
+    const uint8_t *patternc = compiled->pattern;
+    uint32_t patternSize = compiled->patternSize;
+
+    if(patternSize == 0 || patternSize > size) return NULL;
+
+    uint8_t last = patternc[patternSize - 1];
+
+    for(uint32_t j = 0; j <= size - patternSize;)
+    {
+        uint8_t c = startPos[j + patternSize - 1];
+        if(last == c && memcmp(patternc, startPos + j, patternSize - 1) == 0)
+            return startPos + j;
+        j += compiled->table[c];
+    }
+
+    return NULL;
+}
+
+static uint8_t *memsearchShort(uint8_t *startPos, const uint8_t *pattern, uint32_t size, uint32_t patternSize)
+{
+    //Anchor on the last byte that isn't 0x00 or 0xFF, those being the most common ones in code and data
+    uint32_t anchor = patternSize - 1;
+    while(anchor > 0 && (pattern[anchor] == 0x00 || pattern[anchor] == 0xFF)) anchor--;
+
+    uint8_t *pos = startPos + anchor,
+       *end = startPos + (size - patternSize) + anchor + 1;
+
+    while(pos < end && (pos = (uint8_t *)memchr(pos, pattern[anchor], end - pos)) != NULL)
+    {
+        if(memcmp(pos - anchor, pattern, patternSize) == 0)
+            return pos - anchor;
+        pos++;
+    }
+
+    return NULL;
+}
+
+uint8_t *memsearch(uint8_t *startPos, const void *pattern, uint32_t size, uint32_t patternSize)
+{
+    if(patternSize == 0 || patternSize > size) return NULL;
+
+    if(patternSize <= MEMSEARCH_SHORT_PATTERN_MAX_SIZE)
+        return memsearchShort(startPos, (const uint8_t *)pattern, size, patternSize);
+
+    MemsearchPattern compiled;
+    memsearchCompile(&compiled, pattern, patternSize);
+
+    return memsearchCompiled(startPos, size, &compiled);
+}
+
+//For instruction signatures: both the buffer and the pattern are word-aligned, so only word-aligned locations are considered
+uint32_t *memsearchAligned(uint32_t *startPos, const uint32_t *pattern, uint32_t size, uint32_t patternSize)
+{
+    if(patternSize < 4 || patternSize > size) return NULL;
+
+    uint32_t first = pattern[0];
+
+    for(uint32_t *pos = startPos, *end = startPos + (size - patternSize) / 4; pos <= end; pos++)
+    {
+        if(*pos == first && memcmp(pos + 1, pattern + 1, patternSize - 4) == 0)
+            return pos;
+    }
+
+    return NULL;
+}
@@ -1,6 +1,6 @@
 /*
 *   This file is part of Luma3DS
-*   Copyright (C) 2016-2020 Aurora Wright, TuxSH
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
 *
 *   This program is free software: you can redistribute it and/or modify
 *   it under the terms of the GNU General Public License as published by
@@ -26,31 +26,25 @@
 
 /*
 *   Boyer-Moore Horspool algorithm adapted from http://www-igm.univ-mlv.fr/~lecroq/string/node18.html#SECTION00180
-*   memcpy, memset and memcmp adapted from https://github.com/mid-kid/CakesForeveryWan/blob/557a8e8605ab3ee173af6497486e8f22c261d0e2/source/memfuncs.c
+*   Shared by arm9, loader and rosalina
 */
 
-#include "memory.h"
+#pragma once
 
-u8 *memsearch(u8 *startPos, const void *pattern, u32 size, u32 patternSize)
-{
-    const u8 *patternc = (const u8 *)pattern;
-    u32 table[256];
+#include <stdint.h>
+#include <string.h>
 
-    //Preprocessing
-    for(u32 i = 0; i < 256; i++)
-        table[i] = patternSize;
-    for(u32 i = 0; i < patternSize - 1; i++)
-        table[patternc[i]] = patternSize - i - 1;
+//Patterns up to this size are located with memchr rather than with a skip table
+#define MEMSEARCH_SHORT_PATTERN_MAX_SIZE 4
 
-    //Searching
-    u32 j = 0;
-    while(j <= size - patternSize)
-    {
-        u8 c = startPos[j + patternSize - 1];
-        if(patternc[patternSize - 1] == c && memcmp(pattern, startPos + j, patternSize - 1) == 0)
-            return startPos + j;
-        j += table[c];
-    }
+typedef struct MemsearchPattern
+{
+    const uint8_t *pattern;
+    uint32_t patternSize;
+    uint32_t table[256];
+} MemsearchPattern;
 
-    return NULL;
-}
+void memsearchCompile(MemsearchPattern *compiled, const void *pattern, uint32_t patternSize);
+uint8_t *memsearchCompiled(uint8_t *startPos, uint32_t size, const MemsearchPattern *compiled);
+uint8_t *memsearch(uint8_t *startPos, const void *pattern, uint32_t size, uint32_t patternSize);
+uint32_t *memsearchAligned(uint32_t *startPos, const uint32_t *pattern, uint32_t size, uint32_t patternSize);
@@ -35,4 +35,6 @@ enum singleOptions
     PATCHUNITINFO,
     CUTSLEEPWIFI,
     ENABLESAFEFIRMROSALINA,
+    CACHEDECRYPTEDFIRM,
+    WRITEBOOTTIMELOG,
 };
@@ -0,0 +1,85 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#pragma once
+
+#include "types.h"
+#include "kernel.h"
+
+#define CPU_TIME_NB_THREADS     256 // per core, power of two
+#define CPU_TIME_NB_PROCESSES   64  // per core, power of two
+#define CPU_TIME_SLOT_CACHE     32  // per core, power of two
+
+// Open-addressing table of tick counters; keys are thread or process IDs + 1, 0 meaning empty
+typedef struct CpuTimeTable
+{
+    u32 size;
+    u32 count;
+    u32 *keys;
+    u64 *ticks;
+} CpuTimeTable;
+
+// The counts are an approximation, a lower bound of the CPU time: the extension doesn't hook the scheduler's context
+// switch, so switches are inferred from SVC entries and returns. Only the time a thread spends in user mode between an
+// SVC return and its next SVC entry on the same core is charged: time spent blocked in an SVC isn't CPU time, and an
+// interval during which another thread entered or left an SVC on that core is dropped, since the switches happened at
+// unknown points in between. So a thread preempted in user mode loses that whole interval, and a compute-bound thread
+// that makes no SVC isn't charged at all.
+// Each core only updates its own tables, with interrupts disabled
+typedef struct CpuTimeCore
+{
+    CpuTimeTable threads;
+    CpuTimeTable processes;
+
+    // Thread that last returned from an SVC on this core, NULL if there's none or it has entered an SVC since
+    KThread *thread;
+    u64 tick;
+
+    // Table slots of the threads seen last, direct-mapped by thread
+    struct
+    {
+        KThread *thread;
+        u32 threadSlot;
+        u32 processSlot;
+    } slotCache[CPU_TIME_SLOT_CACHE];
+
+    u32 nbThreadsAfterPrune;
+    u32 nbProcessesAfterPrune;
+} CpuTimeCore;
+
+bool cpuTimeTableAdd(CpuTimeTable *table, u32 id, u64 ticks);
+u64 cpuTimeTableGet(const CpuTimeTable *table, u32 id);
+void cpuTimeTableRetain(CpuTimeTable *table, bool (*isAlive)(u32 id));
+void cpuTimeObserveReturn(CpuTimeCore *core, KThread *thread, u64 tick);
+void cpuTimeObserveEntry(CpuTimeCore *core, KThread *thread, u64 tick);
+
+extern bool cpuTimeEnabled;
+
+void cpuTimeSetEnabled(bool enable);
+void signalCpuTimeEntry(KThread *thread);
+void signalCpuTimeReturn(KThread *thread);
+Result GetThreadCpuTime(s64 *out, KThread *thread);
+Result GetProcessCpuTime(s64 *out, KProcess *process);
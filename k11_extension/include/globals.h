@@ -67,6 +67,7 @@ extern void (*SleepThread)(s64 ns);
 extern Result (*CreateEvent)(Handle *out, ResetType resetType);
 extern Result (*CloseHandle)(Handle handle);
 extern Result (*GetHandleInfo)(s64 *out, Handle handle, u32 type);
+extern u64 (*GetSystemTick)(void);
 extern Result (*GetSystemInfo)(s64 *out, s32 type, s32 param);
 extern Result (*GetProcessInfo)(s64 *out, Handle processHandle, u32 type);
 extern Result (*GetThreadInfo)(s64 *out, Handle threadHandle, u32 type);
@@ -76,6 +77,8 @@ extern Result (*OpenProcess)(Handle *out, u32 processId);
 extern Result (*GetProcessId)(u32 *out, Handle process);
 extern Result (*DebugActiveProcess)(Handle *out, u32 processId);
 extern Result (*SignalEvent)(Handle event);
+extern Result (*ReadProcessMemory)(void *buffer, Handle debug, u32 addr, u32 size);
+extern Result (*WriteProcessMemory)(Handle debug, const void *buffer, u32 addr, u32 size);
 extern Result (*UnmapProcessMemory)(Handle processHandle, void *dst, u32 size);
 extern Result (*KernelSetState)(u32 type, u32 varg1, u32 varg2, u32 varg3);
 
@@ -127,6 +130,8 @@ extern void  (*mcuReboot)(void);
 extern void  (*coreBarrier)(void);
 extern void* (*kAlloc)(FcramDescriptor *fcramDesc, u32 nbPages, u32 alignment, u32 region);
 
+#define BOOT_TIMELINE_MAX_STAGES    16 // keep in sync with arm9/source/bootprof.h
+
 typedef struct CfwInfo
 {
     char magic[4];
@@ -143,6 +148,10 @@ typedef struct CfwInfo
     u64 hbldr3dsxTitleId;
     u32 rosalinaMenuCombo;
     u32 rosalinaFlags;
+
+    // Filled by arm9 in arm9/source/bootprof.c
+    u32 bootReachedStages;
+    u32 bootStageEnd[BOOT_TIMELINE_MAX_STAGES];
 } CfwInfo;
 
 extern CfwInfo cfwInfo;
@@ -26,29 +26,57 @@
 
 #pragma once
 
+#include <string.h>
 #include "types.h"
 #include "globals.h"
 #include "kernel.h"
 #include "utils.h"
 
-#define MAX_SESSION     345
+#define MAX_SESSION             345
+#define SESSION_HASH_BITS       9
+#define SESSION_HASH_SIZE       (1 << SESSION_HASH_BITS) // must stay > MAX_SESSION
+#define SESSION_NAME_BUCKETS    64
 
 // the structure of sessions is apparently not the same on older versions...
 
+// services SendSyncRequestHook cares about, resolved once when the session is registered
+typedef enum ServiceId
+{
+    SERVICE_OTHER = 0,
+    SERVICE_SRV,
+    SERVICE_SRV_PM,
+    SERVICE_CFG_U,
+    SERVICE_CFG_S,
+    SERVICE_CFG_I,
+    SERVICE_NDM_U,
+    SERVICE_ERR_F,
+    SERVICE_APT,
+    SERVICE_FS_USER,
+} ServiceId;
+
 typedef struct SessionInfo
 {
     KSession *session;
     char name[12];
+    u32 serviceId;
+    u16 prevByName, nextByName; // name bucket chain (indices + 1), nextByName also links free entries
 } SessionInfo;
 
-typedef struct LangemuAttributes
+extern Vtable__KAutoObject *clientSessionVtable;
+extern u32 sessionInfosGeneration; // incremented each time a session is registered or unregistered
+
+// All KClientSession objects share the same vtable: after the first successful
+// class name check, identifying one is a single pointer comparison
+static inline bool isClientSession(KAutoObject *obj)
 {
-    u64 titleId;
-    u8 mask, region, language, country, state;
-} LangemuAttributes;
+    if(obj->vtable == clientSessionVtable)
+        return true;
+    else if(strcmp(classNameOfAutoObject(obj), "KClientSession") != 0)
+        return false;
 
-extern KRecursiveLock processLangemuLock;
-extern LangemuAttributes processLangemuAttributes[0x40];
+    clientSessionVtable = obj->vtable;
+    return true;
+}
 
 SessionInfo *SessionInfo_Lookup(KSession *session);
 SessionInfo *SessionInfo_FindFirst(const char *name);
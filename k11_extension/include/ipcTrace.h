@@ -0,0 +1,53 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#pragma once
+
+#include "types.h"
+
+#define IPC_TRACE_EVENTS_PER_CORE   128
+#define IPC_TRACE_NAME_CACHE_BITS   4   // per core
+#define IPC_TRACE_READ_ATTEMPTS     8
+
+// Keep in sync with sysmodules/rosalina/include/menus/miscellaneous.h
+typedef struct IpcTraceEvent
+{
+    u32 seq;        // 0 if the slot is empty or being written
+    u32 pid;
+    u32 cmdHeader;
+    u32 duration;   // in system ticks, between the request being sent and its reply
+    u64 sendTick;
+    char name[8];   // service name, empty if the session wasn't registered
+} IpcTraceEvent;
+
+struct KSession;
+
+extern bool ipcTraceEnabled;
+
+void ipcTraceSetEnabled(bool enable);
+void ipcTraceGetServiceName(char *name, struct KSession *session);
+void ipcTraceRecord(u32 pid, const char *name, u32 cmdHeader, u64 sendTick, u64 replyTick);
+Result ipcTraceRead(IpcTraceEvent *out, u32 maxEvents, u32 *outCount); // grouped by core, each in reply order
@@ -0,0 +1,63 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#pragma once
+
+#include "types.h"
+#include "kernel.h"
+
+#define LANGEMU_NB_TITLES       0x40
+#define LANGEMU_NB_PROCESSES    0x40 // power of two
+
+typedef struct LangemuAttributes
+{
+    u64 titleId;
+    u8 mask, region, language, country, state;
+} LangemuAttributes;
+
+// The loader registers attributes by title ID before creating the process. Each process then looks
+// its title up once, the result being cached by PID, direct-mapped: PIDs are never reused, so a
+// collision only means the evicted process will have to look its title up again
+typedef struct LangemuProcessEntry
+{
+    u32 key;    // PID + 1, 0 meaning empty
+    u32 index;  // index in titles + 1, 0 meaning the title has no attributes
+} LangemuProcessEntry;
+
+typedef struct LangemuState
+{
+    u32 nbTitles;
+    LangemuAttributes titles[LANGEMU_NB_TITLES];
+    LangemuProcessEntry processes[LANGEMU_NB_PROCESSES];
+} LangemuState;
+
+bool langemuStateAddTitle(LangemuState *state, const LangemuAttributes *attribs);
+const LangemuAttributes *langemuStateGet(LangemuState *state, u32 pid, u64 titleId);
+void langemuStateForgetProcess(LangemuState *state, u32 pid);
+
+Result SetLangemuAttributes(const LangemuAttributes *attribs);
+bool getProcessLangemuAttributes(LangemuAttributes *out, KProcess *process);
+void signalLangemuProcessExit(KProcess *process);
@@ -0,0 +1,55 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#pragma once
+
+#include "utils.h"
+#include "kernel.h"
+#include "svc.h"
+
+#define MAX_PROCESS_MEMORY_ACCESSES 0x100
+
+typedef enum ProcessMemoryAccessType
+{
+    PROCESSMEMACCESS_READ = 0,
+    PROCESSMEMACCESS_WRITE,
+} ProcessMemoryAccessType;
+
+// Keep in sync with sysmodules/rosalina/include/csvc.h
+typedef struct ProcessMemoryAccess
+{
+    u32 address;        // in the debugged process
+    u32 size;
+    u32 type;           // ProcessMemoryAccessType
+    void *buffer;       // in the caller's address space
+    Result result;      // written back
+    u32 transferred;    // written back, bytes copied before the first failure
+} ProcessMemoryAccess;
+
+Result validateProcessMemoryAccess(const ProcessMemoryAccess *access);
+u32 getProcessMemoryAccessChunkSize(u32 address, u32 remaining);
+
+Result AccessProcessMemory(Handle debug, ProcessMemoryAccess *accesses, u32 count);
@@ -0,0 +1,48 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#pragma once
+
+#include "utils.h"
+#include "kernel.h"
+#include "svc.h"
+
+#define MAX_PROCESS_MEMORY_MAPPINGS 16
+
+// Keep in sync with sysmodules/rosalina/include/csvc.h
+typedef struct ProcessMemoryMapping
+{
+    Handle srcProcess;  // ignored when unmapping
+    u32 srcVa;          // ignored when unmapping
+    u32 dstVa;
+    u32 size;
+    Result result;      // written back
+} ProcessMemoryMapping;
+
+Result sortProcessMemoryMappings(u8 *order, u32 *outNbValid, ProcessMemoryMapping *mappings, u32 count);
+u32 getNbCoalescableProcessMemoryMappings(const u8 *order, const ProcessMemoryMapping *mappings, u32 first, u32 count, bool unmap);
+
+Result MapProcessMemoryBatch(Handle dstProcessHandle, ProcessMemoryMapping *mappings, u32 count, bool unmap);
@@ -30,5 +30,6 @@
 #include "kernel.h"
 #include "svc.h"
 
+Result doMapProcessMemory(KProcess *dstProcess, u32 vaDst, KProcess *srcProcess, u32 vaSrc, u32 size); // no cache maintenance
 Result MapProcessMemoryEx(Handle dstProcessHandle, u32 vaDst, Handle srcProcessHandle, u32 vaSrc, u32 size);
 Result MapProcessMemoryExWrapper(Handle dstProcessHandle, u32 vaDst, Handle srcProcessHandle, u32 vaSrc, u32 size);
@@ -0,0 +1,69 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#pragma once
+
+#include "types.h"
+#include "kernel.h"
+
+#define MAX_SVC_STATS               4
+#define SVC_STATS_NB_SVCS           0x80
+#define SVC_STATS_NB_BUCKETS        8
+#define SVC_STATS_NB_INFLIGHT       32
+
+// Latency bucket i holds calls shorter than 2^(10 + 2i) system ticks (about 3.8us * 4^i), the last one holds the rest
+typedef struct SvcStatsCore
+{
+    u32 counts[SVC_STATS_NB_SVCS];
+    u64 totalTicks[SVC_STATS_NB_SVCS];
+    u16 buckets[SVC_STATS_NB_SVCS][SVC_STATS_NB_BUCKETS];
+
+    // Pending calls, direct-mapped by thread: collisions and threads migrating to another core only lose latency samples
+    struct
+    {
+        KThread *thread;
+        u32 svcId;
+        u64 entryTick;
+    } inflight[SVC_STATS_NB_INFLIGHT];
+} SvcStatsCore;
+
+// Each core only updates its own counters, with interrupts disabled, so that SVCs don't take any lock
+typedef struct SvcStats
+{
+    u32 key; // PID + 1, 0 if the slot is free
+    SvcStatsCore cores[4];
+} SvcStats;
+
+u32 svcStatsGetBucket(u64 ticks);
+void svcStatsAccountEntry(SvcStatsCore *stats, KThread *thread, u32 svcId, u64 tick);
+void svcStatsAccountReturn(SvcStatsCore *stats, KThread *thread, u32 svcId, u64 tick);
+s64 svcStatsSum(const SvcStats *stats, u32 svcId, u32 type);
+
+Result SetSvcStatsEnabled(u32 pid, bool enable);
+void signalSvcStatsEntry(KProcess *process, KThread *thread, u32 svcId);
+void signalSvcStatsReturn(KProcess *process, KThread *thread, u32 svcId);
+void signalSvcStatsProcessExit(KProcess *process);
+Result GetSvcStatsInfo(s64 *out, KProcess *process, u32 type);
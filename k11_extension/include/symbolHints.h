@@ -0,0 +1,51 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#pragma once
+
+#include "types.h"
+#include "kernel11SymbolHints.h"
+
+// Kernel11's .text as seen from here: where it is, its VA, and where .rodata starts (.text ends there)
+typedef struct Kernel11Text
+{
+    const u32 *text;
+    u32 textVA;
+    u32 rodataVA;
+} Kernel11Text;
+
+// NULL when not found
+typedef struct SchedulerSymbols
+{
+    const u32 *adjustThread;
+    const u32 *attemptSwitchingThreadContext;
+    const u32 *invalidateInstructionCacheRange;
+} SchedulerSymbols;
+
+// These check the hints from arm9 first, and scan .text as usual if the instructions there don't match.
+// They return whether the hints were used
+bool findFcramDescriptorLoad(const u32 **load, const Kernel11Text *text, const Kernel11SymbolHints *hints);
+bool findSchedulerSymbols(SchedulerSymbols *symbols, const Kernel11Text *text, const Kernel11SymbolHints *hints, u32 interruptManagerVA, u32 objectContextVA);
@@ -34,6 +34,10 @@ typedef KSchedulableInterruptEvent* (*SGI0Handler_t)(KBaseInterruptEvent *this,
 // http://infocenter.arm.com/help/index.jsp?topic=/com.arm.doc.ddi0360f/CCHDIFIJ.html
 void executeFunctionOnCores(SGI0Handler_t func, u8 targetList, u8 targetListFilter);
 
+// Same, but only returns once every targeted core has run func, so that the next caller can't replace it while an
+// SGI is still pending. Interrupts are enabled while waiting if the current core is targeted
+void executeFunctionOnCoresAndWait(SGI0Handler_t func, u8 targetList);
+
 void KScheduler__TriggerCrossCoreInterrupt(KScheduler *this);
 void KThread__DebugReschedule(KThread *this, bool lock);
 
@@ -77,6 +77,14 @@ static inline u32 getCurrentCoreID(void)
     return coreId & 3;
 }
 
+// lr of the thread that last ran in user mode on this core, from the banked register
+static inline u32 getUserModeLr(void)
+{
+    u32 lr;
+    __asm__ volatile("stmia %0, {lr}^" :: "r"(&lr) : "memory");
+    return lr;
+}
+
 u32 convertVAToPA(const void *addr, bool writeCheck);
 
 u32 safecpy(void *dst, const void *src, u32 len);
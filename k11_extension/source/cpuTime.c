@@ -0,0 +1,311 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include <string.h>
+
+#include "cpuTime.h"
+#include "globals.h"
+#include "synchronization.h"
+#include "utils.h"
+
+static u32 cpuTimeThreadKeys[4][CPU_TIME_NB_THREADS];
+static u64 cpuTimeThreadTicks[4][CPU_TIME_NB_THREADS];
+static u32 cpuTimeProcessKeys[4][CPU_TIME_NB_PROCESSES];
+static u64 cpuTimeProcessTicks[4][CPU_TIME_NB_PROCESSES];
+
+static CpuTimeCore cpuTimeCores[4];
+
+static KRecursiveLock cpuTimeLock = { NULL };
+
+bool cpuTimeEnabled = false;
+
+static inline u32 cpuTimeTableFindSlot(const CpuTimeTable *table, u32 key)
+{
+    u32 slot = (key * 2654435761u) & (table->size - 1);
+
+    while(table->keys[slot] != 0 && table->keys[slot] != key)
+        slot = (slot + 1) & (table->size - 1);
+
+    return slot;
+}
+
+// Returns table->size if the table is full
+static u32 cpuTimeTableInsert(CpuTimeTable *table, u32 id)
+{
+    u32 slot = cpuTimeTableFindSlot(table, id + 1);
+
+    if(table->keys[slot] == 0)
+    {
+        // Keep the load factor at 3/4 at most so that probe runs stay short
+        if(4 * (table->count + 1) > 3 * table->size)
+            return table->size;
+
+        table->keys[slot] = id + 1;
+        table->ticks[slot] = 0;
+        table->count++;
+    }
+
+    return slot;
+}
+
+bool cpuTimeTableAdd(CpuTimeTable *table, u32 id, u64 ticks)
+{
+    u32 slot = cpuTimeTableInsert(table, id);
+
+    if(slot == table->size)
+        return false;
+
+    table->ticks[slot] += ticks;
+    return true;
+}
+
+u64 cpuTimeTableGet(const CpuTimeTable *table, u32 id)
+{
+    u32 slot = cpuTimeTableFindSlot(table, id + 1);
+    u64 ticks, ticks2;
+
+    if(table->keys[slot] == 0)
+        return 0;
+
+    // Updated by another core without locking: read until two reads agree
+    do
+    {
+        ticks = *(const volatile u64 *)&table->ticks[slot];
+        ticks2 = *(const volatile u64 *)&table->ticks[slot];
+    } while(ticks != ticks2);
+
+    return ticks;
+}
+
+static void cpuTimeTableRemoveSlot(CpuTimeTable *table, u32 hole)
+{
+    // Backward-shift deletion, see SessionInfo_Remove
+    for(u32 slot = (hole + 1) & (table->size - 1); table->keys[slot] != 0; slot = (slot + 1) & (table->size - 1))
+    {
+        u32 home = (table->keys[slot] * 2654435761u) & (table->size - 1);
+        if(((slot - home) & (table->size - 1)) >= ((slot - hole) & (table->size - 1)))
+        {
+            table->keys[hole] = table->keys[slot];
+            table->ticks[hole] = table->ticks[slot];
+            hole = slot;
+        }
+    }
+
+    table->keys[hole] = 0;
+    table->ticks[hole] = 0;
+    table->count--;
+}
+
+void cpuTimeTableRetain(CpuTimeTable *table, bool (*isAlive)(u32 id))
+{
+    // Entries moved into an already visited slot by a removal are alive, since dead ones before them are gone already
+    for(u32 slot = 0; slot < table->size; slot++)
+    {
+        while(table->keys[slot] != 0 && !isAlive(table->keys[slot] - 1))
+            cpuTimeTableRemoveSlot(table, slot);
+    }
+}
+
+static inline u32 cpuTimeGetSlotCacheIndex(KThread *thread)
+{
+    return ((u32)thread >> 4) & (CPU_TIME_SLOT_CACHE - 1);
+}
+
+void cpuTimeObserveReturn(CpuTimeCore *core, KThread *thread, u64 tick)
+{
+    core->thread = thread;
+    core->tick = tick;
+}
+
+void cpuTimeObserveEntry(CpuTimeCore *core, KThread *thread, u64 tick)
+{
+    KThread *last = core->thread;
+
+    core->thread = NULL;
+    if(last != thread || tick <= core->tick)
+        return;
+
+    u32 threadId = thread->threadId;
+    u32 pid = idOfProcess(thread->ownerProcess);
+    u32 index = cpuTimeGetSlotCacheIndex(thread);
+    u32 threadSlot = core->slotCache[index].threadSlot;
+    u32 processSlot = core->slotCache[index].processSlot;
+
+    // Removals move entries around, and thread objects are reused
+    if(core->slotCache[index].thread != thread || core->threads.keys[threadSlot] != threadId + 1 ||
+       core->processes.keys[processSlot] != pid + 1)
+    {
+        threadSlot = cpuTimeTableInsert(&core->threads, threadId);
+        processSlot = cpuTimeTableInsert(&core->processes, pid);
+        if(threadSlot == core->threads.size || processSlot == core->processes.size)
+        {
+            core->slotCache[index].thread = NULL;
+            return;
+        }
+
+        core->slotCache[index].thread = thread;
+        core->slotCache[index].threadSlot = threadSlot;
+        core->slotCache[index].processSlot = processSlot;
+    }
+
+    core->threads.ticks[threadSlot] += tick - core->tick;
+    core->processes.ticks[processSlot] += tick - core->tick;
+}
+
+static bool cpuTimeIsThreadAlive(u32 id)
+{
+    for(KLinkedListNode *node = threadList->list.nodes.first; node != (KLinkedListNode *)&threadList->list.nodes; node = node->next)
+    {
+        if(((KThread *)node->key)->threadId == id)
+            return true;
+    }
+
+    return false;
+}
+
+static bool cpuTimeIsProcessAlive(u32 pid)
+{
+    for(KLinkedListNode *node = threadList->list.nodes.first; node != (KLinkedListNode *)&threadList->list.nodes; node = node->next)
+    {
+        KProcess *process = ((KThread *)node->key)->ownerProcess;
+        if(process != NULL && idOfProcess(process) == pid)
+            return true;
+    }
+
+    return false;
+}
+
+static inline bool cpuTimeShouldPrune(const CpuTimeTable *table, u32 countAfterPrune)
+{
+    // Walking the thread list is slow, so don't do it again until a new entry has been added
+    return 4 * table->count >= 3 * table->size - 4 && table->count != countAfterPrune;
+}
+
+static void cpuTimePrune(void)
+{
+    CpuTimeCore *core = &cpuTimeCores[getCurrentCoreID()];
+
+    if(cpuTimeShouldPrune(&core->threads, core->nbThreadsAfterPrune))
+    {
+        cpuTimeTableRetain(&core->threads, cpuTimeIsThreadAlive);
+        core->nbThreadsAfterPrune = core->threads.count;
+    }
+    if(cpuTimeShouldPrune(&core->processes, core->nbProcessesAfterPrune))
+    {
+        cpuTimeTableRetain(&core->processes, cpuTimeIsProcessAlive);
+        core->nbProcessesAfterPrune = core->processes.count;
+    }
+}
+
+void cpuTimeSetEnabled(bool enable)
+{
+    KRecursiveLock__Lock(criticalSectionLock);
+    KRecursiveLock__Lock(&cpuTimeLock);
+
+    if(enable && !cpuTimeEnabled)
+    {
+        memset(cpuTimeThreadKeys, 0, sizeof(cpuTimeThreadKeys));
+        memset(cpuTimeProcessKeys, 0, sizeof(cpuTimeProcessKeys));
+        memset(cpuTimeCores, 0, sizeof(cpuTimeCores));
+
+        for(u32 i = 0; i < 4; i++)
+        {
+            cpuTimeCores[i].threads = (CpuTimeTable){ CPU_TIME_NB_THREADS, 0, cpuTimeThreadKeys[i], cpuTimeThreadTicks[i] };
+            cpuTimeCores[i].processes = (CpuTimeTable){ CPU_TIME_NB_PROCESSES, 0, cpuTimeProcessKeys[i], cpuTimeProcessTicks[i] };
+        }
+
+        __dmb();
+    }
+
+    cpuTimeEnabled = enable;
+
+    KRecursiveLock__Unlock(&cpuTimeLock);
+    KRecursiveLock__Unlock(criticalSectionLock);
+}
+
+void signalCpuTimeEntry(KThread *thread)
+{
+    if(!cpuTimeEnabled || thread->ownerProcess == NULL)
+        return;
+
+    u64 tick = GetSystemTick();
+    CpuTimeCore *core = &cpuTimeCores[getCurrentCoreID()];
+
+    // Forget the threads and processes that died when the tables are getting full, which needs the critical section
+    if(cpuTimeShouldPrune(&core->threads, core->nbThreadsAfterPrune) || cpuTimeShouldPrune(&core->processes, core->nbProcessesAfterPrune))
+    {
+        KRecursiveLock__Lock(criticalSectionLock);
+        u32 cpsr = __get_cpsr();
+        __disable_irq();
+        cpuTimePrune();
+        __set_cpsr_cx(cpsr);
+        KRecursiveLock__Unlock(criticalSectionLock);
+    }
+
+    u32 cpsr = __get_cpsr();
+    __disable_irq();
+    cpuTimeObserveEntry(&cpuTimeCores[getCurrentCoreID()], thread, tick);
+    __set_cpsr_cx(cpsr);
+}
+
+void signalCpuTimeReturn(KThread *thread)
+{
+    if(!cpuTimeEnabled || thread->ownerProcess == NULL)
+        return;
+
+    u32 cpsr = __get_cpsr();
+    __disable_irq();
+    cpuTimeObserveReturn(&cpuTimeCores[getCurrentCoreID()], thread, GetSystemTick());
+    __set_cpsr_cx(cpsr);
+}
+
+Result GetThreadCpuTime(s64 *out, KThread *thread)
+{
+    u64 ticks = 0;
+
+    if(!cpuTimeEnabled)
+        return 0xF8C007F4; // not implemented
+
+    for(u32 core = 0; core < getNumberOfCores(); core++)
+        ticks += cpuTimeTableGet(&cpuTimeCores[core].threads, thread->threadId);
+
+    *out = (s64)ticks;
+    return 0;
+}
+
+Result GetProcessCpuTime(s64 *out, KProcess *process)
+{
+    u64 ticks = 0;
+
+    if(!cpuTimeEnabled)
+        return 0xF8C007F4; // not implemented
+
+    for(u32 core = 0; core < getNumberOfCores(); core++)
+        ticks += cpuTimeTableGet(&cpuTimeCores[core].processes, idOfProcess(process));
+
+    *out = (s64)ticks;
+    return 0;
+}
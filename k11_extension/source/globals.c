@@ -66,6 +66,7 @@ void (*SleepThread)(s64 ns);
 Result (*CreateEvent)(Handle *out, ResetType resetType);
 Result (*CloseHandle)(Handle handle);
 Result (*GetHandleInfo)(s64 *out, Handle handle, u32 type);
+u64 (*GetSystemTick)(void);
 Result (*GetSystemInfo)(s64 *out, s32 type, s32 param);
 Result (*GetProcessInfo)(s64 *out, Handle processHandle, u32 type);
 Result (*GetThreadInfo)(s64 *out, Handle threadHandle, u32 type);
@@ -75,6 +76,8 @@ Result (*OpenProcess)(Handle *out, u32 processId);
 Result (*GetProcessId)(u32 *out, Handle process);
 Result (*DebugActiveProcess)(Handle *out, u32 processId);
 Result (*SignalEvent)(Handle event);
+Result (*ReadProcessMemory)(void *buffer, Handle debug, u32 addr, u32 size);
+Result (*WriteProcessMemory)(Handle debug, const void *buffer, u32 addr, u32 size);
 Result (*UnmapProcessMemory)(Handle processHandle, void *dst, u32 size);
 Result (*KernelSetState)(u32 type, u32 varg1, u32 varg2, u32 varg3);
 
@@ -26,51 +26,87 @@
 #include <string.h>
 
 #include "ipc.h"
+#include "langemu.h"
 
+// Session infos live in a fixed pool and are never moved once allocated. They are indexed by an
+// open-addressing (linear probing) hash table keyed by the KSession pointer, and chained per
+// name hash bucket for SessionInfo_FindFirst. Indices are stored +1 so that 0 means "none".
 static SessionInfo sessionInfos[MAX_SESSION] = { {NULL} };
+static u16 sessionInfoSlots[SESSION_HASH_SIZE] = { 0 };
+static u16 sessionNameBuckets[SESSION_NAME_BUCKETS] = { 0 };
+static u16 freeSessionInfos = 0;
+static u32 nbAllocatedSessions = 0;
 static u32 nbActiveSessions = 0;
 static KRecursiveLock sessionInfosLock = { NULL };
 
-KRecursiveLock processLangemuLock;
-LangemuAttributes processLangemuAttributes[0x40];
+Vtable__KAutoObject *clientSessionVtable = NULL;
+u32 sessionInfosGeneration = 0;
 
 static void *customSessionVtable[0x10] = { NULL }; // should be enough
 
-static u32 SessionInfo_FindClosestSlot(KSession *session)
+static u32 SessionInfo_GetServiceId(const char *name)
 {
-    if(nbActiveSessions == 0 || session <= sessionInfos[0].session)
-        return 0;
-    else if(session > sessionInfos[nbActiveSessions - 1].session)
-        return nbActiveSessions;
-
-    u32 a = 0, b = nbActiveSessions - 1, m;
+    static const struct
+    {
+        const char *name;
+        u32 id;
+    } services[] = {
+        { "srv:",       SERVICE_SRV },
+        { "srv:pm",     SERVICE_SRV_PM },
+        { "cfg:u",      SERVICE_CFG_U },
+        { "cfg:s",      SERVICE_CFG_S },
+        { "cfg:i",      SERVICE_CFG_I },
+        { "ndm:u",      SERVICE_NDM_U },
+        { "err:f",      SERVICE_ERR_F },
+        { "fs:USER",    SERVICE_FS_USER },
+    };
 
-    do
+    for(u32 i = 0; i < sizeof(services) / sizeof(services[0]); i++)
     {
-        m = (a + b) / 2;
-        if(sessionInfos[m].session < session)
-            a = m;
-        else if(sessionInfos[m].session > session)
-            b = m;
-        else
-            return m;
+        if(strncmp(name, services[i].name, 12) == 0)
+            return services[i].id;
     }
-    while(b - a > 1);
 
-    return b;
+    return strncmp(name, "APT:", 4) == 0 ? SERVICE_APT : SERVICE_OTHER;
+}
+
+static inline u32 SessionInfo_HashSession(KSession *session)
+{
+    // Kernel objects are slab-allocated and word-aligned: drop the low bits, then Fibonacci hashing
+    return (((u32)session >> 2) * 2654435761u) >> (32 - SESSION_HASH_BITS);
+}
+
+static u32 SessionInfo_HashName(const char *name)
+{
+    u32 hash = 2166136261u; // FNV-1a
+    for(u32 i = 0; i < 12 && name[i] != 0; i++)
+        hash = (hash ^ (u8)name[i]) * 16777619u;
+
+    return hash & (SESSION_NAME_BUCKETS - 1);
+}
+
+// Returns the table slot holding the session or, if it isn't there, the empty slot that would receive it
+static u32 SessionInfo_FindSlot(KSession *session)
+{
+    u32 slot = SessionInfo_HashSession(session);
+
+    while(sessionInfoSlots[slot] != 0 && sessionInfos[sessionInfoSlots[slot] - 1].session != session)
+        slot = (slot + 1) & (SESSION_HASH_SIZE - 1);
+
+    return slot;
 }
 
 SessionInfo *SessionInfo_Lookup(KSession *session)
 {
+    // Sessions that were never registered keep their original vtable
+    if((void **)(session->autoObject.vtable) != customSessionVtable)
+        return NULL;
+
     KRecursiveLock__Lock(criticalSectionLock);
     KRecursiveLock__Lock(&sessionInfosLock);
 
-    SessionInfo *ret;
-    u32 id = SessionInfo_FindClosestSlot(session);
-    if(id == nbActiveSessions)
-        ret = NULL;
-    else
-        ret = (void **)(sessionInfos[id].session->autoObject.vtable) == customSessionVtable ? &sessionInfos[id] : NULL;
+    u32 slot = SessionInfo_FindSlot(session);
+    SessionInfo *ret = sessionInfoSlots[slot] == 0 ? NULL : &sessionInfos[sessionInfoSlots[slot] - 1];
 
     KRecursiveLock__Unlock(&sessionInfosLock);
     KRecursiveLock__Unlock(criticalSectionLock);
@@ -83,13 +119,13 @@ SessionInfo *SessionInfo_FindFirst(const char *name)
     KRecursiveLock__Lock(criticalSectionLock);
     KRecursiveLock__Lock(&sessionInfosLock);
 
-    SessionInfo *ret;
-    u32 id;
-    for(id = 0; id < nbActiveSessions && strncmp(sessionInfos[id].name, name, 12) != 0; id++);
-    if(id == nbActiveSessions)
-        ret = NULL;
-    else
-        ret = (void **)(sessionInfos[id].session->autoObject.vtable) == customSessionVtable ? &sessionInfos[id] : NULL;
+    SessionInfo *ret = NULL;
+    for(u16 id = sessionNameBuckets[SessionInfo_HashName(name)]; id != 0 && ret == NULL; id = sessionInfos[id - 1].nextByName)
+    {
+        SessionInfo *info = &sessionInfos[id - 1];
+        if(strncmp(info->name, name, 12) == 0 && (void **)(info->session->autoObject.vtable) == customSessionVtable)
+            ret = info;
+    }
 
     KRecursiveLock__Unlock(&sessionInfosLock);
     KRecursiveLock__Unlock(criticalSectionLock);
@@ -106,29 +142,39 @@ void SessionInfo_Add(KSession *session, const char *name)
     KRecursiveLock__Lock(criticalSectionLock);
     KRecursiveLock__Lock(&sessionInfosLock);
 
-    if(nbActiveSessions == MAX_SESSION)
+    u32 slot = SessionInfo_FindSlot(session);
+
+    if(nbActiveSessions == MAX_SESSION || sessionInfoSlots[slot] != 0)
     {
         KRecursiveLock__Unlock(&sessionInfosLock);
         KRecursiveLock__Unlock(criticalSectionLock);
         return;
     }
 
-    u32 id = SessionInfo_FindClosestSlot(session);
-
-    if(id != nbActiveSessions && sessionInfos[id].session == session)
+    u16 id;
+    if(freeSessionInfos != 0)
     {
-        KRecursiveLock__Unlock(&sessionInfosLock);
-        KRecursiveLock__Unlock(criticalSectionLock);
-        return;
+        id = freeSessionInfos;
+        freeSessionInfos = sessionInfos[id - 1].nextByName;
     }
+    else
+        id = (u16)++nbAllocatedSessions;
 
-    for(u32 i = nbActiveSessions; i > id && i != 0; i--)
-        sessionInfos[i] = sessionInfos[i - 1];
+    SessionInfo *info = &sessionInfos[id - 1];
+    u32 bucket = SessionInfo_HashName(name);
 
-    nbActiveSessions++;
+    info->session = session;
+    strncpy(info->name, name, 12);
+    info->serviceId = SessionInfo_GetServiceId(name);
+    info->prevByName = 0;
+    info->nextByName = sessionNameBuckets[bucket];
+    if(info->nextByName != 0)
+        sessionInfos[info->nextByName - 1].prevByName = id;
+    sessionNameBuckets[bucket] = id;
 
-    sessionInfos[id].session = session;
-    strncpy(sessionInfos[id].name, name, 12);
+    sessionInfoSlots[slot] = id;
+    nbActiveSessions++;
+    sessionInfosGeneration++;
 
     KRecursiveLock__Unlock(&sessionInfosLock);
     KRecursiveLock__Unlock(criticalSectionLock);
@@ -139,26 +185,44 @@ void SessionInfo_Remove(KSession *session)
     KRecursiveLock__Lock(criticalSectionLock);
     KRecursiveLock__Lock(&sessionInfosLock);
 
-    if(nbActiveSessions == MAX_SESSION)
+    u32 hole = SessionInfo_FindSlot(session);
+    u16 id = sessionInfoSlots[hole];
+
+    if(id == 0)
     {
         KRecursiveLock__Unlock(&sessionInfosLock);
         KRecursiveLock__Unlock(criticalSectionLock);
         return;
     }
 
-    u32 id = SessionInfo_FindClosestSlot(session);
+    SessionInfo *info = &sessionInfos[id - 1];
 
-    if(id == nbActiveSessions)
+    if(info->prevByName != 0)
+        sessionInfos[info->prevByName - 1].nextByName = info->nextByName;
+    else
+        sessionNameBuckets[SessionInfo_HashName(info->name)] = info->nextByName;
+    if(info->nextByName != 0)
+        sessionInfos[info->nextByName - 1].prevByName = info->prevByName;
+
+    memset(info, 0, sizeof(SessionInfo));
+    info->nextByName = freeSessionInfos;
+    freeSessionInfos = id;
+    nbActiveSessions--;
+
+    // Backward-shift deletion: pull up the following entries of the probe run that can legally
+    // occupy the hole, so that lookups never need tombstones
+    for(u32 slot = (hole + 1) & (SESSION_HASH_SIZE - 1); sessionInfoSlots[slot] != 0; slot = (slot + 1) & (SESSION_HASH_SIZE - 1))
     {
-        KRecursiveLock__Unlock(&sessionInfosLock);
-        KRecursiveLock__Unlock(criticalSectionLock);
-        return;
+        u32 home = SessionInfo_HashSession(sessionInfos[sessionInfoSlots[slot] - 1].session);
+        if(((slot - home) & (SESSION_HASH_SIZE - 1)) >= ((slot - hole) & (SESSION_HASH_SIZE - 1)))
+        {
+            sessionInfoSlots[hole] = sessionInfoSlots[slot];
+            hole = slot;
+        }
     }
 
-    for(u32 i = id; i < nbActiveSessions - 1; i++)
-        sessionInfos[i] = sessionInfos[i + 1];
-
-    memset(&sessionInfos[--nbActiveSessions], 0, sizeof(SessionInfo));
+    sessionInfoSlots[hole] = 0;
+    sessionInfosGeneration++;
 
     KRecursiveLock__Unlock(&sessionInfosLock);
     KRecursiveLock__Unlock(criticalSectionLock);
@@ -184,26 +248,13 @@ void SessionInfo_ChangeVtable(KSession *session)
 
 bool doLangEmu(Result *res, u32 *cmdbuf)
 {
-    KRecursiveLock__Lock(criticalSectionLock);
-    KRecursiveLock__Lock(&processLangemuLock);
-
-    u64 titleId = codeSetOfProcess(currentCoreContext->objectContext.currentProcess)->titleId;
-    LangemuAttributes *attribs = NULL;
+    LangemuAttributes attributes;
+    LangemuAttributes *attribs = &attributes;
     bool skip = true;
 
     *res = 0;
-    for(u32 i = 0; i < 0x40; i++)
-    {
-        if(processLangemuAttributes[i].titleId == titleId)
-            attribs = &processLangemuAttributes[i];
-    }
-
-    if(attribs == NULL)
-    {
-        KRecursiveLock__Unlock(&processLangemuLock);
-        KRecursiveLock__Unlock(criticalSectionLock);
+    if(!getProcessLangemuAttributes(attribs, currentCoreContext->objectContext.currentProcess))
         return false;
-    }
 
     if((cmdbuf[0] == 0x20000 || cmdbuf[0] == 0x4060000 || cmdbuf[0] == 0x8160000) && (attribs->mask & 1)) // SecureInfoGetRegion
     {
@@ -230,8 +281,6 @@ bool doLangEmu(Result *res, u32 *cmdbuf)
     else
         skip = false;
 
-    KRecursiveLock__Unlock(&processLangemuLock);
-    KRecursiveLock__Unlock(criticalSectionLock);
     return skip;
 }
 
@@ -0,0 +1,177 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include <string.h>
+
+#include "ipcTrace.h"
+#include "ipc.h"
+#include "globals.h"
+#include "synchronization.h"
+#include "utils.h"
+
+// One ring per core, written from SendSyncRequestHook without any lock: producers reserve
+// a slot with ldrex/strex, and each slot carries a sequence number so that readers can
+// discard the ones being overwritten
+static IpcTraceEvent ipcTraceEvents[4][IPC_TRACE_EVENTS_PER_CORE] = { { { 0 } } };
+static u32 ipcTraceHeads[4] = { 0 };
+
+// Service names of the sessions traced last on each core, so that traced requests don't take the
+// session info locks. Registering or unregistering any session invalidates them, see sessionInfosGeneration
+typedef struct IpcTraceNameCacheEntry
+{
+    KSession *session;
+    u32 generation;
+    char name[8];
+} IpcTraceNameCacheEntry;
+
+static IpcTraceNameCacheEntry ipcTraceNameCache[4][1 << IPC_TRACE_NAME_CACHE_BITS] = { { { NULL } } };
+
+bool ipcTraceEnabled = false;
+
+void ipcTraceSetEnabled(bool enable)
+{
+    if(enable && !ipcTraceEnabled)
+    {
+        memset(ipcTraceEvents, 0, sizeof(ipcTraceEvents));
+        memset(ipcTraceHeads, 0, sizeof(ipcTraceHeads));
+        __dmb();
+    }
+
+    ipcTraceEnabled = enable;
+}
+
+static inline IpcTraceNameCacheEntry *ipcTraceNameCacheEntry(KSession *session)
+{
+    // Same multiplicative hash as the session info table
+    return &ipcTraceNameCache[getCurrentCoreID()][(((u32)session >> 2) * 2654435761u) >> (32 - IPC_TRACE_NAME_CACHE_BITS)];
+}
+
+void ipcTraceGetServiceName(char *name, KSession *session)
+{
+    // Read before the lookup: if a session is (un)registered in between, the entry filled below is already stale
+    u32 generation = *(vu32 *)&sessionInfosGeneration;
+    IpcTraceNameCacheEntry *entry;
+    bool found;
+
+    // Interrupts are disabled so that no other thread uses the entry in the meantime
+    u32 cpsr = __get_cpsr();
+    __disable_irq();
+    entry = ipcTraceNameCacheEntry(session);
+    found = entry->session == session && entry->generation == generation;
+    if(found)
+        memcpy(name, entry->name, 8);
+    __set_cpsr_cx(cpsr);
+
+    if(found)
+        return;
+
+    SessionInfo *info = SessionInfo_Lookup(session);
+    if(info != NULL)
+        memcpy(name, info->name, 8);
+    else
+        memset(name, 0, 8);
+
+    __disable_irq();
+    entry = ipcTraceNameCacheEntry(session);
+    entry->session = session;
+    entry->generation = generation;
+    memcpy(entry->name, name, 8);
+    __set_cpsr_cx(cpsr);
+}
+
+void ipcTraceRecord(u32 pid, const char *name, u32 cmdHeader, u64 sendTick, u64 replyTick)
+{
+    u32 core = getCurrentCoreID();
+    u32 *head = &ipcTraceHeads[core];
+    u32 ticket;
+
+    do
+        ticket = (u32)__ldrex((s32 *)head);
+    while(__strex((s32 *)head, (s32)(ticket + 1)));
+
+    IpcTraceEvent *event = &ipcTraceEvents[core][ticket % IPC_TRACE_EVENTS_PER_CORE];
+
+    event->seq = 0;
+    __dmb();
+
+    event->pid = pid;
+    event->cmdHeader = cmdHeader;
+    event->duration = (u32)(replyTick - sendTick);
+    event->sendTick = sendTick;
+    strncpy(event->name, name, 8);
+    __dmb();
+
+    event->seq = ticket + 1;
+}
+
+static bool ipcTraceReadEvent(IpcTraceEvent *out, const IpcTraceEvent *event, u32 ticket)
+{
+    for(u32 attempt = 0; attempt < IPC_TRACE_READ_ATTEMPTS; attempt++)
+    {
+        u32 seq = *(vu32 *)&event->seq;
+        __dmb();
+        memcpy(out, event, sizeof(IpcTraceEvent));
+        __dmb();
+
+        if(seq == ticket + 1 && seq == *(vu32 *)&event->seq)
+        {
+            out->seq = seq;
+            return true;
+        }
+
+        // Overwritten by a more recent event, that isn't part of this read
+        if(seq != 0 && (s32)(seq - (ticket + 1)) > 0)
+            return false;
+    }
+
+    // Still being written
+    return false;
+}
+
+Result ipcTraceRead(IpcTraceEvent *out, u32 maxEvents, u32 *outCount)
+{
+    u32 nbEvents = 0;
+
+    for(u32 core = 0; core < getNumberOfCores(); core++)
+    {
+        u32 head = *(vu32 *)&ipcTraceHeads[core];
+        u32 first = head > IPC_TRACE_EVENTS_PER_CORE ? head - IPC_TRACE_EVENTS_PER_CORE : 0;
+
+        // Oldest to newest
+        for(u32 ticket = first; ticket < head && nbEvents < maxEvents; ticket++)
+        {
+            IpcTraceEvent copy;
+
+            if(!ipcTraceReadEvent(&copy, &ipcTraceEvents[core][ticket % IPC_TRACE_EVENTS_PER_CORE], ticket))
+                continue;
+
+            if(!kernelToUsrMemcpy8(&out[nbEvents++], &copy, sizeof(IpcTraceEvent)))
+                return 0xE0E01BF5;
+        }
+    }
+
+    return kernelToUsrMemcpy8(outCount, &nbEvents, sizeof(u32)) ? 0 : 0xE0E01BF5;
+}
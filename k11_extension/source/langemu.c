@@ -0,0 +1,111 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include <string.h>
+
+#include "langemu.h"
+#include "globals.h"
+
+static LangemuState langemuState = { 0 };
+static KRecursiveLock langemuLock = { NULL };
+
+bool langemuStateAddTitle(LangemuState *state, const LangemuAttributes *attribs)
+{
+    u32 i;
+    for(i = 0; i < state->nbTitles && state->titles[i].titleId != attribs->titleId; i++);
+
+    if(i == state->nbTitles)
+    {
+        if(i == LANGEMU_NB_TITLES)
+            return false;
+        state->nbTitles++;
+    }
+
+    // Registering the same title again (e.g. when it is relaunched) updates its entry in place.
+    // Cached lookups may be missing the new title, forget them all
+    state->titles[i] = *attribs;
+    memset(state->processes, 0, sizeof(state->processes));
+    return true;
+}
+
+const LangemuAttributes *langemuStateGet(LangemuState *state, u32 pid, u64 titleId)
+{
+    LangemuProcessEntry *entry = &state->processes[pid & (LANGEMU_NB_PROCESSES - 1)];
+
+    if(entry->key != pid + 1)
+    {
+        u32 i;
+        for(i = 0; i < state->nbTitles && state->titles[i].titleId != titleId; i++);
+
+        entry->key = pid + 1;
+        entry->index = i < state->nbTitles ? i + 1 : 0;
+    }
+
+    return entry->index != 0 ? &state->titles[entry->index - 1] : NULL;
+}
+
+void langemuStateForgetProcess(LangemuState *state, u32 pid)
+{
+    LangemuProcessEntry *entry = &state->processes[pid & (LANGEMU_NB_PROCESSES - 1)];
+
+    if(entry->key == pid + 1)
+        entry->key = 0;
+}
+
+Result SetLangemuAttributes(const LangemuAttributes *attribs)
+{
+    KRecursiveLock__Lock(criticalSectionLock);
+    KRecursiveLock__Lock(&langemuLock);
+    bool added = langemuStateAddTitle(&langemuState, attribs);
+    KRecursiveLock__Unlock(&langemuLock);
+    KRecursiveLock__Unlock(criticalSectionLock);
+
+    return added ? 0 : 0xD8609013;
+}
+
+bool getProcessLangemuAttributes(LangemuAttributes *out, KProcess *process)
+{
+    KRecursiveLock__Lock(criticalSectionLock);
+    KRecursiveLock__Lock(&langemuLock);
+
+    const LangemuAttributes *attribs = langemuStateGet(&langemuState, idOfProcess(process), codeSetOfProcess(process)->titleId);
+    if(attribs != NULL)
+        *out = *attribs;
+
+    KRecursiveLock__Unlock(&langemuLock);
+    KRecursiveLock__Unlock(criticalSectionLock);
+
+    return attribs != NULL;
+}
+
+void signalLangemuProcessExit(KProcess *process)
+{
+    KRecursiveLock__Lock(criticalSectionLock);
+    KRecursiveLock__Lock(&langemuLock);
+    langemuStateForgetProcess(&langemuState, idOfProcess(process));
+    KRecursiveLock__Unlock(&langemuLock);
+    KRecursiveLock__Unlock(criticalSectionLock);
+}
@@ -31,6 +31,7 @@
 #include "svc.h"
 #include "svc/ConnectToPort.h"
 #include "svcHandler.h"
+#include "symbolHints.h"
 
 #define K11EXT_VA         0x70000000
 
@@ -44,6 +45,8 @@ struct KExtParameters
     volatile bool done;
 
     CfwInfo cfwInfo;
+
+    Kernel11SymbolHints symbolHints;
 } kExtParameters = { .basePA = 0x12345678 }; // place this in .data
 
 static ALIGN(1024) u32 g_L2Table[256] = {0};
@@ -165,23 +168,26 @@ static void installMmuHooks(void)
     mapL2Section[3] = (u32)KProcessHwInfo__MapL2Section_Hook;
 }
 
-static void findUsefulSymbols(void)
+// The slowest scans only check the hints from arm9 first, and are done as usual if the instructions there don't match
+static void findUsefulSymbols(const Kernel11SymbolHints *hints)
 {
     u32 *off;
 
-    // Get fcramDescriptor
-    for (off = (u32 *)0xFFF00000; ; ++off)
-    {
-        if (  (off[0] >> 16) == 0xE59F
-           && (off[1] >> 16) == 0xE3A0
-           && (off[2] >> 16) == 0xE3A0
-           && (off[3] >> 16) == 0xE1A0
-           && (off[4] >> 16) == 0xEB00)
-        {
-            fcramDescriptor = (FcramDescriptor *)off[2 + (off[0] & 0xFFFF) / 4];
-            break;
-        }
-    }
+    // The hints must point into .text, which ends where the InterruptManager's objects' vtables start
+    for(off = (u32 *)officialSVCs[0x50]; off[0] != 0xE1A05000 || off[1] != 0xE2100102 || off[2] != 0x5A00000B; off++);
+    InterruptManager__MapInterrupt = (Result (*)(InterruptManager *, KBaseInterruptEvent *, u32, u32, u32, bool, bool))decodeArmBranch(--off);
+    interruptManager = *(InterruptManager **)(off - 4 + (off[-6] & 0xFFF) / 4);
+
+    // Shitty/lazy heuristic but it works on even 4.5, so...
+    u32 textStart = ((u32)originalHandlers[2]) & ~0xFFFF;
+    u32 rodataStart = (u32)(interruptManager->N3DS.privateInterrupts[1][0x1D].interruptEvent->vtable) & ~0xFFF;
+
+    // Get fcramDescriptor, looked for from the start of the kernel
+    Kernel11Text kernelText = { (const u32 *)0xFFF00000, 0xFFF00000, rodataStart };
+    const u32 *fcramDescriptorLoad;
+    findFcramDescriptorLoad(&fcramDescriptorLoad, &kernelText, hints);
+    off = (u32 *)fcramDescriptorLoad;
+    fcramDescriptor = (FcramDescriptor *)off[2 + (off[0] & 0xFFFF) / 4];
 
     // Get kAlloc
     for (; *off != 0xE1A00005 || *(off + 1) != 0xE320F000; ++off);
@@ -249,9 +255,6 @@ static void findUsefulSymbols(void)
     off = (u32 *)decodeArmBranch((u32 *)officialSVCs[0x37] + 3) + 5; /* GetThreadId */
     KProcessHandleTable__ToKThread = (KThread * (*)(KProcessHandleTable *, Handle))decodeArmBranch((*off >> 16) == 0xEB00 ? off : off + 2);
 
-    for(off = (u32 *)officialSVCs[0x50]; off[0] != 0xE1A05000 || off[1] != 0xE2100102 || off[2] != 0x5A00000B; off++);
-    InterruptManager__MapInterrupt = (Result (*)(InterruptManager *, KBaseInterruptEvent *, u32, u32, u32, bool, bool))decodeArmBranch(--off);
-    interruptManager = *(InterruptManager **)(off - 4 + (off[-6] & 0xFFF) / 4);
     for(off = (u32 *)officialSVCs[0x54]; *off != 0xE8BD8008; off++);
     flushDataCacheRange = (void (*)(void *, u32))(*(u32 **)(off[1]) + 3);
 
@@ -325,6 +328,7 @@ static void findUsefulSymbols(void)
     CreateEvent = (Result (*)(Handle *, ResetType))decodeArmBranch((u32 *)officialSVCs[0x17] + 3);
     CloseHandle = (Result (*)(Handle))officialSVCs[0x23];
     GetHandleInfo = (Result (*)(s64 *, Handle, u32))decodeArmBranch((u32 *)officialSVCs[0x29] + 3);
+    GetSystemTick = (u64 (*)(void))officialSVCs[0x28];
     GetSystemInfo = (Result (*)(s64 *, s32, s32))decodeArmBranch((u32 *)officialSVCs[0x2A] + 3);
     GetProcessInfo = (Result (*)(s64 *, Handle, u32))decodeArmBranch((u32 *)officialSVCs[0x2B] + 3);
     GetThreadInfo = (Result (*)(s64 *, Handle, u32))decodeArmBranch((u32 *)officialSVCs[0x2C] + 3);
@@ -335,6 +339,8 @@ static void findUsefulSymbols(void)
     DebugActiveProcess = (Result (*)(Handle *, u32))decodeArmBranch((u32 *)officialSVCs[0x60] + 3);
     SignalEvent = (Result (*)(Handle event))officialSVCs[0x18];
 
+    ReadProcessMemory = (Result (*)(void *, Handle, u32, u32))officialSVCs[0x6A];
+    WriteProcessMemory = (Result (*)(Handle, const void *, u32, u32))officialSVCs[0x6B];
     UnmapProcessMemory = (Result (*)(Handle, void *, u32))officialSVCs[0x72];
     KernelSetState = (Result (*)(u32, u32, u32, u32))((u32 *)officialSVCs[0x7C] + 1);
 
@@ -349,23 +355,12 @@ static void findUsefulSymbols(void)
 
     ///////////////////////////////////////////
 
-    // Shitty/lazy heuristic but it works on even 4.5, so...
-    u32 textStart = ((u32)originalHandlers[2]) & ~0xFFFF;
-    u32 rodataStart = (u32)(interruptManager->N3DS.privateInterrupts[1][0x1D].interruptEvent->vtable) & ~0xFFF;
-    u32 textSize = rodataStart - textStart;
-    for(off = (u32 *)textStart; off < (u32 *)(textStart + textSize - 12); off++)
-    {
-        if(off[0] == 0xE5D13034 && off[1] == 0xE1530002)
-            KScheduler__AdjustThread = (void (*)(KScheduler *, KThread *, u32))off;
-        else if(off[0] == (u32)interruptManager && off[1] == (u32)&currentCoreContext->objectContext)
-            KScheduler__AttemptSwitchingThreadContext = (void (*)(KScheduler *))(off - 2);
-        else if(off[0] == 0xE3510B1A && off[1] == 0xE3A06000)
-        {
-            u32 *off2;
-            for(off2 = off; *off2 != 0xE92D40F8; off2--);
-            invalidateInstructionCacheRange = (void (*)(void *, u32))off2;
-        }
-    }
+    Kernel11Text text = { (const u32 *)textStart, textStart, rodataStart };
+    SchedulerSymbols schedulerSymbols;
+    findSchedulerSymbols(&schedulerSymbols, &text, hints, (u32)interruptManager, (u32)&currentCoreContext->objectContext);
+    KScheduler__AdjustThread = (void (*)(KScheduler *, KThread *, u32))schedulerSymbols.adjustThread;
+    KScheduler__AttemptSwitchingThreadContext = (void (*)(KScheduler *))schedulerSymbols.attemptSwitchingThreadContext;
+    invalidateInstructionCacheRange = (void (*)(void *, u32))schedulerSymbols.invalidateInstructionCacheRange;
 
     installMmuHooks();
 }
@@ -395,7 +390,7 @@ void main(FcramLayout *layout, KCoreContext *ctxs)
     while(*arm11SvcTable != NULL) arm11SvcTable++; //Look for SVC0 (NULL)
     memcpy(officialSVCs, arm11SvcTable, 4 * 0x7E);
 
-    findUsefulSymbols();
+    findUsefulSymbols(&p->symbolHints);
 
     GetSystemInfo(&nb, 26, 0);
     nbSection0Modules = (u32)nb;
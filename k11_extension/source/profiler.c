@@ -0,0 +1,197 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include "profiler.h"
+#include "globals.h"
+#include "synchronization.h"
+#include "utils.h"
+#include "debug.h"
+
+// One single-producer ring per core: only code running on that core with interrupts disabled (the SGI handler, or
+// profilerRequestSamples for the calling core) pushes samples, and only profilerRead (serialized by profilerLock) pops them
+static ProfilerSample profilerSamples[4][PROFILER_SAMPLES_PER_CORE] = { { { 0 } } };
+static u32 profilerHeads[4] = { 0 };
+static u32 profilerTails[4] = { 0 };
+static u32 profilerNbDropped[4] = { 0 };
+
+static KRecursiveLock profilerLock = { NULL };
+
+bool profilerEnabled = false;
+u32 profilerPid = 0;
+
+Result profilerSetTarget(u32 pid, bool enable)
+{
+    KRecursiveLock__Lock(criticalSectionLock);
+    KRecursiveLock__Lock(&profilerLock);
+
+    profilerEnabled = false;
+    __dmb();
+
+    for(u32 core = 0; core < getNumberOfCores(); core++)
+    {
+        profilerHeads[core] = 0;
+        profilerTails[core] = 0;
+        profilerNbDropped[core] = 0;
+    }
+
+    profilerPid = pid;
+    __dmb();
+    profilerEnabled = enable;
+
+    KRecursiveLock__Unlock(&profilerLock);
+    KRecursiveLock__Unlock(criticalSectionLock);
+
+    return 0;
+}
+
+static void profilerPushSample(u32 core, KThread *thread, bool isCurrentThread)
+{
+    KProcess *process = thread->ownerProcess;
+
+    if(process == NULL || idOfProcess(process) != profilerPid)
+        return;
+
+    // The most recent user -> kernel transition of the thread (the interrupt that stopped it, or the SVC it is in)
+    // pushed its srs frame at the top of its kernel stack, see svcHandler.s
+    u8 *pageEnd = (u8 *)thread->endOfThreadContext;
+    u32 spsr = *(u32 *)(pageEnd - 0xCC);
+
+    if((spsr & 0x1F) != 0x10)
+        return;
+
+    u32 head = profilerHeads[core];
+    if(head - *(vu32 *)&profilerTails[core] >= PROFILER_SAMPLES_PER_CORE)
+    {
+        profilerNbDropped[core]++;
+        return;
+    }
+
+    ProfilerSample *sample = &profilerSamples[core][head % PROFILER_SAMPLES_PER_CORE];
+    u32 lr = 0;
+
+    // Within a SVC, the banked user registers may belong to whichever thread last returned to user mode. Those of
+    // a thread that was preempted in user mode aren't at a known place: lr is left at 0 then
+    if(*(u8 *)(pageEnd - 0xB8 + 3) != 0)
+        lr = *(u32 *)(pageEnd - 0xD4);
+    else if(isCurrentThread)
+        lr = getUserModeLr();
+
+    sample->pc = *(u32 *)(pageEnd - 0xD0);
+    sample->lr = lr;
+    __dmb();
+    profilerHeads[core] = head + 1;
+}
+
+static KSchedulableInterruptEvent *profilerSample(KBaseInterruptEvent *this UNUSED, u32 interruptID UNUSED)
+{
+    KThread *thread = currentCoreContext->objectContext.currentThread;
+
+    if(profilerEnabled && thread != NULL)
+        profilerPushSample(getCurrentCoreID(), thread, true);
+
+    return NULL;
+}
+
+// The calling thread has just woken up and preempted whichever thread was running on its core: that is the highest
+// priority thread still ready to run there. Needs the critical section
+static KThread *profilerFindPreemptedThread(u32 coreID)
+{
+    KThread *current = currentCoreContext->objectContext.currentThread;
+    KThread *preempted = NULL;
+
+    for(KLinkedListNode *node = threadList->list.nodes.first; node != (KLinkedListNode *)&threadList->list.nodes; node = node->next)
+    {
+        KThread *thread = (KThread *)node->key;
+
+        if(thread != current && thread->coreId == coreID && thread->schedulingMask == 1 &&
+           (preempted == NULL || thread->dynamicPriority < preempted->dynamicPriority))
+            preempted = thread;
+    }
+
+    return preempted;
+}
+
+void profilerRequestSamples(void)
+{
+    u32 coreID = getCurrentCoreID();
+    u32 targetList = ((1 << getNumberOfCores()) - 1) & ~(1 << coreID);
+
+    if(!profilerEnabled)
+        return;
+
+    // The calling core can't be interrupted in the thread it preempted: sample where that thread was stopped instead
+    KRecursiveLock__Lock(criticalSectionLock);
+    KThread *preempted = profilerFindPreemptedThread(coreID);
+    if(preempted != NULL)
+    {
+        u32 cpsr = __get_cpsr();
+        __disable_irq();
+        profilerPushSample(coreID, preempted, false);
+        __set_cpsr_cx(cpsr);
+    }
+    KRecursiveLock__Unlock(criticalSectionLock);
+
+    // Serialized with the watchpoint updates, as there is only one SGI0 handler
+    KRecursiveLock__Lock(&dbgParamsLock);
+    executeFunctionOnCoresAndWait(profilerSample, (u8)targetList);
+    KRecursiveLock__Unlock(&dbgParamsLock);
+}
+
+Result profilerRead(ProfilerSample *out, u32 maxSamples, u32 *outCounts)
+{
+    Result res = 0;
+    u32 counts[2] = { 0 }; // samples read, samples dropped
+
+    KRecursiveLock__Lock(&profilerLock);
+
+    for(u32 core = 0; core < getNumberOfCores() && res == 0; core++)
+    {
+        u32 head = *(vu32 *)&profilerHeads[core];
+        u32 tail = profilerTails[core];
+        __dmb();
+
+        for(; tail != head && counts[0] < maxSamples; tail++)
+        {
+            if(!kernelToUsrMemcpy8(&out[counts[0]++], &profilerSamples[core][tail % PROFILER_SAMPLES_PER_CORE], sizeof(ProfilerSample)))
+            {
+                res = 0xE0E01BF5;
+                break;
+            }
+        }
+
+        __dmb();
+        profilerTails[core] = tail;
+        counts[1] += *(vu32 *)&profilerNbDropped[core];
+        profilerNbDropped[core] = 0;
+    }
+
+    KRecursiveLock__Unlock(&profilerLock);
+
+    if(res == 0 && !kernelToUsrMemcpy8(outCounts, counts, sizeof(counts)))
+        res = 0xE0E01BF5;
+
+    return res;
+}
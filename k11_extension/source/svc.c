@@ -27,6 +27,9 @@
 #include <string.h>
 #include "synchronization.h"
 #include "svc.h"
+#include "svcStats.h"
+#include "cpuTime.h"
+#include "langemu.h"
 #include "svc/ControlMemory.h"
 #include "svc/GetHandleInfo.h"
 #include "svc/GetSystemInfo.h"
@@ -48,6 +51,8 @@
 #include "svc/CopyHandle.h"
 #include "svc/TranslateHandle.h"
 #include "svc/ControlMemoryUnsafe.h"
+#include "svc/AccessProcessMemory.h"
+#include "svc/MapProcessMemoryBatch.h"
 
 void *officialSVCs[0x7E] = {NULL};
 
@@ -62,6 +67,9 @@ void signalSvcEntry(u8 *pageEnd)
     // Since DBGEVENT_SYSCALL_ENTRY is non blocking, we'll cheat using EXCEVENT_UNDEFINED_SYSCALL (debug->svcId is fortunately an u16!)
     if(debugOfProcess(currentProcess) != NULL && shouldSignalSyscallDebugEvent(currentProcess, svcId))
         SignalDebugEvent(DBGEVENT_OUTPUT_STRING, 0xFFFFFFFE, svcId);
+
+    signalSvcStatsEntry(currentProcess, currentCoreContext->objectContext.currentThread, svcId);
+    signalCpuTimeEntry(currentCoreContext->objectContext.currentThread);
 }
 
 void signalSvcReturn(u8 *pageEnd)
@@ -77,6 +85,9 @@ void signalSvcReturn(u8 *pageEnd)
     if(debugOfProcess(currentProcess) != NULL && shouldSignalSyscallDebugEvent(currentProcess, svcId))
         SignalDebugEvent(DBGEVENT_OUTPUT_STRING, 0xFFFFFFFF, svcId);
 
+    signalSvcStatsReturn(currentProcess, currentCoreContext->objectContext.currentThread, svcId);
+    signalCpuTimeReturn(currentCoreContext->objectContext.currentThread);
+
     // Signal if the memory layout of the process changed
     if (flags & SignalOnMemLayoutChanges && flags & MemLayoutChanged)
     {
@@ -110,6 +121,9 @@ void *svcHook(u8 *pageEnd)
         {
             u32      flags = KPROCESS_GET_RVALUE(currentProcess, customFlags);
 
+            signalLangemuProcessExit(currentProcess);
+            signalSvcStatsProcessExit(currentProcess);
+
             if (flags & SignalOnExit)
             {
                 // Signal that the process is about to be terminated
@@ -184,6 +198,10 @@ void *svcHook(u8 *pageEnd)
             return ControlMemoryEx;
         case 0xA3:
             return ControlMemoryUnsafeWrapper;
+        case 0xA4:
+            return AccessProcessMemory;
+        case 0xA5:
+            return MapProcessMemoryBatch;
 
         case 0xB0:
             return ControlService;
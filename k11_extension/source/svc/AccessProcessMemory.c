@@ -0,0 +1,99 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include "globals.h"
+#include "svc/AccessProcessMemory.h"
+
+Result validateProcessMemoryAccess(const ProcessMemoryAccess *access)
+{
+    if(access->type != PROCESSMEMACCESS_READ && access->type != PROCESSMEMACCESS_WRITE)
+        return 0xD8E007ED; // invalid enum value
+
+    u32 last = access->size - 1;
+    if(access->size != 0 && (access->address + last < access->address || (u32)access->buffer + last < (u32)access->buffer))
+        return 0xE0E01BFD; // out of range
+
+    return 0;
+}
+
+u32 getProcessMemoryAccessChunkSize(u32 address, u32 remaining)
+{
+    // Accesses are split on the target's page boundaries, so that a failure only loses the faulting page
+    u32 pageRemaining = 0x1000 - (address & 0xFFF);
+    return remaining < pageRemaining ? remaining : pageRemaining;
+}
+
+static Result doProcessMemoryAccess(Handle debug, ProcessMemoryAccess *access)
+{
+    Result res = validateProcessMemoryAccess(access);
+    access->transferred = 0;
+
+    while(res == 0 && access->transferred < access->size)
+    {
+        u32 address = access->address + access->transferred;
+        u8 *buffer = (u8 *)access->buffer + access->transferred;
+        u32 size = getProcessMemoryAccessChunkSize(address, access->size - access->transferred);
+
+        if(access->type == PROCESSMEMACCESS_READ)
+            res = ReadProcessMemory(buffer, debug, address, size);
+        else
+            res = WriteProcessMemory(debug, buffer, address, size);
+
+        if(res == 0)
+            access->transferred += size;
+    }
+
+    return res;
+}
+
+Result AccessProcessMemory(Handle debug, ProcessMemoryAccess *accesses, u32 count)
+{
+    ProcessMemoryAccess batch[8];
+    Result firstFailure = 0;
+
+    if(count > MAX_PROCESS_MEMORY_ACCESSES)
+        return 0xE0E01BFD;
+
+    for(u32 i = 0; i < count; i += 8)
+    {
+        u32 n = count - i < 8 ? count - i : 8;
+
+        if(!usrToKernelMemcpy8(batch, accesses + i, n * sizeof(ProcessMemoryAccess)))
+            return 0xE0E01BF5;
+
+        for(u32 j = 0; j < n; j++)
+        {
+            batch[j].result = doProcessMemoryAccess(debug, &batch[j]);
+            if(firstFailure == 0)
+                firstFailure = batch[j].result;
+        }
+
+        if(!kernelToUsrMemcpy8(accesses + i, batch, n * sizeof(ProcessMemoryAccess)))
+            return 0xE0E01BF5;
+    }
+
+    return firstFailure;
+}
@@ -47,7 +47,7 @@ Result ControlService(ServiceOp op, u32 varg1, u32 varg2)
                 // not the exact same tests but it should work
                 if(strcmp(classNameOfAutoObject(obj), "KServerSession") == 0)
                     session = ((KServerSession *)obj)->parentSession;
-                else if(strcmp(classNameOfAutoObject(obj), "KClientSession") == 0)
+                else if(isClientSession(obj))
                     session = ((KClientSession *)obj)->parentSession;
             }
 
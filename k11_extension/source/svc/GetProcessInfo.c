@@ -25,6 +25,8 @@
 */
 
 #include "svc/GetProcessInfo.h"
+#include "svcStats.h"
+#include "cpuTime.h"
 #include <string.h>
 
 Result GetProcessInfoHook(s64 *out, Handle processHandle, u32 type)
@@ -87,8 +89,18 @@ Result GetProcessInfoHook(s64 *out, Handle processHandle, u32 type)
                 *out = (s64)(mmusize | ((s64)mmupa << 32));
                 break;
             }
+            case 0x10020: // Approximate user-mode CPU time between SVCs, in system ticks (lower bound, see cpuTime.h)
+                res = GetProcessCpuTime(out, process);
+                break;
+            case 0x10010: // SVC statistics: whether they're collected for this process
+                res = GetSvcStatsInfo(out, process, type);
+                break;
             default:
-                res = 0xD8E007ED; // invalid enum value
+                // SVC statistics: calls, total time and latency buckets of each SVC (see svcStats.h)
+                if(type >= 0x10100 && type < 0x10300)
+                    res = GetSvcStatsInfo(out, process, type);
+                else
+                    res = 0xD8E007ED; // invalid enum value
                 break;
         }
 
@@ -27,6 +27,7 @@
 #include "svc/GetSystemInfo.h"
 #include "utils.h"
 #include "ipc.h"
+#include "ipcTrace.h"
 #include "synchronization.h"
 
 Result GetSystemInfoHook(s64 *out, s32 type, s32 param)
@@ -91,9 +92,27 @@ Result GetSystemInfoHook(s64 *out, s32 type, s32 param)
                     *out = stolenSystemMemRegionSize;
                     break;
 
+                case 0x400: // boot timeline: bitmask of the stages reached
+                    *out = cfwInfo.bootReachedStages;
+                    break;
+
+                case 0x500: // IPC tracing enabled
+                    *out = ipcTraceEnabled ? 1 : 0;
+                    break;
+
+                case 0x501: // IPC trace capacity, in events
+                    *out = IPC_TRACE_EVENTS_PER_CORE * getNumberOfCores();
+                    break;
+
                 default:
-                    *out = 0;
-                    res = 0xF8C007F4; // not implemented
+                    // boot timeline: end of each stage, in microseconds
+                    if(param >= 0x401 && param < 0x401 + BOOT_TIMELINE_MAX_STAGES)
+                        *out = cfwInfo.bootStageEnd[param - 0x401];
+                    else
+                    {
+                        *out = 0;
+                        res = 0xF8C007F4; // not implemented
+                    }
                     break;
             }
             break;
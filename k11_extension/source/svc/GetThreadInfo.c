@@ -26,12 +26,13 @@
 #include <string.h>
 
 #include "svc/GetThreadInfo.h"
+#include "cpuTime.h"
 
 Result GetThreadInfoHook(s64 *out, Handle threadHandle, u32 type)
 {
     Result res = 0;
 
-    if(type == 0x10000) // Get TLS
+    if(type == 0x10000 || type == 0x10001) // Get TLS, get approximate CPU time (see cpuTime.h)
     {
         KProcessHandleTable *handleTable = handleTableOfProcess(currentCoreContext->objectContext.currentProcess);
         KThread *thread;
@@ -47,7 +48,10 @@ Result GetThreadInfoHook(s64 *out, Handle threadHandle, u32 type)
         if(thread == NULL)
             return 0xD8E007F7; // invalid handle
 
-        *out = (s64)(u64)(u32)thread->threadLocalStorage;
+        if(type == 0x10000)
+            *out = (s64)(u64)(u32)thread->threadLocalStorage;
+        else
+            res = GetThreadCpuTime(out, thread);
 
         KAutoObject *obj = (KAutoObject *)thread;
         obj->vtable->DecrementReferenceCount(obj);
@@ -28,7 +28,12 @@
 #include "svc/KernelSetState.h"
 #include "synchronization.h"
 #include "ipc.h"
+#include "langemu.h"
 #include "debug.h"
+#include "ipcTrace.h"
+#include "svcStats.h"
+#include "cpuTime.h"
+#include "profiler.h"
 
 #define MAX_DEBUG 3
 
@@ -125,25 +130,16 @@ Result KernelSetStateHook(u32 type, u32 varg1, u32 varg2, u32 varg3)
         }
         case 0x10001:
         {
-            KRecursiveLock__Lock(criticalSectionLock);
-            KRecursiveLock__Lock(&processLangemuLock);
-
-            u32 i;
-            for(i = 0; i < 0x40 && processLangemuAttributes[i].titleId != 0ULL; i++);
-            if(i < 0x40)
-            {
-                processLangemuAttributes[i].titleId = ((u64)varg3 << 32) | (u32)varg2;
-                processLangemuAttributes[i].state = (u8)(varg1 >> 24);
-                processLangemuAttributes[i].country = (u8)(varg1 >> 16);
-                processLangemuAttributes[i].language = (u8)(varg1 >> 8);
-                processLangemuAttributes[i].region = (u8)((varg1 >> 4) & 0xf);
-                processLangemuAttributes[i].mask = (u8)(varg1 & 0xf);
-            }
-            else
-                res = 0xD8609013;
-
-            KRecursiveLock__Unlock(&processLangemuLock);
-            KRecursiveLock__Unlock(criticalSectionLock);
+            LangemuAttributes attribs = {
+                .titleId = ((u64)varg3 << 32) | (u32)varg2,
+                .state = (u8)(varg1 >> 24),
+                .country = (u8)(varg1 >> 16),
+                .language = (u8)(varg1 >> 8),
+                .region = (u8)((varg1 >> 4) & 0xf),
+                .mask = (u8)(varg1 & 0xf),
+            };
+
+            res = SetLangemuAttributes(&attribs);
             break;
         }
         case 0x10002:
@@ -153,14 +149,16 @@ Result KernelSetStateHook(u32 type, u32 varg1, u32 varg2, u32 varg3)
         }
         case 0x10003:
         {
-            executeFunctionOnCores(enableMonitorModeDebugging, 0xF, 0);
+            KRecursiveLock__Lock(&dbgParamsLock);
+            executeFunctionOnCoresAndWait(enableMonitorModeDebugging, 0xF);
+            KRecursiveLock__Unlock(&dbgParamsLock);
             break;
         }
         case 0x10004:
         {
             KRecursiveLock__Lock(&dbgParamsLock);
             dbgParamWatchpointId = varg1;
-            executeFunctionOnCores(disableWatchpoint, 0xF, 0);
+            executeFunctionOnCoresAndWait(disableWatchpoint, 0xF);
             KRecursiveLock__Unlock(&dbgParamsLock);
             break;
         }
@@ -171,7 +169,7 @@ Result KernelSetStateHook(u32 type, u32 varg1, u32 varg2, u32 varg3)
             dbgParamDVA = varg1;
             dbgParamWCR = varg2;
             dbgParamContextId = varg3;
-            executeFunctionOnCores(setWatchpointWithContextId, 0xF, 0);
+            executeFunctionOnCoresAndWait(setWatchpointWithContextId, 0xF);
             KRecursiveLock__Unlock(&dbgParamsLock);
             break;
         }
@@ -182,7 +180,7 @@ Result KernelSetStateHook(u32 type, u32 varg1, u32 varg2, u32 varg3)
             dbgParamDVA = varg1;
             dbgParamWCR = varg2;
             dbgParamContextId = varg3;
-            executeFunctionOnCores(setWatchpointWithContextId, 0xF, 0);
+            executeFunctionOnCoresAndWait(setWatchpointWithContextId, 0xF);
             KRecursiveLock__Unlock(&dbgParamsLock);
             break;
         }
@@ -195,6 +193,41 @@ Result KernelSetStateHook(u32 type, u32 varg1, u32 varg2, u32 varg3)
             }
             break;
         }
+        case 0x10008:
+        {
+            ipcTraceSetEnabled((bool)varg1);
+            break;
+        }
+        case 0x10009:
+        {
+            res = ipcTraceRead((IpcTraceEvent *)varg1, varg2, (u32 *)varg3);
+            break;
+        }
+        case 0x1000A:
+        {
+            res = SetSvcStatsEnabled(varg1, (bool)varg2);
+            break;
+        }
+        case 0x1000B:
+        {
+            cpuTimeSetEnabled((bool)varg1);
+            break;
+        }
+        case 0x1000C:
+        {
+            res = profilerSetTarget(varg1, (bool)varg2);
+            break;
+        }
+        case 0x1000D:
+        {
+            profilerRequestSamples();
+            break;
+        }
+        case 0x1000E:
+        {
+            res = profilerRead((ProfilerSample *)varg1, varg2, (u32 *)varg3);
+            break;
+        }
         default:
         {
             res = KernelSetState(type, varg1, varg2, varg3);
@@ -0,0 +1,210 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include "globals.h"
+#include "svc/MapProcessMemoryBatch.h"
+#include "svc/MapProcessMemoryEx.h"
+
+static Result validateProcessMemoryMapping(const ProcessMemoryMapping *mapping)
+{
+    if(((mapping->srcVa | mapping->dstVa) & 0xFFF) != 0)
+        return 0xE0E01BF1; // misaligned address
+    if((mapping->size & 0xFFF) != 0 || mapping->size == 0)
+        return 0xE0E01BF2; // misaligned size
+    if(mapping->dstVa + mapping->size < mapping->dstVa || mapping->srcVa + mapping->size < mapping->srcVa)
+        return 0xE0E01BFD; // out of range
+
+    return 0;
+}
+
+// Sorts the valid mappings by destination address, and checks that they don't overlap. Invalid ones get their result set and are left out,
+// valid ones are left with a result of 0
+Result sortProcessMemoryMappings(u8 *order, u32 *outNbValid, ProcessMemoryMapping *mappings, u32 count)
+{
+    u32 nbValid = 0;
+
+    for(u32 i = 0; i < count; i++)
+    {
+        ProcessMemoryMapping *mapping = &mappings[i];
+        u32 j;
+
+        mapping->result = validateProcessMemoryMapping(mapping);
+        if(mapping->result != 0)
+            continue;
+
+        for(j = nbValid++; j > 0 && mappings[order[j - 1]].dstVa > mapping->dstVa; j--)
+            order[j] = order[j - 1];
+        order[j] = (u8)i;
+    }
+
+    for(u32 i = 1; i < nbValid; i++)
+    {
+        const ProcessMemoryMapping *prev = &mappings[order[i - 1]];
+        if(prev->dstVa + prev->size > mappings[order[i]].dstVa)
+            return 0xE0E01BFD;
+    }
+
+    *outNbValid = nbValid;
+    return 0;
+}
+
+// Number of sorted mappings, starting from the first-th, that are contiguous and can be done at once
+u32 getNbCoalescableProcessMemoryMappings(const u8 *order, const ProcessMemoryMapping *mappings, u32 first, u32 count, bool unmap)
+{
+    const ProcessMemoryMapping *prev = &mappings[order[first]];
+    u32 n;
+
+    for(n = 1; first + n < count; n++)
+    {
+        const ProcessMemoryMapping *mapping = &mappings[order[first + n]];
+
+        if(prev->dstVa + prev->size != mapping->dstVa)
+            break;
+        if(!unmap && (prev->srcProcess != mapping->srcProcess || prev->srcVa + prev->size != mapping->srcVa))
+            break;
+
+        prev = mapping;
+    }
+
+    return n;
+}
+
+static KProcess *getProcessFromHandle(KProcessHandleTable *handleTable, Handle processHandle)
+{
+    if(processHandle == CUR_PROCESS_HANDLE)
+    {
+        KProcess *process = currentCoreContext->objectContext.currentProcess;
+        KAutoObject__AddReference((KAutoObject *)process);
+        return process;
+    }
+    else
+        return KProcessHandleTable__ToKProcess(handleTable, processHandle);
+}
+
+// Used when the descriptors couldn't be read: stores the result of each of them on its own. A count that is too
+// large is most likely bogus, so only the descriptors a valid call could have passed are written to
+static Result setProcessMemoryMappingResults(ProcessMemoryMapping *mappings, u32 count, Result res)
+{
+    for(u32 i = 0; i < count && i < MAX_PROCESS_MEMORY_MAPPINGS; i++)
+    {
+        if(!kernelToUsrMemcpy8(&mappings[i].result, &res, sizeof(Result)))
+            break;
+    }
+
+    return res;
+}
+
+Result MapProcessMemoryBatch(Handle dstProcessHandle, ProcessMemoryMapping *mappings, u32 count, bool unmap)
+{
+    Result                  res = 0;
+    Result                  firstFailure = 0;
+    ProcessMemoryMapping    batch[MAX_PROCESS_MEMORY_MAPPINGS];
+    u8                      order[MAX_PROCESS_MEMORY_MAPPINGS];
+    u32                     nbValid = 0;
+    KProcess                *dstProcess = NULL;
+    KProcessHandleTable     *handleTable = handleTableOfProcess(currentCoreContext->objectContext.currentProcess);
+
+    // Every descriptor gets a result, whatever the outcome
+    if(count == 0 || count > MAX_PROCESS_MEMORY_MAPPINGS)
+        return setProcessMemoryMappingResults(mappings, count, 0xE0E01BFD);
+
+    if(!usrToKernelMemcpy8(batch, mappings, count * sizeof(ProcessMemoryMapping)))
+        return setProcessMemoryMappingResults(mappings, count, 0xE0E01BF5);
+
+    res = sortProcessMemoryMappings(order, &nbValid, batch, count);
+    if(res == 0)
+    {
+        dstProcess = getProcessFromHandle(handleTable, dstProcessHandle);
+        if(dstProcess == NULL)
+            res = 0xD8E007F7;
+    }
+
+    // Nothing was done: the valid descriptors fail with the batch
+    if(res != 0)
+    {
+        for(u32 i = 0; i < count; i++)
+        {
+            if(batch[i].result == 0)
+                batch[i].result = res;
+        }
+
+        nbValid = 0;
+    }
+
+    for(u32 i = 0, n; i < nbValid; i += n)
+    {
+        ProcessMemoryMapping *first = &batch[order[i]];
+        ProcessMemoryMapping *last;
+
+        // UnmapProcessMemory only handles up to 64MB at once on these kernels
+        if(unmap && GET_VERSION_MINOR(kernelVersion) < 37)
+            n = 1;
+        else
+            n = getNbCoalescableProcessMemoryMappings(order, batch, i, nbValid, unmap);
+        last = &batch[order[i + n - 1]];
+
+        u32 size = last->dstVa + last->size - first->dstVa;
+
+        if(unmap)
+        {
+            if(GET_VERSION_MINOR(kernelVersion) < 37) // < 6.x
+                res = UnmapProcessMemory(dstProcessHandle, (void *)first->dstVa, size);
+            else
+                res = KProcessHwInfo__UnmapProcessMemory(hwInfoOfProcess(dstProcess), (void *)first->dstVa, size >> 12);
+        }
+        else
+        {
+            KProcess *srcProcess = getProcessFromHandle(handleTable, first->srcProcess);
+
+            if(srcProcess == NULL)
+                res = 0xD8E007F7;
+            else
+            {
+                res = doMapProcessMemory(dstProcess, first->dstVa, srcProcess, first->srcVa, size);
+                ((KAutoObject *)srcProcess)->vtable->DecrementReferenceCount((KAutoObject *)srcProcess);
+            }
+        }
+
+        for(u32 j = i; j < i + n; j++)
+            batch[order[j]].result = res;
+    }
+
+    if(dstProcess != NULL)
+    {
+        ((KAutoObject *)dstProcess)->vtable->DecrementReferenceCount((KAutoObject *)dstProcess);
+
+        invalidateEntireInstructionCache();
+        flushEntireDataCache();
+    }
+
+    for(u32 i = 0; i < count && firstFailure == 0; i++)
+        firstFailure = batch[i].result;
+
+    if(!kernelToUsrMemcpy8(mappings, batch, count * sizeof(ProcessMemoryMapping)))
+        return 0xE0E01BF5;
+
+    return firstFailure;
+}
@@ -27,10 +27,11 @@
 
 #include "svc/SendSyncRequest.h"
 #include "ipc.h"
+#include "ipcTrace.h"
 
 static inline bool isNdmuWorkaround(const SessionInfo *info, u32 pid)
 {
-    return info != NULL && strcmp(info->name, "ndm:u") == 0 && hasStartedRosalinaNetworkFuncsOnce && pid >= nbSection0Modules;
+    return info != NULL && info->serviceId == SERVICE_NDM_U && hasStartedRosalinaNetworkFuncsOnce && pid >= nbSection0Modules;
 }
 
 Result SendSyncRequestHook(Handle handle)
@@ -45,7 +46,16 @@ Result SendSyncRequestHook(Handle handle)
     Result res = 0;
 
      // not the exact same test but it should work
-    bool isValidClientSession = clientSession != NULL && strcmp(classNameOfAutoObject(&clientSession->syncObject.autoObject), "KClientSession") == 0;
+    bool isValidClientSession = clientSession != NULL && isClientSession(&clientSession->syncObject.autoObject);
+
+    u32 cmdHeader = cmdbuf[0];
+    u64 sendTick = 0;
+    char traceName[8] = { 0 };
+    if(ipcTraceEnabled && isValidClientSession)
+    {
+        ipcTraceGetServiceName(traceName, clientSession->parentSession);
+        sendTick = GetSystemTick();
+    }
 
     if(isValidClientSession)
     {
@@ -67,7 +77,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x10082:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
-                if(info != NULL && (strcmp(info->name, "cfg:u") == 0 || strcmp(info->name, "cfg:s") == 0 || strcmp(info->name, "cfg:i") == 0)) // GetConfigInfoBlk2
+                if(info != NULL && (info->serviceId == SERVICE_CFG_U || info->serviceId == SERVICE_CFG_S || info->serviceId == SERVICE_CFG_I)) // GetConfigInfoBlk2
                     skip = doLangEmu(&res, cmdbuf);
 
                 break;
@@ -76,7 +86,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x10800:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
-                if(info != NULL && strcmp(info->name, "err:f") == 0) // Throw
+                if(info != NULL && info->serviceId == SERVICE_ERR_F) // Throw
                     skip = doErrfThrowHook(cmdbuf);
 
                 break;
@@ -85,7 +95,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x20000:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
-                if(info != NULL && (strcmp(info->name, "cfg:u") == 0 || strcmp(info->name, "cfg:s") == 0 || strcmp(info->name, "cfg:i") == 0)) // SecureInfoGetRegion
+                if(info != NULL && (info->serviceId == SERVICE_CFG_U || info->serviceId == SERVICE_CFG_S || info->serviceId == SERVICE_CFG_I)) // SecureInfoGetRegion
                     skip = doLangEmu(&res, cmdbuf);
 
                 break;
@@ -107,7 +117,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x50100:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
-                if(info != NULL && (strcmp(info->name, "srv:") == 0 || (GET_VERSION_MINOR(kernelVersion) < 39 && strcmp(info->name, "srv:pm") == 0)))
+                if(info != NULL && (info->serviceId == SERVICE_SRV || (GET_VERSION_MINOR(kernelVersion) < 39 && info->serviceId == SERVICE_SRV_PM)))
                 {
                     char name[9] = { 0 };
                     memcpy(name, cmdbuf + 1, 8);
@@ -121,7 +131,7 @@ Result SendSyncRequestHook(Handle handle)
                         outClientSession = (KClientSession *)KProcessHandleTable__ToKAutoObject(handleTable, (Handle)cmdbuf[3]);
                         if(outClientSession != NULL)
                         {
-                            if(strcmp(classNameOfAutoObject(&outClientSession->syncObject.autoObject), "KClientSession") == 0)
+                            if(isClientSession(&outClientSession->syncObject.autoObject))
                                 SessionInfo_Add(outClientSession->parentSession, name);
                             outClientSession->syncObject.autoObject.vtable->DecrementReferenceCount(&outClientSession->syncObject.autoObject);
                         }
@@ -160,7 +170,7 @@ Result SendSyncRequestHook(Handle handle)
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
 
-                if (info != NULL && strcmp(info->name, "srv:") == 0 && cmdbuf[1] == 0x1002)
+                if (info != NULL && info->serviceId == SERVICE_SRV && cmdbuf[1] == 0x1002)
                 {
                     // Wake up application thread
                     PLG__WakeAppThread();
@@ -178,7 +188,7 @@ Result SendSyncRequestHook(Handle handle)
 
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
 
-                if (info != NULL && strncmp(info->name, "APT:", 4) == 0 && cmdbuf[1] == 0x300)
+                if (info != NULL && info->serviceId == SERVICE_APT && cmdbuf[1] == 0x300)
                 {
                     res = SendSyncRequest(handle);
                     skip = true;
@@ -199,7 +209,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x4010082:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
-                if(info != NULL && (strcmp(info->name, "cfg:s") == 0 || strcmp(info->name, "cfg:i") == 0)) // GetConfigInfoBlk4
+                if(info != NULL && (info->serviceId == SERVICE_CFG_S || info->serviceId == SERVICE_CFG_I)) // GetConfigInfoBlk4
                     skip = doLangEmu(&res, cmdbuf);
 
                 break;
@@ -208,7 +218,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x4020082:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
-                if(info != NULL && (strcmp(info->name, "cfg:s") == 0 || strcmp(info->name, "cfg:i") == 0)) // GetConfigInfoBlk8
+                if(info != NULL && (info->serviceId == SERVICE_CFG_S || info->serviceId == SERVICE_CFG_I)) // GetConfigInfoBlk8
                     skip = doLangEmu(&res, cmdbuf);
 
                 break;
@@ -217,7 +227,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x8010082:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
-                if(info != NULL && (strcmp(info->name, "cfg:s") == 0 || strcmp(info->name, "cfg:i") == 0)) // GetConfigInfoBlk4
+                if(info != NULL && (info->serviceId == SERVICE_CFG_S || info->serviceId == SERVICE_CFG_I)) // GetConfigInfoBlk4
                     skip = doLangEmu(&res, cmdbuf);
 
                 break;
@@ -226,7 +236,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x8020082:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession);
-                if(info != NULL && strcmp(info->name, "cfg:i") == 0) // GetConfigInfoBlk8
+                if(info != NULL && info->serviceId == SERVICE_CFG_I) // GetConfigInfoBlk8
                     skip = doLangEmu(&res, cmdbuf);
 
                 break;
@@ -235,7 +245,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x4060000:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession); // SecureInfoGetRegion
-                if(info != NULL && (strcmp(info->name, "cfg:s") == 0 || strcmp(info->name, "cfg:i") == 0))
+                if(info != NULL && (info->serviceId == SERVICE_CFG_S || info->serviceId == SERVICE_CFG_I))
                     skip = doLangEmu(&res, cmdbuf);
 
                 break;
@@ -244,7 +254,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x8160000:
             {
                 SessionInfo *info = SessionInfo_Lookup(clientSession->parentSession); // SecureInfoGetRegion
-                if(info != NULL && strcmp(info->name, "cfg:i") == 0)
+                if(info != NULL && info->serviceId == SERVICE_CFG_I)
                     skip = doLangEmu(&res, cmdbuf);
 
                 break;
@@ -253,7 +263,7 @@ Result SendSyncRequestHook(Handle handle)
             case 0x08030204:
             {
                SessionInfo* info = SessionInfo_Lookup(clientSession->parentSession); // OpenFileDirectly
-               if (!(info != NULL && strcmp(info->name, "fs:USER") == 0))
+               if (!(info != NULL && info->serviceId == SERVICE_FS_USER))
                   break;
 
                if (strcmp((char*)(cmdbuf[12] + 12), "logo") != 0)
@@ -291,5 +301,8 @@ Result SendSyncRequestHook(Handle handle)
 
     res = skip ? res : SendSyncRequest(handle);
 
+    if(sendTick != 0)
+        ipcTraceRecord(pid, traceName, cmdHeader, sendTick, GetSystemTick());
+
     return res;
 }
@@ -0,0 +1,249 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include <string.h>
+
+#include "svcStats.h"
+#include "globals.h"
+#include "synchronization.h"
+#include "utils.h"
+
+static SvcStats svcStats[MAX_SVC_STATS] = { { 0 } };
+static u32 nbSvcStatsEnabled = 0;
+static KRecursiveLock svcStatsLock = { NULL }; // only taken to enable or disable the statistics of a process
+
+static inline u32 svcStatsGetInflightSlot(KThread *thread)
+{
+    return ((u32)thread >> 4) % SVC_STATS_NB_INFLIGHT;
+}
+
+u32 svcStatsGetBucket(u64 ticks)
+{
+    if(ticks < (1 << 10))
+        return 0;
+    else if(ticks >= (1 << (10 + 2 * (SVC_STATS_NB_BUCKETS - 2))))
+        return SVC_STATS_NB_BUCKETS - 1;
+
+    u32 log2 = 31 - __builtin_clz((u32)ticks);
+    return (log2 - 10) / 2 + 1;
+}
+
+void svcStatsAccountEntry(SvcStatsCore *stats, KThread *thread, u32 svcId, u64 tick)
+{
+    u32 slot = svcStatsGetInflightSlot(thread);
+
+    stats->counts[svcId]++;
+    stats->inflight[slot].thread = thread;
+    stats->inflight[slot].svcId = svcId;
+    stats->inflight[slot].entryTick = tick;
+}
+
+void svcStatsAccountReturn(SvcStatsCore *stats, KThread *thread, u32 svcId, u64 tick)
+{
+    u32 slot = svcStatsGetInflightSlot(thread);
+
+    if(stats->inflight[slot].thread != thread || stats->inflight[slot].svcId != svcId)
+        return;
+
+    u64 ticks = tick - stats->inflight[slot].entryTick;
+    u16 *bucket = &stats->buckets[svcId][svcStatsGetBucket(ticks)];
+
+    stats->totalTicks[svcId] += ticks;
+    if(*bucket != 0xFFFF)
+        ++*bucket;
+    stats->inflight[slot].thread = NULL;
+}
+
+s64 svcStatsSum(const SvcStats *stats, u32 svcId, u32 type)
+{
+    u64 sum = 0;
+
+    switch(type)
+    {
+        case 0x10100: // number of calls
+            for(u32 core = 0; core < 4; core++)
+                sum += stats->cores[core].counts[svcId];
+            break;
+        case 0x10180: // total time spent, in system ticks
+            for(u32 core = 0; core < 4; core++)
+                sum += stats->cores[core].totalTicks[svcId];
+            break;
+        case 0x10200: // latency buckets 0 to 3, 16 bits each
+        case 0x10280: // latency buckets 4 to 7
+            for(u32 i = 0; i < 4; i++)
+            {
+                u32 bucket = 0;
+                for(u32 core = 0; core < 4; core++)
+                    bucket += stats->cores[core].buckets[svcId][(type & SVC_STATS_NB_SVCS) != 0 ? 4 + i : i];
+                sum |= (u64)(bucket < 0xFFFF ? bucket : 0xFFFF) << (16 * i);
+            }
+            break;
+        default:
+            break;
+    }
+
+    return (s64)sum;
+}
+
+static SvcStats *svcStatsFind(u32 key)
+{
+    for(u32 i = 0; i < MAX_SVC_STATS; i++)
+    {
+        if(*(vu32 *)&svcStats[i].key == key)
+            return &svcStats[i];
+    }
+
+    return NULL;
+}
+
+static bool svcStatsIsProcessAlive(u32 pid)
+{
+    for(KLinkedListNode *node = threadList->list.nodes.first; node != (KLinkedListNode *)&threadList->list.nodes; node = node->next)
+    {
+        KProcess *process = ((KThread *)node->key)->ownerProcess;
+        if(process != NULL && idOfProcess(process) == pid)
+            return true;
+    }
+
+    return false;
+}
+
+Result SetSvcStatsEnabled(u32 pid, bool enable)
+{
+    Result res = 0;
+
+    KRecursiveLock__Lock(criticalSectionLock);
+    KRecursiveLock__Lock(&svcStatsLock);
+
+    SvcStats *stats = svcStatsFind(pid + 1);
+
+    if(enable && stats == NULL)
+    {
+        // Processes that were terminated by another one don't go through signalSvcStatsProcessExit
+        for(u32 i = 0; i < MAX_SVC_STATS && nbSvcStatsEnabled == MAX_SVC_STATS; i++)
+        {
+            if(!svcStatsIsProcessAlive(svcStats[i].key - 1))
+            {
+                svcStats[i].key = 0;
+                nbSvcStatsEnabled--;
+            }
+        }
+
+        stats = svcStatsFind(0);
+        if(stats == NULL)
+            res = 0xC86018FF; // Out of resource (255)
+        else
+        {
+            // A core may still be accounting a call of the process that used the slot before: at worst, that call is misattributed
+            memset(stats->cores, 0, sizeof(stats->cores));
+            __dmb();
+            stats->key = pid + 1;
+            nbSvcStatsEnabled++;
+        }
+    }
+    else if(!enable)
+    {
+        if(stats == NULL)
+            res = 0xE0E01BFD; // out of range
+        else
+        {
+            stats->key = 0;
+            nbSvcStatsEnabled--;
+        }
+    }
+
+    KRecursiveLock__Unlock(&svcStatsLock);
+    KRecursiveLock__Unlock(criticalSectionLock);
+
+    return res;
+}
+
+void signalSvcStatsEntry(KProcess *process, KThread *thread, u32 svcId)
+{
+    if(nbSvcStatsEnabled == 0 || svcId >= SVC_STATS_NB_SVCS)
+        return;
+
+    u64 tick = GetSystemTick();
+
+    u32 cpsr = __get_cpsr();
+    __disable_irq();
+
+    SvcStats *stats = svcStatsFind(idOfProcess(process) + 1);
+    if(stats != NULL)
+        svcStatsAccountEntry(&stats->cores[getCurrentCoreID()], thread, svcId, tick);
+
+    __set_cpsr_cx(cpsr);
+}
+
+void signalSvcStatsReturn(KProcess *process, KThread *thread, u32 svcId)
+{
+    if(nbSvcStatsEnabled == 0 || svcId >= SVC_STATS_NB_SVCS)
+        return;
+
+    u64 tick = GetSystemTick();
+
+    u32 cpsr = __get_cpsr();
+    __disable_irq();
+
+    SvcStats *stats = svcStatsFind(idOfProcess(process) + 1);
+    if(stats != NULL)
+        svcStatsAccountReturn(&stats->cores[getCurrentCoreID()], thread, svcId, tick);
+
+    __set_cpsr_cx(cpsr);
+}
+
+void signalSvcStatsProcessExit(KProcess *process)
+{
+    if(nbSvcStatsEnabled != 0)
+        SetSvcStatsEnabled(idOfProcess(process), false);
+}
+
+Result GetSvcStatsInfo(s64 *out, KProcess *process, u32 type)
+{
+    SvcStats *stats = svcStatsFind(idOfProcess(process) + 1);
+    u32 svcId = type & (SVC_STATS_NB_SVCS - 1);
+
+    if(type == 0x10010)
+        *out = stats != NULL ? 1 : 0;
+    else if(stats == NULL)
+        return 0xD8E007F7; // not tracked
+    else
+    {
+        switch(type & ~(SVC_STATS_NB_SVCS - 1))
+        {
+            case 0x10100:
+            case 0x10180:
+            case 0x10200:
+            case 0x10280:
+                *out = svcStatsSum(stats, svcId, type & ~(SVC_STATS_NB_SVCS - 1));
+                break;
+            default:
+                return 0xD8E007ED; // invalid enum value
+        }
+    }
+
+    return 0;
+}
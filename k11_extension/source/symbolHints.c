@@ -0,0 +1,108 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+#include <string.h>
+#include "symbolHints.h"
+
+// Hints are only used if the words to check at them are within .text
+static inline const u32 *getSymbolHint(const Kernel11Text *text, u32 va, u32 size)
+{
+    return va >= text->textVA && va < text->rodataVA && text->rodataVA - va >= size && (va & 3) == 0 ? text->text + (va - text->textVA) / 4 : NULL;
+}
+
+static inline bool isFcramDescriptorLoad(const u32 *off)
+{
+    return (off[0] >> 16) == 0xE59F
+        && (off[1] >> 16) == 0xE3A0
+        && (off[2] >> 16) == 0xE3A0
+        && (off[3] >> 16) == 0xE1A0
+        && (off[4] >> 16) == 0xEB00;
+}
+
+bool findFcramDescriptorLoad(const u32 **load, const Kernel11Text *text, const Kernel11SymbolHints *hints)
+{
+    const u32 *off = getSymbolHint(text, hints->fcramDescriptorLoad, 20),
+              *end = text->text + (text->rodataVA - text->textVA) / 4 - 5;
+
+    if (off != NULL && isFcramDescriptorLoad(off))
+    {
+        *load = off;
+        return true;
+    }
+
+    for (off = text->text; off < end && !isFcramDescriptorLoad(off); ++off);
+    *load = off < end ? off : NULL;
+
+    return false;
+}
+
+// Where invalidateInstructionCacheRange starts, from somewhere in its body
+static const u32 *findInvalidateInstructionCacheRange(const Kernel11Text *text, const u32 *body)
+{
+    const u32 *off;
+
+    for(off = body; off >= text->text && *off != 0xE92D40F8; off--);
+
+    return off >= text->text ? off : NULL;
+}
+
+bool findSchedulerSymbols(SchedulerSymbols *symbols, const Kernel11Text *text, const Kernel11SymbolHints *hints, u32 interruptManagerVA, u32 objectContextVA)
+{
+    const u32 *adjustThread = getSymbolHint(text, hints->schedulerAdjustThread, 8);
+    const u32 *switchLiterals = getSymbolHint(text, hints->attemptSwitchingThreadContextLiterals, 8);
+    const u32 *icacheBody = getSymbolHint(text, hints->invalidateInstructionCacheRangeBody, 8);
+    const u32 *off;
+
+    if (   adjustThread != NULL && adjustThread[0] == 0xE5D13034 && adjustThread[1] == 0xE1530002
+        && switchLiterals != NULL && switchLiterals[0] == interruptManagerVA && switchLiterals[1] == objectContextVA
+        && icacheBody != NULL && icacheBody[0] == 0xE3510B1A && icacheBody[1] == 0xE3A06000)
+    {
+        off = findInvalidateInstructionCacheRange(text, icacheBody);
+        if(off != NULL)
+        {
+            symbols->adjustThread = adjustThread;
+            symbols->attemptSwitchingThreadContext = switchLiterals - 2;
+            symbols->invalidateInstructionCacheRange = off;
+            return true;
+        }
+    }
+
+    // The last match of each in .text
+    memset(symbols, 0, sizeof(SchedulerSymbols));
+
+    u32 textSize = text->rodataVA - text->textVA;
+    for(off = text->text; off < text->text + (textSize - 12) / 4; off++)
+    {
+        if(off[0] == 0xE5D13034 && off[1] == 0xE1530002)
+            symbols->adjustThread = off;
+        else if(off[0] == interruptManagerVA && off[1] == objectContextVA)
+            symbols->attemptSwitchingThreadContext = off - 2;
+        else if(off[0] == 0xE3510B1A && off[1] == 0xE3A06000)
+            symbols->invalidateInstructionCacheRange = findInvalidateInstructionCacheRange(text, off);
+    }
+
+    return false;
+}
@@ -31,16 +31,52 @@
 
 extern SGI0Handler_t SGI0Handler;
 
+static SGI0Handler_t SGI0Function;
+static u32 SGI0Acks[4] = { 0 };
+
 void executeFunctionOnCores(SGI0Handler_t handler, u8 targetList, u8 targetListFilter)
 {
     u32 coreID = getCurrentCoreID();
     SGI0Handler = handler;
 
-    if(targetListFilter == 0 && (targetListFilter & (1 << coreID)) != 0)
+    if((targetListFilter == 0 && (targetList & (1 << coreID)) != 0) || targetListFilter == 2)
         __enable_irq(); // make sure interrupts aren't masked
     MPCORE_GID_SGI = (targetListFilter << 24) | (targetList << 16) | 0;
 }
 
+static KSchedulableInterruptEvent *executeFunctionAndAck(KBaseInterruptEvent *this, u32 interruptID)
+{
+    KSchedulableInterruptEvent *res = SGI0Function(this, interruptID);
+
+    __dmb();
+    SGI0Acks[getCurrentCoreID()]++;
+    return res;
+}
+
+void executeFunctionOnCoresAndWait(SGI0Handler_t func, u8 targetList)
+{
+    u32 acks[4];
+    u32 cpsr = __get_cpsr();
+
+    for(u32 core = 0; core < getNumberOfCores(); core++)
+        acks[core] = *(vu32 *)&SGI0Acks[core];
+
+    SGI0Function = func;
+    __dmb();
+
+    // The calling core has to take its own SGI before it can acknowledge it
+    if((targetList & (1 << getCurrentCoreID())) != 0)
+        __enable_irq();
+    executeFunctionOnCores(executeFunctionAndAck, targetList, 0);
+
+    for(u32 core = 0; core < getNumberOfCores(); core++)
+    {
+        while((targetList & (1 << core)) != 0 && *(vu32 *)&SGI0Acks[core] == acks[core]);
+    }
+
+    __set_cpsr_cx(cpsr);
+}
+
 void KScheduler__TriggerCrossCoreInterrupt(KScheduler *this)
 {
     this->triggerCrossCoreInterrupt = false;
@@ -1,5 +1,6 @@
 #include "bps_patcher.h"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
 #include <optional>
@@ -30,19 +31,72 @@ using Number = u32;
 constexpr std::size_t FooterSize = 12;
 
 // The BPS format uses CRC32 checksums.
-[[gnu::optimize("Os")]] static u32 crc32(const u8 *data, std::size_t size)
+// They are computed four bytes at a time ("slicing-by-4") with tables built at compile time.
+struct Crc32Tables
 {
-    u32 crc = 0xFFFFFFFF;
-    for(std::size_t i = 0; i < size; ++i)
+    u32 entries[4][256];
+};
+
+static constexpr Crc32Tables MakeCrc32Tables()
+{
+    Crc32Tables tables{};
+    for(u32 i = 0; i < 256; ++i)
     {
-        crc ^= data[i];
+        u32 crc = i;
         for(std::size_t j = 0; j < 8; ++j)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        tables.entries[0][i] = crc;
+    }
+    for(u32 i = 0; i < 256; ++i)
+    {
+        for(std::size_t j = 1; j < 4; ++j)
+        {
+            const u32 prev = tables.entries[j - 1][i];
+            tables.entries[j][i] = (prev >> 8) ^ tables.entries[0][prev & 0xFF];
+        }
+    }
+    return tables;
+}
+
+static constexpr Crc32Tables Crc32Table = MakeCrc32Tables();
+
+class Crc32
+{
+public:
+    void Update(const u8 *data, std::size_t size)
+    {
+        const auto &t = Crc32Table.entries;
+        u32 crc = m_crc;
+
+        for(; size != 0 && (reinterpret_cast<uintptr_t>(data) & 3) != 0; --size)
+            crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+
+        // Relies on words being little endian.
+        for(; size >= 4; size -= 4, data += 4)
         {
-            u32 mask = -(crc & 1);
-            crc = (crc >> 1) ^ (0xEDB88320 & mask);
+            u32 word;
+            std::memcpy(&word, data, sizeof(word));
+            crc ^= word;
+            crc = t[3][crc & 0xFF] ^ t[2][(crc >> 8) & 0xFF] ^ t[1][(crc >> 16) & 0xFF] ^ t[0][crc >> 24];
         }
+
+        for(; size != 0; --size)
+            crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+
+        m_crc = crc;
     }
-    return ~crc;
+
+    u32 Finish() const { return ~m_crc; }
+
+private:
+    u32 m_crc = 0xFFFFFFFF;
+};
+
+static u32 crc32(const u8 *data, std::size_t size)
+{
+    Crc32 crc;
+    crc.Update(data, size);
+    return crc.Finish();
 }
 
 // Utility class to make keeping track of offsets and bound checks less error prone.
@@ -54,17 +108,17 @@ public:
 
     bool Read(void *buffer, std::size_t length)
     {
-        if(m_offset + length > m_size)
+        if(m_offset > m_size || length > m_size - m_offset)
             return false;
         std::memcpy(buffer, m_ptr + m_offset, length);
         m_offset += length;
         return true;
     }
 
-    template <typename OtherType>
-    [[gnu::optimize("Os")]] bool CopyFrom(Stream<OtherType> &other, std::size_t length)
+    template <typename Source>
+    [[gnu::optimize("Os")]] bool CopyFrom(Source &other, std::size_t length)
     {
-        if(m_offset + length > m_size)
+        if(m_offset > m_size || length > m_size - m_offset)
             return false;
         if(!other.Read(m_ptr + m_offset, length))
             return false;
@@ -72,6 +126,66 @@ public:
         return true;
     }
 
+    auto data() const { return m_ptr; }
+    std::size_t size() const { return m_size; }
+    std::size_t Tell() const { return m_offset; }
+
+    bool Seek(size_t offset)
+    {
+        m_offset = offset;
+        return true;
+    }
+
+private:
+    T *m_ptr = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_offset = 0;
+};
+
+// Reads the patch file front to back through a buffer, so that it never has to be loaded whole.
+class PatchStream
+{
+public:
+    PatchStream(util::File &file, std::size_t size, u8 *buffer, std::size_t buffer_size)
+        : m_file{file}, m_size{size}, m_buffer{buffer}, m_buffer_size{buffer_size}
+    {
+    }
+
+    bool Read(void *buffer, std::size_t length)
+    {
+        if(m_offset > m_size || length > m_size - m_offset)
+            return false;
+
+        u8 *out = static_cast<u8 *>(buffer);
+        const std::size_t buffered = std::min(length, m_buffer_end - m_buffer_pos);
+        std::memcpy(out, m_buffer + m_buffer_pos, buffered);
+        m_buffer_pos += buffered;
+        m_offset += buffered;
+        out += buffered;
+        length -= buffered;
+        if(length == 0)
+            return true;
+
+        // Large reads go straight to their destination.
+        if(length >= m_buffer_size)
+        {
+            if(!m_file.Read(out, length, m_offset))
+                return false;
+            m_offset += length;
+            return true;
+        }
+
+        const std::size_t fill_size = std::min(m_buffer_size, m_size - m_offset);
+        m_buffer_pos = m_buffer_end = 0;
+        if(!m_file.Read(m_buffer, fill_size, m_offset))
+            return false;
+        std::memcpy(out, m_buffer, length);
+        m_buffer_pos = length;
+        m_buffer_end = fill_size;
+        m_offset += length;
+        return true;
+    }
+
     template <typename ValueType>
     std::optional<ValueType> Read()
     {
@@ -97,34 +211,41 @@ public:
         return data;
     }
 
-    auto data() const { return m_ptr; }
     std::size_t size() const { return m_size; }
     std::size_t Tell() const { return m_offset; }
 
     bool Seek(size_t offset)
     {
         m_offset = offset;
+        m_buffer_pos = m_buffer_end = 0;
         return true;
     }
 
 private:
-    T *m_ptr = nullptr;
+    util::File &m_file;
     std::size_t m_size = 0;
     std::size_t m_offset = 0;
+    u8 *m_buffer = nullptr;
+    std::size_t m_buffer_size = 0;
+    std::size_t m_buffer_pos = 0;
+    std::size_t m_buffer_end = 0;
 };
 
 class PatchApplier
 {
 public:
-    PatchApplier(Stream<const u8> source, Stream<u8> target, Stream<const u8> patch)
+    PatchApplier(Stream<const u8> source, Stream<u8> target, PatchStream &patch)
         : m_source{source}, m_target{target}, m_patch{patch}
     {
     }
 
     [[gnu::always_inline]] bool Apply()
     {
-        const auto magic = *m_patch.Read<std::array<char, 4>>();
-        if(std::string_view(magic.data(), magic.size()) != "BPS1")
+        if(m_patch.size() < FooterSize)
+            return false;
+
+        const auto magic = m_patch.Read<std::array<char, 4>>();
+        if(!magic || std::string_view(magic->data(), magic->size()) != "BPS1")
             return false;
 
         const Bps::Number source_size = m_patch.ReadNumber();
@@ -135,24 +256,34 @@ public:
 
         const std::size_t command_start_offset = m_patch.Tell();
         const std::size_t command_end_offset = m_patch.size() - FooterSize;
+        if(command_start_offset > command_end_offset)
+            return false;
         m_patch.Seek(command_end_offset);
-        const u32 source_crc32 = *m_patch.Read<u32>();
-        const u32 target_crc32 = *m_patch.Read<u32>();
+        const auto source_crc32 = m_patch.Read<u32>();
+        const auto target_crc32 = m_patch.Read<u32>();
         m_patch.Seek(command_start_offset);
+        if(!source_crc32 || !target_crc32)
+            return false;
 
-        if(crc32(m_source.data(), source_size) != source_crc32)
+        if(crc32(m_source.data(), source_size) != *source_crc32)
             return false;
 
-        // Process all patch commands.
-        std::memset(m_target.data(), 0, m_target.size());
+        // Process all patch commands, checksumming the target as it gets written.
+        Crc32 target_crc;
         while(m_patch.Tell() < command_end_offset)
         {
+            const std::size_t start = m_target.Tell();
             const bool ok = HandleCommand();
             if(!ok)
                 return false;
+            target_crc.Update(m_target.data() + start, m_target.Tell() - start);
         }
 
-        return crc32(m_target.data(), target_size) == target_crc32;
+        if(m_target.Tell() != target_size || target_crc.Finish() != *target_crc32)
+            return false;
+
+        std::memset(m_target.data() + target_size, 0, m_target.size() - target_size);
+        return true;
     }
 
 private:
@@ -198,14 +329,25 @@ private:
     {
         const Number data = m_patch.ReadNumber();
         m_target_relative_offset += (data & 1 ? -1 : +1) * int(data >> 1);
-        if(m_target.Tell() + length > m_target.size())
+        const std::size_t offset = m_target.Tell();
+        if(length > m_target.size() - offset)
             return false;
-        if(m_target_relative_offset + length > m_target.size())
+        // Only bytes that have already been written can be copied.
+        if(m_target_relative_offset >= offset)
             return false;
-        // Byte by byte copy.
-        for(size_t i = 0; i < length; ++i)
-            m_target.data()[m_target.Tell() + i] = m_target.data()[m_target_relative_offset++];
-        m_target.Seek(m_target.Tell() + length);
+        u8 *target = m_target.data();
+        if(offset - m_target_relative_offset >= length)
+        {
+            std::memcpy(target + offset, target + m_target_relative_offset, length);
+        }
+        else
+        {
+            // Overlapping copies repeat the pattern, so they have to go byte by byte.
+            for(size_t i = 0; i < length; ++i)
+                target[offset + i] = target[m_target_relative_offset + i];
+        }
+        m_target_relative_offset += length;
+        m_target.Seek(offset + length);
         return true;
     }
 
@@ -213,7 +355,7 @@ private:
     std::size_t m_target_relative_offset = 0;
     Stream<const u8> m_source;
     Stream<u8> m_target;
-    Stream<const u8> m_patch;
+    PatchStream &m_patch;
 };
 
 }  // namespace Bps
@@ -245,6 +387,8 @@ private:
     u32 m_size;
 };
 
+constexpr std::size_t PatchBufferSize = 0x10000;
+
 static inline bool ApplyCodeBpsPatch(u64 prog_id, u8 *code, u32 size)
 {
     char bps_path[] = "/luma/titles/0000000000000000/code.bps";
@@ -254,18 +398,17 @@ static inline bool ApplyCodeBpsPatch(u64 prog_id, u8 *code, u32 size)
         return true;
     const u32 patch_size = u32(patch_file.GetSize().value_or(0));
 
-    // Temporarily use APPLICATION memory to store the source and patch data.
+    // Temporarily use APPLICATION memory to store the source data and to buffer the patch,
+    // which is streamed from the file as its commands are processed.
     ScopedAppHeap memory;
 
     u8 *source_data = reinterpret_cast<u8 *>(memory.BaseAddress);
-    u8 *patch_data = source_data + size;
+    u8 *patch_buffer = source_data + size;
     std::memcpy(source_data, code, size);
-    if(!patch_file.Read(patch_data, patch_size, 0))
-        return false;
 
     Bps::Stream<const u8> source_stream{source_data, size};
     Bps::Stream target_stream{code, size};
-    Bps::Stream<const u8> patch_stream{patch_data, patch_size};
+    Bps::PatchStream patch_stream{patch_file, patch_size, patch_buffer, PatchBufferSize};
     Bps::PatchApplier applier{source_stream, target_stream, patch_stream};
     if(!applier.Apply())
         svcBreak(USERBREAK_PANIC);
@@ -0,0 +1,144 @@
+#include <3ds.h>
+#include "codecache.h"
+#include "patcher.h"
+#include "strings.h"
+
+#define CODE_CACHE_MAGIC    0x3243434C // "LCC2"
+#define FNV_OFFSET_BASIS    0xCBF29CE484222325ULL
+#define FNV_PRIME           0x00000100000001B3ULL
+
+u64 codeCacheHash(u64 hash, const void *data, u32 size)
+{
+    const u8 *p = (const u8 *)data;
+
+    //FNV-1a, a word at a time: callers pass word-aligned buffers
+    for(; size >= 4; size -= 4, p += 4)
+        hash = (hash ^ *(const u32 *)p) * FNV_PRIME;
+    for(; size > 0; size--, p++)
+        hash = (hash ^ *p) * FNV_PRIME;
+
+    return hash;
+}
+
+static void statFile(CodeCacheFileInfo *info, FS_Archive archive, const char *path)
+{
+    u16 path16[64];
+    Handle handle;
+    u32 i;
+
+    memset(info, 0, sizeof(CodeCacheFileInfo));
+
+    if(R_FAILED(FSUSER_OpenFile(&handle, archive, fsMakePath(PATH_ASCII, path), FS_OPEN_READ, 0))) return;
+    if(R_FAILED(FSFILE_GetSize(handle, &info->size))) info->size = ~0ULL;
+    FSFILE_Close(handle);
+
+    //Only SDMC has file timestamps, which is where the cache lives
+    for(i = 0; path[i] != 0; i++) path16[i] = path[i];
+    path16[i] = 0;
+    if(R_FAILED(FSUSER_ControlArchive(archive, ARCHIVE_ACTION_GET_TIMESTAMP, path16, (i + 1) * 2, &info->mtime, sizeof(info->mtime))))
+        info->mtime = ~0ULL;
+}
+
+bool codeCacheInitKey(CodeCacheKey *key, u64 titleId, const ExHeader_CodeSetInfo *csi, u32 imageSize)
+{
+    //Only titles that are patched with files of their own are worth it, everything else is quicker to patch again
+    if(!isSdMode || !CONFIG(PATCHGAMES) || nextGamePatchDisabled || !isGameOrHomeMenuTitle(titleId)) return false;
+
+    FS_Archive archive;
+
+    if(R_FAILED(FSUSER_OpenArchive(&archive, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) return false;
+
+    static const char *fileNames[CODE_CACHE_NB_FILES] = { "bin", "ips", "bps" };
+    char path[] = "/luma/titles/0000000000000000/code.bin";
+    progIdToStr(path + 28, titleId);
+
+    memset(key, 0, sizeof(CodeCacheKey));
+
+    bool hasOverrides = false;
+
+    for(u32 i = 0; i < CODE_CACHE_NB_FILES; i++)
+    {
+        memcpy(path + 35, fileNames[i], 3);
+        statFile(&key->files[i], archive, path);
+        hasOverrides |= key->files[i].size != 0 || key->files[i].mtime != 0;
+    }
+
+    //Only whether it exists matters to the code, not what it holds
+    Handle handle;
+
+    memcpy(path + 30, "romfs", 6);
+    if(R_SUCCEEDED(FSUSER_OpenDirectory(&handle, archive, fsMakePath(PATH_ASCII, path))))
+    {
+        key->hasRomFs = 1;
+        hasOverrides = true;
+        FSDIR_Close(handle);
+    }
+
+    FSUSER_CloseArchive(archive);
+
+    if(!hasOverrides) return false;
+
+    s64 version,
+        commitHash;
+
+    svcGetSystemInfo(&version, 0x10000, 0);
+    svcGetSystemInfo(&commitHash, 0x10000, 1);
+
+    u32 environment[] = { (u32)version, (u32)commitHash, config, multiConfig, bootConfig, isN3DS };
+
+    key->magic = CODE_CACHE_MAGIC;
+    key->imageSize = imageSize;
+    key->titleId = titleId;
+    key->environmentHash = codeCacheHash(codeCacheHash(FNV_OFFSET_BASIS, environment, sizeof(environment)), csi, sizeof(ExHeader_CodeSetInfo));
+
+    return true;
+}
+
+bool codeCacheLoad(const CodeCacheKey *key, u8 *code)
+{
+    char path[] = "/luma/titles/0000000000000000/code.cache";
+    progIdToStr(path + 28, key->titleId);
+
+    IFile file;
+
+    if(R_FAILED(IFile_Open(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, path), FS_OPEN_READ))) return false;
+
+    CodeCacheKey cachedKey;
+    u64 fileSize,
+        total;
+
+    bool ret = R_SUCCEEDED(IFile_GetSize(&file, &fileSize)) && fileSize == sizeof(CodeCacheKey) + key->imageSize &&
+               R_SUCCEEDED(IFile_Read(&file, &total, &cachedKey, sizeof(CodeCacheKey))) && total == sizeof(CodeCacheKey) &&
+               memcmp(&cachedKey, key, sizeof(CodeCacheKey)) == 0;
+
+    //Nothing has been written to the code yet, so a failed read only means patching it as usual
+    if(ret) ret = R_SUCCEEDED(IFile_Read(&file, &total, code, key->imageSize)) && total == key->imageSize;
+
+    IFile_Close(&file);
+
+    return ret;
+}
+
+void codeCacheStore(const CodeCacheKey *key, const u8 *code)
+{
+    char path[] = "/luma/titles/0000000000000000/code.cache";
+    progIdToStr(path + 28, key->titleId);
+
+    IFile file;
+
+    if(R_FAILED(IFile_Open(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, path), FS_OPEN_CREATE | FS_OPEN_WRITE))) return;
+
+    //The key is written last, so that an interrupted write never leaves a cache that looks valid
+    static const CodeCacheKey invalidKey = { 0 };
+    u64 total;
+
+    if(R_SUCCEEDED(IFile_SetSize(&file, sizeof(CodeCacheKey) + key->imageSize)) &&
+       R_SUCCEEDED(IFile_Write(&file, &total, &invalidKey, sizeof(CodeCacheKey), 0)) && total == sizeof(CodeCacheKey) &&
+       R_SUCCEEDED(IFile_Write(&file, &total, code, key->imageSize, 0)) && total == key->imageSize)
+    {
+        file.pos = 0;
+        IFile_Write(&file, &total, key, sizeof(CodeCacheKey), FS_WRITE_FLUSH);
+    }
+
+    IFile_Close(&file);
+}
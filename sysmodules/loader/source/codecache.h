@@ -0,0 +1,37 @@
+#pragma once
+
+#include <3ds/types.h>
+#include <3ds/exheader.h>
+
+// What the key knows about an override file under /luma/titles/[u64 titleID in hex, uppercase]/. All zero if it doesn't exist
+typedef struct CodeCacheFileInfo
+{
+    u64 size;
+    u64 mtime;
+} CodeCacheFileInfo;
+
+enum
+{
+    CODE_CACHE_CODE_BIN = 0,
+    CODE_CACHE_CODE_IPS,
+    CODE_CACHE_CODE_BPS,
+    CODE_CACHE_NB_FILES,
+};
+
+// Header of /luma/titles/[u64 titleID in hex, uppercase]/code.cache, followed by the code image.
+// It holds everything the finished (decompressed and patched) image depends on, without having to read any of it
+typedef struct CodeCacheKey
+{
+    u32 magic;
+    u32 imageSize;
+    u64 titleId;
+    u64 environmentHash;    // Luma build, configuration, console type, code set info (incl. title version)
+    CodeCacheFileInfo files[CODE_CACHE_NB_FILES];
+    u32 hasRomFs;
+    u32 reserved;
+} CodeCacheKey;
+
+u64 codeCacheHash(u64 hash, const void *data, u32 size);
+bool codeCacheInitKey(CodeCacheKey *key, u64 titleId, const ExHeader_CodeSetInfo *csi, u32 imageSize);
+bool codeCacheLoad(const CodeCacheKey *key, u8 *code);
+void codeCacheStore(const CodeCacheKey *key, const u8 *code);
@@ -0,0 +1,89 @@
+#include <string.h>
+#include "ips_patcher.h"
+
+typedef struct IpsReader
+{
+    IFile *file;
+    u32 pos, end;
+    u8 buffer[0x1000];
+} IpsReader;
+
+static bool ipsRead(IpsReader *reader, void *out, u32 len)
+{
+    u32 buffered = reader->end - reader->pos;
+    u64 total;
+
+    if(len <= buffered)
+    {
+        memcpy(out, reader->buffer + reader->pos, len);
+        reader->pos += len;
+        return true;
+    }
+
+    memcpy(out, reader->buffer + reader->pos, buffered);
+    out = (u8 *)out + buffered;
+    len -= buffered;
+    reader->pos = reader->end = 0;
+
+    //Large records are read straight into the code, everything else goes through the buffer
+    if(len >= sizeof(reader->buffer))
+        return R_SUCCEEDED(IFile_Read(reader->file, &total, out, len)) && total == len;
+
+    if(R_FAILED(IFile_Read(reader->file, &total, reader->buffer, sizeof(reader->buffer))) || total < len) return false;
+
+    memcpy(out, reader->buffer, len);
+    reader->pos = len;
+    reader->end = (u32)total;
+
+    return true;
+}
+
+bool patcherApplyIpsPatch(IFile *file, u8 *code, u32 size)
+{
+    static IpsReader reader;
+    reader.file = file;
+    reader.pos = reader.end = 0;
+
+    u8 buffer[5];
+
+    if(!ipsRead(&reader, buffer, 5)) return false;
+
+    //IPS32 is the same as IPS, with 32-bit offsets
+    bool isIps32 = memcmp(buffer, "IPS32", 5) == 0;
+    if(!isIps32 && memcmp(buffer, "PATCH", 5) != 0) return false;
+
+    u32 offsetSize = isIps32 ? 4 : 3;
+    const char *eofMarker = isIps32 ? "EEOF" : "EOF";
+
+    while(ipsRead(&reader, buffer, offsetSize))
+    {
+        if(memcmp(buffer, eofMarker, offsetSize) == 0) return true;
+
+        u32 offset = 0;
+        for(u32 i = 0; i < offsetSize; i++)
+            offset = (offset << 8) | buffer[i];
+
+        if(!ipsRead(&reader, buffer, 2)) return false;
+
+        u32 patchSize = (buffer[0] << 8) | buffer[1];
+
+        if(!patchSize)
+        {
+            if(!ipsRead(&reader, buffer, 3)) return false;
+
+            u32 rleSize = (buffer[0] << 8) | buffer[1];
+
+            if(offset > size || rleSize > size - offset) return false;
+
+            memset(code + offset, buffer[2], rleSize);
+
+            continue;
+        }
+
+        if(offset > size || patchSize > size - offset) return false;
+
+        if(!ipsRead(&reader, code + offset, patchSize)) return false;
+    }
+
+    return false;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <3ds/types.h>
+#include <3ds/result.h>
+#include "ifile.h"
+
+// Applies the IPS or IPS32 patch read from file to code. Returns false if the patch is malformed, truncated, or
+// writes outside of code
+bool patcherApplyIpsPatch(IFile *file, u8 *code, u32 size);
@@ -1,6 +1,8 @@
 #include <3ds.h>
 #include "memory.h"
 #include "patcher.h"
+#include "codecache.h"
+#include "lzss.h"
 #include "ifile.h"
 #include "util.h"
 #include "hbldr.h"
@@ -26,70 +28,63 @@ typedef struct prog_addrs_t
     u32 total_size;
 } prog_addrs_t;
 
-static int lzss_decompress(u8 *end)
+#define CODE_READ_CHUNK_SIZE    0x10000
+
+static u8 ALIGN(8) codeReaderStack[0x1000];
+
+static void codeReaderThreadMain(void *arg)
 {
-    unsigned int v1; // r1@2
-    u8 *v2; // r2@2
-    u8 *v3; // r3@2
-    u8 *v4; // r1@2
-    char v5; // r5@4
-    char v6; // t1@4
-    signed int v7; // r6@4
-    int v9; // t1@7
-    u8 *v11; // r3@8
-    int v12; // r12@8
-    int v13; // t1@8
-    int v14; // t1@8
-    unsigned int v15; // r7@8
-    int v16; // r12@8
-    int ret;
-
-    ret = 0;
-    if ( end )
+    CodeReader *reader = (CodeReader *)arg;
+    Result res = 0;
+    u64 total;
+
+    for (u32 end = reader->size; end > 0 && R_SUCCEEDED(res); )
     {
-        v1 = *((u32 *)end - 2);
-        v2 = &end[*((u32 *)end - 1)];
-        v3 = &end[-(v1 >> 24)];
-        v4 = &end[-(v1 & 0xFFFFFF)];
-        while ( v3 > v4 )
-        {
-            v6 = *(v3-- - 1);
-            v5 = v6;
-            v7 = 8;
-            while ( 1 )
-            {
-                if ( (v7-- < 1) )
-                    break;
-                if ( v5 & 0x80 )
-                {
-                    v13 = *(v3 - 1);
-                    v11 = v3 - 1;
-                    v12 = v13;
-                    v14 = *(v11 - 1);
-                    v3 = v11 - 1;
-                    v15 = ((v14 | (v12 << 8)) & 0xFFFF0FFF) + 2;
-                    v16 = v12 + 32;
-                    do
-                    {
-                        ret = v2[v15];
-                        *(v2-- - 1) = ret;
-                        v16 -= 16;
-                    }
-                    while ( !(v16 < 0) );
-                }
-                else
-                {
-                    v9 = *(v3-- - 1);
-                    ret = v9;
-                    *(v2-- - 1) = v9;
-                }
-                v5 *= 2;
-                if ( v3 <= v4 )
-                    return ret;
-            }
-        }
+        u32 start = end > CODE_READ_CHUNK_SIZE ? (end - 1) & ~(CODE_READ_CHUNK_SIZE - 1) : 0;
+
+        reader->file->pos = start;
+        res = IFile_Read(reader->file, &total, reader->buf + start, end - start);
+        if (R_SUCCEEDED(res) && total != end - start)
+            res = 0xC900464F;
+
+        if (R_SUCCEEDED(res))
+            __atomic_store_n(&reader->loaded, reader->buf + start, __ATOMIC_RELEASE);
+        else
+            __atomic_store_n(&reader->res, res, __ATOMIC_RELEASE);
+
+        LightEvent_Signal(&reader->progress);
+        end = start;
     }
-    return ret;
+
+    svcExitThread();
+}
+
+static bool readAndDecompressCode(IFile *file, u8 *buf, u32 size, u32 bufSize)
+{
+    CodeReader reader = { .file = file, .buf = buf, .size = size, .loaded = buf + size, .res = 0 };
+    Handle thread;
+    s32 priority;
+
+    LightEvent_Init(&reader.progress, RESET_ONESHOT);
+
+    // Same priority: the reader gets to issue the next read whenever the decompressor waits for the previous one,
+    // which keeps one read in flight while a chunk is being decompressed. Read everything first if that fails
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+    if (R_FAILED(svcCreateThread(&thread, codeReaderThreadMain, (u32)&reader, (u32 *)(codeReaderStack + sizeof(codeReaderStack)), priority, -2)))
+    {
+        u64 total;
+
+        reader.loaded = buf;
+        return R_SUCCEEDED(IFile_Read(file, &total, buf, size)) && total == size && lzss_decompress(buf, size, bufSize, &reader);
+    }
+
+    bool ret = lzss_decompress(buf, size, bufSize, &reader);
+
+    // The reader may still be running if the data is corrupted
+    svcWaitSynchronization(thread, -1LL);
+    svcCloseHandle(thread);
+
+    return ret && R_SUCCEEDED(reader.res);
 }
 
 static inline bool hbldrIs3dsxTitle(u64 tid)
@@ -115,8 +110,19 @@ static Result loadCode(u64 titleId, prog_addrs_t *shared, u64 programHandle, int
     FS_Path filePath;
     u64 size;
     u64 total;
+    u32 imageSize = shared->total_size << 12;
+    ExHeader_CodeSetInfo *csi = &g_exheaderInfo.sci.codeset_info;
+    CodeCacheKey cacheKey;
+    bool useCache = codeCacheInitKey(&cacheKey, titleId, csi, imageSize);
 
-    if(!CONFIG(PATCHGAMES) || !loadTitleCodeSection(titleId, (u8 *)shared->text_addr, (u64)shared->total_size << 12))
+    // the cached image is already decompressed and patched, only the settings patchCode passes to the kernel are left
+    if (useCache && codeCacheLoad(&cacheKey, (u8 *)shared->text_addr))
+    {
+        applyTitleLocaleConfig(titleId);
+        return 0;
+    }
+
+    if(!CONFIG(PATCHGAMES) || !loadTitleCodeSection(titleId, (u8 *)shared->text_addr, imageSize))
     {
         archivePath.type = PATH_BINARY;
         archivePath.data = &programHandle;
@@ -138,18 +144,24 @@ static Result loadCode(u64 titleId, prog_addrs_t *shared, u64 programHandle, int
             return 0xC900464F;
         }
 
-        // read code
-        assertSuccess(IFile_Read(&file, &total, (void *)shared->text_addr, size));
-        IFile_Close(&file); // done reading
-
-        // decompress
+        // read code, while decompressing it if it's compressed
         if (isCompressed)
-            lzss_decompress((u8 *)shared->text_addr + size);
+        {
+            if (!readAndDecompressCode(&file, (u8 *)shared->text_addr, size, imageSize))
+                svcBreak(USERBREAK_ASSERT);
+            IFile_Close(&file);
+        }
+        else
+        {
+            assertSuccess(IFile_Read(&file, &total, (void *)shared->text_addr, size));
+            IFile_Close(&file); // done reading
+        }
     }
 
-    ExHeader_CodeSetInfo *csi = &g_exheaderInfo.sci.codeset_info;
+    patchCode(titleId, csi->flags.remaster_version, (u8 *)shared->text_addr, imageSize, csi->text.size, csi->rodata.size, csi->data.size, csi->rodata.address, csi->data.address);
 
-    patchCode(titleId, csi->flags.remaster_version, (u8 *)shared->text_addr, shared->total_size << 12, csi->text.size, csi->rodata.size, csi->data.size, csi->rodata.address, csi->data.address);
+    if (useCache)
+        codeCacheStore(&cacheKey, (const u8 *)shared->text_addr);
 
     return 0;
 }
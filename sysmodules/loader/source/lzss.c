@@ -0,0 +1,158 @@
+#include <string.h>
+#include "lzss.h"
+
+static bool waitForCodeSlow(CodeReader *reader, const u8 *addr)
+{
+    while (__atomic_load_n(&reader->loaded, __ATOMIC_ACQUIRE) > addr)
+    {
+        if (R_FAILED(__atomic_load_n(&reader->res, __ATOMIC_ACQUIRE)))
+            return false;
+        LightEvent_Wait(&reader->progress);
+    }
+
+    return true;
+}
+
+// Returns false if reading failed before addr was reached
+static inline bool waitForCode(CodeReader *reader, const u8 *addr)
+{
+    return __atomic_load_n(&reader->loaded, __ATOMIC_ACQUIRE) <= addr || waitForCodeSlow(reader, addr);
+}
+
+static inline void copy4(u8 *dst, const u8 *src)
+{
+    u32 word;
+
+    memcpy(&word, src, 4);
+    memcpy(dst, &word, 4);
+}
+
+static inline void copy8(u8 *dst, const u8 *src)
+{
+    u32 lo, hi;
+
+    memcpy(&lo, src, 4);
+    memcpy(&hi, src + 4, 4);
+    memcpy(dst, &lo, 4);
+    memcpy(dst + 4, &hi, 4);
+}
+
+// Decompresses ExeFS code in place, as it is being read. The compressed data ends with a footer giving its size and
+// how much larger the decompressed data is; it is decoded backwards, the output growing downwards towards the input.
+// Returns false if the data is corrupted (truncated, referring to data outside of what has been decompressed, or
+// not decompressing to the size given by its footer)
+bool lzss_decompress(u8 *buf, u32 size, u32 bufSize, CodeReader *reader)
+{
+    u32 footer,
+        extraSize;
+
+    if (size < 8 || !waitForCode(reader, buf + size - 8))
+        return false;
+
+    memcpy(&footer, buf + size - 8, 4);
+    memcpy(&extraSize, buf + size - 4, 4);
+
+    u32 headerSize = footer >> 24;
+    u32 compressedSize = footer & 0xFFFFFF;
+
+    if (headerSize < 8 || headerSize > compressedSize || compressedSize > size || extraSize > bufSize - size)
+        return false;
+
+    const u8 *inStart = buf + size - compressedSize;
+    const u8 *in = buf + size - headerSize;
+    u8 *out = buf + size + extraSize;
+    const u8 *outEnd = out;
+
+    while (in > inStart)
+    {
+        // A group of tokens reads a flag byte and at most 16 bytes, and writes at most 8 * 18 bytes. Far enough from
+        // the start of the input, and from the output catching up with it, every copy can be done in whole words,
+        // spilling over below the output: all of it is overwritten later
+        bool fast = in - inStart >= 25 && out - in >= 161;
+
+        // Only the last few groups need everything to have been read
+        if (!waitForCode(reader, fast ? in - 25 : buf))
+            return false;
+
+        // Tokens, MSB first: 0 is a literal byte, 1 a back-reference (12-bit distance, 4-bit length)
+        u32 flags = (u32)*--in << 24;
+
+        if (fast)
+        {
+            for (u32 remaining = 8; ; )
+            {
+                u32 nbLiterals = flags == 0 ? remaining : (u32)__builtin_clz(flags);
+
+                copy8(out - 8, in - 8);
+                in -= nbLiterals;
+                out -= nbLiterals;
+                flags <<= nbLiterals;
+                remaining -= nbLiterals;
+
+                if (remaining == 0)
+                    break;
+
+                u32 hi = *--in;
+                u32 lo = *--in;
+                u32 len = (hi >> 4) + 3;
+                u32 dist = (((hi & 0xF) << 8) | lo) + 3;
+
+                if (dist > (u32)(outEnd - out))
+                    return false;
+
+                u8 *dst = out - len;
+                const u8 *src = dst + dist;
+
+                // Copying words downwards gives the same result as copying bytes even when the ranges overlap,
+                // since every word is read from above what it overwrites
+                if (dist >= 4)
+                {
+                    for (s32 i = (s32)len - 4; i > -4; i -= 4)
+                        copy4(dst + i, src + i);
+                }
+                else
+                {
+                    for (u32 i = len; i > 0; i--)
+                        dst[i - 1] = src[i - 1];
+                }
+
+                out = dst;
+                flags <<= 1;
+                remaining--;
+            }
+
+            continue;
+        }
+
+        // Near the ends of the buffer, one byte at a time. The output may catch up with the input there: bytes
+        // that are still to be read can then be overwritten first, as in the reference implementation
+        for (u32 remaining = 8; remaining > 0 && in > inStart; remaining--, flags <<= 1)
+        {
+            if (out <= buf)
+                return false;
+
+            if (!(flags & 0x80000000))
+            {
+                *--out = *--in;
+                continue;
+            }
+
+            if (in - inStart < 2)
+                return false;
+
+            u32 hi = *--in;
+            u32 lo = *--in;
+            u32 len = (hi >> 4) + 3;
+            u32 dist = (((hi & 0xF) << 8) | lo) + 3;
+
+            if (dist > (u32)(outEnd - out) || len > (u32)(out - buf))
+                return false;
+
+            for (u32 i = 0; i < len; i++, out--)
+                out[-1] = out[dist - 1];
+        }
+    }
+
+    // The decompressed data ends exactly where the compressed data started
+    return waitForCode(reader, buf) && out == inStart;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <3ds/types.h>
+#include <3ds/result.h>
+#include <3ds/synchronization.h>
+#include "ifile.h"
+
+// Compressed code is read by another thread, from the end of the file since that's where decompression starts:
+// the first chunks are decompressed while the next ones are being read
+typedef struct CodeReader
+{
+    IFile *file;
+    u8 *buf;
+    u32 size;
+    const u8 *loaded; // everything from there to the end has been read
+    Result res;
+    LightEvent progress;
+} CodeReader;
+
+// Decompresses ExeFS code in place, as it is being read (see lzss.c)
+bool lzss_decompress(u8 *buf, u32 size, u32 bufSize, CodeReader *reader);
@@ -1,6 +1,7 @@
 #include <3ds.h>
 #include "patcher.h"
 #include "bps_patcher.h"
+#include "ips_patcher.h"
 #include "memory.h"
 #include "strings.h"
 #include "romfsredir.h"
@@ -8,10 +9,13 @@
 static u32 patchMemory(u8 *start, u32 size, const void *pattern, u32 patSize, s32 offset, const void *replace, u32 repSize, u32 count)
 {
     u32 i;
+    MemsearchPattern compiled;
+
+    memsearchCompile(&compiled, pattern, patSize);
 
     for(i = 0; i < count; i++)
     {
-        u8 *found = memsearch(start, pattern, size, patSize);
+        u8 *found = memsearchCompiled(start, size, &compiled);
 
         if(found == NULL) break;
 
@@ -262,7 +266,7 @@ static inline bool findLayeredFsPayloadOffset(u8 *code, u32 size, u32 roSize, u3
 static inline bool applyCodeIpsPatch(u64 progId, u8 *code, u32 size)
 {
     /* Here we look for "/luma/titles/[u64 titleID in hex, uppercase]/code.ips"
-       If it exists it should be an IPS format patch */
+       If it exists it should be an IPS or IPS32 format patch */
 
     char path[] = "/luma/titles/0000000000000000/code.ips";
     progIdToStr(path + 28, progId);
@@ -271,48 +275,8 @@ static inline bool applyCodeIpsPatch(u64 progId, u8 *code, u32 size)
 
     if(!openLumaFile(&file, path)) return true;
 
-    bool ret = false;
-    u8 buffer[5];
-    u64 total;
-
-    if(R_FAILED(IFile_Read(&file, &total, buffer, 5)) || total != 5 || memcmp(buffer, "PATCH", 5) != 0) goto exit;
-
-    while(R_SUCCEEDED(IFile_Read(&file, &total, buffer, 3)) && total == 3)
-    {
-        if(memcmp(buffer, "EOF", 3) == 0)
-        {
-            ret = true;
-            break;
-        }
-
-        u32 offset = (buffer[0] << 16) | (buffer[1] << 8) | buffer[2];
-
-        if(R_FAILED(IFile_Read(&file, &total, buffer, 2)) || total != 2) break;
-
-        u32 patchSize = (buffer[0] << 8) | buffer[1];
-
-        if(!patchSize)
-        {
-            if(R_FAILED(IFile_Read(&file, &total, buffer, 2)) || total != 2) break;
-
-            u32 rleSize = (buffer[0] << 8) | buffer[1];
-
-            if(offset + rleSize > size) break;
-
-            if(R_FAILED(IFile_Read(&file, &total, buffer, 1)) || total != 1) break;
+    bool ret = patcherApplyIpsPatch(&file, code, size);
 
-            for(u32 i = 0; i < rleSize; i++)
-                code[offset + i] = buffer[0];
-
-            continue;
-        }
-
-        if(offset + patchSize > size) break;
-
-        if(R_FAILED(IFile_Read(&file, &total, code + offset, patchSize)) || total != patchSize) break;
-    }
-
-exit:
     IFile_Close(&file);
 
     return ret;
@@ -565,14 +529,36 @@ static inline bool patchLayeredFs(u64 progId, u8 *code, u32 size, u32 textSize,
     return true;
 }
 
+static inline bool isHomeMenuTitle(u64 progId)
+{
+    return progId == 0x0004003000008F02LL || //USA Home Menu
+           progId == 0x0004003000008202LL || //JPN Home Menu
+           progId == 0x0004003000009802LL || //EUR Home Menu
+           progId == 0x000400300000A902LL || //KOR Home Menu
+           progId == 0x000400300000A102LL || //CHN Home Menu
+           progId == 0x000400300000B102LL;   //TWN Home Menu
+}
+
+bool isGameOrHomeMenuTitle(u64 progId)
+{
+    return (u32)((progId >> 0x20) & 0xFFFFFFEDULL) == 0x00040000 || isHomeMenuTitle(progId);
+}
+
+void applyTitleLocaleConfig(u64 progId)
+{
+    u8 mask,
+       regionId,
+       languageId,
+       countryId,
+       stateId;
+
+    if(loadTitleLocaleConfig(progId, &mask, &regionId, &languageId, &countryId, &stateId))
+        svcKernelSetState(0x10001, ((u32)stateId << 24) | ((u32)countryId << 16) | ((u32)languageId << 8) | ((u32)regionId << 4) | (u32)mask , progId);
+}
+
 void patchCode(u64 progId, u16 progVer, u8 *code, u32 size, u32 textSize, u32 roSize, u32 dataSize, u32 roAddress, u32 dataAddress)
 {
-    bool isHomeMenu = progId == 0x0004003000008F02LL || //USA Home Menu
-                      progId == 0x0004003000008202LL || //JPN Home Menu
-                      progId == 0x0004003000009802LL || //EUR Home Menu
-                      progId == 0x000400300000A902LL || //KOR Home Menu
-                      progId == 0x000400300000A102LL || //CHN Home Menu
-                      progId == 0x000400300000B102LL;   //TWN Home Menu
+    bool isHomeMenu = isHomeMenuTitle(progId);
 
     if(isHomeMenu)
     {
@@ -885,16 +871,9 @@ void patchCode(u64 progId, u16 progVer, u8 *code, u32 size, u32 textSize, u32 ro
         if(!patcherApplyCodeBpsPatch(progId, code, size)) goto error;
         if(!applyCodeIpsPatch(progId, code, size)) goto error;
 
-        if((u32)((progId >> 0x20) & 0xFFFFFFEDULL) == 0x00040000 || isHomeMenu)
+        if(isGameOrHomeMenuTitle(progId))
         {
-            u8 mask,
-               regionId,
-               languageId,
-               countryId,
-               stateId;
-
-            if(loadTitleLocaleConfig(progId, &mask, &regionId, &languageId, &countryId, &stateId))
-                svcKernelSetState(0x10001, ((u32)stateId << 24) | ((u32)countryId << 16) | ((u32)languageId << 8) | ((u32)regionId << 4) | (u32)mask , progId);
+            applyTitleLocaleConfig(progId);
             if(!patchLayeredFs(progId, code, size, textSize, roSize, dataSize, roAddress, dataAddress)) goto error;
         }
     }
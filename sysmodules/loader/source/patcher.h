@@ -37,11 +37,15 @@ enum singleOptions
     PATCHUNITINFO,
     CUTSLEEPWIFI,
     ENABLESAFEFIRMROSALINA,
+    CACHEDECRYPTEDFIRM,
+    WRITEBOOTTIMELOG,
 };
 
 extern u32 config, multiConfig, bootConfig;
 extern bool isN3DS, isSdMode, nextGamePatchDisabled;
 
+bool isGameOrHomeMenuTitle(u64 progId);
+void applyTitleLocaleConfig(u64 progId);
 void patchCode(u64 progId, u16 progVer, u8 *code, u32 size, u32 textSize, u32 roSize, u32 dataSize, u32 roAddress, u32 dataAddress);
 bool loadTitleCodeSection(u64 progId, u8 *code, u32 size);
 bool loadTitleExheaderInfo(u64 progId, ExHeader_Info *exheaderInfo);
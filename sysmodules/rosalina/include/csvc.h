@@ -88,6 +88,28 @@ Result svcMapProcessMemoryEx(Handle dstProcessHandle, u32 destAddress, Handle sr
  */
 Result svcUnmapProcessMemoryEx(Handle process, u32 destAddress, u32 size);
 
+/// Mapping descriptor for @ref svcMapProcessMemoryBatch
+typedef struct ProcessMemoryMapping
+{
+    Handle srcProcess;  ///< Handle of the process whose memory is mapped, ignored when unmapping
+    u32 srcVa;          ///< Address in the source process, ignored when unmapping
+    u32 dstVa;          ///< Address in the destination process
+    u32 size;           ///< Size of the block of memory, multiple of 0x1000 bytes
+    Result result;      ///< [out] Result of the operation for this mapping
+} ProcessMemoryMapping;
+
+/**
+ * @brief Maps or unmaps several blocks of memory into a process at once, as if by @ref svcMapProcessMemoryEx and @ref svcUnmapProcessMemoryEx.
+ * Contiguous blocks are merged, and caches are only flushed once at the end.
+ * @param dstProcess Handle of the process to map the memory into.
+ * @param[in,out] mappings Mapping descriptors, at most 16. Destination ranges must not overlap; misaligned ones only fail individually.
+ * @param count Number of descriptors.
+ * @param unmap Whether to unmap the blocks rather than mapping them.
+ * @return 0 if all mappings succeeded, or the result of the first one which failed (all of them are attempted regardless).
+ * Every descriptor gets a result even when the call fails as a whole (bad count, overlap, bad handle...).
+ */
+Result svcMapProcessMemoryBatch(Handle dstProcess, ProcessMemoryMapping *mappings, u32 count, bool unmap);
+
 /**
  * @brief Controls memory mapping, with the choice to use region attributes or not.
  * @param[out] addr_out The virtual address resulting from the operation. Usually the same as addr0.
@@ -120,6 +142,34 @@ Result svcControlMemoryEx(u32* addr_out, u32 addr0, u32 addr1, u32 size, MemOp o
  * @sa svcControlMemory
  */
 Result svcControlMemoryUnsafe(u32 *out, u32 addr0, u32 size, MemOp op, MemPerm perm);
+
+/// Kind of a @ref ProcessMemoryAccess
+typedef enum ProcessMemoryAccessType
+{
+    PROCESSMEMACCESS_READ = 0,  ///< Read from the debugged process into the buffer
+    PROCESSMEMACCESS_WRITE,     ///< Write the buffer into the debugged process
+} ProcessMemoryAccessType;
+
+/// Memory access descriptor for @ref svcAccessProcessMemory
+typedef struct ProcessMemoryAccess
+{
+    u32 address;        ///< Address in the debugged process
+    u32 size;           ///< Size of the access
+    u32 type;           ///< See @ref ProcessMemoryAccessType
+    void *buffer;       ///< Buffer in the current process
+    Result result;      ///< [out] Result of the access
+    u32 transferred;    ///< [out] Number of bytes copied before the first failure
+} ProcessMemoryAccess;
+
+/**
+ * @brief Reads and writes the memory of a debugged process in a single call, as if by @ref svcReadProcessMemory and @ref svcWriteProcessMemory.
+ * @param debug Debug handle of the process. Process handles aren't accepted, as the accesses go through the kernel's own
+ *              ReadProcessMemory and WriteProcessMemory.
+ * @param[in,out] accesses Access descriptors, processed in order. Each of them is split on page boundaries.
+ * @param count Number of descriptors, at most 0x100.
+ * @return 0 if all accesses succeeded, or the result of the first one which failed. All accesses are attempted regardless.
+ */
+Result svcAccessProcessMemory(Handle debug, ProcessMemoryAccess *accesses, u32 count);
 ///@}
 
 ///@name System
@@ -0,0 +1,38 @@
+/*
+*   This file is part of Luma3DS.
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   SPDX-License-Identifier: (MIT OR GPL-2.0-or-later)
+*/
+
+#pragma once
+
+#include "gdb.h"
+
+#define PROFILER_HISTOGRAM_SIZE 2048 // power of 2
+#define PROFILER_READ_BATCH     128
+#define PROFILER_DEFAULT_RATE   1000
+#define PROFILER_MAX_RATE       10000
+
+// Keep in sync with k11_extension/include/profiler.h
+typedef struct ProfilerSample
+{
+    u32 pc;
+    u32 lr; // 0 if unknown
+} ProfilerSample;
+
+typedef struct ProfilerHistogram
+{
+    u32 nbSamples;
+    u32 nbDropped;  // lost in the kernel rings, or because the histogram was full
+    u32 addresses[PROFILER_HISTOGRAM_SIZE];
+    u32 counts[PROFILER_HISTOGRAM_SIZE]; // 0 for empty slots
+} ProfilerHistogram;
+
+void GDB_ClearProfilerHistogram(ProfilerHistogram *histogram);
+void GDB_AddProfilerSample(ProfilerHistogram *histogram, u32 address);
+int GDB_FormatProfilerHistogram(char *out, u32 outSize, const ProfilerHistogram *histogram);
+
+int GDB_StartProfiler(u32 pid, u32 rate, bool callers);
+void GDB_StopProfiler(u32 pid); // no-op if pid isn't being profiled
+int GDB_DumpProfiler(char *out, u32 outSize);
@@ -22,5 +22,6 @@ GDB_DECLARE_REMOTE_COMMAND_HANDLER(FlushCaches);
 GDB_DECLARE_REMOTE_COMMAND_HANDLER(ToggleExternalMemoryAccess);
 GDB_DECLARE_REMOTE_COMMAND_HANDLER(CatchSvc);
 GDB_DECLARE_REMOTE_COMMAND_HANDLER(GetThreadPriority);
+GDB_DECLARE_REMOTE_COMMAND_HANDLER(Profile);
 
 GDB_DECLARE_QUERY_HANDLER(Rcmd);
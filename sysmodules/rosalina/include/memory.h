@@ -28,8 +28,8 @@
 
 #include <3ds/types.h>
 #include <string.h>
+#include "memsearch.h"
 
-u8 *memsearch(u8 *startPos, const void *pattern, u32 size, u32 patternSize);
 void hexItoa(u64 number, char *out, u32 digits, bool uppercase);
 unsigned long int xstrtoul(const char *nptr, char **endptr, int base, bool allowPrefix, bool *ok);
 unsigned long long int xstrtoull(const char *nptr, char **endptr, int base, bool allowPrefix, bool *ok);
@@ -29,6 +29,19 @@
 #include <3ds/types.h>
 #include "menu.h"
 
+#define IPC_TRACE_MAX_EVENTS    (4 * 128)
+
+// Keep in sync with k11_extension/include/ipcTrace.h
+typedef struct IpcTraceEvent
+{
+    u32 seq;
+    u32 pid;
+    u32 cmdHeader;
+    u32 duration;
+    u64 sendTick;
+    char name[8];
+} IpcTraceEvent;
+
 extern Menu miscellaneousMenu;
 
 void MiscellaneousMenu_SwitchBoot3dsxTargetTitle(void);
@@ -38,3 +51,5 @@ void MiscellaneousMenu_InputRedirection(void);
 void MiscellaneousMenu_UpdateTimeDateNtp(void);
 void MiscellaneousMenu_NullifyUserTimeOffset(void);
 void MiscellaneousMenu_DumpDspFirm(void);
+void MiscellaneousMenu_ShowBootTimeline(void);
+void MiscellaneousMenu_IpcTrace(void);
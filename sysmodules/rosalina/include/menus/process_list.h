@@ -29,5 +29,6 @@
 #include <3ds/types.h>
 
 #define PROCESSES_PER_MENU_PAGE 18
+#define SVC_STATS_PER_MENU_PAGE 11
 
 void RosalinaMenu_ProcessList(void);
@@ -95,6 +95,16 @@ SVC_BEGIN svcFreeMemory
     bx   lr
 SVC_END
 
+SVC_BEGIN svcAccessProcessMemory
+    svc 0xA4
+    bx lr
+SVC_END
+
+SVC_BEGIN svcMapProcessMemoryBatch
+    svc 0xA5
+    bx lr
+SVC_END
+
 SVC_BEGIN svcControlService
     svc 0xB0
     bx lr
@@ -14,6 +14,7 @@
 #include "gdb/watchpoints.h"
 #include "gdb/breakpoints.h"
 #include "gdb/stop_point.h"
+#include "gdb/profiler.h"
 
 void GDB_InitializeContext(GDBContext *ctx)
 {
@@ -121,6 +122,8 @@ void GDB_DetachFromProcess(GDBContext *ctx)
     svcKernelSetState(0x10002, ctx->pid, false);
     memset(ctx->svcMask, 0, 32);
 
+    GDB_StopProfiler(ctx->pid);
+
     memset(ctx->threadListData, 0, sizeof(ctx->threadListData));
     ctx->threadListDataPos = 0;
 
@@ -6,6 +6,7 @@
 */
 
 #include "gdb/breakpoints.h"
+#include "csvc.h"
 
 #define _REENT_ONLY
 #include <errno.h>
@@ -68,8 +69,14 @@ int GDB_AddBreakpoint(GDBContext *ctx, u32 address, bool thumb, bool persist)
 
     Breakpoint *bkpt = &ctx->breakpoints[id];
     u32 instr = thumb ? BREAKPOINT_INSTRUCTION_THUMB : BREAKPOINT_INSTRUCTION_ARM;
-    if(R_FAILED(svcReadProcessMemory(&bkpt->savedInstruction, ctx->debug, address, thumb ? 2 : 4)) ||
-       R_FAILED(svcWriteProcessMemory(ctx->debug, &instr, address, thumb ? 2 : 4)))
+
+    // Save the instruction and replace it in a single svc. Both are at the same address, so they succeed or fail together
+    ProcessMemoryAccess accesses[2] = {
+        { address, thumb ? 2 : 4, PROCESSMEMACCESS_READ, &bkpt->savedInstruction, 0, 0 },
+        { address, thumb ? 2 : 4, PROCESSMEMACCESS_WRITE, &instr, 0, 0 },
+    };
+
+    if(R_FAILED(svcAccessProcessMemory(ctx->debug, accesses, 2)))
     {
         for(u32 i = id; i < ctx->nbBreakpoints - 1; i++)
             ctx->breakpoints[i] = ctx->breakpoints[i + 1];
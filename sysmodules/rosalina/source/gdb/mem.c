@@ -122,11 +122,31 @@ Result GDB_WriteTargetMemoryInPage(GDBContext *ctx, const void *in, u32 addr, u3
     }
 }
 
+static bool GDB_IsUserMemoryRange(u32 addr, u32 len)
+{
+    s64 TTBCR;
+    svcGetSystemInfo(&TTBCR, 0x10002, 0);
+
+    return addr + len >= addr && addr + len <= (1u << (32 - (u32)TTBCR));
+}
+
+static u32 GDB_AccessTargetUserMemory(GDBContext *ctx, void *buf, u32 addr, u32 len, ProcessMemoryAccessType type)
+{
+    // Lets the kernel do the page splitting, rather than doing one svc per page
+    ProcessMemoryAccess access = { addr, len, type, buf, 0, 0 };
+    svcAccessProcessMemory(ctx->debug, &access, 1);
+    return access.transferred;
+}
+
 u32 GDB_ReadTargetMemory(void *out, GDBContext *ctx, u32 addr, u32 len)
 {
     Result r = 0;
     u32 remaining = len, total = 0;
     u8 *out8 = (u8 *)out;
+
+    if(GDB_IsUserMemoryRange(addr, len))
+        return GDB_AccessTargetUserMemory(ctx, out, addr, len, PROCESSMEMACCESS_READ);
+
     do
     {
         u32 nb = (remaining > 0x1000 - (addr & 0xFFF)) ? 0x1000 - (addr & 0xFFF) : remaining;
@@ -147,6 +167,10 @@ u32 GDB_WriteTargetMemory(GDBContext *ctx, const void *in, u32 addr, u32 len)
 {
     Result r = 0;
     u32 remaining = len, total = 0;
+
+    if(GDB_IsUserMemoryRange(addr, len))
+        return GDB_AccessTargetUserMemory(ctx, (void *)in, addr, len, PROCESSMEMACCESS_WRITE);
+
     do
     {
         u32 nb = (remaining > 0x1000 - (addr & 0xFFF)) ? 0x1000 - (addr & 0xFFF) : remaining;
@@ -200,6 +224,9 @@ u32 GDB_SearchMemory(bool *found, GDBContext *ctx, u32 addr, u32 len, const void
     u8 buf[0x1000 + 0x1000 * ((GDB_BUF_LEN + 0xFFF) / 0x1000)];
     u32 maxNbPages = 1 + ((GDB_BUF_LEN + 0xFFF) / 0x1000);
     u32 curAddr = addr;
+    MemsearchPattern compiled;
+
+    memsearchCompile(&compiled, pattern, patternLen);
 
     s64 TTBCR;
     svcGetSystemInfo(&TTBCR, 0x10002, 0);
@@ -208,7 +235,14 @@ u32 GDB_SearchMemory(bool *found, GDBContext *ctx, u32 addr, u32 len, const void
         u32 nbPages;
         u32 addrBase = curAddr & ~0xFFF, addrDispl = curAddr & 0xFFF;
 
-        for(nbPages = 0; nbPages < maxNbPages; nbPages++)
+        if(addrBase < (1u << (32 - (u32)TTBCR)))
+        {
+            // One svc for all the pages, which are searched up to the first one that can't be read
+            ProcessMemoryAccess access = { addrBase, 0x1000 * maxNbPages, PROCESSMEMACCESS_READ, buf, 0, 0 };
+            svcAccessProcessMemory(ctx->debug, &access, 1);
+            nbPages = access.transferred / 0x1000;
+        }
+        else for(nbPages = 0; nbPages < maxNbPages; nbPages++)
         {
             if(addr >= (1u << (32 - (u32)TTBCR)))
             {
@@ -223,7 +257,8 @@ u32 GDB_SearchMemory(bool *found, GDBContext *ctx, u32 addr, u32 len, const void
 
         u8 *pos = NULL;
         if(addrDispl + patternLen <= 0x1000 * nbPages)
-            pos = memsearch(buf + addrDispl, pattern, 0x1000 * nbPages - addrDispl, patternLen);
+            pos = patternLen <= MEMSEARCH_SHORT_PATTERN_MAX_SIZE ? memsearch(buf + addrDispl, pattern, 0x1000 * nbPages - addrDispl, patternLen) :
+                                                                   memsearchCompiled(buf + addrDispl, 0x1000 * nbPages - addrDispl, &compiled);
 
         if(pos != NULL)
         {
@@ -0,0 +1,206 @@
+/*
+*   This file is part of Luma3DS.
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   SPDX-License-Identifier: (MIT OR GPL-2.0-or-later)
+*/
+
+#include "gdb/profiler.h"
+#include "MyThread.h"
+#include "menu.h"
+#include "fmt.h"
+
+#define _REENT_ONLY
+#include <errno.h>
+
+/*
+    The kernel samples the interrupted user-mode PC and LR of the profiled process on the other cores
+    each time it is asked to; this thread asks at the requested rate, and folds the samples it drains
+    from the kernel rings into a histogram keyed by either of them.
+*/
+
+static ProfilerHistogram histogram;
+static ProfilerSample samples[PROFILER_READ_BATCH];
+
+static RecursiveLock profilerLock;
+static MyThread profilerThread;
+static u8 ALIGN(8) profilerThreadStack[0x1000];
+
+static bool profilerRunning = false;
+static bool profilerShouldStop = false;
+static bool profilerCallers = false;
+static u32 profilerPid = 0;
+static s64 profilerPeriod = 0;
+
+static inline u32 GDB_HashProfilerAddress(u32 address)
+{
+    return ((address >> 1) * 2654435761u) & (PROFILER_HISTOGRAM_SIZE - 1);
+}
+
+void GDB_ClearProfilerHistogram(ProfilerHistogram *histogram)
+{
+    memset(histogram, 0, sizeof(ProfilerHistogram));
+}
+
+void GDB_AddProfilerSample(ProfilerHistogram *histogram, u32 address)
+{
+    u32 slot = GDB_HashProfilerAddress(address);
+
+    for(u32 i = 0; i < PROFILER_HISTOGRAM_SIZE; i++, slot = (slot + 1) & (PROFILER_HISTOGRAM_SIZE - 1))
+    {
+        if(histogram->counts[slot] == 0)
+        {
+            histogram->addresses[slot] = address;
+            histogram->counts[slot] = 1;
+            histogram->nbSamples++;
+            return;
+        }
+        else if(histogram->addresses[slot] == address)
+        {
+            histogram->counts[slot]++;
+            histogram->nbSamples++;
+            return;
+        }
+    }
+
+    histogram->nbDropped++;
+}
+
+int GDB_FormatProfilerHistogram(char *out, u32 outSize, const ProfilerHistogram *histogram)
+{
+    char line[32];
+    int n = sprintf(out, "%lu samples, %lu dropped\n", histogram->nbSamples, histogram->nbDropped);
+    u32 prevCount = 0xFFFFFFFF, prevSlot = 0xFFFFFFFF;
+
+    // Highest counts first, one "address count" line each so that the output can be fed to addr2line
+    while(true)
+    {
+        u32 bestSlot = 0xFFFFFFFF, bestCount = 0;
+        for(u32 slot = 0; slot < PROFILER_HISTOGRAM_SIZE; slot++)
+        {
+            u32 count = histogram->counts[slot];
+            if(count > bestCount && (count < prevCount || (count == prevCount && slot > prevSlot)))
+            {
+                bestSlot = slot;
+                bestCount = count;
+            }
+        }
+
+        if(bestSlot == 0xFFFFFFFF)
+            break;
+
+        int lineLen = sprintf(line, "0x%08lx %lu\n", histogram->addresses[bestSlot], bestCount);
+        if((u32)(n + lineLen) >= outSize)
+            break;
+
+        memcpy(out + n, line, lineLen + 1);
+        n += lineLen;
+        prevSlot = bestSlot;
+        prevCount = bestCount;
+    }
+
+    return n;
+}
+
+static void GDB_DrainProfilerSamples(void)
+{
+    u32 counts[2]; // samples read, samples dropped
+
+    RecursiveLock_Lock(&profilerLock);
+
+    do
+    {
+        if(R_FAILED(svcKernelSetState(0x1000E, samples, PROFILER_READ_BATCH, counts)))
+            break;
+
+        for(u32 i = 0; i < counts[0]; i++)
+        {
+            // The caller of threads preempted on the core we run on isn't known
+            if(profilerCallers && samples[i].lr == 0)
+                histogram.nbDropped++;
+            else
+                GDB_AddProfilerSample(&histogram, profilerCallers ? samples[i].lr : samples[i].pc);
+        }
+        histogram.nbDropped += counts[1];
+    }
+    while(counts[0] == PROFILER_READ_BATCH);
+
+    RecursiveLock_Unlock(&profilerLock);
+}
+
+static void GDB_ProfilerThreadMain(void)
+{
+    for(u32 i = 1; !profilerShouldStop; i++)
+    {
+        svcSleepThread(profilerPeriod);
+        svcKernelSetState(0x1000D); // sample every core
+
+        // Kernel rings hold 256 samples per core
+        if((i % (PROFILER_READ_BATCH / 2)) == 0)
+            GDB_DrainProfilerSamples();
+    }
+
+    GDB_DrainProfilerSamples();
+}
+
+int GDB_StartProfiler(u32 pid, u32 rate, bool callers)
+{
+    static bool lockInitialized = false;
+    if(!lockInitialized)
+    {
+        RecursiveLock_Init(&profilerLock);
+        lockInitialized = true;
+    }
+
+    if(rate == 0 || rate > PROFILER_MAX_RATE)
+        return -EINVAL;
+
+    GDB_StopProfiler(profilerPid);
+
+    RecursiveLock_Lock(&profilerLock);
+    GDB_ClearProfilerHistogram(&histogram);
+    profilerPid = pid;
+    profilerCallers = callers;
+    profilerPeriod = 1000 * 1000 * 1000LL / rate;
+    profilerShouldStop = false;
+    RecursiveLock_Unlock(&profilerLock);
+
+    if(R_FAILED(svcKernelSetState(0x1000C, pid, true)))
+        return -EPERM;
+
+    // Higher priority than the debugger threads, to keep the sampling period steady
+    if(R_FAILED(MyThread_Create(&profilerThread, GDB_ProfilerThreadMain, profilerThreadStack, 0x1000, 0x18, CORE_SYSTEM)))
+    {
+        svcKernelSetState(0x1000C, 0, false);
+        return -EBUSY;
+    }
+
+    profilerRunning = true;
+    return 0;
+}
+
+void GDB_StopProfiler(u32 pid)
+{
+    if(!profilerRunning || pid != profilerPid)
+        return;
+
+    profilerShouldStop = true;
+    MyThread_Join(&profilerThread, -1LL);
+    svcKernelSetState(0x1000C, 0, false);
+    profilerRunning = false;
+}
+
+int GDB_DumpProfiler(char *out, u32 outSize)
+{
+    if(!profilerRunning && histogram.nbSamples == 0)
+        return sprintf(out, "Profiler not started.\n");
+
+    if(profilerRunning)
+        GDB_DrainProfilerSamples();
+
+    RecursiveLock_Lock(&profilerLock);
+    int n = GDB_FormatProfilerHistogram(out, outSize, &histogram);
+    RecursiveLock_Unlock(&profilerLock);
+
+    return n;
+}
@@ -10,6 +10,7 @@
 #include "csvc.h"
 #include "fmt.h"
 #include "gdb/breakpoints.h"
+#include "gdb/profiler.h"
 #include "utils.h"
 
 #include "../utils.h"
@@ -29,7 +30,8 @@ struct
     { "flushcaches"       , GDB_REMOTE_COMMAND_HANDLER(FlushCaches) },
     { "toggleextmemaccess", GDB_REMOTE_COMMAND_HANDLER(ToggleExternalMemoryAccess) },
     { "catchsvc"          , GDB_REMOTE_COMMAND_HANDLER(CatchSvc) },
-    { "getthreadpriority" , GDB_REMOTE_COMMAND_HANDLER(GetThreadPriority)}
+    { "getthreadpriority" , GDB_REMOTE_COMMAND_HANDLER(GetThreadPriority)},
+    { "profile"           , GDB_REMOTE_COMMAND_HANDLER(Profile) }
 };
 
 static const char *GDB_SkipSpaces(const char *pos)
@@ -123,14 +125,20 @@ GDB_DECLARE_REMOTE_COMMAND_HANDLER(SyncRequestInfo)
         goto end;
     }
 
-    r = svcReadProcessMemory(&cmdId, ctx->debug, ctx->threadInfos[id].tls + 0x80, 4);
-    if(R_FAILED(r))
+    // The command ID in the TLS and the instruction at pc, in a single svc
+    ProcessMemoryAccess accesses[2] = {
+        { ctx->threadInfos[id].tls + 0x80, 4, PROCESSMEMACCESS_READ, &cmdId, 0, 0 },
+        { regs.cpu_registers.pc, (regs.cpu_registers.cpsr & 0x20) ? 2 : 4, PROCESSMEMACCESS_READ, &instr, 0, 0 },
+    };
+
+    svcAccessProcessMemory(ctx->debug, accesses, 2);
+    if(R_FAILED(accesses[0].result))
     {
         n = sprintf(outbuf, "Invalid or running thread.\n");
         goto end;
     }
 
-    r = svcReadProcessMemory(&instr, ctx->debug, regs.cpu_registers.pc, (regs.cpu_registers.cpsr & 0x20) ? 2 : 4);
+    r = accesses[1].result;
 
     if(R_SUCCEEDED(r) && (((regs.cpu_registers.cpsr & 0x20) && instr == BREAKPOINT_INSTRUCTION_THUMB) || instr == BREAKPOINT_INSTRUCTION_ARM))
     {
@@ -448,6 +456,53 @@ GDB_DECLARE_REMOTE_COMMAND_HANDLER(GetThreadPriority)
     return GDB_SendHexPacket(ctx, outbuf, n);
 }
 
+GDB_DECLARE_REMOTE_COMMAND_HANDLER(Profile)
+{
+    // profile start [rate] [callers] | profile stop | profile [dump]
+    char outbuf[GDB_BUF_LEN / 2 + 1];
+    const char *pos = ctx->commandData;
+    int n;
+
+    if(strncmp(pos, "start", 5) == 0)
+    {
+        bool ok = true;
+        bool callers;
+        char *end;
+        u32 rate = PROFILER_DEFAULT_RATE;
+
+        pos = GDB_SkipSpaces(pos + 5);
+        if(*pos >= '0' && *pos <= '9')
+        {
+            rate = xstrtoul(pos, &end, 0, true, &ok);
+            if(!ok)
+                return GDB_ReplyErrno(ctx, EILSEQ);
+
+            pos = GDB_SkipSpaces(end);
+        }
+
+        callers = strncmp(pos, "callers", 7) == 0;
+        if(!callers && *pos != 0)
+            return GDB_ReplyErrno(ctx, EILSEQ);
+
+        int r = GDB_StartProfiler(ctx->pid, rate, callers);
+        if(r == 0)
+            n = sprintf(outbuf, "Sampling %s of process %lu at %lu Hz.\n", callers ? "callers" : "PCs", ctx->pid, rate);
+        else
+            n = sprintf(outbuf, "Failed to start the profiler (%d).\n", r);
+    }
+    else if(strncmp(pos, "stop", 4) == 0)
+    {
+        GDB_StopProfiler(ctx->pid);
+        n = sprintf(outbuf, "Profiler stopped.\n");
+    }
+    else if(*pos == 0 || strncmp(pos, "dump", 4) == 0)
+        n = GDB_DumpProfiler(outbuf, sizeof(outbuf));
+    else
+        return GDB_ReplyErrno(ctx, EILSEQ);
+
+    return GDB_SendHexPacket(ctx, outbuf, n);
+}
+
 GDB_DECLARE_QUERY_HANDLER(Rcmd)
 {
     char commandData[GDB_BUF_LEN / 2 + 1];
@@ -244,17 +244,17 @@ static Result InputRedirection_DoUndoIrPatches(Handle processHandle, bool doPatc
         u32 irDataPhys = (u32)PA_FROM_VA_PTR(irData);
         u32 irCodePhys = (u32)PA_FROM_VA_PTR(&irCodePatchFunc);
 
-        u32 *off = (u32 *)memsearch((u8 *)0x00100000, &irOrigReadingCode, totalSize, sizeof(irOrigReadingCode) - 4);
+        u32 *off = memsearchAligned((u32 *)0x00100000, irOrigReadingCode, totalSize, sizeof(irOrigReadingCode) - 4);
         if(off == NULL)
         {
             svcUnmapProcessMemoryEx(CUR_PROCESS_HANDLE, 0x00100000, totalSize);
             return -1;
         }
 
-        u32 *off2 = (u32 *)memsearch((u8 *)0x00100000, &irOrigWaitSyncCode, totalSize, sizeof(irOrigWaitSyncCode));
+        u32 *off2 = memsearchAligned((u32 *)0x00100000, irOrigWaitSyncCode, totalSize, sizeof(irOrigWaitSyncCode));
         if(off2 == NULL)
         {
-            off2 = (u32 *)memsearch((u8 *)0x00100000, &irOrigWaitSyncCodeOld, totalSize, sizeof(irOrigWaitSyncCodeOld));
+            off2 = memsearchAligned((u32 *)0x00100000, irOrigWaitSyncCodeOld, totalSize, sizeof(irOrigWaitSyncCodeOld));
             if(off2 == NULL)
             {
                 svcUnmapProcessMemoryEx(CUR_PROCESS_HANDLE, 0x00100000, totalSize);
@@ -262,7 +262,7 @@ static Result InputRedirection_DoUndoIrPatches(Handle processHandle, bool doPatc
             }
         }
 
-        u32 *off3 = (u32 *)memsearch((u8 *)0x00100000, &irOrigCppFlagCode, totalSize, sizeof(irOrigCppFlagCode));
+        u32 *off3 = memsearchAligned((u32 *)0x00100000, irOrigCppFlagCode, totalSize, sizeof(irOrigCppFlagCode));
         if(off3 == NULL)
         {
             svcUnmapProcessMemoryEx(CUR_PROCESS_HANDLE, 0x00100000, totalSize);
@@ -360,21 +360,21 @@ static Result InputRedirection_DoUndoHidPatches(Handle processHandle, bool doPat
 
     if (R_SUCCEEDED(res) && !patchPrepared)
     {
-        u32 *off = (u32 *)memsearch((u8 *)0x00100000, &hidOrigRegisterAndValue, totalSize, sizeof(hidOrigRegisterAndValue));
+        u32 *off = memsearchAligned((u32 *)0x00100000, hidOrigRegisterAndValue, totalSize, sizeof(hidOrigRegisterAndValue));
         if(off == NULL)
         {
             svcUnmapProcessMemoryEx(CUR_PROCESS_HANDLE, 0x00100000, totalSize);
             return -1;
         }
 
-        u32 *off2 = (u32 *)memsearch((u8 *)off + sizeof(hidOrigRegisterAndValue), &hidOrigRegisterAndValue, totalSize - ((u32)off - 0x00100000), sizeof(hidOrigRegisterAndValue));
+        u32 *off2 = memsearchAligned(off + sizeof(hidOrigRegisterAndValue) / 4, hidOrigRegisterAndValue, totalSize - ((u32)off - 0x00100000) - sizeof(hidOrigRegisterAndValue), sizeof(hidOrigRegisterAndValue));
         if(off2 == NULL)
         {
             svcUnmapProcessMemoryEx(CUR_PROCESS_HANDLE, 0x00100000, totalSize);
             return -2;
         }
 
-        u32 *off3 = (u32 *)memsearch((u8 *)0x00100000, &hidOrigCode, totalSize, sizeof(hidOrigCode));
+        u32 *off3 = memsearchAligned((u32 *)0x00100000, hidOrigCode, totalSize, sizeof(hidOrigCode));
         if(off3 == NULL)
         {
             svcUnmapProcessMemoryEx(CUR_PROCESS_HANDLE, 0x00100000, totalSize);
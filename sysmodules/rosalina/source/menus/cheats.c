@@ -34,6 +34,7 @@
 #include "fmt.h"
 #include "ifile.h"
 #include "pmdbgext.h"
+#include "csvc.h"
 
 #define MAKE_QWORD(hi,low) \
     ((u64) ((((u64)(hi)) << 32) | (low)))
@@ -121,21 +122,76 @@ static u32 Cheat_GetRandomNumber(void)
     return (u32)(cheatRngState >> 32);
 }
 
+// Last memory block found valid, reset for each cheat so that most accesses don't need to query the memory layout
+static u32 validBlockStart = 0;
+static u32 validBlockEnd = 0;
+
 static bool Cheat_IsValidAddress(const Handle processHandle, u32 address, u32 size)
 {
     MemInfo info;
     PageInfo out;
 
+    if (address >= validBlockStart && address < validBlockEnd && size <= validBlockEnd - address)
+        return true;
+
     Result res = svcQueryDebugProcessMemory(&info, &out, processHandle, address);
     if (R_SUCCEEDED(res) && info.state != MEMSTATE_FREE && info.base_addr > 0 && info.base_addr <= address && address <= info.base_addr + info.size - size) {
+        validBlockStart = info.base_addr;
+        validBlockEnd = info.base_addr + info.size;
         return true;
     }
     return false;
 }
 
-static u32 ReadWriteBuffer32 = 0;
-static u16 ReadWriteBuffer16 = 0;
-static u8 ReadWriteBuffer8 = 0;
+// Writes are queued, then issued together with svcAccessProcessMemory before the next read and once the cheat is done,
+// so that a cheat made of writes only costs a single SVC
+#define CHEAT_MAX_QUEUED_ACCESSES 32
+
+static ProcessMemoryAccess queuedAccesses[CHEAT_MAX_QUEUED_ACCESSES];
+static u32 queuedValues[CHEAT_MAX_QUEUED_ACCESSES];
+static u32 nbQueuedAccesses = 0;
+
+static bool Cheat_FlushAccesses(const Handle processHandle)
+{
+    if (nbQueuedAccesses == 0)
+        return true;
+
+    Result res = svcAccessProcessMemory(processHandle, queuedAccesses, nbQueuedAccesses);
+    nbQueuedAccesses = 0;
+    return R_SUCCEEDED(res);
+}
+
+static void Cheat_QueueAccess(u32 addr, u32 size, ProcessMemoryAccessType type, u32 value)
+{
+    u32 i = nbQueuedAccesses++;
+
+    // Little endian, the value is in the first bytes
+    queuedValues[i] = value;
+    queuedAccesses[i] = (ProcessMemoryAccess){ addr, size, type, &queuedValues[i], 0, 0 };
+}
+
+static bool Cheat_QueueWrite(const Handle processHandle, u32 addr, u32 size, u32 value)
+{
+    if (nbQueuedAccesses == CHEAT_MAX_QUEUED_ACCESSES && !Cheat_FlushAccesses(processHandle))
+        return false;
+
+    Cheat_QueueAccess(addr, size, PROCESSMEMACCESS_WRITE, value);
+    return true;
+}
+
+// Goes out with the queued writes, which it has to see. Fails if any of them does
+static bool Cheat_ReadAfterWrites(const Handle processHandle, u32 addr, u32 size, u32* value)
+{
+    if (nbQueuedAccesses == CHEAT_MAX_QUEUED_ACCESSES && !Cheat_FlushAccesses(processHandle))
+        return false;
+
+    u32 i = nbQueuedAccesses;
+    Cheat_QueueAccess(addr, size, PROCESSMEMACCESS_READ, 0);
+
+    bool ok = Cheat_FlushAccesses(processHandle);
+    *value = queuedValues[i];
+    return ok;
+}
 
 static bool Cheat_Write8(const Handle processHandle, u32 offset, u8 value)
 {
@@ -147,8 +203,7 @@ static bool Cheat_Write8(const Handle processHandle, u32 offset, u8 value)
     }
     if (Cheat_IsValidAddress(processHandle, addr, 1))
     {
-        *((u8*) (&ReadWriteBuffer8)) = value;
-        return R_SUCCEEDED(svcWriteProcessMemory(processHandle, &ReadWriteBuffer8, addr, 1));
+        return Cheat_QueueWrite(processHandle, addr, 1, value);
     }
     return false;
 }
@@ -163,8 +218,7 @@ static bool Cheat_Write16(const Handle processHandle, u32 offset, u16 value)
     }
     if (Cheat_IsValidAddress(processHandle, addr, 2))
     {
-        *((u16*) (&ReadWriteBuffer16)) = value;
-        return R_SUCCEEDED(svcWriteProcessMemory(processHandle, &ReadWriteBuffer16, addr, 2));
+        return Cheat_QueueWrite(processHandle, addr, 2, value);
     }
     return false;
 }
@@ -179,8 +233,7 @@ static bool Cheat_Write32(const Handle processHandle, u32 offset, u32 value)
     }
     if (Cheat_IsValidAddress(processHandle, addr, 4))
     {
-        *((u32*) (&ReadWriteBuffer32)) = value;
-        return R_SUCCEEDED(svcWriteProcessMemory(processHandle, &ReadWriteBuffer32, addr, 4));
+        return Cheat_QueueWrite(processHandle, addr, 4, value);
     }
     return false;
 }
@@ -195,9 +248,10 @@ static bool Cheat_Read8(const Handle processHandle, u32 offset, u8* retValue)
     }
     if (Cheat_IsValidAddress(processHandle, addr, 1))
     {
-        Result res = svcReadProcessMemory(&ReadWriteBuffer8, processHandle, addr, 1);
-        *retValue = *((u8*) (&ReadWriteBuffer8));
-        return R_SUCCEEDED(res);
+        u32 value;
+        bool ok = Cheat_ReadAfterWrites(processHandle, addr, 1, &value);
+        *retValue = (u8) value;
+        return ok;
     }
     return false;
 }
@@ -212,9 +266,10 @@ static bool Cheat_Read16(const Handle processHandle, u32 offset, u16* retValue)
     }
     if (Cheat_IsValidAddress(processHandle, addr, 2))
     {
-        Result res = svcReadProcessMemory(&ReadWriteBuffer16, processHandle, addr, 2);
-        *retValue = *((u16*) (&ReadWriteBuffer16));
-        return R_SUCCEEDED(res);
+        u32 value;
+        bool ok = Cheat_ReadAfterWrites(processHandle, addr, 2, &value);
+        *retValue = (u16) value;
+        return ok;
     }
     return false;
 }
@@ -229,9 +284,7 @@ static bool Cheat_Read32(const Handle processHandle, u32 offset, u32* retValue)
     }
     if (Cheat_IsValidAddress(processHandle, addr, 4))
     {
-        Result res = svcReadProcessMemory(&ReadWriteBuffer32, processHandle, addr, 4);
-        *retValue = *((u32*) (&ReadWriteBuffer32));
-        return R_SUCCEEDED(res);
+        return Cheat_ReadAfterWrites(processHandle, addr, 4, retValue);
     }
     return false;
 }
@@ -272,6 +325,8 @@ static u32 Cheat_ApplyCheat(const Handle processHandle, CheatDescription* const
     cheat_state.storedStack = 0;
     cheat_state.ifCount = 0;
     cheat_state.storedIfCount = 0;
+    validBlockStart = 0;
+    validBlockEnd = 0;
 
     while (cheat_state.index < cheat->codesCount)
     {
@@ -1646,6 +1701,9 @@ static Result Cheat_MapMemoryAndApplyCheat(u32 pid, CheatDescription* const chea
         {
             Cheat_EatEvents(debugHandle);
             cheat->valid = Cheat_ApplyCheat(debugHandle, cheat);
+            // Writes failing there invalidate the cheat, as they would have when made one by one
+            if (!Cheat_FlushAccesses(debugHandle))
+                cheat->valid = 0;
 
             svcCloseHandle(debugHandle);
             svcCloseHandle(processHandle);
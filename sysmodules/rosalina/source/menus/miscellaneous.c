@@ -25,6 +25,7 @@
 */
 
 #include <3ds.h>
+#include <stdlib.h>
 #include "menus/miscellaneous.h"
 #include "input_redirection.h"
 #include "ntp.h"
@@ -73,6 +74,8 @@ Menu miscellaneousMenu = {
         { "Update time and date via NTP", METHOD, .method = &MiscellaneousMenu_UpdateTimeDateNtp },
         { "Nullify user time offset", METHOD, .method = &MiscellaneousMenu_NullifyUserTimeOffset },
         { "Dump DSP firmware", METHOD, .method = &MiscellaneousMenu_DumpDspFirm },
+        { "Show boot timeline", METHOD, .method = &MiscellaneousMenu_ShowBootTimeline },
+        { "IPC trace", METHOD, .method = &MiscellaneousMenu_IpcTrace },
         { "Save settings", METHOD, .method = &MiscellaneousMenu_SaveSettings },
         {},
     }
@@ -561,3 +564,231 @@ void MiscellaneousMenu_DumpDspFirm(void)
     }
     while(!(waitInput() & KEY_B) && !menuShouldExit);
 }
+
+void MiscellaneousMenu_ShowBootTimeline(void)
+{
+    // Keep in sync with arm9/source/bootprof.h
+    static const char *stageNames[] = {
+        "Mount", "Config", "Menu", "EmuNAND", "FIRM read", "FIRM decrypt", "FIRM check", "FIRM load", "Patch", "Launch",
+    };
+
+    s64 out;
+    u32 reachedStages;
+    svcGetSystemInfo(&out, 0x10000, 0x400);
+    reachedStages = (u32)out;
+
+    Draw_Lock();
+    Draw_ClearFramebuffer();
+    Draw_FlushFramebuffer();
+    Draw_Unlock();
+
+    do
+    {
+        Draw_Lock();
+        Draw_DrawString(10, 10, COLOR_TITLE, "Miscellaneous options menu");
+
+        u32 posY = 30;
+        u32 previousEnd = 0;
+
+        if(reachedStages == 0)
+            Draw_DrawString(10, posY, COLOR_WHITE, "No boot timeline available.");
+
+        for(u32 i = 0; i < sizeof(stageNames) / sizeof(stageNames[0]); i++)
+        {
+            if(!(reachedStages & BIT(i)))
+                continue;
+
+            svcGetSystemInfo(&out, 0x10000, 0x401 + i);
+            u32 end = (u32)out;
+
+            posY = Draw_DrawFormattedString(10, posY, COLOR_WHITE, "%-12s %8lu.%03lu ms (+%lu.%03lu ms)",
+                stageNames[i], end / 1000, end % 1000, (end - previousEnd) / 1000, (end - previousEnd) % 1000) + SPACING_Y;
+            previousEnd = end;
+        }
+
+        Draw_FlushFramebuffer();
+        Draw_Unlock();
+    }
+    while(!(waitInput() & KEY_B) && !menuShouldExit);
+}
+
+typedef struct IpcTraceSummary
+{
+    char name[9];
+    u32 count;
+    u64 totalTicks;
+    u32 histogram[4]; // < 100 us, < 1 ms, < 10 ms, >= 10 ms
+} IpcTraceSummary;
+
+static IpcTraceEvent ipcTraceEvents[IPC_TRACE_MAX_EVENTS];
+
+static inline u32 ipcTraceTicksToUs(u64 ticks)
+{
+    return (u32)(1000000 * ticks / SYSCLOCK_ARM11);
+}
+
+static int MiscellaneousMenu_CompareIpcTraceEvents(const void *a, const void *b)
+{
+    const IpcTraceEvent *eventA = (const IpcTraceEvent *)a, *eventB = (const IpcTraceEvent *)b;
+
+    if(eventA->sendTick != eventB->sendTick)
+        return eventA->sendTick < eventB->sendTick ? -1 : 1;
+    else
+        return eventA->seq < eventB->seq ? -1 : eventA->seq > eventB->seq;
+}
+
+static u32 MiscellaneousMenu_FetchIpcTrace(void)
+{
+    u32 nbEvents = 0;
+
+    if(R_FAILED(svcKernelSetState(0x10009, (u32)ipcTraceEvents, IPC_TRACE_MAX_EVENTS, (u32)&nbEvents)))
+        return 0;
+
+    // The kernel returns each core's ring in reply order, one core after the other: interleave them by send tick
+    qsort(ipcTraceEvents, nbEvents, sizeof(IpcTraceEvent), MiscellaneousMenu_CompareIpcTraceEvents);
+    return nbEvents;
+}
+
+static u32 MiscellaneousMenu_SummarizeIpcTrace(IpcTraceSummary *summaries, u32 maxSummaries, u32 nbEvents)
+{
+    u32 nbSummaries = 0;
+
+    memset(summaries, 0, maxSummaries * sizeof(IpcTraceSummary));
+    for(u32 i = 0; i < nbEvents; i++)
+    {
+        const IpcTraceEvent *event = &ipcTraceEvents[i];
+        u32 id;
+
+        for(id = 0; id < nbSummaries && strncmp(summaries[id].name, event->name, 8) != 0; id++);
+        if(id == nbSummaries)
+        {
+            // Services that don't fit are accounted in the last entry
+            if(nbSummaries == maxSummaries)
+                id = maxSummaries - 1;
+            else
+                memcpy(summaries[nbSummaries++].name, event->name, 8);
+        }
+
+        u32 us = ipcTraceTicksToUs(event->duration);
+        summaries[id].count++;
+        summaries[id].totalTicks += event->duration;
+        summaries[id].histogram[us < 100 ? 0 : us < 1000 ? 1 : us < 10000 ? 2 : 3]++;
+    }
+
+    // Most used services first
+    for(u32 i = 1; i < nbSummaries; i++)
+    {
+        IpcTraceSummary tmp = summaries[i];
+        u32 j;
+        for(j = i; j > 0 && summaries[j - 1].count < tmp.count; j--)
+            summaries[j] = summaries[j - 1];
+        summaries[j] = tmp;
+    }
+
+    return nbSummaries;
+}
+
+static Result MiscellaneousMenu_DumpIpcTrace(u32 nbEvents)
+{
+    IFile file;
+    Result res;
+    u64 total;
+    char buf[0x400];
+    u32 len;
+
+    res = IFile_Open(
+        &file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""),
+        fsMakePath(PATH_ASCII, "/luma/ipctrace.txt"), FS_OPEN_CREATE | FS_OPEN_WRITE
+    );
+    if(R_FAILED(res))
+        return res;
+
+    len = sprintf(buf, "# send tick, pid, service, command header, duration (us)\n");
+    for(u32 i = 0; i < nbEvents && R_SUCCEEDED(res); i++)
+    {
+        const IpcTraceEvent *event = &ipcTraceEvents[i];
+        char name[9] = { 0 };
+
+        memcpy(name, event->name, 8);
+        len += sprintf(buf + len, "%llu %lu %-8s 0x%08lx %lu\n",
+            event->sendTick, event->pid, name[0] != 0 ? name : "?", event->cmdHeader, ipcTraceTicksToUs(event->duration));
+
+        if(len >= sizeof(buf) - 0x40)
+        {
+            res = IFile_Write(&file, &total, buf, len, 0);
+            len = 0;
+        }
+    }
+
+    if(R_SUCCEEDED(res) && len != 0)
+        res = IFile_Write(&file, &total, buf, len, 0);
+    if(R_SUCCEEDED(res))
+        res = IFile_SetSize(&file, file.pos); // truncate accordingly
+
+    IFile_Close(&file);
+    return res;
+}
+
+void MiscellaneousMenu_IpcTrace(void)
+{
+    IpcTraceSummary summaries[12];
+    Result dumpRes = 0;
+    bool dumped = false;
+    u32 pressed = 0;
+    s64 out;
+
+    Draw_Lock();
+    Draw_ClearFramebuffer();
+    Draw_FlushFramebuffer();
+    Draw_Unlock();
+
+    do
+    {
+        if(pressed & KEY_A)
+        {
+            svcGetSystemInfo(&out, 0x10000, 0x500);
+            svcKernelSetState(0x10008, out == 0);
+            dumped = false;
+        }
+
+        svcGetSystemInfo(&out, 0x10000, 0x500);
+        bool enabled = out != 0;
+        u32 nbEvents = MiscellaneousMenu_FetchIpcTrace();
+        u32 nbSummaries = MiscellaneousMenu_SummarizeIpcTrace(summaries, sizeof(summaries) / sizeof(summaries[0]), nbEvents);
+
+        if(pressed & KEY_X)
+        {
+            dumpRes = MiscellaneousMenu_DumpIpcTrace(nbEvents);
+            dumped = true;
+        }
+
+        Draw_Lock();
+        Draw_ClearFramebuffer();
+        Draw_DrawString(10, 10, COLOR_TITLE, "Miscellaneous options menu");
+
+        u32 posY = Draw_DrawFormattedString(10, 30, COLOR_WHITE, "IPC tracing is %s (%lu events).", enabled ? "enabled" : "disabled", nbEvents);
+        posY = Draw_DrawString(10, posY + SPACING_Y, COLOR_WHITE, "A: toggle, X: dump to /luma/ipctrace.txt, B: back") + SPACING_Y;
+        if(dumped)
+        {
+            if(R_SUCCEEDED(dumpRes))
+                posY = Draw_DrawString(10, posY, COLOR_GREEN, "Trace written to the SD card.") + SPACING_Y;
+            else
+                posY = Draw_DrawFormattedString(10, posY, COLOR_RED, "Failed to write the trace (0x%08lx).", dumpRes) + SPACING_Y;
+        }
+
+        posY = Draw_DrawString(10, posY + SPACING_Y, COLOR_TITLE, "Service  Count  Avg us  <0.1ms  <1ms <10ms >10ms") + SPACING_Y;
+        for(u32 i = 0; i < nbSummaries; i++)
+        {
+            const IpcTraceSummary *s = &summaries[i];
+            posY = Draw_DrawFormattedString(10, posY, COLOR_WHITE, "%-8s %5lu %7lu %7lu %5lu %5lu %5lu",
+                s->name[0] != 0 ? s->name : "?", s->count, ipcTraceTicksToUs(s->totalTicks / s->count),
+                s->histogram[0], s->histogram[1], s->histogram[2], s->histogram[3]) + SPACING_Y;
+        }
+
+        Draw_FlushFramebuffer();
+        Draw_Unlock();
+
+        pressed = waitInputWithTimeout(1000);
+    }
+    while(!(pressed & KEY_B) && !menuShouldExit);
+}
@@ -233,11 +233,17 @@ static void ProcessListMenu_MemoryViewer(const ProcessInfo *info)
         svcQueryProcessMemory(&mem, &out, processHandle, heapStartAddress);
         heapTotalSize = mem.size;
 
-        Result codeRes = svcMapProcessMemoryEx(CUR_PROCESS_HANDLE, codeDestAddress, processHandle, codeStartAddress, codeTotalSize);
-        Result heapRes = svcMapProcessMemoryEx(CUR_PROCESS_HANDLE, heapDestAddress, processHandle, heapStartAddress, heapTotalSize);
+        // Either may fail on its own, e.g. when the process has no heap
+        ProcessMemoryMapping mappings[2] =
+        {
+            { processHandle, codeStartAddress, codeDestAddress, codeTotalSize, -1 },
+            { processHandle, heapStartAddress, heapDestAddress, heapTotalSize, -1 },
+        };
+
+        Result mapRes = svcMapProcessMemoryBatch(CUR_PROCESS_HANDLE, mappings, 2, false);
 
-        bool codeAvailable = R_SUCCEEDED(codeRes);
-        bool heapAvailable = R_SUCCEEDED(heapRes);
+        bool codeAvailable = R_SUCCEEDED(mapRes) || R_SUCCEEDED(mappings[0].result);
+        bool heapAvailable = R_SUCCEEDED(mapRes) || R_SUCCEEDED(mappings[1].result);
 
         if(codeAvailable || heapAvailable)
         {
@@ -574,15 +580,133 @@ static void ProcessListMenu_MemoryViewer(const ProcessInfo *info)
             clearMenu();
         }
 
-        if(codeAvailable)
+        if(codeAvailable && heapAvailable)
+            svcMapProcessMemoryBatch(CUR_PROCESS_HANDLE, mappings, 2, true);
+        else if(codeAvailable)
             svcUnmapProcessMemoryEx(CUR_PROCESS_HANDLE, codeDestAddress, codeTotalSize);
-        if(heapAvailable)
+        else if(heapAvailable)
             svcUnmapProcessMemoryEx(CUR_PROCESS_HANDLE, heapDestAddress, heapTotalSize);
 
         svcCloseHandle(processHandle);
     }
 }
 
+static void ProcessListMenu_SvcStats(const ProcessInfo *info)
+{
+    Handle processHandle;
+    Result res = svcOpenProcess(&processHandle, info->pid);
+    if(R_FAILED(res))
+        return;
+
+    s64 out = 0;
+    svcGetProcessInfo(&out, processHandle, 0x10010);
+    bool enabled = out != 0;
+    bool cpuTimeEnabled = R_SUCCEEDED(svcGetProcessInfo(&out, processHandle, 0x10020));
+    u32 pressed = 0;
+
+    Draw_Lock();
+    Draw_ClearFramebuffer();
+    Draw_FlushFramebuffer();
+    Draw_Unlock();
+
+    do
+    {
+        if(pressed & KEY_A)
+        {
+            res = svcKernelSetState(0x1000A, info->pid, !enabled);
+            if(R_SUCCEEDED(res))
+                enabled = !enabled;
+        }
+        else if(pressed & KEY_Y)
+        {
+            // System-wide, unlike the SVC statistics
+            res = svcKernelSetState(0x1000B, !cpuTimeEnabled);
+            if(R_SUCCEEDED(res))
+                cpuTimeEnabled = !cpuTimeEnabled;
+        }
+
+        // Hottest SVCs first, by number of calls
+        u32 svcIds[SVC_STATS_PER_MENU_PAGE], counts[SVC_STATS_PER_MENU_PAGE];
+        u32 nbShown = 0;
+        for(u32 svcId = 0; enabled && svcId < 0x80; svcId++)
+        {
+            svcGetProcessInfo(&out, processHandle, 0x10100 + svcId);
+            u32 count = (u32)out, pos;
+            if(count == 0)
+                continue;
+
+            for(pos = nbShown; pos > 0 && counts[pos - 1] < count; pos--)
+            {
+                if(pos < SVC_STATS_PER_MENU_PAGE)
+                {
+                    svcIds[pos] = svcIds[pos - 1];
+                    counts[pos] = counts[pos - 1];
+                }
+            }
+
+            if(pos < SVC_STATS_PER_MENU_PAGE)
+            {
+                svcIds[pos] = svcId;
+                counts[pos] = count;
+                if(nbShown < SVC_STATS_PER_MENU_PAGE)
+                    nbShown++;
+            }
+        }
+
+        Draw_Lock();
+        Draw_ClearFramebuffer();
+        Draw_DrawFormattedString(10, 10, COLOR_TITLE, "SVC statistics: %.8s (pid %lu)", info->name, info->pid);
+
+        u32 posY = Draw_DrawString(10, 30, COLOR_WHITE, enabled ? "Collection is enabled. A: disable, B: back." : "Collection is disabled. A: enable, B: back.");
+        if(R_FAILED(res))
+            posY = Draw_DrawFormattedString(10, posY + SPACING_Y, COLOR_RED, "Operation failed (0x%08lx).", res);
+
+        // The kernel only sees switches at SVC boundaries: time a thread is preempted in user mode isn't counted
+        s64 cpuTicks = 0;
+        if(cpuTimeEnabled && R_SUCCEEDED(svcGetProcessInfo(&cpuTicks, processHandle, 0x10020)))
+        {
+            posY = Draw_DrawFormattedString(10, posY + SPACING_Y, COLOR_WHITE, "CPU time (approx.): %lu ms. Y: stop.", (u32)(1000 * (u64)cpuTicks / SYSCLOCK_ARM11));
+            posY = Draw_DrawString(10, posY + SPACING_Y, COLOR_WHITE, "Lower bound: time preempted outside SVCs is lost.");
+        }
+        else
+            posY = Draw_DrawString(10, posY + SPACING_Y, COLOR_WHITE, "CPU time accounting is disabled. Y: enable.");
+
+        posY = Draw_DrawString(10, posY + 2 * SPACING_Y, COLOR_TITLE, "SVC     Calls  Total ms  <15us <250us  <4ms  >4ms") + SPACING_Y;
+        for(u32 i = 0; i < nbShown; i++)
+        {
+            s64 totalTicks, lowBuckets, highBuckets;
+            svcGetProcessInfo(&totalTicks, processHandle, 0x10180 + svcIds[i]);
+            svcGetProcessInfo(&lowBuckets, processHandle, 0x10200 + svcIds[i]);
+            svcGetProcessInfo(&highBuckets, processHandle, 0x10280 + svcIds[i]);
+
+            // Each of the 8 kernel buckets is 4 times as wide as the previous one, show them in pairs
+            u32 buckets[4];
+            for(u32 j = 0; j < 2; j++)
+            {
+                buckets[j] = (u16)(lowBuckets >> (32 * j)) + (u16)(lowBuckets >> (32 * j + 16));
+                buckets[2 + j] = (u16)(highBuckets >> (32 * j)) + (u16)(highBuckets >> (32 * j + 16));
+            }
+
+            posY = Draw_DrawFormattedString(10, posY, COLOR_WHITE, "0x%02lX %8lu %9lu %6lu %6lu %5lu %5lu",
+                svcIds[i], counts[i], (u32)(1000 * (u64)totalTicks / SYSCLOCK_ARM11),
+                buckets[0], buckets[1], buckets[2], buckets[3]) + SPACING_Y;
+        }
+
+        Draw_FlushFramebuffer();
+        Draw_Unlock();
+
+        pressed = waitInputWithTimeout(1000);
+    }
+    while(!(pressed & KEY_B) && !menuShouldExit);
+
+    Draw_Lock();
+    Draw_ClearFramebuffer();
+    Draw_FlushFramebuffer();
+    Draw_Unlock();
+
+    svcCloseHandle(processHandle);
+}
+
 static inline void ProcessListMenu_HandleSelected(const ProcessInfo *info)
 {
     if(!gdbServer.super.running || info->isZombie)
@@ -705,6 +829,8 @@ void RosalinaMenu_ProcessList(void)
             break;
         else if(pressed & KEY_A)
             ProcessListMenu_HandleSelected(&infos[selected]);
+        else if(pressed & KEY_Y)
+            ProcessListMenu_SvcStats(&infos[selected]);
         else if(pressed & KEY_DOWN)
             selected++;
         else if(pressed & KEY_UP)
@@ -206,6 +206,7 @@ Result     MemoryBlock__MountInProcess(void)
     {
         error->message = "Couldn't map heap memory block";
         error->code = res;
+        svcUnmapProcessMemoryEx(target, 0x07000000, header->exeSize);
     }
 
     return res;
@@ -216,12 +217,13 @@ Result     MemoryBlock__UnmountFromProcess(void)
     Handle          target = PluginLoaderCtx.target;
     PluginHeader    *header = &PluginLoaderCtx.header;
 
-    Result  res = 0;
-
-    res = svcUnmapProcessMemoryEx(target, 0x07000000, header->exeSize);
-    res |= svcUnmapProcessMemoryEx(target, header->heapVA, header->heapSize);
+    ProcessMemoryMapping mappings[2] =
+    {
+        { 0, 0, 0x07000000, header->exeSize, 0 },
+        { 0, 0, header->heapVA, header->heapSize, 0 },
+    };
 
-    return res;
+    return svcMapProcessMemoryBatch(target, mappings, 2, true);
 }
 
 Result    MemoryBlock__SetSwapSettings(u32* func, bool isDec, u32* params)
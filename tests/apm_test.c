@@ -0,0 +1,271 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Checks k11_extension/source/svc/AccessProcessMemory.c against a simulated debugged process: descriptor
+*   validation, page splitting, partial transfers, and descriptor lists longer than what's copied at once
+*/
+
+#include <sys/mman.h>
+
+#include "test.h"
+
+//Included rather than linked, to get at the helpers the SVC uses
+#include "svc/AccessProcessMemory.c"
+
+//The debugged process: TARGET_NB_PAGES pages from TARGET_ADDR, some of them unmapped
+#define TARGET_ADDR         0x00100000
+#define TARGET_NB_PAGES     16
+#define TARGET_DEBUG        0x1234
+
+static u8 targetMemory[TARGET_NB_PAGES * 0x1000];
+static bool targetMapped[TARGET_NB_PAGES];
+
+//The caller's buffers, at a fixed address so that they look like userland ones to the range checks
+#define CALLER_ADDR         0x30000000
+#define CALLER_SIZE         0x10000
+
+static u8 *callerMemory;
+static u32 nbReads, nbWrites, nbCopiesIn, nbCopiesOut;
+
+static bool isCallerRange(const void *p, u32 len)
+{
+    return (const u8 *)p >= callerMemory && (const u8 *)p + len <= callerMemory + CALLER_SIZE;
+}
+
+//As svcReadProcessMemory and svcWriteProcessMemory, but they also check that the SVC never crosses a page
+static Result hostAccessTarget(void *dst, const void *src, Handle debug, u32 addr, u32 size, bool write)
+{
+    CHECK(debug == TARGET_DEBUG);
+    CHECK(size != 0 && (addr & ~0xFFF) == ((addr + size - 1) & ~0xFFF));
+
+    u32 page = (addr - TARGET_ADDR) / 0x1000;
+    if(addr < TARGET_ADDR || page >= TARGET_NB_PAGES || !targetMapped[page])
+        return 0xE0E01BF5;
+
+    u8 *target = targetMemory + (addr - TARGET_ADDR);
+    if(write) memcpy(target, src, size);
+    else memcpy(dst, target, size);
+
+    return 0;
+}
+
+static Result hostReadProcessMemory(void *buffer, Handle debug, u32 addr, u32 size)
+{
+    nbReads++;
+    return hostAccessTarget(buffer, NULL, debug, addr, size, false);
+}
+
+static Result hostWriteProcessMemory(Handle debug, const void *buffer, u32 addr, u32 size)
+{
+    nbWrites++;
+    return hostAccessTarget(NULL, buffer, debug, addr, size, true);
+}
+
+static bool hostUsrToKernelMemcpy8(void *dst, const void *src, u32 len)
+{
+    nbCopiesIn++;
+    if(!isCallerRange(src, len)) return false;
+    memcpy(dst, src, len);
+    return true;
+}
+
+static bool hostKernelToUsrMemcpy8(void *dst, const void *src, u32 len)
+{
+    nbCopiesOut++;
+    if(!isCallerRange(dst, len)) return false;
+    memcpy(dst, src, len);
+    return true;
+}
+
+Result (*ReadProcessMemory)(void *buffer, Handle debug, u32 addr, u32 size) = hostReadProcessMemory;
+Result (*WriteProcessMemory)(Handle debug, const void *buffer, u32 addr, u32 size) = hostWriteProcessMemory;
+bool (*usrToKernelMemcpy8)(void *dst, const void *src, u32 len) = hostUsrToKernelMemcpy8;
+bool (*kernelToUsrMemcpy8)(void *dst, const void *src, u32 len) = hostKernelToUsrMemcpy8;
+
+static void resetTarget(void)
+{
+    testFillRandom(targetMemory, sizeof(targetMemory), 256);
+    for(u32 i = 0; i < TARGET_NB_PAGES; i++)
+        targetMapped[i] = true;
+
+    memset(callerMemory, 0, CALLER_SIZE);
+    nbReads = nbWrites = nbCopiesIn = nbCopiesOut = 0;
+}
+
+static ProcessMemoryAccess makeAccess(u32 address, u32 size, ProcessMemoryAccessType type, void *buffer)
+{
+    return (ProcessMemoryAccess){ address, size, type, buffer, 0x12345678, 0x12345678 };
+}
+
+static void testValidation(void)
+{
+    ProcessMemoryAccess access = makeAccess(TARGET_ADDR, 0x10, PROCESSMEMACCESS_READ, callerMemory);
+
+    CHECK(validateProcessMemoryAccess(&access) == 0);
+
+    access.type = 2;
+    CHECK(validateProcessMemoryAccess(&access) == (Result)0xD8E007ED);
+
+    //Neither range may wrap around, an empty one never does
+    access = makeAccess(0xFFFFFFF0, 0x10, PROCESSMEMACCESS_WRITE, callerMemory);
+    CHECK(validateProcessMemoryAccess(&access) == 0);
+    access.size = 0x11;
+    CHECK(validateProcessMemoryAccess(&access) == (Result)0xE0E01BFD);
+    access.size = 0;
+    CHECK(validateProcessMemoryAccess(&access) == 0);
+
+    access = makeAccess(TARGET_ADDR, 0x20, PROCESSMEMACCESS_READ, (void *)(uintptr_t)0xFFFFFFF0);
+    CHECK(validateProcessMemoryAccess(&access) == (Result)0xE0E01BFD);
+    access.size = 0x10;
+    CHECK(validateProcessMemoryAccess(&access) == 0);
+}
+
+static void testChunkSize(void)
+{
+    static const struct { u32 address, remaining, size; } cases[] = {
+        { 0x1000, 0x10, 0x10 }, { 0x1000, 0x1000, 0x1000 }, { 0x1000, 0x1001, 0x1000 }, { 0x1FFF, 0x10, 1 },
+        { 0x1FF0, 0x10, 0x10 }, { 0x1FF0, 0x11, 0x10 }, { 0x1234, 0x5000, 0xDCC }, { 0xFFFFF000, 0x2000, 0x1000 },
+    };
+
+    for(u32 i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        CHECK(getProcessMemoryAccessChunkSize(cases[i].address, cases[i].remaining) == cases[i].size);
+
+    //Random splits always tile the range, one page at most at a time
+    for(u32 i = 0; i < 10000; i++)
+    {
+        u32 address = testRand(), size = testRand() % 0x4000 + 1, done = 0, nbChunks = 0;
+
+        while(done < size)
+        {
+            u32 chunk = getProcessMemoryAccessChunkSize(address + done, size - done);
+            CHECK(chunk != 0 && chunk <= size - done);
+            CHECK(((address + done) & ~0xFFF) == ((address + done + chunk - 1) & ~0xFFF));
+            done += chunk;
+            nbChunks++;
+        }
+
+        CHECK(nbChunks == ((address + size - 1) >> 12) - (address >> 12) + 1);
+    }
+}
+
+static void testAccesses(void)
+{
+    resetTarget();
+
+    ProcessMemoryAccess *accesses = (ProcessMemoryAccess *)callerMemory;
+    u8 *buffers = callerMemory + 0x1000;
+
+    //A write then a read of the same bytes, across a page boundary, and a read within a page
+    testFillRandom(buffers, 0x200, 256);
+    accesses[0] = makeAccess(TARGET_ADDR + 0x1F80, 0x100, PROCESSMEMACCESS_WRITE, buffers);
+    accesses[1] = makeAccess(TARGET_ADDR + 0x1F80, 0x100, PROCESSMEMACCESS_READ, buffers + 0x1000);
+    accesses[2] = makeAccess(TARGET_ADDR + 0x3010, 0x20, PROCESSMEMACCESS_READ, buffers + 0x2000);
+
+    CHECK(AccessProcessMemory(TARGET_DEBUG, accesses, 3) == 0);
+    CHECK(memcmp(targetMemory + 0x1F80, buffers, 0x100) == 0);
+    CHECK(memcmp(buffers + 0x1000, buffers, 0x100) == 0);
+    CHECK(memcmp(buffers + 0x2000, targetMemory + 0x3010, 0x20) == 0);
+    for(u32 i = 0; i < 3; i++)
+        CHECK(accesses[i].result == 0 && accesses[i].transferred == accesses[i].size);
+    CHECK(nbWrites == 2 && nbReads == 3);
+    CHECK(nbCopiesIn == 1 && nbCopiesOut == 1);
+
+    //An unmapped page stops its access there, the others still go through, the first failure is returned
+    resetTarget();
+    targetMapped[5] = false;
+    accesses[0] = makeAccess(TARGET_ADDR + 0x3800, 0x3000, PROCESSMEMACCESS_READ, buffers);
+    accesses[1] = makeAccess(TARGET_ADDR + 0x5100, 0x10, PROCESSMEMACCESS_WRITE, buffers);
+    accesses[2] = makeAccess(TARGET_ADDR + 0x6000, 0x10, PROCESSMEMACCESS_READ, buffers + 0x4000);
+    accesses[3] = makeAccess(TARGET_ADDR, 0x10, 7, buffers);
+
+    CHECK(AccessProcessMemory(TARGET_DEBUG, accesses, 4) == (Result)0xE0E01BF5);
+    CHECK(accesses[0].result == (Result)0xE0E01BF5 && accesses[0].transferred == 0x1800);
+    CHECK(memcmp(buffers, targetMemory + 0x3800, 0x1800) == 0);
+    CHECK(accesses[1].result == (Result)0xE0E01BF5 && accesses[1].transferred == 0);
+    CHECK(accesses[2].result == 0 && accesses[2].transferred == 0x10);
+    CHECK(memcmp(buffers + 0x4000, targetMemory + 0x6000, 0x10) == 0);
+    CHECK(accesses[3].result == (Result)0xD8E007ED && accesses[3].transferred == 0);
+
+    //Empty accesses succeed without any SVC
+    resetTarget();
+    accesses[0] = makeAccess(TARGET_ADDR + 0xFFFFF, 0, PROCESSMEMACCESS_READ, buffers);
+    CHECK(AccessProcessMemory(TARGET_DEBUG, accesses, 1) == 0);
+    CHECK(accesses[0].result == 0 && accesses[0].transferred == 0 && nbReads == 0);
+    CHECK(AccessProcessMemory(TARGET_DEBUG, accesses, 0) == 0 && nbCopiesIn == 1);
+}
+
+//The descriptors are copied in and out eight at a time
+static void testLongLists(void)
+{
+    ProcessMemoryAccess *accesses = (ProcessMemoryAccess *)callerMemory;
+    u32 *values = (u32 *)(callerMemory + MAX_PROCESS_MEMORY_ACCESSES * sizeof(ProcessMemoryAccess));
+
+    for(u32 count = 1; count <= MAX_PROCESS_MEMORY_ACCESSES; count += 1 + count / 4)
+    {
+        resetTarget();
+
+        for(u32 i = 0; i < count; i++)
+            accesses[i] = makeAccess(TARGET_ADDR + 4 * i, 4, PROCESSMEMACCESS_READ, &values[i]);
+
+        CHECK(AccessProcessMemory(TARGET_DEBUG, accesses, count) == 0);
+        CHECK(memcmp(values, targetMemory, 4 * count) == 0);
+        CHECK(nbReads == count);
+        CHECK(nbCopiesIn == (count + 7) / 8 && nbCopiesOut == nbCopiesIn);
+        for(u32 i = 0; i < count; i++)
+            CHECK(accesses[i].result == 0 && accesses[i].transferred == 4);
+    }
+
+    resetTarget();
+    CHECK(AccessProcessMemory(TARGET_DEBUG, accesses, MAX_PROCESS_MEMORY_ACCESSES + 1) == (Result)0xE0E01BFD);
+    CHECK(nbCopiesIn == 0 && nbReads == 0);
+
+    //A descriptor list running off the caller's memory faults once the accesses before it are done
+    ProcessMemoryAccess *last = (ProcessMemoryAccess *)(callerMemory + CALLER_SIZE) - 10;
+    for(u32 i = 0; i < 10; i++)
+        last[i] = makeAccess(TARGET_ADDR + 4 * i, 4, PROCESSMEMACCESS_READ, &values[i]);
+
+    CHECK(AccessProcessMemory(TARGET_DEBUG, last, 16) == (Result)0xE0E01BF5);
+    CHECK(nbReads == 8);
+    CHECK(last[7].result == 0 && last[7].transferred == 4 && last[8].result == 0x12345678);
+}
+
+int main(void)
+{
+    callerMemory = mmap((void *)CALLER_ADDR, CALLER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(callerMemory != (u8 *)CALLER_ADDR)
+    {
+        fprintf(stderr, "apm: couldn't map the caller's memory\n");
+        return 1;
+    }
+
+    testValidation();
+    testChunkSize();
+    testAccesses();
+    testLongLists();
+
+    return testResult("apm");
+}
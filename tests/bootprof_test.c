@@ -0,0 +1,179 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Drives arm9/source/bootprof.c with a fake clock and a fake SD
+*/
+
+#include "test.h"
+#include "bootprof.h"
+#include "config.h"
+#include "utils.h"
+
+//What bootprof.c uses from the rest of arm9
+CfgData configData;
+bool isSdMode;
+
+static u64 fakeTicks;
+
+void startChrono(void)
+{
+}
+
+u64 chronoTicks(void)
+{
+    return fakeTicks;
+}
+
+static struct
+{
+    u32 count;
+    char path[32];
+    char data[0x1800];
+    u32 size;
+} written;
+
+bool fileWrite(const void *buffer, const char *path, u32 size)
+{
+    written.count++;
+    snprintf(written.path, sizeof(written.path), "%s", path);
+    CHECK(size <= sizeof(written.data));
+    written.size = size < sizeof(written.data) ? size : sizeof(written.data);
+    memcpy(written.data, buffer, written.size);
+    return true;
+}
+
+u32 formatSignatureOffsets(char *out, u32 size)
+{
+    static const char line[] = "signature 0: 0x00001234\n";
+    CHECK(size >= sizeof(line));
+    memcpy(out, line, sizeof(line) - 1);
+    return sizeof(line) - 1;
+}
+
+//A quarter of a second is a whole number of ticks and of microseconds
+#define QUARTER_SECOND (TICKS_PER_SEC / 4)
+
+static void testTimeline(void)
+{
+    BootTimeline handoff;
+    memset(&handoff, 0xFF, sizeof(handoff));
+
+    isSdMode = true;
+    configData.config = 1 << WRITEBOOTTIMELOG;
+
+    fakeTicks = 12345;
+    bootProfStart();
+    bootProfSetHandoff(&handoff);
+
+    fakeTicks += QUARTER_SECOND;
+    bootProfMark(BOOTSTAGE_MOUNT);
+    fakeTicks += QUARTER_SECOND;
+    bootProfMark(BOOTSTAGE_CONFIG);
+    //No menu, EmuNAND or FIRM read: those stages don't show up
+    fakeTicks += 4 * QUARTER_SECOND;
+    bootProfMark(BOOTSTAGE_FIRM_CHECK);
+
+    bootProfPatchBegin();
+    fakeTicks += QUARTER_SECOND;
+    CHECK(bootProfPatchEnd("patchSignatureChecks", 0) == 0);
+    bootProfPatchBegin();
+    CHECK(bootProfPatchEnd("patchFirmlaunches", 2) == 2);
+
+    bootProfMark(BOOTSTAGE_PATCH);
+    fakeTicks += QUARTER_SECOND;
+    bootProfFinish();
+
+    CHECK(handoff.reachedStages == (1 << BOOTSTAGE_MOUNT | 1 << BOOTSTAGE_CONFIG | 1 << BOOTSTAGE_FIRM_CHECK |
+                                    1 << BOOTSTAGE_PATCH | 1 << BOOTSTAGE_LAUNCH));
+    CHECK(handoff.stageEnd[BOOTSTAGE_MOUNT] == 250000);
+    CHECK(handoff.stageEnd[BOOTSTAGE_CONFIG] == 500000);
+    CHECK(handoff.stageEnd[BOOTSTAGE_FIRM_CHECK] == 1500000);
+    CHECK(handoff.stageEnd[BOOTSTAGE_PATCH] == 1750000);
+    CHECK(handoff.stageEnd[BOOTSTAGE_LAUNCH] == 2000000);
+
+    static const char expected[] =
+        "mount: 250000 us (+250000)\n"
+        "config: 500000 us (+250000)\n"
+        "firm check: 1500000 us (+1000000)\n"
+        "patch: 1750000 us (+250000)\n"
+        "launch: 2000000 us (+250000)\n"
+        "patchSignatureChecks: 0 failed, 250000 us\n"
+        "patchFirmlaunches: 2 failed, 0 us\n"
+        "signature 0: 0x00001234\n";
+
+    CHECK(written.count == 1);
+    CHECK(strcmp(written.path, BOOT_TIMELINE_FILE) == 0);
+    CHECK(written.size == sizeof(expected) - 1 && memcmp(written.data, expected, written.size) == 0);
+}
+
+static void testLogIsOptIn(void)
+{
+    BootTimeline handoff;
+
+    //The timeline is still handed over, but nothing is written
+    for(u32 i = 0; i < 2; i++)
+    {
+        isSdMode = i == 0;
+        configData.config = i == 0 ? 0 : 1 << WRITEBOOTTIMELOG;
+        written.count = 0;
+        memset(&handoff, 0, sizeof(handoff));
+
+        bootProfStart();
+        bootProfSetHandoff(&handoff);
+        fakeTicks += QUARTER_SECOND;
+        bootProfFinish();
+
+        CHECK(written.count == 0);
+        CHECK(handoff.reachedStages & (1 << BOOTSTAGE_LAUNCH));
+    }
+}
+
+static void testFormat(void)
+{
+    BootTimeline timeline = {0};
+    char out[BOOTSTAGE_COUNT * 48];
+
+    CHECK(bootProfFormat(out, &timeline) == 0);
+
+    //Longest possible lines
+    timeline.reachedStages = (1 << BOOTSTAGE_COUNT) - 1;
+    for(u32 i = 0; i < BOOTSTAGE_COUNT; i++)
+        timeline.stageEnd[i] = 0xFFFFFFFF;
+
+    u32 size = bootProfFormat(out, &timeline);
+    CHECK(size < sizeof(out));
+    CHECK(strncmp(out, "mount: 4294967295 us (+4294967295)\n", 35) == 0);
+}
+
+int main(void)
+{
+    testTimeline();
+    testLogIsOptIn();
+    testFormat();
+
+    return testResult("bootprof");
+}
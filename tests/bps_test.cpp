@@ -0,0 +1,583 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Known-answer tests of the CRC32 of sysmodules/loader/source/bps_patcher.cpp, tests of its BPS applier
+*   against patches made by a small encoder, and a benchmark of both
+*/
+
+#include <sys/mman.h>
+#include <vector>
+
+#include "test.h"
+
+//Included rather than linked, to get at the checksum and the applier
+#include "bps_patcher.cpp"
+
+extern "C"
+{
+#include "strings.c"
+}
+
+//The patch file, read through FSFILE_Read only
+static const u8 *fileData;
+static u32 fileSize,
+           nbReads;
+static bool fileExists;
+static char openedPath[64];
+static s32 nbOpenFiles;
+static u32 nbPanics;
+
+static const Handle fileHandle = 0x1234;
+
+extern "C"
+{
+FS_Path fsMakePath(FS_PathType type, const void *path)
+{
+    return FS_Path{type, (u32)strlen((const char *)path) + 1, path};
+}
+
+Result FSUSER_OpenFileDirectly(Handle *out, FS_ArchiveID archiveId, FS_Path archivePath, FS_Path filePath, u32 openFlags, u32 attributes)
+{
+    (void)archivePath;
+    (void)attributes;
+
+    CHECK(archiveId == ARCHIVE_SDMC && filePath.type == PATH_ASCII && openFlags == FS_OPEN_READ);
+    snprintf(openedPath, sizeof(openedPath), "%s", (const char *)filePath.data);
+    if(!fileExists) return -1;
+
+    nbOpenFiles++;
+    *out = fileHandle;
+
+    return 0;
+}
+
+Result FSFILE_Read(Handle handle, u32 *bytesRead, u64 offset, void *buffer, u32 size)
+{
+    u64 left = offset < fileSize ? fileSize - offset : 0;
+    u32 n = size < left ? size : (u32)left;
+
+    CHECK(handle == fileHandle);
+    nbReads++;
+    memcpy(buffer, fileData + offset, n);
+    *bytesRead = n;
+
+    return 0;
+}
+
+Result FSFILE_GetSize(Handle handle, u64 *size)
+{
+    CHECK(handle == fileHandle);
+    *size = fileSize;
+
+    return 0;
+}
+
+Result FSFILE_Close(Handle handle)
+{
+    CHECK(handle == fileHandle);
+    nbOpenFiles--;
+
+    return 0;
+}
+
+//APPLICATION memory, mapped where the loader expects it
+s64 osGetMemRegionFree(MemRegion region)
+{
+    CHECK(region == MEMREGION_APPLICATION);
+
+    return 4 << 20;
+}
+
+Result svcControlMemory(u32 *addr_out, u32 addr0, u32 addr1, u32 size, MemOp op, MemPerm perm)
+{
+    (void)addr1;
+    (void)perm;
+
+    if(op == MEMOP_FREE)
+        return munmap((void *)(uintptr_t)addr0, size) == 0 ? 0 : -1;
+
+    void *p = mmap((void *)(uintptr_t)addr0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED) return -1;
+    if(p != (void *)(uintptr_t)addr0)
+    {
+        munmap(p, size);
+        return -1;
+    }
+
+    *addr_out = addr0;
+
+    return 0;
+}
+
+void svcBreak(UserBreakType breakReason)
+{
+    CHECK(breakReason == USERBREAK_PANIC);
+    nbPanics++;
+}
+}
+
+static u32 referenceCrc32(const u8 *data, size_t size)
+{
+    u32 crc = 0xFFFFFFFF;
+
+    for(size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for(u32 j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+    }
+
+    return ~crc;
+}
+
+static void testCrc32(void)
+{
+    static const struct
+    {
+        const char *data;
+        u32 crc;
+    } knownAnswers[] = {
+        { "", 0x00000000 },
+        { "a", 0xE8B7BE43 },
+        { "abc", 0x352441C2 },
+        { "123456789", 0xCBF43926 },
+        { "The quick brown fox jumps over the lazy dog", 0x414FA339 },
+    };
+
+    for(const auto &answer : knownAnswers)
+    {
+        CHECK(patcher::Bps::crc32((const u8 *)answer.data, strlen(answer.data)) == answer.crc);
+        CHECK(referenceCrc32((const u8 *)answer.data, strlen(answer.data)) == answer.crc);
+    }
+
+    //Every alignment, around the word loop's boundaries
+    u8 buf[0x1000 + 8];
+    testFillRandom(buf, sizeof(buf), 256);
+    for(u32 offset = 0; offset < 8; offset++)
+    {
+        for(u32 size : { 0u, 1u, 2u, 3u, 4u, 5u, 7u, 8u, 9u, 15u, 16u, 17u, 63u, 1000u, 0x1000u })
+            CHECK(patcher::Bps::crc32(buf + offset, size) == referenceCrc32(buf + offset, size));
+    }
+
+    //Updating in pieces, as the applier does with the target
+    for(u32 i = 0; i < 200; i++)
+    {
+        patcher::Bps::Crc32 crc;
+        u32 pos = 0;
+
+        while(pos < sizeof(buf))
+        {
+            u32 len = testRand() % 40;
+            if(len > sizeof(buf) - pos) len = sizeof(buf) - pos;
+            crc.Update(buf + pos, len);
+            pos += len;
+        }
+        CHECK(crc.Finish() == referenceCrc32(buf, sizeof(buf)));
+    }
+}
+
+//Encoder
+static void putNumber(std::vector<u8> &out, u32 n)
+{
+    for(;;)
+    {
+        u8 x = n & 0x7F;
+        n >>= 7;
+        if(n == 0)
+        {
+            out.push_back(0x80 | x);
+            return;
+        }
+        out.push_back(x);
+        n--;
+    }
+}
+
+static void putCommand(std::vector<u8> &out, u32 command, u32 length)
+{
+    putNumber(out, ((length - 1) << 2) | command);
+}
+
+static void putOffset(std::vector<u8> &out, s64 delta)
+{
+    putNumber(out, (u32)((delta < 0 ? -delta : delta) << 1) | (delta < 0 ? 1 : 0));
+}
+
+static void putWord(std::vector<u8> &out, u32 word)
+{
+    for(u32 i = 0; i < 4; i++)
+        out.push_back((u8)(word >> (8 * i)));
+}
+
+static std::vector<u8> makePatch(const std::vector<u8> &source, const std::vector<u8> &target, const std::vector<u8> &commands,
+                                 u32 metadataSize = 0)
+{
+    std::vector<u8> patch = { 'B', 'P', 'S', '1' };
+
+    putNumber(patch, source.size());
+    putNumber(patch, target.size());
+    putNumber(patch, metadataSize);
+    patch.insert(patch.end(), commands.begin(), commands.end());
+    putWord(patch, referenceCrc32(source.data(), source.size()));
+    putWord(patch, referenceCrc32(target.data(), target.size()));
+    putWord(patch, referenceCrc32(patch.data(), patch.size()));
+
+    return patch;
+}
+
+//Random commands of every kind, most of them short, building the target as they go
+static std::vector<u8> makeRandomPatch(const std::vector<u8> &source, std::vector<u8> &target, u32 targetSize, u32 maxLength)
+{
+    std::vector<u8> commands;
+    s64 sourceOffset = 0, targetOffset = 0;
+
+    target.clear();
+    while(target.size() < targetSize)
+    {
+        u32 length = 1 + testRand() % (testRand() % 5 != 0 ? 64 : maxLength);
+        if(length > targetSize - target.size()) length = targetSize - target.size();
+
+        switch(testRand() % 4)
+        {
+            case 0:
+                if(target.size() + length > source.size()) break;
+                putCommand(commands, 0, length);
+                target.insert(target.end(), source.begin() + target.size(), source.begin() + target.size() + length);
+                continue;
+            case 2:
+            {
+                if(length > source.size()) break;
+                u32 offset = testRand() % (source.size() - length + 1);
+                putCommand(commands, 2, length);
+                putOffset(commands, offset - sourceOffset);
+                target.insert(target.end(), source.begin() + offset, source.begin() + offset + length);
+                sourceOffset = offset + length;
+                continue;
+            }
+            case 3:
+            {
+                if(target.empty()) break;
+                //Close behind, so that the copies often overlap what they write
+                u32 offset = target.size() - 1 - testRand() % (target.size() < 300 ? target.size() : 300);
+                putCommand(commands, 3, length);
+                putOffset(commands, offset - targetOffset);
+                for(u32 i = 0; i < length; i++)
+                    target.push_back(target[offset + i]);
+                targetOffset = offset + length;
+                continue;
+            }
+            default:
+                break;
+        }
+
+        putCommand(commands, 1, length);
+        for(u32 i = 0; i < length; i++)
+        {
+            target.push_back((u8)testRand());
+            commands.push_back(target.back());
+        }
+    }
+
+    return makePatch(source, target, commands);
+}
+
+static std::vector<u8> randomBytes(u32 size)
+{
+    std::vector<u8> data(size);
+    testFillRandom(data.data(), size, 256);
+
+    return data;
+}
+
+//The code buffer starts with the source, followed by whatever was there
+static std::vector<u8> makeCode(const std::vector<u8> &source, u32 size)
+{
+    std::vector<u8> code = randomBytes(size);
+    std::copy(source.begin(), source.end(), code.begin());
+
+    return code;
+}
+
+static bool isPatched(const std::vector<u8> &code, const std::vector<u8> &target)
+{
+    for(u32 i = target.size(); i < code.size(); i++)
+        if(code[i] != 0) return false;
+
+    return std::equal(target.begin(), target.end(), code.begin());
+}
+
+//Runs the applier alone, so that the patches it rejects don't panic
+static bool applyPatch(const std::vector<u8> &patch, std::vector<u8> &code, u32 bufferSize = patcher::PatchBufferSize)
+{
+    static u8 patchBuffer[patcher::PatchBufferSize];
+    std::vector<u8> source = code;
+    util::File file;
+
+    fileData = patch.data();
+    fileSize = patch.size();
+    fileExists = true;
+    nbReads = 0;
+    CHECK(file.Open("/code.bps", FS_OPEN_READ));
+
+    patcher::Bps::Stream<const u8> sourceStream{source.data(), source.size()};
+    patcher::Bps::Stream<u8> targetStream{code.data(), code.size()};
+    patcher::Bps::PatchStream patchStream{file, patch.size(), patchBuffer, bufferSize};
+    patcher::Bps::PatchApplier applier{sourceStream, targetStream, patchStream};
+
+    return applier.Apply();
+}
+
+static void testApply(void)
+{
+    std::vector<u8> target;
+
+    //Through the loader's entry point, from the title's directory
+    for(u32 i = 0; i < 100; i++)
+    {
+        std::vector<u8> source = randomBytes(1 + testRand() % 0x4000);
+        u32 targetSize = 1 + testRand() % (source.size() + 0x100);
+        std::vector<u8> patch = makeRandomPatch(source, target, targetSize, 0x1000);
+        u32 size = std::max(source.size(), target.size()) + testRand() % 64;
+        std::vector<u8> code = makeCode(source, size);
+
+        fileData = patch.data();
+        fileSize = patch.size();
+        fileExists = true;
+        nbPanics = 0;
+        CHECK(patcherApplyCodeBpsPatch(0x0004000000123400ULL, code.data(), code.size()));
+        CHECK(nbPanics == 0 && nbOpenFiles == 0);
+        CHECK(strcmp(openedPath, "/luma/titles/0004000000123400/code.bps") == 0);
+        CHECK(isPatched(code, target));
+    }
+
+    //No code.bps: nothing to do
+    std::vector<u8> code = randomBytes(0x100), original = code;
+    fileExists = false;
+    nbPanics = 0;
+    CHECK(patcherApplyCodeBpsPatch(0x0004000000123400ULL, code.data(), code.size()));
+    CHECK(nbPanics == 0 && nbOpenFiles == 0 && code == original);
+
+    //A patch which doesn't apply panics
+    std::vector<u8> source = randomBytes(0x100);
+    std::vector<u8> patch = makeRandomPatch(source, target, 0x100, 0x40);
+    patch[patch.size() - 12] ^= 1;
+    code = makeCode(source, 0x100);
+    fileData = patch.data();
+    fileSize = patch.size();
+    fileExists = true;
+    CHECK(patcherApplyCodeBpsPatch(0x0004000000123400ULL, code.data(), code.size()));
+    CHECK(nbPanics == 1 && nbOpenFiles == 0);
+
+    //Longer patches, with reads of any size relative to the patch buffer
+    for(u32 i = 0; i < 10; i++)
+    {
+        std::vector<u8> source = randomBytes(0x40000 + testRand() % 0x40000);
+        std::vector<u8> patch = makeRandomPatch(source, target, source.size() - testRand() % 0x1000, 0x18000);
+        std::vector<u8> code = makeCode(source, source.size());
+
+        CHECK(applyPatch(patch, code, 1 + testRand() % 0x4000) && isPatched(code, target));
+    }
+
+    //Overlapping target copies repeat what was just written
+    std::vector<u8> commands, pattern = { 'a', 'b', 'c' };
+    putCommand(commands, 1, 3);
+    commands.insert(commands.end(), pattern.begin(), pattern.end());
+    putCommand(commands, 3, 8);
+    putOffset(commands, 0);
+    source = { 0 };
+    target = { 'a', 'b', 'c', 'a', 'b', 'c', 'a', 'b', 'c', 'a', 'b' };
+    code = makeCode(source, 16);
+    CHECK(applyPatch(makePatch(source, target, commands), code) && isPatched(code, target));
+}
+
+static void testRejected(void)
+{
+    std::vector<u8> source = randomBytes(0x200), target, commands;
+    std::vector<u8> patch = makeRandomPatch(source, target, 0x1F0, 0x40);
+    std::vector<u8> code;
+
+    code = makeCode(source, 0x200);
+    CHECK(applyPatch(patch, code));
+
+    //Bad magic
+    std::vector<u8> bad = patch;
+    bad[3] = '2';
+    code = makeCode(source, 0x200);
+    CHECK(!applyPatch(bad, code));
+
+    //Every truncation
+    for(u32 len = 0; len < patch.size(); len++)
+    {
+        bad.assign(patch.begin(), patch.begin() + len);
+        code = makeCode(source, 0x200);
+        CHECK(!applyPatch(bad, code));
+    }
+
+    //Source or target checksum mismatch
+    for(u32 i = 12; i > 4; i--)
+    {
+        bad = patch;
+        bad[bad.size() - i] ^= 0x80;
+        code = makeCode(source, 0x200);
+        CHECK(!applyPatch(bad, code));
+    }
+
+    //Source or target larger than the code, metadata
+    code.assign(source.begin(), source.end() - 1);
+    CHECK(!applyPatch(patch, code));
+    code = makeCode(source, 0x200);
+    CHECK(!applyPatch(makePatch(randomBytes(0x201), target, {}), code));
+    CHECK(!applyPatch(makePatch(source, randomBytes(0x201), {}), code));
+    code = makeCode(source, 0x200);
+    CHECK(!applyPatch(makePatch(source, target, {}, 1), code));
+
+    //Commands going past the end of the code, of the source, or copying from what hasn't been written yet
+    std::vector<u8> written = { 1, 2, 3, 4 };
+    commands.clear();
+    putCommand(commands, 1, 4);
+    commands.insert(commands.end(), written.begin(), written.end());
+    putCommand(commands, 3, 4);
+    putOffset(commands, 4);
+    code = makeCode(source, 0x200);
+    CHECK(!applyPatch(makePatch(source, std::vector<u8>(8), commands), code));
+
+    commands.clear();
+    putCommand(commands, 2, 0x10);
+    putOffset(commands, 0x1F8);
+    code = makeCode(source, 0x200);
+    CHECK(!applyPatch(makePatch(source, std::vector<u8>(0x10), commands), code));
+
+    commands.clear();
+    putCommand(commands, 2, 0x10);
+    putOffset(commands, -1);
+    code = makeCode(source, 0x200);
+    CHECK(!applyPatch(makePatch(source, std::vector<u8>(0x10), commands), code));
+
+    commands.clear();
+    putCommand(commands, 0, 0x201);
+    code = makeCode(source, 0x200);
+    CHECK(!applyPatch(makePatch(source, source, commands), code));
+
+    commands.clear();
+    putCommand(commands, 1, 0x201);
+    commands.resize(commands.size() + 0x201);
+    code = makeCode(source, 0x200);
+    CHECK(!applyPatch(makePatch(source, source, commands), code));
+
+    //Flipped bits are caught by the checksums, except in the patch's own which isn't checked
+    for(u32 i = 0; i < 2000; i++)
+    {
+        u32 pos = testRand() % patch.size();
+        bad = patch;
+        bad[pos] ^= 1 << (testRand() % 8);
+        code = makeCode(source, 0x200);
+        CHECK(applyPatch(bad, code) == (pos >= patch.size() - 4));
+    }
+}
+
+static void testReadCount(void)
+{
+    std::vector<u8> source = randomBytes(0x100000), target, commands;
+
+    //Small commands only, as in a typical code.bps: one read for the header, one for the footer, then one per buffer's worth of commands
+    std::vector<u8> patch = makeRandomPatch(source, target, source.size(), 64);
+    std::vector<u8> code = makeCode(source, source.size());
+
+    CHECK(patch.size() > 4 * patcher::PatchBufferSize);
+    CHECK(applyPatch(patch, code) && isPatched(code, target));
+    CHECK(nbReads <= patch.size() / patcher::PatchBufferSize + 3);
+
+    //Literals larger than the buffer are read directly, and the buffer is filled again after each of them
+    const u32 nbLiterals = 8, literalSize = 0x18000;
+    target.clear();
+    for(u32 i = 0; i < nbLiterals; i++)
+    {
+        putCommand(commands, 1, literalSize);
+        for(u32 j = 0; j < literalSize; j++)
+        {
+            target.push_back((u8)testRand());
+            commands.push_back(target.back());
+        }
+        putCommand(commands, 0, 0x10);
+        target.insert(target.end(), source.begin() + target.size(), source.begin() + target.size() + 0x10);
+    }
+    patch = makePatch(source, target, commands);
+    code = makeCode(source, source.size());
+
+    CHECK(applyPatch(patch, code) && isPatched(code, target));
+    CHECK(nbReads <= patch.size() / patcher::PatchBufferSize + 3 + 2 * nbLiterals);
+}
+
+static void benchmark(void)
+{
+    std::vector<u8> source = randomBytes(4 << 20), target;
+    std::vector<u8> patch = makeRandomPatch(source, target, source.size(), 0x1000);
+    double reference = 1e9, current = 1e9, apply = 1e9;
+    u32 crc = 0;
+
+    for(u32 i = 0; i < 10; i++)
+    {
+        double start = testNow();
+        crc ^= referenceCrc32(source.data(), source.size());
+        double t = testNow() - start;
+        if(t < reference) reference = t;
+
+        start = testNow();
+        crc ^= patcher::Bps::crc32(source.data(), source.size());
+        t = testNow() - start;
+        if(t < current) current = t;
+
+        std::vector<u8> code = source;
+        start = testNow();
+        bool ret = applyPatch(patch, code);
+        t = testNow() - start;
+        if(t < apply) apply = t;
+
+        if(!ret || !isPatched(code, target)) testFailures++;
+    }
+
+    if(crc != 0) testFailures++;
+
+    printf("bps: crc32 over %u KiB, bit-wise %.1f MiB/s, slicing-by-4 %.1f MiB/s; applying a %u KiB patch, %.1f MiB/s of target\n",
+           (u32)source.size() >> 10, source.size() / reference / (1 << 20), source.size() / current / (1 << 20),
+           (u32)patch.size() >> 10, target.size() / apply / (1 << 20));
+}
+
+int main(int argc, char **argv)
+{
+    if(testIsBench(argc, argv))
+        benchmark();
+    else
+    {
+        testCrc32();
+        testApply();
+        testRejected();
+        testReadCount();
+    }
+
+    return testResult("bps");
+}
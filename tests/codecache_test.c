@@ -0,0 +1,496 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Launches a title through the code image cache of sysmodules/loader/source/codecache.c against a mocked SD card,
+*   checking that cached and uncached launches produce the same image and that every key input invalidates it
+*/
+
+#include <3ds.h>
+
+#include "test.h"
+#include "codecache.h"
+#include "patcher.h"
+
+u32 config = 1 << PATCHGAMES, multiConfig, bootConfig;
+bool isN3DS, isSdMode = true, nextGamePatchDisabled;
+
+static s64 lumaCommitHash = 0x1234567;
+
+bool isGameOrHomeMenuTitle(u64 progId)
+{
+    return (u32)((progId >> 0x20) & 0xFFFFFFEDULL) == 0x00040000 || progId == 0x0004003000008F02LL;
+}
+
+Result svcGetSystemInfo(s64 *out, u32 type, s32 param)
+{
+    CHECK(type == 0x10000);
+    *out = param == 0 ? 0x0A0200 : lumaCommitHash;
+
+    return 0;
+}
+
+//SD card
+#define MAX_ENTRIES 16
+
+typedef struct
+{
+    char path[64];
+    bool isDir;
+    u8 *data;
+    u64 size,
+        mtime,
+        bytesRead;
+} Entry;
+
+static Entry entries[MAX_ENTRIES];
+static s32 nbOpenHandles,
+           nbOpenArchives;
+static u32 writeBudget = ~0u;
+
+static Entry *findEntry(const char *path)
+{
+    for(u32 i = 0; i < MAX_ENTRIES; i++)
+        if(entries[i].path[0] != 0 && strcmp(entries[i].path, path) == 0) return &entries[i];
+
+    return NULL;
+}
+
+static Entry *putEntry(const char *path, bool isDir)
+{
+    Entry *entry = findEntry(path);
+
+    for(u32 i = 0; entry == NULL && i < MAX_ENTRIES; i++)
+        if(entries[i].path[0] == 0) entry = &entries[i];
+
+    free(entry->data);
+    memset(entry, 0, sizeof(Entry));
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    entry->isDir = isDir;
+
+    return entry;
+}
+
+static void putFile(const char *path, u32 size, u64 mtime)
+{
+    Entry *entry = putEntry(path, false);
+
+    entry->data = malloc(size);
+    entry->size = size;
+    entry->mtime = mtime;
+    testFillRandom(entry->data, size, 256);
+}
+
+static void removeEntry(const char *path)
+{
+    Entry *entry = findEntry(path);
+
+    if(entry == NULL) return;
+    free(entry->data);
+    memset(entry, 0, sizeof(Entry));
+}
+
+FS_Path fsMakePath(FS_PathType type, const void *path)
+{
+    FS_Path ret = { type, strlen((const char *)path) + 1, path };
+
+    return ret;
+}
+
+Result FSUSER_OpenArchive(FS_Archive *archive, FS_ArchiveID id, FS_Path path)
+{
+    CHECK(id == ARCHIVE_SDMC && path.type == PATH_EMPTY);
+    *archive = 1;
+    nbOpenArchives++;
+
+    return 0;
+}
+
+Result FSUSER_CloseArchive(FS_Archive archive)
+{
+    CHECK(archive == 1);
+    nbOpenArchives--;
+
+    return 0;
+}
+
+Result FSUSER_ControlArchive(FS_Archive archive, FS_ArchiveAction action, void *input, u32 inputSize, void *output, u32 outputSize)
+{
+    const u16 *path16 = (const u16 *)input;
+    char path[64];
+    u32 i;
+
+    CHECK(archive == 1 && action == ARCHIVE_ACTION_GET_TIMESTAMP && outputSize == sizeof(u64));
+    for(i = 0; i < inputSize / 2 && i < sizeof(path); i++) path[i] = (char)path16[i];
+    CHECK(i > 0 && path[i - 1] == 0);
+
+    Entry *entry = findEntry(path);
+    if(entry == NULL || entry->isDir) return 0xC8804478;
+    memcpy(output, &entry->mtime, sizeof(u64));
+
+    return 0;
+}
+
+Result FSUSER_OpenFile(Handle *out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes)
+{
+    (void)attributes;
+
+    CHECK(archive == 1 && path.type == PATH_ASCII && openFlags == FS_OPEN_READ);
+
+    Entry *entry = findEntry((const char *)path.data);
+    if(entry == NULL || entry->isDir) return 0xC8804478;
+    *out = 1 + (entry - entries);
+    nbOpenHandles++;
+
+    return 0;
+}
+
+Result FSFILE_GetSize(Handle handle, u64 *size)
+{
+    *size = entries[handle - 1].size;
+
+    return 0;
+}
+
+Result FSFILE_Close(Handle handle)
+{
+    (void)handle;
+    nbOpenHandles--;
+
+    return 0;
+}
+
+Result FSUSER_OpenDirectory(Handle *out, FS_Archive archive, FS_Path path)
+{
+    CHECK(archive == 1 && path.type == PATH_ASCII);
+
+    Entry *entry = findEntry((const char *)path.data);
+    if(entry == NULL || !entry->isDir) return 0xC8804478;
+    *out = 1 + (entry - entries);
+    nbOpenHandles++;
+
+    return 0;
+}
+
+Result FSDIR_Close(Handle handle)
+{
+    (void)handle;
+    nbOpenHandles--;
+
+    return 0;
+}
+
+Result IFile_Open(IFile *file, FS_ArchiveID archiveId, FS_Path archivePath, FS_Path filePath, u32 flags)
+{
+    CHECK(archiveId == ARCHIVE_SDMC && archivePath.type == PATH_EMPTY && filePath.type == PATH_ASCII);
+
+    Entry *entry = findEntry((const char *)filePath.data);
+    if(entry == NULL && (flags & FS_OPEN_CREATE) != 0) entry = putEntry((const char *)filePath.data, false);
+    if(entry == NULL || entry->isDir) return 0xC8804478;
+
+    file->handle = 1 + (entry - entries);
+    file->pos = 0;
+    file->size = entry->size;
+    nbOpenHandles++;
+
+    return 0;
+}
+
+Result IFile_Close(IFile *file)
+{
+    (void)file;
+    nbOpenHandles--;
+
+    return 0;
+}
+
+Result IFile_GetSize(IFile *file, u64 *size)
+{
+    *size = entries[file->handle - 1].size;
+
+    return 0;
+}
+
+Result IFile_SetSize(IFile *file, u64 size)
+{
+    Entry *entry = &entries[file->handle - 1];
+
+    entry->data = realloc(entry->data, size);
+    if(size > entry->size) memset(entry->data + entry->size, 0, size - entry->size);
+    entry->size = size;
+
+    return 0;
+}
+
+Result IFile_Read(IFile *file, u64 *total, void *buffer, u32 len)
+{
+    Entry *entry = &entries[file->handle - 1];
+    u64 n = file->pos < entry->size ? entry->size - file->pos : 0;
+
+    if(n > len) n = len;
+    memcpy(buffer, entry->data + file->pos, n);
+    file->pos += n;
+    entry->bytesRead += n;
+    *total = n;
+
+    return 0;
+}
+
+//Runs out after writeBudget bytes, as if the card had been pulled out
+Result IFile_Write(IFile *file, u64 *total, const void *buffer, u32 len, u32 flags)
+{
+    Entry *entry = &entries[file->handle - 1];
+    u32 n = len < writeBudget ? len : writeBudget;
+
+    (void)flags;
+    if(file->pos + n > entry->size) IFile_SetSize(file, file->pos + n);
+    memcpy(entry->data + file->pos, buffer, n);
+    file->pos += n;
+    writeBudget -= n;
+    *total = n;
+
+    return n == len ? 0 : (Result)0xC86044CD;
+}
+
+//Title
+#define IMAGE_SIZE  0x40000
+
+static u64 titleId = 0x0004000000123400ULL;
+static ExHeader_CodeSetInfo csi;
+
+#define TITLE_PATH(name)    "/luma/titles/0004000000123400/" name
+
+static void readOverride(const char *path, u8 *code, u32 offset, bool add)
+{
+    IFile file;
+    u8 buf[0x100];
+    u64 total;
+
+    if(R_FAILED(IFile_Open(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, path), FS_OPEN_READ))) return;
+
+    for(u32 pos = offset; R_SUCCEEDED(IFile_Read(&file, &total, buf, sizeof(buf))) && total != 0; pos += total)
+    {
+        for(u32 i = 0; i < total; i++)
+            code[(pos + i) % IMAGE_SIZE] = add ? code[(pos + i) % IMAGE_SIZE] + buf[i] : buf[i];
+    }
+
+    IFile_Close(&file);
+}
+
+//Stands in for reading the code from the ExeFS and patchCode: what it produces depends on every input of the key
+static void coldLaunch(u8 *code)
+{
+    for(u32 i = 0; i < IMAGE_SIZE; i++)
+        code[i] = (u8)(i * 31 + csi.flags.remaster_version + (u32)titleId);
+
+    readOverride(TITLE_PATH("code.bin"), code, 0, false);
+    readOverride(TITLE_PATH("code.bps"), code, 0x1000, true);
+    readOverride(TITLE_PATH("code.ips"), code, 0x2000, true);
+
+    if(findEntry(TITLE_PATH("romfs")) != NULL) memcpy(code + 0x3000, "lf:", 3);
+
+    code[0] ^= config;
+    code[1] ^= isN3DS;
+    code[2] ^= (u8)lumaCommitHash;
+}
+
+//Same steps as loadCode
+static bool launch(u8 *code)
+{
+    CodeCacheKey key;
+    bool useCache = codeCacheInitKey(&key, titleId, &csi, IMAGE_SIZE);
+
+    if(useCache && codeCacheLoad(&key, code)) return true;
+
+    coldLaunch(code);
+
+    if(useCache) codeCacheStore(&key, code);
+
+    return false;
+}
+
+static u8 image[IMAGE_SIZE],
+          expected[IMAGE_SIZE];
+
+static u64 overrideBytesRead(void)
+{
+    u64 total = 0;
+
+    for(u32 i = 0; i < MAX_ENTRIES; i++)
+        if(strstr(entries[i].path, "code.cache") == NULL) total += entries[i].bytesRead;
+
+    return total;
+}
+
+static void resetBytesRead(void)
+{
+    for(u32 i = 0; i < MAX_ENTRIES; i++) entries[i].bytesRead = 0;
+}
+
+static bool launchMatches(bool expectHit)
+{
+    memset(image, 0xCC, sizeof(image));
+    resetBytesRead();
+
+    bool hit = launch(image);
+
+    //A hit reads nothing but the cache file: the override files and the ExeFS are left alone
+    if(hit) CHECK(overrideBytesRead() == 0);
+
+    coldLaunch(expected);
+    CHECK(nbOpenHandles == 0 && nbOpenArchives == 0);
+
+    return hit == expectHit && memcmp(image, expected, IMAGE_SIZE) == 0;
+}
+
+static void resetTitle(void)
+{
+    for(u32 i = 0; i < MAX_ENTRIES; i++) removeEntry(entries[i].path);
+
+    config = 1 << PATCHGAMES;
+    isN3DS = false;
+    isSdMode = true;
+    nextGamePatchDisabled = false;
+    lumaCommitHash = 0x1234567;
+    writeBudget = ~0u;
+    memset(&csi, 0, sizeof(csi));
+    csi.flags.remaster_version = 3;
+    csi.text.size = 0x30000;
+}
+
+static void testNotCached(void)
+{
+    //No override files
+    resetTitle();
+    CHECK(launchMatches(false));
+    CHECK(launchMatches(false));
+    CHECK(findEntry(TITLE_PATH("code.cache")) == NULL);
+
+    //Overrides, but patching is disabled, or we are in NAND mode, or the title isn't a game
+    putFile(TITLE_PATH("code.ips"), 0x200, 100);
+
+    config = 0;
+    CHECK(launchMatches(false));
+    config = 1 << PATCHGAMES;
+
+    isSdMode = false;
+    CHECK(launchMatches(false));
+    isSdMode = true;
+
+    nextGamePatchDisabled = true;
+    CHECK(launchMatches(false));
+    nextGamePatchDisabled = false;
+
+    CHECK(findEntry(TITLE_PATH("code.cache")) == NULL);
+}
+
+static void testHitsAndInvalidation(void)
+{
+    resetTitle();
+    putFile(TITLE_PATH("code.ips"), 0x200, 100);
+
+    CHECK(launchMatches(false));
+    CHECK(findEntry(TITLE_PATH("code.cache"))->size == sizeof(CodeCacheKey) + IMAGE_SIZE);
+    CHECK(launchMatches(true));
+    CHECK(launchMatches(true));
+
+    //Override files being touched, rewritten with a different size, added or removed
+    findEntry(TITLE_PATH("code.ips"))->mtime += 2;
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    putFile(TITLE_PATH("code.ips"), 0x300, findEntry(TITLE_PATH("code.ips"))->mtime);
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    putFile(TITLE_PATH("code.bps"), 0x80, 200);
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    putFile(TITLE_PATH("code.bin"), 0x20000, 300);
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    putEntry(TITLE_PATH("romfs"), true);
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    removeEntry(TITLE_PATH("code.ips"));
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    //Title update, configuration, console and Luma build
+    csi.flags.remaster_version++;
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    config |= 1 << PATCHVERSTRING;
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    isN3DS = true;
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    lumaCommitHash++;
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    //The cache doesn't survive the last override going away and coming back unchanged by chance
+    removeEntry(TITLE_PATH("code.bps"));
+    removeEntry(TITLE_PATH("code.bin"));
+    removeEntry(TITLE_PATH("romfs"));
+    CHECK(launchMatches(false));
+    putFile(TITLE_PATH("code.ips"), 0x200, 400);
+    CHECK(launchMatches(false) && launchMatches(true));
+}
+
+static void testDamagedCache(void)
+{
+    resetTitle();
+    putFile(TITLE_PATH("code.ips"), 0x200, 100);
+
+    //Interrupted in the middle of the image, then right before the key
+    const u32 budgets[] = { sizeof(CodeCacheKey) + IMAGE_SIZE / 2, sizeof(CodeCacheKey) + IMAGE_SIZE };
+
+    for(u32 i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++)
+    {
+        removeEntry(TITLE_PATH("code.cache"));
+        writeBudget = budgets[i];
+        CHECK(launchMatches(false));
+        writeBudget = ~0u;
+        CHECK(launchMatches(false) && launchMatches(true));
+    }
+
+    //Truncated, or with a different key
+    Entry *cache = findEntry(TITLE_PATH("code.cache"));
+    cache->size--;
+    CHECK(launchMatches(false) && launchMatches(true));
+
+    cache->data[8] ^= 1;
+    CHECK(launchMatches(false) && launchMatches(true));
+}
+
+int main(void)
+{
+    testNotCached();
+    testHitsAndInvalidation();
+    testDamagedCache();
+
+    resetTitle();
+
+    return testResult("codecache");
+}
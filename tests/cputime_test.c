@@ -0,0 +1,349 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Runs k11_extension/source/cpuTime.c against scripted and randomized context switches, and checks
+*   that only the time threads actually spent running in user mode is charged
+*/
+
+#include "test.h"
+
+//Included rather than linked, to get at the per-core state
+#include "cpuTime.c"
+
+__thread u32 testCoreId;
+static u64 testTick;
+
+static u64 hostGetSystemTick(void)
+{
+    return testTick;
+}
+
+static void hostLock(KRecursiveLock *lock)
+{
+    (void)lock;
+}
+
+bool isN3DS = true;
+u32 kernelVersion;
+
+static KRecursiveLock hostCriticalSectionLock;
+static KObjectList hostThreadList;
+
+KRecursiveLock *criticalSectionLock = &hostCriticalSectionLock;
+KObjectList *threadList = &hostThreadList;
+void (*KRecursiveLock__Lock)(KRecursiveLock *this) = hostLock;
+void (*KRecursiveLock__Unlock)(KRecursiveLock *this) = hostLock;
+u64 (*GetSystemTick)(void) = hostGetSystemTick;
+
+#define NB_PROCESSES    8
+#define NB_THREADS      512
+
+static KProcess processes[NB_PROCESSES];
+static KThread threads[NB_THREADS];
+static KLinkedListNode threadNodes[NB_THREADS];
+static bool threadsAlive[NB_THREADS];
+static u32 nextThreadId = 0x100;
+
+//Thread i belongs to process i % NB_PROCESSES; (re)creating it gives it a new ID, like a reused thread object
+static KThread *createThread(u32 i)
+{
+    KLinkedListNode *head = (KLinkedListNode *)&hostThreadList.list.nodes;
+
+    threads[i].threadId = nextThreadId++;
+    threads[i].ownerProcess = &processes[i % NB_PROCESSES];
+    if(!threadsAlive[i])
+    {
+        threadNodes[i].key = &threads[i];
+        threadNodes[i].prev = head->prev;
+        threadNodes[i].next = head;
+        head->prev->next = &threadNodes[i];
+        head->prev = &threadNodes[i];
+        threadsAlive[i] = true;
+    }
+
+    return &threads[i];
+}
+
+static void exitThread(u32 i)
+{
+    threadNodes[i].prev->next = threadNodes[i].next;
+    threadNodes[i].next->prev = threadNodes[i].prev;
+    threadsAlive[i] = false;
+}
+
+static void setup(void)
+{
+    KLinkedListNode *head = (KLinkedListNode *)&hostThreadList.list.nodes;
+
+    head->next = head->prev = head;
+    memset(threadsAlive, 0, sizeof(threadsAlive));
+    for(u32 i = 0; i < NB_PROCESSES; i++)
+        processes[i].N3DS.processId = 0x20 + i;
+
+    cpuTimeSetEnabled(false);
+    cpuTimeSetEnabled(true);
+}
+
+static void svcEntry(u32 core, u64 tick, KThread *thread)
+{
+    testCoreId = core;
+    testTick = tick;
+    signalCpuTimeEntry(thread);
+}
+
+static void svcReturn(u32 core, u64 tick, KThread *thread)
+{
+    testCoreId = core;
+    testTick = tick;
+    signalCpuTimeReturn(thread);
+}
+
+static s64 threadTime(KThread *thread)
+{
+    s64 out = -1;
+    CHECK(GetThreadCpuTime(&out, thread) == 0);
+    return out;
+}
+
+static s64 processTime(u32 i)
+{
+    s64 out = -1;
+    CHECK(GetProcessCpuTime(&out, &processes[i]) == 0);
+    return out;
+}
+
+static void testScriptedSwitches(void)
+{
+    setup();
+
+    KThread *a = createThread(0), *b = createThread(1), *c = createThread(8), *d = createThread(3);
+
+    //a sleeps in svcSleepThread from 100 to 10000: that isn't CPU time
+    svcReturn(0, 0, a);
+    svcEntry(0, 100, a);
+    svcReturn(0, 110, b);
+    svcEntry(0, 300, b);
+    svcReturn(0, 10000, a);
+    svcEntry(0, 10050, a);
+    CHECK(threadTime(a) == 150);
+    CHECK(threadTime(b) == 190);
+
+    //a is preempted in user mode by c, woken up by an interrupt: the switch times are unknown, so a's interval is dropped
+    svcReturn(0, 20000, a);
+    svcReturn(0, 20050, c);
+    svcEntry(0, 20080, c);
+    svcEntry(0, 20120, a);
+    CHECK(threadTime(a) == 150);
+    CHECK(threadTime(c) == 30);
+
+    //a non-blocking SVC, then a migration to core 1 in user mode
+    svcReturn(0, 30000, a);
+    svcEntry(0, 30010, a);
+    svcReturn(0, 30012, a);
+    svcEntry(1, 30100, a);
+    CHECK(threadTime(a) == 160);
+
+    //Threads of the same process on different cores
+    svcReturn(2, 40000, d);
+    svcReturn(3, 40000, c);
+    svcEntry(3, 40500, c);
+    svcEntry(2, 41000, d);
+    CHECK(threadTime(c) == 530);
+    CHECK(threadTime(d) == 1000);
+    CHECK(processTime(0) == 160 + 530);
+    CHECK(processTime(1) == 190);
+    CHECK(processTime(3) == 1000);
+    CHECK(processTime(2) == 0);
+
+    //Disabled, then enabled again: counters are reset
+    cpuTimeSetEnabled(false);
+    s64 out;
+    CHECK(GetThreadCpuTime(&out, a) == (Result)0xF8C007F4);
+    cpuTimeSetEnabled(true);
+    CHECK(threadTime(a) == 0);
+    CHECK(processTime(0) == 0);
+}
+
+//Each core runs its own threads; the reference is the time each thread really spent in user mode
+static void testRandomSchedule(bool preemption)
+{
+    static u64 userTicks[NB_THREADS];
+    u64 wallTicks = 0;
+
+    setup();
+    memset(userTicks, 0, sizeof(userTicks));
+    for(u32 i = 0; i < 64; i++)
+        createThread(i);
+
+    //Thread 16 * core + i runs on core
+    for(u32 core = 0; core < 4; core++)
+    {
+        KThread *pool = &threads[16 * core];
+        bool preempted[16] = { false };
+        s32 current = -1;
+        u64 now = 0;
+
+        for(u32 step = 0; step < 20000; step++)
+        {
+            if(current < 0 || (preemption && testRand() % 4 == 0))
+            {
+                //Another thread gets the CPU: it either returns from the SVC it was waiting in, or resumes where it was preempted
+                if(current >= 0)
+                    preempted[current] = true;
+
+                current = testRand() % 16;
+                if(preempted[current])
+                    preempted[current] = false;
+                else
+                    svcReturn(core, now, &pool[current]);
+            }
+
+            //Runs in user mode, then makes an SVC which either returns right away or blocks
+            u32 ticks = 1 + testRand() % 5000;
+            now += ticks;
+            userTicks[16 * core + current] += ticks;
+            svcEntry(core, now, &pool[current]);
+
+            now += testRand() % 100;
+            if(testRand() % 2 == 0)
+                svcReturn(core, now, &pool[current]);
+            else
+                current = -1;
+        }
+
+        wallTicks += now;
+    }
+
+    //Never more than what really ran, and all of it when threads are never preempted in user mode
+    u64 total = 0, userTotal = 0;
+    for(u32 i = 0; i < 64; i++)
+    {
+        s64 charged = threadTime(&threads[i]);
+        CHECK(charged >= 0 && (u64)charged <= userTicks[i]);
+        if(!preemption)
+            CHECK((u64)charged == userTicks[i]);
+        total += charged;
+        userTotal += userTicks[i];
+    }
+    CHECK(total <= wallTicks);
+    CHECK(total > userTotal / 2);
+
+    u64 processTotal = 0;
+    for(u32 i = 0; i < NB_PROCESSES; i++)
+        processTotal += processTime(i);
+    CHECK(processTotal == total);
+}
+
+//Dead threads are pruned once the tables fill up, and the cached slots of the live ones follow their entries
+static void testPruning(void)
+{
+    setup();
+
+    KThread *live[4];
+    for(u32 i = 0; i < 4; i++)
+        live[i] = createThread(i);
+
+    u64 tick = 0;
+    for(u32 round = 0; round < 20; round++)
+    {
+        //Short-lived threads, each charged once
+        for(u32 i = 4; i < 64; i++)
+        {
+            KThread *thread = createThread(i);
+            svcReturn(0, tick, thread);
+            svcEntry(0, tick + 1, thread);
+            tick += 2;
+            exitThread(i);
+        }
+
+        for(u32 i = 0; i < 4; i++)
+        {
+            svcReturn(0, tick, live[i]);
+            svcEntry(0, tick + 10, live[i]);
+            tick += 10;
+        }
+    }
+
+    CHECK(cpuTimeCores[0].threads.count <= 3 * CPU_TIME_NB_THREADS / 4);
+    for(u32 i = 0; i < 4; i++)
+        CHECK(threadTime(live[i]) == 20 * 10);
+
+    //Only the live threads are left once the table is pruned again
+    for(u32 i = 4; cpuTimeCores[0].threads.count < 3 * CPU_TIME_NB_THREADS / 4 - 1; i++)
+    {
+        KThread *thread = createThread(i);
+        svcReturn(0, tick, thread);
+        svcEntry(0, tick + 1, thread);
+        tick += 2;
+        exitThread(i);
+    }
+    svcEntry(0, tick, live[0]);
+    CHECK(cpuTimeCores[0].threads.count == 4);
+    for(u32 i = 0; i < 4; i++)
+        CHECK(threadTime(live[i]) == 20 * 10);
+
+    svcReturn(0, tick, live[1]);
+    svcEntry(0, tick + 7, live[1]);
+    CHECK(threadTime(live[1]) == 20 * 10 + 7);
+}
+
+static void benchEntryReturn(void)
+{
+    setup();
+
+    KThread *pool[64];
+    for(u32 i = 0; i < 64; i++)
+        pool[i] = createThread(i);
+
+    u32 nbIterations = 20000000;
+    double start = testNow();
+    for(u32 i = 0; i < nbIterations; i++)
+    {
+        KThread *thread = pool[i % 64];
+        svcReturn(0, 2 * (u64)i, thread);
+        svcEntry(0, 2 * (u64)i + 1, thread);
+    }
+    double elapsed = testNow() - start;
+
+    printf("cputime: %.1f ns per SVC return and entry pair, 64 threads\n", 1e9 * elapsed / nbIterations);
+}
+
+int main(int argc, char **argv)
+{
+    if(testIsBench(argc, argv))
+    {
+        benchEntryReturn();
+        return 0;
+    }
+
+    testScriptedSwitches();
+    testRandomSchedule(false);
+    testRandomSchedule(true);
+    testPruning();
+
+    return testResult("cputime");
+}
@@ -0,0 +1,385 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Runs FatFs over arm9/source/fatfs/diskio.c and in-memory FAT32 volumes, counting the reads that reach each
+*   medium, and which cache pool they were made for
+*/
+
+#include <sys/mman.h>
+
+#include "test.h"
+#include "fatimage.h"
+#include "fatfs/ff.h"
+
+//Included rather than linked, to get at the pools. FatFs' calls go through the wrapper below, which counts them
+#define disk_read diskioRead
+#include "fatfs/diskio.c"
+#undef disk_read
+
+static TestMedium sdCard, ctrNand;
+static u32 ffReads;
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+    ffReads++;
+    return diskioRead(pdrv, buff, sector, count);
+}
+
+//Reads that reach a medium, by the pool they fill, the last one being for reads that bypass the cache
+#define NB_POOLS (sizeof(pools) / sizeof(pools[0]))
+
+static u32 poolReads[NB_POOLS + 1];
+
+static void countPoolRead(const u8 *out)
+{
+    u32 i;
+
+    for(i = 0; i < NB_POOLS; i++)
+        if(out >= (const u8 *)pools[i].lines && out < (const u8 *)(pools[i].lines + pools[i].count)) break;
+
+    poolReads[i]++;
+}
+
+u32 sdmmc_sdcard_init(void)
+{
+    return 0;
+}
+
+int sdmmc_sdcard_readsectors(u32 sector_no, u32 numsectors, u8 *out)
+{
+    countPoolRead(out);
+    return testMediumRead(&sdCard, sector_no, numsectors, out);
+}
+
+int sdmmc_sdcard_writesectors(u32 sector_no, u32 numsectors, const u8 *in)
+{
+    return testMediumWrite(&sdCard, sector_no, numsectors, in);
+}
+
+int ctrNandInit(void)
+{
+    return 0;
+}
+
+int ctrNandRead(u32 sector, u32 sectorCount, u8 *outbuf)
+{
+    countPoolRead(outbuf);
+    return testMediumRead(&ctrNand, sector, sectorCount, outbuf);
+}
+
+int ctrNandWrite(u32 sector, u32 sectorCount, const u8 *inbuf)
+{
+    return testMediumWrite(&ctrNand, sector, sectorCount, inbuf);
+}
+
+bool I2C_readRegBuf(I2cDevice devId, u8 regAddr, u8 *out, u32 size)
+{
+    (void)devId;
+    (void)regAddr;
+    memset(out, 0x21, size);
+    return true;
+}
+
+static void resetCounters(void)
+{
+    ffReads = 0;
+    memset(poolReads, 0, sizeof(poolReads));
+    sdCard.nbReads = sdCard.nbSectorsRead = sdCard.nbWrites = 0;
+    ctrNand.nbReads = ctrNand.nbSectorsRead = ctrNand.nbWrites = 0;
+}
+
+//The SD write protect switch, which disk_write() reads from the SDMMC registers
+static void mapSdmmcRegisters(void)
+{
+    void *regs = mmap((void *)SDMMC_BASE, 0x1000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(regs != (void *)SDMMC_BASE)
+    {
+        fprintf(stderr, "diskio: couldn't map the SDMMC registers\n");
+        exit(1);
+    }
+
+    *(vu16 *)(SDMMC_BASE + REG_SDSTATUS0) = TMIO_STAT0_WRPROTECT;
+}
+
+//FatFs R0.13c reads the character after the terminating null of a path, literals get a second one
+#define FF_PATH(path) (path "\0")
+
+static FATFS sdFs;
+
+//As mountVolume() in fs.c
+static void mountSd(void)
+{
+    CHECK(f_mount(&sdFs, FF_PATH("0:"), 1) == FR_OK);
+    disk_setlayout(sdFs.pdrv, sdFs.win, sdFs.fatbase, sdFs.n_fats * sdFs.fsize);
+}
+
+static void writeFile(const char *path, const u8 *data, u32 size)
+{
+    FIL file;
+    UINT written = 0;
+
+    CHECK(f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+    CHECK(f_write(&file, data, size, &written) == FR_OK && written == size);
+    CHECK(f_close(&file) == FR_OK);
+}
+
+//What the boot path looks like: a few directories, payloads, and a FIRM-sized file
+#define NB_PAYLOADS     48
+#define BIG_FILE_SIZE   (600 * 512)
+
+static u8 bigFile[BIG_FILE_SIZE];
+
+static u32 payloadSize(u32 i)
+{
+    return 200 + 37 * i;
+}
+
+static void populateSd(void)
+{
+    char path[64];
+    u8 data[2048];
+
+    CHECK(f_mkdir(FF_PATH("0:/luma")) == FR_OK);
+    CHECK(f_mkdir(FF_PATH("0:/luma/payloads")) == FR_OK);
+    CHECK(f_mkdir(FF_PATH("0:/luma/sysmodules")) == FR_OK);
+
+    //Empty first, so that the directory clusters are contiguous
+    for(u32 i = 0; i < NB_PAYLOADS; i++)
+    {
+        sprintf(path, "0:/luma/payloads/payload_%02lu.firm", (unsigned long)i);
+        writeFile(path, NULL, 0);
+    }
+
+    for(u32 i = 0; i < NB_PAYLOADS; i++)
+    {
+        sprintf(path, "0:/luma/payloads/payload_%02lu.firm", (unsigned long)i);
+        memset(data, (int)i, sizeof(data));
+        writeFile(path, data, payloadSize(i));
+    }
+
+    testFillRandom(bigFile, sizeof(bigFile), 256);
+    writeFile(FF_PATH("0:/boot.firm"), bigFile, sizeof(bigFile));
+}
+
+//Lists the payloads and looks each of them up, as the payload menu does
+static void walkPayloads(void)
+{
+    DIR dir;
+    FILINFO info;
+    u32 nbFound = 0;
+    char path[64];
+
+    CHECK(f_opendir(&dir, FF_PATH("0:/luma/payloads")) == FR_OK);
+    while(f_readdir(&dir, &info) == FR_OK && info.fname[0] != 0)
+    {
+        sprintf(path, "0:/luma/payloads/%s", info.fname);
+        CHECK(f_stat(path, &info) == FR_OK);
+        nbFound++;
+    }
+    CHECK(f_closedir(&dir) == FR_OK);
+    CHECK(nbFound == NB_PAYLOADS);
+}
+
+//Reads the big file in small pieces, through the file's own sector buffer
+static void readBigFile(void)
+{
+    FIL file;
+    u8 piece[100];
+    UINT read;
+
+    CHECK(f_open(&file, FF_PATH("0:/boot.firm"), FA_READ) == FR_OK);
+    for(u32 pos = 0; pos < BIG_FILE_SIZE; pos += read)
+    {
+        CHECK(f_read(&file, piece, sizeof(piece), &read) == FR_OK && read != 0);
+        if(read == 0) break;
+        CHECK(memcmp(piece, bigFile + pos, read) == 0);
+    }
+    CHECK(f_close(&file) == FR_OK);
+}
+
+static void testMetadataPools(bool verbose)
+{
+    //A new mount starts from an empty cache
+    CHECK(disk_initialize(SDCARD) == 0);
+    mountSd();
+    resetCounters();
+
+    walkPayloads();
+    u32 walkReads = ffReads;
+    CHECK(sdCard.nbReads * 4 <= walkReads);
+    CHECK(poolReads[2] == 0 && poolReads[3] == 0);
+    if(verbose) printf("diskio: listing %u payloads, %lu sector reads from FatFs, %lu from the SD (%lu FAT, %lu directory)\n", NB_PAYLOADS,
+           (unsigned long)walkReads, (unsigned long)sdCard.nbReads, (unsigned long)poolReads[0], (unsigned long)poolReads[1]);
+
+    //File data goes to its own pool, the metadata is still there afterwards
+    resetCounters();
+    readBigFile();
+    CHECK(poolReads[2] <= BIG_FILE_SIZE / 512 / CACHE_LINE_SECTORS + 1);
+    CHECK(poolReads[1] == 0 && poolReads[3] == 0);
+    if(verbose) printf("diskio: reading a %u KiB file 100 bytes at a time, %lu sector reads from FatFs, %lu from the SD\n",
+                       BIG_FILE_SIZE / 1024, (unsigned long)ffReads, (unsigned long)sdCard.nbReads);
+
+    resetCounters();
+    walkPayloads();
+    CHECK(ffReads == walkReads && sdCard.nbReads == 0);
+}
+
+//Every write goes to the medium and to the lines holding its sectors
+static void testWriteThrough(void)
+{
+    static u8 shadow[BIG_FILE_SIZE];
+    FIL file;
+    UINT done;
+
+    memcpy(shadow, bigFile, sizeof(shadow));
+    CHECK(f_open(&file, FF_PATH("0:/boot.firm"), FA_READ | FA_WRITE) == FR_OK);
+
+    for(u32 i = 0; i < 300; i++)
+    {
+        u32 pos = testRand() % (BIG_FILE_SIZE - 1024), size = 1 + testRand() % 1024;
+        u8 data[1024];
+
+        CHECK(f_lseek(&file, pos) == FR_OK);
+        if(testRand() % 2 == 0)
+        {
+            testFillRandom(data, size, 256);
+            CHECK(f_write(&file, data, size, &done) == FR_OK && done == size);
+            memcpy(shadow + pos, data, size);
+        }
+        else
+        {
+            CHECK(f_read(&file, data, size, &done) == FR_OK && done == size);
+            CHECK(memcmp(data, shadow + pos, size) == 0);
+        }
+    }
+    CHECK(f_close(&file) == FR_OK);
+
+    //Once more through a new mount, the cache being empty
+    memcpy(bigFile, shadow, sizeof(bigFile));
+    CHECK(disk_initialize(SDCARD) == 0);
+    mountSd();
+    readBigFile();
+
+    //Sector by sector, the cached copy and the card agree
+    u8 sector[512];
+    for(u32 s = 0; s < 4096; s++)
+    {
+        CHECK(diskioRead(SDCARD, sector, s, 1) == RES_OK);
+        CHECK(memcmp(sector, sdCard.data + (size_t)s * 512, 512) == 0);
+    }
+}
+
+//A failed write leaves the medium in an unknown state, the lines holding those sectors are dropped
+static void testFailedWrite(void)
+{
+    u8 sector[512], data[512];
+
+    CHECK(diskioRead(SDCARD, sector, 100, 1) == RES_OK);
+    resetCounters();
+    CHECK(diskioRead(SDCARD, sector, 101, 1) == RES_OK && sdCard.nbReads == 0);
+
+    memset(data, 0xA5, sizeof(data));
+    sdCard.failingSector = 101;
+    CHECK(disk_write(SDCARD, data, 101, 1) == RES_PARERR);
+    sdCard.failingSector = 0xFFFFFFFF;
+
+    CHECK(diskioRead(SDCARD, sector, 100, 1) == RES_OK && sdCard.nbReads == 1);
+    CHECK(memcmp(sector, sdCard.data + 100 * 512, 512) == 0);
+
+    //Writing with the card write protected fails too
+    *(vu16 *)(SDMMC_BASE + REG_SDSTATUS0) = 0;
+    CHECK(disk_write(SDCARD, data, 101, 1) == RES_PARERR);
+    *(vu16 *)(SDMMC_BASE + REG_SDSTATUS0) = TMIO_STAT0_WRPROTECT;
+    CHECK(diskioRead(SDCARD, sector, 101, 1) == RES_OK && sdCard.nbReads == 2);
+    CHECK(memcmp(sector, sdCard.data + 101 * 512, 512) == 0);
+}
+
+static void testDrives(void)
+{
+    u8 sector[512];
+
+    //Both drives' lines live side by side
+    CHECK(disk_initialize(CTRNAND) == 0);
+    testFillRandom(ctrNand.data, 64 * 512, 256);
+    CHECK(diskioRead(CTRNAND, sector, 3, 1) == RES_OK);
+    CHECK(diskioRead(SDCARD, sector, 3, 1) == RES_OK);
+    resetCounters();
+    CHECK(diskioRead(CTRNAND, sector, 5, 1) == RES_OK && memcmp(sector, ctrNand.data + 5 * 512, 512) == 0);
+    CHECK(diskioRead(SDCARD, sector, 5, 1) == RES_OK && memcmp(sector, sdCard.data + 5 * 512, 512) == 0);
+    CHECK(ctrNand.nbReads == 0 && sdCard.nbReads == 0);
+
+    //Remounting CTRNAND from another NAND drops its lines only
+    testFillRandom(ctrNand.data, 64 * 512, 256);
+    CHECK(disk_initialize(CTRNAND) == 0);
+    CHECK(diskioRead(CTRNAND, sector, 5, 1) == RES_OK && memcmp(sector, ctrNand.data + 5 * 512, 512) == 0);
+    CHECK(diskioRead(SDCARD, sector, 5, 1) == RES_OK);
+    CHECK(ctrNand.nbReads == 1 && sdCard.nbReads == 0);
+
+    //Reads of a whole line or more go straight to the medium
+    u8 sectors[CACHE_LINE_SECTORS * 512];
+    resetCounters();
+    CHECK(diskioRead(CTRNAND, sectors, 0, CACHE_LINE_SECTORS) == RES_OK && ctrNand.nbReads == 1);
+    CHECK(poolReads[NB_POOLS] == 1);
+    CHECK(memcmp(sectors, ctrNand.data, sizeof(sectors)) == 0);
+
+    //A line going past the end of the medium can't be read, the sectors still can
+    u32 last = ctrNand.nbSectors - 1;
+    resetCounters();
+    CHECK(diskioRead(CTRNAND, sector, last, 1) == RES_OK);
+    CHECK(memcmp(sector, ctrNand.data + (size_t)last * 512, 512) == 0);
+    CHECK(poolReads[NB_POOLS] == 1);
+    CHECK(diskioRead(CTRNAND, sector, last + 1, 1) != RES_OK);
+}
+
+int main(int argc, char **argv)
+{
+    bool bench = testIsBench(argc, argv);
+
+    mapSdmmcRegisters();
+
+    //72000 sectors are enough for FAT32 with one sector per cluster. CTRNAND doesn't end on a line
+    testMediumInit(&sdCard, 72000);
+    testMediumInit(&ctrNand, 4099);
+    testFormatFat32(&sdCard, 0);
+
+    CHECK(disk_initialize(SDCARD) == 0);
+    mountSd();
+    populateSd();
+
+    testMetadataPools(bench);
+    if(bench) return 0;
+
+    testWriteThrough();
+    testFailedWrite();
+    testDrives();
+
+    testMediumFree(&sdCard);
+    testMediumFree(&ctrNand);
+
+    return testResult("diskio");
+}
@@ -0,0 +1,334 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Runs locateEmuNand() from arm9/source/emunand.c against a synthetic SD card holding several EmuNANDs, checking
+*   what it finds, how many sectors it reads, and the layouts it leaves to be saved with the configuration
+*/
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "emunand.h"
+#include "config.h"
+#include "fatfs/sdmmc/sdmmc.h"
+
+//An Old 3DS NAND, and where its "Default" EmuNAND layout puts each EmuNAND
+#define NAND_SIZE           0x1D7800
+#define EMUNAND_SLOT        ROUND_TO_4MB(NAND_SIZE + 1)
+
+EmuNandLayouts emuNandLayouts;
+
+//Only patchEmuNand() uses these
+const u8 emunandPatch[4];
+const u32 emunandPatchSize = sizeof(emunandPatch);
+u32 emunandPatchSdmmcStructPtr, emunandPatchNandOffset, emunandPatchNcsdHeaderOffset;
+
+//Only the sectors that were written are stored, everything else reads as zeroes
+#define MAX_SD_SECTORS 16
+
+static struct
+{
+    u32 sector;
+    u8 data[0x200];
+} sdSectors[MAX_SD_SECTORS];
+
+static u32 nbSdSectors, sdCid[4], nandSize = NAND_SIZE, sdReads;
+
+static u8 *getSdSector(u32 sector, bool create)
+{
+    for(u32 i = 0; i < nbSdSectors; i++)
+        if(sdSectors[i].sector == sector) return sdSectors[i].data;
+
+    if(!create || nbSdSectors == MAX_SD_SECTORS) return NULL;
+
+    sdSectors[nbSdSectors].sector = sector;
+    memset(sdSectors[nbSdSectors].data, 0, 0x200);
+    return sdSectors[nbSdSectors++].data;
+}
+
+int sdmmc_sdcard_readsectors(u32 sector_no, u32 numsectors, u8 *out)
+{
+    sdReads++;
+    for(u32 i = 0; i < numsectors; i++)
+    {
+        const u8 *data = getSdSector(sector_no + i, false);
+
+        if(data != NULL) memcpy(out + i * 0x200, data, 0x200);
+        else memset(out + i * 0x200, 0, 0x200);
+    }
+
+    return 0;
+}
+
+void sdmmc_get_cid(bool isNand, u32 *info)
+{
+    CHECK(!isNand);
+    memcpy(info, sdCid, sizeof(sdCid));
+}
+
+mmcdevice *getMMCDevice(int drive)
+{
+    static mmcdevice nand;
+
+    CHECK(drive == 0);
+    nand.total_size = nandSize;
+    return &nand;
+}
+
+static void writeMbr(u32 fatStart)
+{
+    u8 *mbr = getSdSector(0, true);
+
+    memcpy(mbr + 0x1C6, &fatStart, sizeof(fatStart));
+    mbr[0x1FE] = 0x55;
+    mbr[0x1FF] = 0xAA;
+}
+
+//RedNAND keeps the NCSD header in the sector after the start, Gateway's EmuNAND right after the NAND image
+static void writeEmuNand(u32 offset, bool isRedNand)
+{
+    u8 *header = getSdSector(isRedNand ? offset + 1 : offset + nandSize, true);
+
+    memcpy(header + 0x100, "NCSD", 4);
+}
+
+static void eraseEmuNand(u32 offset, bool isRedNand)
+{
+    u8 *header = getSdSector(isRedNand ? offset + 1 : offset + nandSize, false);
+
+    if(header != NULL) memset(header, 0, 0x200);
+}
+
+/*
+*   locateEmuNand() reads the MBR once per boot, into function statics, so each boot runs in a child process.
+*   What it found comes back through shared memory, and the layouts are kept as writeConfig() would
+*/
+typedef struct Boot
+{
+    FirmwareSource nandType;
+    u32 offset, header;
+    u32 nbReads;
+    EmuNandLayouts layouts;
+} Boot;
+
+static Boot *bootResult;
+static EmuNandLayouts savedLayouts;
+
+static Boot boot(FirmwareSource nandType)
+{
+    int failures = testFailures;
+
+    memset(bootResult, 0xFF, sizeof(Boot));
+    pid_t pid = fork();
+
+    if(pid == 0)
+    {
+        emuNandLayouts = savedLayouts;
+        sdReads = 0;
+        locateEmuNand(&nandType);
+
+        bootResult->nandType = nandType;
+        bootResult->offset = emuOffset;
+        bootResult->header = emuHeader;
+        bootResult->nbReads = sdReads;
+        bootResult->layouts = emuNandLayouts;
+        _exit(testFailures != failures);
+    }
+
+    int status;
+    if(pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "emunand: the boot didn't complete\n");
+        exit(1);
+    }
+
+    savedLayouts = bootResult->layouts;
+    return *bootResult;
+}
+
+static bool isLayoutKnown(FirmwareSource nandType, u32 offset, u32 header)
+{
+    u32 index = (u32)nandType - 1;
+
+    return (savedLayouts.knownLayouts & (1 << index)) != 0 && savedLayouts.layouts[index].offset == offset &&
+           savedLayouts.layouts[index].header == header;
+}
+
+//RedNAND at the start of the card, then Gateway EmuNANDs in the next two slots, then the FAT partition
+static void setUpSd(void)
+{
+    static const u32 cid[4] = {0x1234ABCD, 0x5678, 0x9ABC, 0xDEF0};
+
+    nbSdSectors = 0;
+    memcpy(sdCid, cid, sizeof(sdCid));
+    writeMbr(3 * EMUNAND_SLOT);
+    writeEmuNand(0, true);
+    writeEmuNand(EMUNAND_SLOT, false);
+    writeEmuNand(2 * EMUNAND_SLOT, false);
+    memset(&savedLayouts, 0, sizeof(savedLayouts));
+}
+
+static void testDiscovery(void)
+{
+    Boot b;
+
+    setUpSd();
+
+    //"Legacy" then "Default" layout, RedNAND then Gateway for each, after the MBR
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.nandType == FIRMWARE_EMUNAND2 && b.offset == EMUNAND_SLOT && b.header == NAND_SIZE);
+    CHECK(b.nbReads == 5);
+    CHECK(savedLayouts.knownLayouts == 1 << 1 && isLayoutKnown(FIRMWARE_EMUNAND2, EMUNAND_SLOT, NAND_SIZE));
+    CHECK(memcmp(savedLayouts.sdCid, sdCid, sizeof(sdCid)) == 0);
+    CHECK(savedLayouts.nandSize == NAND_SIZE && savedLayouts.fatStart == 3 * EMUNAND_SLOT);
+
+    //Then the MBR and the NCSD header
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.nandType == FIRMWARE_EMUNAND2 && b.offset == EMUNAND_SLOT && b.header == NAND_SIZE);
+    CHECK(b.nbReads == 2);
+
+    b = boot(FIRMWARE_EMUNAND);
+    CHECK(b.nandType == FIRMWARE_EMUNAND && b.offset == 1 && b.header == 0);
+    CHECK(b.nbReads == 2);
+    CHECK(savedLayouts.knownLayouts == ((1 << 0) | (1 << 1)));
+
+    b = boot(FIRMWARE_EMUNAND3);
+    CHECK(b.nandType == FIRMWARE_EMUNAND3 && b.offset == 2 * EMUNAND_SLOT && b.header == NAND_SIZE);
+    b = boot(FIRMWARE_EMUNAND3);
+    CHECK(b.nbReads == 2);
+
+    //There's no fourth one, the first one is already known
+    b = boot(FIRMWARE_EMUNAND4);
+    CHECK(b.nandType == FIRMWARE_EMUNAND && b.offset == 1 && b.header == 0);
+    CHECK(b.nbReads == 2);
+    CHECK(savedLayouts.knownLayouts == ((1 << 0) | (1 << 1) | (1 << 2)));
+}
+
+//Another SD card, even with the same partitioning, starts over
+static void testCidChange(void)
+{
+    Boot b;
+
+    setUpSd();
+    boot(FIRMWARE_EMUNAND);
+    boot(FIRMWARE_EMUNAND2);
+
+    sdCid[3] ^= 1;
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.nandType == FIRMWARE_EMUNAND2 && b.offset == EMUNAND_SLOT && b.header == NAND_SIZE);
+    CHECK(b.nbReads == 5);
+    CHECK(savedLayouts.knownLayouts == 1 << 1);
+    CHECK(memcmp(savedLayouts.sdCid, sdCid, sizeof(sdCid)) == 0);
+
+    //As does another console
+    nandSize = NAND_SIZE - 0x800;
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.nbReads > 2 && savedLayouts.nandSize == nandSize);
+    nandSize = NAND_SIZE;
+}
+
+static void testRepartition(void)
+{
+    Boot b;
+
+    setUpSd();
+    boot(FIRMWARE_EMUNAND);
+    boot(FIRMWARE_EMUNAND3);
+
+    //The FAT partition now starts where the third EmuNAND was
+    writeMbr(2 * EMUNAND_SLOT + 0x1000);
+    b = boot(FIRMWARE_EMUNAND3);
+    CHECK(b.nandType == FIRMWARE_EMUNAND && b.offset == 1 && b.header == 0);
+    CHECK(savedLayouts.knownLayouts == 1 << 0);
+    CHECK(savedLayouts.fatStart == 2 * EMUNAND_SLOT + 0x1000);
+
+    //The second one still fits
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.nandType == FIRMWARE_EMUNAND2 && b.offset == EMUNAND_SLOT && b.header == NAND_SIZE);
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.nbReads == 2);
+}
+
+//An EmuNAND that moved or went away since its layout was saved
+static void testStaleLayout(void)
+{
+    Boot b;
+
+    setUpSd();
+    boot(FIRMWARE_EMUNAND2);
+
+    //Recreated as RedNAND in the "Legacy" layout, found after the failed check
+    eraseEmuNand(EMUNAND_SLOT, false);
+    writeEmuNand(0x200000, true);
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.nandType == FIRMWARE_EMUNAND2 && b.offset == 0x200001 && b.header == 0);
+    CHECK(b.nbReads == 3);
+    CHECK(isLayoutKnown(FIRMWARE_EMUNAND2, 0x200001, 0));
+
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.offset == 0x200001 && b.nbReads == 2);
+
+    //Deleted, falling back to the first one
+    eraseEmuNand(0x200000, true);
+    b = boot(FIRMWARE_EMUNAND2);
+    CHECK(b.nandType == FIRMWARE_EMUNAND && b.offset == 1 && b.header == 0);
+    CHECK(savedLayouts.knownLayouts == 1 << 0);
+
+    //And to SysNAND without any
+    eraseEmuNand(0, true);
+    b = boot(FIRMWARE_EMUNAND);
+    CHECK(b.nandType == FIRMWARE_SYSNAND);
+    CHECK(savedLayouts.knownLayouts == 0);
+}
+
+//ISN3DS reads the SoC info register
+static void mapCfg11(void)
+{
+    void *cfg11 = mmap((void *)0x10140000, 0x1000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(cfg11 != (void *)0x10140000)
+    {
+        fprintf(stderr, "emunand: couldn't map CFG11\n");
+        exit(1);
+    }
+}
+
+int main(void)
+{
+    mapCfg11();
+    bootResult = mmap(NULL, sizeof(Boot), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(bootResult == MAP_FAILED) return 1;
+
+    testDiscovery();
+    testCidChange();
+    testRepartition();
+    testStaleLayout();
+
+    return testResult("emunand");
+}
@@ -0,0 +1,161 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   In-memory storage for the arm9 disk layer tests: a medium standing in for the SD card or CTRNAND,
+*   and a FAT32 formatter, as arm9 builds FatFs without f_mkfs
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEDIUM_SECTOR_SIZE  512
+
+typedef struct TestMedium
+{
+    uint8_t *data;
+    uint32_t nbSectors;
+    uint32_t nbReads, nbSectorsRead, nbWrites;
+    uint32_t failingSector;     //Accesses covering it fail, 0xFFFFFFFF for none
+} TestMedium;
+
+static inline void testMediumInit(TestMedium *medium, uint32_t nbSectors)
+{
+    medium->data = calloc(nbSectors, MEDIUM_SECTOR_SIZE);
+    medium->nbSectors = nbSectors;
+    medium->nbReads = medium->nbSectorsRead = medium->nbWrites = 0;
+    medium->failingSector = 0xFFFFFFFF;
+}
+
+static inline void testMediumFree(TestMedium *medium)
+{
+    free(medium->data);
+    medium->data = NULL;
+}
+
+static inline bool testMediumCovers(const TestMedium *medium, uint32_t sector, uint32_t count)
+{
+    return count <= medium->nbSectors && sector <= medium->nbSectors - count && medium->failingSector - sector >= count;
+}
+
+//0 on success, as the sdmmc functions
+static inline int testMediumRead(TestMedium *medium, uint32_t sector, uint32_t count, uint8_t *out)
+{
+    medium->nbReads++;
+    if(!testMediumCovers(medium, sector, count)) return 1;
+
+    medium->nbSectorsRead += count;
+    memcpy(out, medium->data + (size_t)sector * MEDIUM_SECTOR_SIZE, (size_t)count * MEDIUM_SECTOR_SIZE);
+    return 0;
+}
+
+static inline int testMediumWrite(TestMedium *medium, uint32_t sector, uint32_t count, const uint8_t *in)
+{
+    medium->nbWrites++;
+    if(!testMediumCovers(medium, sector, count)) return 1;
+
+    memcpy(medium->data + (size_t)sector * MEDIUM_SECTOR_SIZE, in, (size_t)count * MEDIUM_SECTOR_SIZE);
+    return 0;
+}
+
+static inline void testPut16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void testPut32(uint8_t *p, uint32_t v)
+{
+    testPut16(p, (uint16_t)v);
+    testPut16(p + 2, (uint16_t)(v >> 16));
+}
+
+//FAT32 starting at firstSector and going to the end of the medium, with two FATs, 32 reserved sectors and one
+//sector per cluster. The medium needs at least 65525 clusters for FatFs to see FAT32
+#define FAT_IMAGE_RESERVED_SECTORS 32
+
+typedef struct FatImageLayout
+{
+    uint32_t fatStart;          //Relative to the medium
+    uint32_t fatSectors;        //Of each FAT
+    uint32_t dataStart;         //Cluster 2
+} FatImageLayout;
+
+static inline FatImageLayout testFormatFat32(TestMedium *medium, uint32_t firstSector)
+{
+    uint32_t nbSectors = medium->nbSectors - firstSector,
+             fatSectors = ((nbSectors - FAT_IMAGE_RESERVED_SECTORS + 2) * 4 + MEDIUM_SECTOR_SIZE - 1) / MEDIUM_SECTOR_SIZE;
+    uint8_t *vbr = medium->data + (size_t)firstSector * MEDIUM_SECTOR_SIZE;
+    FatImageLayout layout = {
+        firstSector + FAT_IMAGE_RESERVED_SECTORS,
+        fatSectors,
+        firstSector + FAT_IMAGE_RESERVED_SECTORS + 2 * fatSectors
+    };
+
+    memset(vbr, 0, (size_t)(layout.dataStart + 1 - firstSector) * MEDIUM_SECTOR_SIZE);
+
+    memcpy(vbr, "\xEB\x58\x90" "MSWIN4.1", 11);
+    testPut16(vbr + 11, MEDIUM_SECTOR_SIZE);
+    vbr[13] = 1;                                    //Sectors per cluster
+    testPut16(vbr + 14, FAT_IMAGE_RESERVED_SECTORS);
+    vbr[16] = 2;                                    //FATs
+    vbr[21] = 0xF8;                                 //Media
+    testPut16(vbr + 24, 63);
+    testPut16(vbr + 26, 255);
+    testPut32(vbr + 28, firstSector);
+    testPut32(vbr + 32, nbSectors);
+    testPut32(vbr + 36, fatSectors);
+    testPut32(vbr + 44, 2);                         //Root directory cluster
+    testPut16(vbr + 48, 1);                         //FSInfo sector
+    testPut16(vbr + 50, 6);                         //Backup boot sector
+    vbr[64] = 0x80;
+    vbr[66] = 0x29;
+    testPut32(vbr + 67, 0x4C554D41);
+    memcpy(vbr + 71, "NO NAME    FAT32   ", 19);
+    testPut16(vbr + 510, 0xAA55);
+
+    uint8_t *fsInfo = vbr + MEDIUM_SECTOR_SIZE;
+    testPut32(fsInfo, 0x41615252);
+    testPut32(fsInfo + 484, 0x61417272);
+    testPut32(fsInfo + 488, 0xFFFFFFFF);
+    testPut32(fsInfo + 492, 0xFFFFFFFF);
+    testPut32(fsInfo + 508, 0xAA550000);
+
+    //Media descriptor, end of chain marker, then the root directory's single cluster
+    for(uint32_t i = 0; i < 2; i++)
+    {
+        uint8_t *fat = medium->data + (size_t)(layout.fatStart + i * fatSectors) * MEDIUM_SECTOR_SIZE;
+        testPut32(fat, 0x0FFFFFF8);
+        testPut32(fat + 4, 0x0FFFFFFF);
+        testPut32(fat + 8, 0x0FFFFFFF);
+    }
+
+    return layout;
+}
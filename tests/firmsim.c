@@ -0,0 +1,1579 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host simulator for the arm9 FIRM patching code
+*
+*   firmsim                                     self-test on synthetic images
+*   firmsim bench                               signature lookup and patching benchmark on a synthetic image
+*   firmsim <FIRM> [native|twl|agb] [<output>]  patches a decrypted FIRM, prints the boot log and writes the result
+*
+*   FIRMs go through patchNativeFirm(), patchTwlFirm() and patchAgbFirm() from firm.c, for a SysNAND boot with the
+*   default options. VRAM is mapped at its Arm9 address and holds a stand-in k11_extension and two stand-in sysmodules,
+*   so that installK11Extension and mergeSection0 run too. loadNintendoFirm() runs against a CTRNAND FIRM content
+*   encrypted with a software AES, FCRAM being mapped at its Arm9 address. What isn't simulated: the key scrambler,
+*   kernel9Loader (so N3DS FIRMs need a decrypted Arm9 binary) and the EmuNAND patch
+*/
+
+#include <sys/mman.h>
+#include "test.h"
+#include "swcrypto.h"
+#include "types.h"
+
+//There's no hardware to ask, simulate a retail O3DS
+#undef ISN3DS
+#undef ISDEVUNIT
+#define ISN3DS      false
+#define ISDEVUNIT   false
+
+//Included rather than linked, to get at the signature cache and its format, and at the FIRM firm.c patches
+#include "patches.c"
+#include "firm.c"
+
+//And k11_extension's side of the Kernel11 symbol hints
+#include "symbolHints.h"
+
+//What patches.c, firm.c and bootprof.c use from the rest of arm9
+CfgData configData;
+bool isSdMode;
+u16 launchedPath[80+1];
+u32 arm9ExceptionHandlerSvcBreakAddress;
+struct fb fbs[2];
+
+//The reboot patch is assembled by devkitARM (large_patches.s), a blank one of about the same size stands in for it
+const u8 rebootPatch[0x200];
+const u32 rebootPatchSize = sizeof(rebootPatch);
+u32 rebootPatchFopenPtr;
+u16 rebootPatchFileName[80+1];
+
+void error(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+
+    exit(1);
+}
+
+void startChrono(void)
+{
+}
+
+u64 chronoTicks(void)
+{
+    return (u64)(testNow() * TICKS_PER_SEC);
+}
+
+//The rest of firm.c (launching FIRMs, and loading them from elsewhere than CTRNAND) isn't simulated
+#define NOT_SIMULATED() error("%s isn't simulated.", __func__)
+
+void chainload(int argc, char **argv, Firm *firm)
+{
+    NOT_SIMULATED();
+}
+
+//The AES engine with keyslot 0x2C set up: its normal key is made up, as the key scrambler isn't simulated
+static const u8 simKey0x2C[16] = {0x4C, 0x75, 0x6D, 0x61, 0x33, 0x44, 0x53, 0x20, 0x66, 0x69, 0x72, 0x6D, 0x73, 0x69, 0x6D, 0x21};
+static u32 simDecryptions;
+
+//The counter of the start of the ExeFS files, as crypto.c sets it up
+static void simExeFsCtr(u8 *ctr, const Cxi *cxi)
+{
+    memset(ctr, 0, AES_BLOCK_SIZE);
+    for(u32 i = 0; i < 8; i++)
+        ctr[7 - i] = cxi->ncch.partitionId[i];
+    ctr[8] = 2;
+    ctr[15] = 0x200 / AES_BLOCK_SIZE;
+}
+
+//Same checks and layout as in crypto.c
+u32 decryptExeFs(Cxi *cxi)
+{
+    if(memcmp(cxi->ncch.magic, "NCCH", 4) != 0) return 0;
+
+    if(cxi->ncch.exeFsOffset != 5) return 0;
+
+    u8 *exeFsOffset = (u8 *)cxi + 6 * 0x200;
+    u32 exeFsSize = (cxi->ncch.exeFsSize - 1) * 0x200;
+
+    if(exeFsSize > 0x400000) return 0;
+
+    u8 ncchCtr[AES_BLOCK_SIZE];
+    SwAesContext aes;
+
+    simExeFsCtr(ncchCtr, cxi);
+    swAesSetKey(&aes, simKey0x2C);
+    swAesCtr(&aes, (u8 *)cxi, exeFsOffset, exeFsSize, ncchCtr);
+    simDecryptions++;
+
+    return memcmp(cxi, "FIRM", 4) == 0 ? exeFsSize : 0;
+}
+
+u32 decryptNusFirm(const Ticket *ticket, Cxi *cxi, u32 ncchSize)
+{
+    NOT_SIMULATED();
+    return 0;
+}
+
+void sha(void *res, const void *src, u32 size, u32 mode)
+{
+    if(mode != SHA_256_MODE) NOT_SIMULATED();
+
+    swSha256(res, src, size);
+}
+
+//CTRNAND is always there, its FIRM content is in the same in-memory card as the SD files
+bool mountFs(bool isSd, bool switchToCtrNand)
+{
+    return true;
+}
+
+bool findPayload(char *path, u32 pressed)
+{
+    NOT_SIMULATED();
+    return false;
+}
+
+bool payloadMenu(char *path, bool *hasDisplayedMenu)
+{
+    NOT_SIMULATED();
+    return false;
+}
+
+
+u32 patchEmuNand(u8 *arm9Section, u32 kernel9Size, u8 *process9Offset, u32 process9Size, u8 *kernel9Address, u32 firmVersion)
+{
+    NOT_SIMULATED();
+    return 1;
+}
+
+void initScreens(void)
+{
+    NOT_SIMULATED();
+}
+
+void prepareArm11ForFirmlaunch(void)
+{
+    NOT_SIMULATED();
+}
+
+//In-memory SD card, with the semantics of fileRead() and fileWrite() in arm9/source/fs.c
+#define SD_MAX_FILES 8
+
+static struct
+{
+    char path[64];
+    u8 *data;
+    u32 size;
+} sdFiles[SD_MAX_FILES];
+static u32 sdReads, sdWrites;
+
+static void sdClear(void)
+{
+    for(u32 i = 0; i < SD_MAX_FILES; i++)
+    {
+        free(sdFiles[i].data);
+        memset(&sdFiles[i], 0, sizeof(sdFiles[i]));
+    }
+
+    sdReads = sdWrites = 0;
+}
+
+static u32 sdFind(const char *path)
+{
+    for(u32 i = 0; i < SD_MAX_FILES; i++)
+        if(sdFiles[i].data != NULL && strcmp(sdFiles[i].path, path) == 0) return i;
+
+    return SD_MAX_FILES;
+}
+
+//CTRNAND files go in there too, under their FatFs paths
+static u32 nandReads;
+
+u32 fileRead(void *dest, const char *path, u32 maxSize)
+{
+    u32 i = sdFind(path);
+
+    sdReads++;
+    if(dest != NULL && strncmp(path, "1:/", 3) == 0) nandReads++;
+
+    if(i == SD_MAX_FILES) return 0;
+    if(dest == NULL) return sdFiles[i].size;
+    if(sdFiles[i].size > maxSize) return 0;
+
+    memcpy(dest, sdFiles[i].data, sdFiles[i].size);
+
+    return sdFiles[i].size;
+}
+
+bool fileWrite(const void *buffer, const char *path, u32 size)
+{
+    u32 i = sdFind(path);
+
+    sdWrites++;
+
+    if(i == SD_MAX_FILES)
+        for(i = 0; i < SD_MAX_FILES && sdFiles[i].data != NULL; i++);
+    if(i == SD_MAX_FILES) return false;
+
+    free(sdFiles[i].data);
+    snprintf(sdFiles[i].path, sizeof(sdFiles[i].path), "%s", path);
+    sdFiles[i].data = malloc(size + 1);
+    sdFiles[i].size = size;
+    memcpy(sdFiles[i].data, buffer, size);
+    sdFiles[i].data[size] = 0;
+
+    return true;
+}
+
+u32 getFileSize(const char *path)
+{
+    return fileRead(NULL, path, 0);
+}
+
+//The NATIVE_FIRM title on CTRNAND: the content ID and the title version from its TMD
+static struct
+{
+    u32 contentId;
+    u16 titleVersion;
+} simNand;
+static u32 simLocates;
+
+bool firmLocate(FirmContent *content, u32 firmType)
+{
+    if(firmType != NATIVE_FIRM) NOT_SIMULATED();
+
+    simLocates++;
+    sprintf(content->path, "1:/title/00040138/00000002/content/%08lx.app", (unsigned long)simNand.contentId);
+    content->id = simNand.contentId;
+    content->titleVersion = simNand.titleVersion;
+    content->size = getFileSize(content->path);
+
+    return content->size > sizeof(Cxi) + 0x400;
+}
+
+//VRAM, where the Arm11 payload loader leaves k11_extension and our sysmodules for the Arm9 payload. Only the k11_extension
+//header words installK11Extension() reads are filled in, its parameters are 0x1000 bytes in
+#define VRAM_ADDR               0x18000000
+#define VRAM_SIZE               0x600000
+#define SIM_KEXT_SIZE           0x20000
+#define SIM_KEXT_PARAMS         0x1000
+#define SIM_SYSMODULES          0x180000
+
+//Our sysmodules: a loader replacing Nintendo's, and one more
+#define SIM_LOADER_SIZE         0x2000
+#define SIM_ROSALINA_SIZE       0x1000
+
+//Nintendo's sysmodules, in section 0 of synthetic FIRMs
+#define SIM_NB_MODULES          5
+#define SIM_MODULE_SIZE         0x1000
+
+static const char *const simModuleNames[SIM_NB_MODULES] = {"sm", "fs", "pm", "loader", "pxi"};
+
+//Where mergeSection0() copies section 0 to
+static u8 simSection0[0x600000];
+
+//Bytes from 0x50 to 0x7F: no signature nor any of the words the patches look for is made of these only
+static void fillPlain(u8 *pos, u32 size)
+{
+    for(u32 i = 0; i < size; i++) pos[i] = 0x50 + testRand() % 0x30;
+}
+
+static void buildModule(u8 *pos, const char *name, u32 size)
+{
+    Cxi *cxi = (Cxi *)pos;
+
+    fillPlain(pos, size);
+    memset(cxi, 0, sizeof(Cxi));
+    memcpy(cxi->ncch.magic, "NCCH", 4);
+    cxi->ncch.contentSize = size / 0x200;
+    memcpy(cxi->exHeader.systemControlInfo.appTitle, name, strlen(name));
+}
+
+static u8 *mapVram(void)
+{
+    static u8 *vram = NULL;
+
+    if(vram == NULL)
+    {
+        vram = mmap((void *)VRAM_ADDR, VRAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(vram != (u8 *)VRAM_ADDR) error("Couldn't map VRAM at 0x%08X.", VRAM_ADDR);
+    }
+
+    return vram;
+}
+
+//Puts back what's in VRAM at boot, the same every time
+static void loadVram(void)
+{
+    u8 *vram = mapVram();
+    u32 randState = testRandState;
+
+    testSeed(0x5652414D);
+    memset(vram, 0, VRAM_SIZE);
+    ((u32 *)vram)[0x20 / 4] = K11EXT_VA + SIM_KEXT_SIZE;
+    ((u32 *)vram)[0x24 / 4] = K11EXT_VA + SIM_KEXT_PARAMS;
+    buildModule(vram + SIM_SYSMODULES, "loader", SIM_LOADER_SIZE);
+    buildModule(vram + SIM_SYSMODULES + SIM_LOADER_SIZE, "rosalina", SIM_ROSALINA_SIZE);
+    testRandState = randState;
+}
+
+//Firm has pointers in it, so its host layout isn't the one of the image. The header is translated into a Firm placed
+//right before the image, the section offsets being relative to it as in firm.c. Section 0 goes to simSection0
+#define FIRM_HEADER_SPACE 0x400
+
+typedef struct SimFirm
+{
+    Firm *firm;
+    u8 *image;
+    u32 size;
+} SimFirm;
+
+static void simFirmAlloc(SimFirm *sim, u32 size)
+{
+    u8 *buf = calloc(1, FIRM_HEADER_SPACE + size);
+
+    sim->firm = (Firm *)buf;
+    sim->image = buf + FIRM_HEADER_SPACE;
+    sim->size = size;
+}
+
+static void simFirmFree(SimFirm *sim)
+{
+    free(sim->firm);
+}
+
+static u32 read32(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static bool simFirmParseHeader(SimFirm *sim)
+{
+    if(sim->size < 0x200 || memcmp(sim->image, "FIRM", 4) != 0) return false;
+
+    memcpy(sim->firm->magic, "FIRM", 4);
+
+    for(u32 i = 0; i < 4; i++)
+    {
+        const u8 *section = sim->image + 0x40 + 0x30 * i;
+        FirmSection *dst = &sim->firm->section[i];
+        u32 offset = read32(section);
+
+        dst->offset = FIRM_HEADER_SPACE + offset;
+        dst->address = i == 0 ? simSection0 : (u8 *)(uintptr_t)read32(section + 4);
+        dst->size = read32(section + 8);
+        dst->procType = read32(section + 12);
+        memcpy(dst->hash, section + 0x10, 0x20);
+
+        if(dst->size != 0 && (offset > sim->size || dst->size > sim->size - offset)) return false;
+    }
+
+    return true;
+}
+
+//Synthetic FIRMs: Nintendo's sysmodules in section 0, a Kernel11 image in section 1, then the Arm9 binary (Kernel9, Process9's
+//CXI and ExeFS headers, Process9) in section 2, or in section 3 for TWL/AGB-like FIRMs without Kernel11. Plain ones have the
+//signatures planted at random places, patchable ones every patch site once. The tests fill them with bytes from 0x50 to 0x7F,
+//the lookup benchmark with something closer to Arm code
+#define SIM_K11_BASE_VA         0xFFF00000
+#define SIM_K11_SVC_STUB        0x1000
+#define SIM_K11_SVC_HANDLER     0x1100
+#define SIM_K11_VECTOR_STUBS    0x1800
+#define SIM_K11_BIND_INTERRUPT  0x2000
+#define SIM_K11_SVCS            0x3000
+#define SIM_K11_TEXT_PLANTS     0xA000
+#define SIM_K11_PATCH_SITES     0xB000
+#define SIM_K11_MODULES_VA      0xFFF10000
+#define SIM_K11_OBJECT_CONTEXT  0xFFFF9000
+#define SIM_K9_ADDRESS          0x08006800
+#define SIM_K9_PATCH_SITES      0x1000
+#define SIM_P9_ADDRESS          0x08028000
+
+static bool armLikeFiller;
+
+static void fill(u8 *pos, u32 size)
+{
+    fillPlain(pos, size);
+
+    if(armLikeFiller)
+        for(u32 i = 0; i + 4 <= size; i += 4)
+            *(u32 *)(pos + i) = 0xE0000000 | (testRand() & 0x0FFFFFFF);
+}
+
+//The Kernel11, Kernel9 and Process9 parts of a synthetic FIRM
+enum
+{
+    SIM_REGION_KERNEL11 = 0,
+    SIM_REGION_KERNEL9,
+    SIM_REGION_PROCESS9,
+    SIM_REGION_COUNT
+};
+
+typedef struct SimImage
+{
+    SimFirm sim;
+    FirmwareType firmType;
+    u8 *regions[SIM_REGION_COUNT];
+    u32 sizes[SIM_REGION_COUNT];
+    Kernel11SymbolHints hints;
+} SimImage;
+
+#define NB_SIGNATURES (sizeof(signatures) / sizeof(*signatures))
+
+//Every signature but the exceptions page one, which getKernel11Info() has to find at the right place
+static void plantSignatures(u8 *pos, u32 start, u32 end)
+{
+    for(u32 i = 1; i < NB_SIGNATURES; i++)
+        for(u32 n = testRand() % 3; n > 0 && signatures[i].size <= end - start; n--)
+            memcpy(pos + start + testRand() % (end - start - signatures[i].size + 1), signatures[i].pattern, signatures[i].size);
+}
+
+//Lays out everything getKernel11Info() and resolveKernel11SymbolHints() look for, the exceptions page 0x2000 bytes before the end
+//and .data (with the InterruptManager) 0x1000 bytes before it
+static void buildKernel11(u8 *pos, u32 size, Kernel11SymbolHints *hints)
+{
+    u32 *words = (u32 *)pos,
+        page = size / 4 - 0x800,
+        interruptManager = SIM_K11_BASE_VA + 4 * page - 0x1000 + 0x234;
+
+    fill(pos, size);
+
+    //The exception vectors branch to stubs whose literal is the handler, the SVC handler being followed by the SVC table
+    for(u32 id = 1; id <= 4; id++)
+    {
+        u32 stub = id == 2 ? SIM_K11_SVC_STUB : SIM_K11_VECTOR_STUBS + 0x10 * id;
+
+        words[page + id] = 0xEA000000 | (((SIM_K11_BASE_VA + stub - (0xFFFF0008 + 4 * id)) >> 2) & 0xFFFFFF);
+        words[stub / 4 + 2] = SIM_K11_BASE_VA + (id == 2 ? SIM_K11_SVC_HANDLER : SIM_K11_VECTOR_STUBS + 0x100 + 0x10 * id);
+    }
+    words[page + 0xB] = 0xE59CB000;
+
+    u32 *svcTable = &words[SIM_K11_SVC_HANDLER / 4];
+    for(u32 i = 0; i < 8; i++) *svcTable++ = 0x01010101 * (i + 1);
+    svcTable[0] = 0;
+    for(u32 i = 1; i < 0x80; i++) svcTable[i] = SIM_K11_BASE_VA + SIM_K11_SVCS + 0x20 * i;
+    svcTable[0x50] = SIM_K11_BASE_VA + SIM_K11_BIND_INTERRUPT;
+
+    //svcBindInterrupt: ldr r0, =interruptManager, then the sequence the InterruptManager is found after
+    u32 *bindInterrupt = &words[SIM_K11_BIND_INTERRUPT / 4];
+    bindInterrupt[1] = 0xE59F0040;
+    bindInterrupt[8] = 0xE1A05000;
+    bindInterrupt[9] = 0xE2100102;
+    bindInterrupt[10] = 0x5A00000B;
+    bindInterrupt[19] = interruptManager;
+
+    //The first match is the one to take, for the FCRAM descriptor load
+    static const u32 fcramDescriptorLoad[] = {0xE59F0010, 0xE3A01000, 0xE3A02000, 0xE1A03000, 0xEB000010};
+    memcpy(&words[0x6000 / 4], fcramDescriptorLoad, sizeof(fcramDescriptorLoad));
+    memcpy(&words[0x6100 / 4], fcramDescriptorLoad, sizeof(fcramDescriptorLoad));
+
+    //And the last one in .text for these
+    for(u32 off = 0x7000; off <= 0x7100; off += 0x100)
+    {
+        words[off / 4] = 0xE5D13034;
+        words[off / 4 + 1] = 0xE1530002;
+        words[off / 4 + 0x400] = interruptManager;
+        words[off / 4 + 0x401] = SIM_K11_OBJECT_CONTEXT;
+    }
+    words[0x8F00 / 4] = 0xE92D40F8;
+    words[0x9000 / 4] = 0xE3510B1A;
+    words[0x9000 / 4 + 1] = 0xE3A06000;
+
+    //Past .text, to be ignored
+    words[page - 0x300] = 0xE5D13034;
+    words[page - 0x2FF] = 0xE1530002;
+    words[page + 0x30] = 0xE3510B1A;
+    words[page + 0x31] = 0xE3A06000;
+    memset(&words[page + 0x40], 0xFF, size - 4 * (page + 0x40));
+
+    hints->fcramDescriptorLoad = SIM_K11_BASE_VA + 0x6000;
+    hints->schedulerAdjustThread = SIM_K11_BASE_VA + 0x7100;
+    hints->attemptSwitchingThreadContextLiterals = SIM_K11_BASE_VA + 0x8100;
+    hints->invalidateInstructionCacheRangeBody = SIM_K11_BASE_VA + 0x9000;
+}
+
+//What patchKernel11(), installK11Extension() and patchK11ModuleLoading() look for
+static void plantKernel11PatchSites(u8 *pos, u32 size, u32 section0Size)
+{
+    u32 *words = (u32 *)pos,
+        *sites = &words[SIM_K11_PATCH_SITES / 4],
+        page = size / 4 - 0x800;
+
+    //svcControlMemory calls ControlMemory, which compares the process ID to 1 two instructions after loading it
+    static const u32 controlMemory[] = {0xE92D4FF0, 0xE24DD014, 0xE5901000, 0xE5D11000, 0xE3510001, 0x13A00000};
+    words[(SIM_K11_SVCS + 0x20) / 4 + 5] = 0xEB000000 | (((SIM_K11_PATCH_SITES - (SIM_K11_SVCS + 0x20 + 20 + 8)) >> 2) & 0xFFFFFF);
+    memcpy(sites, controlMemory, sizeof(controlMemory));
+
+    //svcDebugActiveProcess and svcKernelSetState
+    words[(SIM_K11_SVCS + 0x20 * 0x60) / 4 + 1] = 0xE3110001;
+    words[(SIM_K11_SVCS + 0x20 * 0x7C) / 4] = 0xE5D00001;
+    words[(SIM_K11_SVCS + 0x20 * 0x7C) / 4 + 1] = 0xE3500000;
+
+    //The MMU setup, FCRAM layout and SGI0 hooks, the latter going two instructions before cpsie i
+    static const u32 mmuSetup[] = {0xE3A0C202, 0xE3A010FF},
+                     fcramLayout[] = {0xE5A40008, 0xE0801002, 0xE5841008},
+                     sgi0Setup[] = {0xE1A00000, 0xE320F003, 0xEAFFFFFD};
+    memcpy(&sites[0x100 / 4], mmuSetup, sizeof(mmuSetup));
+    memcpy(&sites[0x200 / 4], fcramLayout, sizeof(fcramLayout));
+    sites[0x300 / 4] = 0xF1080080;
+    sites[0x308 / 4] = 0xE1A00000;
+    memcpy(&sites[0x320 / 4], sgi0Setup, sizeof(sgi0Setup));
+
+    //kernelpanic, the user exception handlers flag and the ThreadDebug reschedule
+    static const u32 threadDebugReschedule[] = {0xE5D42034, 0xE3550000, 0x13A00080};
+    sites[0x400 / 4] = 0xE2440B02;
+    words[page + 0x20] = 0x096007F9;
+    memcpy(&sites[0x500 / 4], threadDebugReschedule, sizeof(threadDebugReschedule));
+
+    //Module loading: the end of the modules follows ldr r0, [pc], and the size of section 0 comes after it. Then GetSystemInfo
+    memcpy(&pos[SIM_K11_PATCH_SITES + 0x603], "\xE2\x05\x00\x57", 4);
+    sites[0x610 / 4] = 0xE59F0000;
+    sites[0x618 / 4] = SIM_K11_MODULES_VA;
+    sites[0x620 / 4] = section0Size;
+    memcpy(&pos[SIM_K11_PATCH_SITES + 0x700], "\x06\xA0\xE1\xF2", 4);
+}
+
+//The exception handlers install, the SVC table (with svcBreak), kernelpanic and the UNITINFO check
+static void plantKernel9PatchSites(u8 *pos)
+{
+    u32 *sites = (u32 *)(pos + SIM_K9_PATCH_SITES);
+
+    static const u32 exceptionHandlersInstall[] = {0xE5801000, 0xE5800004, 0xE3A01C40, 0xE3A01040},
+                     svcHandler[] = {0xE14FE000, 0xE1A0E00E, 0xE1A0E00E, 0};
+    memcpy(sites, exceptionHandlersInstall, sizeof(exceptionHandlersInstall));
+    memcpy(&sites[0x100 / 4], svcHandler, sizeof(svcHandler));
+    sites[0x10C / 4 + 0x3C] = SIM_K9_ADDRESS + SIM_K9_PATCH_SITES + 0x400;
+    sites[0x500 / 4] = 0x15922000;
+    sites[0x600 / 4] = 0x13A01001;
+}
+
+//Each at an offset that keeps what the patch writes aligned
+static void plantProcess9PatchSites(u8 *pos)
+{
+    #define SITE(offset, a) {(offset), (a), sizeof(a)}
+
+    static const struct
+    {
+        u32 offset;
+        const u8 *pattern;
+        u32 size;
+    } sites[] = {
+        SITE(0x100, p9SignatureChecksPattern),
+        SITE(0x203, p9SignatureChecksPattern2),
+        SITE(0x1000, p9FirmWritesPattern),
+        SITE(0x2013, p9FirmlaunchPattern),
+        SITE(0x3000, p9TitleInstallMinVersionPattern),
+        SITE(0x3101, p9ZeroKeyNcchEncryptionPattern),
+        SITE(0x3202, p9NandNcchEncryptionPattern),
+        SITE(0x3303, p9AccessChecksPattern),
+        SITE(0x3401, p9LgySignatureChecksPattern),
+        SITE(0x3501, p9TwlInvalidSignatureChecksPattern),
+        SITE(0x3600, p9TwlNintendoLogoChecksPattern),
+        SITE(0x3700, p9TwlWhitelistChecksPattern),
+        SITE(0x3801, p9TwlFlashcartChecksPattern),
+        SITE(0x3900, p9TwlShaHashChecksPattern),
+        SITE(0x3A00, p9AgbBootSplashPattern)
+    };
+
+    #undef SITE
+
+    for(u32 i = 0; i < sizeof(sites) / sizeof(*sites); i++) memcpy(pos + sites[i].offset, sites[i].pattern, sites[i].size);
+
+    //The branch patchFirmWrites() replaces comes before "exe:"
+    memcpy(pos + 0xF80, "\x00\x28\x01\xDA", 4);
+}
+
+//A zero k11Size gives a TWL/AGB-like FIRM, without Kernel11
+static void layoutSyntheticFirm(SimImage *img, u32 k11Size, u32 k9Size, u32 p9Size)
+{
+    u32 modulesSize = SIM_NB_MODULES * SIM_MODULE_SIZE,
+        exeFsSize = (p9Size + 0x1FF) / 0x200,
+        arm9Size = k9Size + sizeof(Cxi) + 0x200 + exeFsSize * 0x200,
+        arm9SectionIndex = k11Size == 0 ? 3 : 2;
+
+    simFirmAlloc(&img->sim, modulesSize + k11Size + arm9Size);
+    memset(&img->hints, 0, sizeof(img->hints));
+
+    Firm *firm = img->sim.firm;
+    u8 *arm9Section = img->sim.image + modulesSize + k11Size;
+
+    memcpy(firm->magic, "FIRM", 4);
+    firm->section[0].offset = FIRM_HEADER_SPACE;
+    firm->section[0].address = simSection0;
+    firm->section[0].size = modulesSize;
+    firm->section[1].offset = FIRM_HEADER_SPACE + modulesSize;
+    firm->section[1].address = (u8 *)0x1FF80000;
+    firm->section[1].size = k11Size;
+    firm->section[arm9SectionIndex].offset = FIRM_HEADER_SPACE + modulesSize + k11Size;
+    firm->section[arm9SectionIndex].address = (u8 *)SIM_K9_ADDRESS;
+    firm->section[arm9SectionIndex].size = arm9Size;
+
+    for(u32 i = 0; i < 4; i++)
+        testFillRandom(firm->section[i].hash, 0x20, 256);
+
+    for(u32 i = 0; i < SIM_NB_MODULES; i++)
+        buildModule(img->sim.image + i * SIM_MODULE_SIZE, simModuleNames[i], SIM_MODULE_SIZE);
+
+    //Process9 is the only file in its ExeFS
+    fill(arm9Section, arm9Size);
+
+    Cxi *process9Cxi = (Cxi *)(arm9Section + k9Size);
+    memset(process9Cxi, 0, sizeof(Cxi) + 0x200);
+    memcpy(process9Cxi->ncch.magic, "NCCH", 4);
+    process9Cxi->ncch.exeFsOffset = sizeof(Cxi) / 0x200;
+    process9Cxi->ncch.exeFsSize = 1 + exeFsSize;
+    process9Cxi->exHeader.systemControlInfo.textCodeSet.address = SIM_P9_ADDRESS;
+
+    img->regions[SIM_REGION_KERNEL11] = k11Size == 0 ? NULL : img->sim.image + modulesSize;
+    img->regions[SIM_REGION_KERNEL9] = arm9Section;
+    img->regions[SIM_REGION_PROCESS9] = arm9Section + k9Size + sizeof(Cxi) + 0x200;
+    img->sizes[SIM_REGION_KERNEL11] = k11Size;
+    img->sizes[SIM_REGION_KERNEL9] = k9Size;
+    img->sizes[SIM_REGION_PROCESS9] = p9Size;
+}
+
+static void buildSyntheticFirm(SimImage *img, u32 k11Size, u32 k9Size, u32 p9Size)
+{
+    layoutSyntheticFirm(img, k11Size, k9Size & ~3, p9Size);
+    img->firmType = k11Size == 0 ? TWL_FIRM : NATIVE_FIRM;
+
+    if(k11Size != 0)
+    {
+        buildKernel11(img->regions[SIM_REGION_KERNEL11], k11Size, &img->hints);
+        plantSignatures(img->regions[SIM_REGION_KERNEL11], SIM_K11_TEXT_PLANTS, k11Size - 0x2000 - 0x20);
+    }
+
+    plantSignatures(img->regions[SIM_REGION_KERNEL9], 0, img->sizes[SIM_REGION_KERNEL9]);
+    plantSignatures(img->regions[SIM_REGION_PROCESS9], 0, p9Size);
+}
+
+//Sizes of at least 0x20000, 0x2000 and 0x4000
+static void buildPatchableFirm(SimImage *img, FirmwareType firmType, u32 k11Size, u32 k9Size, u32 p9Size)
+{
+    if(firmType != NATIVE_FIRM) k11Size = 0;
+
+    layoutSyntheticFirm(img, k11Size, k9Size, p9Size);
+    img->firmType = firmType;
+
+    if(k11Size != 0)
+    {
+        buildKernel11(img->regions[SIM_REGION_KERNEL11], k11Size, &img->hints);
+        plantKernel11PatchSites(img->regions[SIM_REGION_KERNEL11], k11Size, img->sim.firm->section[0].size);
+    }
+
+    plantKernel9PatchSites(img->regions[SIM_REGION_KERNEL9]);
+    plantProcess9PatchSites(img->regions[SIM_REGION_PROCESS9]);
+}
+
+//What firm.c does once the FIRM is loaded, for a SysNAND boot with the default options. TWL and AGB FIRMs get the sysmodules
+//there are on the SD, as when loaded from storage. VRAM has to be loaded first
+static u32 simPatchFirm(SimFirm *sim, FirmwareType firmType)
+{
+    firm = sim->firm;
+
+    switch(firmType)
+    {
+        case TWL_FIRM:
+            return patchTwlFirm(0xFFFFFFFF, true, false);
+        case AGB_FIRM:
+            return patchAgbFirm(true, false);
+        default:
+            return patchNativeFirm(0xFFFFFFFF, FIRMWARE_SYSNAND, false, true, false, false);
+    }
+}
+
+//Makes nbLookups lookups of random signatures in random regions, the way the patches do: what's found is often overwritten, so that
+//looking for the same signature again finds the next occurrence. The sequence only depends on seed. Returns how many results
+//differ from a plain search
+static u32 lookUpSignatures(SimImage *img, u32 seed, u32 nbLookups)
+{
+    u32 mismatches = 0;
+
+    for(u32 n = 0; n < nbLookups; n++)
+    {
+        seed = seed * 1103515245 + 12345;
+
+        u32 region = (seed >> 8) % SIM_REGION_COUNT,
+            i = (seed >> 12) % NB_SIGNATURES;
+        if(img->regions[region] == NULL) region = SIM_REGION_PROCESS9;
+
+        u8 *pos = img->regions[region],
+           *expected = memsearch(pos, signatures[i].pattern, img->sizes[region], signatures[i].size),
+           *result = findSignature(pos, signatures[i].pattern, img->sizes[region], signatures[i].size);
+
+        if(result != expected) mismatches++;
+        if(result != NULL && (seed >> 24) % 3 != 0) result[0] ^= 0xFF;
+    }
+
+    return mismatches;
+}
+
+static void testLookupsMatchPlainSearches(void)
+{
+    for(u32 round = 0; round < 300; round++)
+    {
+        SimImage img;
+        u32 k11Size = round % 10 == 9 ? 0 : 0x10000 + 4 * (testRand() % 0x4000),
+            k9Size = testRand() % 0x8000,
+            p9Size = round % 20 == 0 ? testRand() % 12 : testRand() % 0x20000,
+            seed = testRand(),
+            nbLookups = 1 + testRand() % SIGNATURE_CACHE_MAX_LOOKUPS;
+
+        buildSyntheticFirm(&img, k11Size, k9Size, p9Size);
+
+        u8 *original = malloc(img.sim.size + 1),
+           *cold = malloc(img.sim.size + 1);
+        memcpy(original, img.sim.image, img.sim.size);
+
+        //NAND mode: no SD access at all
+        isSdMode = false;
+        sdClear();
+        loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+        CHECK(lookUpSignatures(&img, seed, nbLookups) == 0);
+        saveSignatureCache();
+        CHECK(sdReads == 0 && sdWrites == 0);
+
+        //First boot from the SD: searched, then cached
+        memcpy(img.sim.image, original, img.sim.size);
+        isSdMode = true;
+        loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+        CHECK(lookUpSignatures(&img, seed, nbLookups) == 0);
+        saveSignatureCache();
+        CHECK(sdWrites == 1);
+        memcpy(cold, img.sim.image, img.sim.size);
+
+        //Next boot: the same lookups, all from the cache, and nothing to write
+        memcpy(img.sim.image, original, img.sim.size);
+        loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+        CHECK(lookUpSignatures(&img, seed, nbLookups) == 0);
+        CHECK(signatureCache.nbCachedLookups == nbLookups);
+        saveSignatureCache();
+        CHECK(sdWrites == 1);
+        CHECK(memcmp(cold, img.sim.image, img.sim.size) == 0);
+
+        //Other lookups: the cache is only used as long as it matches
+        memcpy(img.sim.image, original, img.sim.size);
+        loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+        CHECK(lookUpSignatures(&img, seed + 1, nbLookups) == 0);
+        saveSignatureCache();
+
+        free(original);
+        free(cold);
+        simFirmFree(&img.sim);
+    }
+
+    sdClear();
+}
+
+static void testSignatureCache(void)
+{
+    SimImage img;
+    const char *path = "cache/native_signatures.bin";
+
+    isSdMode = true;
+    sdClear();
+    buildSyntheticFirm(&img, 0x20000, 0x4000, 0x10000);
+
+    u8 *p9 = img.regions[SIM_REGION_PROCESS9];
+    u32 p9Size = img.sizes[SIM_REGION_PROCESS9];
+    const u8 *pattern = signatures[12].pattern;
+    u32 patternSize = signatures[12].size;
+
+    //Make sure that there's an occurrence of the pattern after the start of Process9
+    memcpy(p9 + p9Size / 2, pattern, patternSize);
+    memset(p9, 0, p9Size / 2);
+
+    //First boot: searched, then saved
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    u8 *found = findSignature(p9, pattern, p9Size, patternSize);
+    saveSignatureCache();
+    CHECK(found == p9 + p9Size / 2);
+    CHECK(sdWrites == 1 && sdFind(path) != SD_MAX_FILES && sdFiles[sdFind(path)].size == sizeof(SignatureCacheHeader) + sizeof(SignatureLookup));
+
+    //Next boot: an earlier occurrence planted without touching the section hashes isn't seen, as nothing is searched
+    memcpy(p9, pattern, patternSize);
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    CHECK(findSignature(p9, pattern, p9Size, patternSize) == found);
+    saveSignatureCache();
+    CHECK(sdWrites == 1);
+
+    //Unless the location doesn't hold the pattern anymore
+    found[0] ^= 0xFF;
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    CHECK(findSignature(p9, pattern, p9Size, patternSize) == p9);
+    saveSignatureCache();
+    CHECK(sdWrites == 2);
+    found[0] ^= 0xFF;
+
+    //Each FIRM type has its own cache
+    loadSignatureCache(img.sim.firm, SAFE_FIRM);
+    findSignature(p9, pattern, p9Size, patternSize);
+    saveSignatureCache();
+    CHECK(sdWrites == 3 && sdFind("cache/safe_signatures.bin") != SD_MAX_FILES);
+
+    //A different FIRM is a miss
+    memset(p9, 0, patternSize);
+    img.sim.firm->section[2].hash[0] ^= 1;
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    CHECK(signatureCache.nbCachedLookups == 0);
+    CHECK(findSignature(p9, pattern, p9Size, patternSize) == found);
+    saveSignatureCache();
+    CHECK(sdWrites == 4);
+
+    //Out of range offsets, a truncated file or another build's cache are rejected
+    SignatureLookup *lookup = (SignatureLookup *)(sdFiles[sdFind(path)].data + sizeof(SignatureCacheHeader));
+    lookup->result = p9Size;
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    CHECK(findSignature(p9, pattern, p9Size, patternSize) == found);
+    saveSignatureCache();
+    CHECK(sdWrites == 5);
+
+    sdFiles[sdFind(path)].size--;
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    CHECK(signatureCache.nbCachedLookups == 0);
+    saveSignatureCache();
+
+    ((SignatureCacheHeader *)sdFiles[sdFind(path)].data)->commitHash ^= 1;
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    CHECK(signatureCache.nbCachedLookups == 0);
+    CHECK(findSignature(p9, pattern, p9Size, patternSize) == found);
+    saveSignatureCache();
+    CHECK(sdWrites == 6);
+
+    //Once a boot makes a different lookup, the rest is searched for
+    const u8 *other = signatures[13].pattern;
+    u32 otherSize = signatures[13].size;
+
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    findSignature(p9, other, p9Size, otherSize);
+    findSignature(p9, pattern, p9Size, patternSize);
+    saveSignatureCache();
+    CHECK(sdWrites == 7);
+
+    memcpy(p9, pattern, patternSize);
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    findSignature(p9 + 4, other, p9Size - 4, otherSize);
+    CHECK(findSignature(p9, pattern, p9Size, patternSize) == p9);
+    saveSignatureCache();
+    CHECK(sdWrites == 8);
+
+    //Too many lookups to cache
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    for(u32 i = 0; i <= SIGNATURE_CACHE_MAX_LOOKUPS; i++)
+        CHECK(findSignature(p9 + i, pattern, p9Size - i, patternSize) == memsearch(p9 + i, pattern, p9Size - i, patternSize));
+    saveSignatureCache();
+    CHECK(sdWrites == 8);
+
+    //Without a cache, findSignature() is memsearch()
+    CHECK(findSignature(p9 + 1, pattern, p9Size - 1, patternSize) == found);
+
+    simFirmFree(&img.sim);
+    sdClear();
+}
+
+static void testKernel11SymbolHints(void)
+{
+    SimImage img;
+
+    isSdMode = true;
+    sdClear();
+    buildSyntheticFirm(&img, 0x20000, 0x4000, 0x10000);
+
+    u8 *k11 = img.regions[SIM_REGION_KERNEL11];
+    u32 k11Size = img.sizes[SIM_REGION_KERNEL11],
+        baseK11VA,
+        *arm11SvcHandler,
+        *arm11ExceptionsPage;
+    u8 *freeK11Space;
+    Kernel11SymbolHints hints;
+
+    //Resolved, then cached along with the signatures
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    getKernel11Info(k11, k11Size, &baseK11VA, &freeK11Space, &arm11SvcHandler, &arm11ExceptionsPage);
+    getKernel11SymbolHints(&hints, k11, k11Size, arm11ExceptionsPage);
+    saveSignatureCache();
+    CHECK(baseK11VA == SIM_K11_BASE_VA);
+    CHECK(memcmp(&hints, &img.hints, sizeof(hints)) == 0);
+    CHECK(sdWrites == 1);
+
+    //From the cache, even though the kernel changed
+    memset(k11 + 0x9000, 0, 8);
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    getKernel11Info(k11, k11Size, &baseK11VA, &freeK11Space, &arm11SvcHandler, &arm11ExceptionsPage);
+    getKernel11SymbolHints(&hints, k11, k11Size, arm11ExceptionsPage);
+    saveSignatureCache();
+    CHECK(memcmp(&hints, &img.hints, sizeof(hints)) == 0);
+    CHECK(sdWrites == 1);
+
+    //Not if they're asked for at another point
+    loadSignatureCache(img.sim.firm, NATIVE_FIRM);
+    getKernel11SymbolHints(&hints, k11, k11Size, arm11ExceptionsPage);
+    saveSignatureCache();
+    CHECK(hints.invalidateInstructionCacheRangeBody == 0);
+    CHECK(sdWrites == 2);
+
+    simFirmFree(&img.sim);
+    sdClear();
+}
+
+//k11_extension's resolvers on a kernel image, with arm9's hints and without any: they have to find the same
+static bool compareKernel11Resolvers(u8 *k11, u32 baseK11VA, u32 rodataVA, u32 interruptManagerVA, const Kernel11SymbolHints *hints, bool *usedHints)
+{
+    Kernel11Text text = {(const u32 *)k11, baseK11VA, rodataVA};
+    Kernel11SymbolHints noHints;
+    SchedulerSymbols hinted, scanned;
+    const u32 *hintedLoad, *scannedLoad;
+
+    memset(&noHints, 0, sizeof(noHints));
+
+    bool fcramHint = findFcramDescriptorLoad(&hintedLoad, &text, hints),
+         schedulerHints = findSchedulerSymbols(&hinted, &text, hints, interruptManagerVA, SIM_K11_OBJECT_CONTEXT);
+
+    findFcramDescriptorLoad(&scannedLoad, &text, &noHints);
+    findSchedulerSymbols(&scanned, &text, &noHints, interruptManagerVA, SIM_K11_OBJECT_CONTEXT);
+
+    *usedHints = fcramHint && schedulerHints;
+
+    return hintedLoad == scannedLoad && memcmp(&hinted, &scanned, sizeof(hinted)) == 0;
+}
+
+static void testKernel11Resolvers(void)
+{
+    SimImage img;
+
+    isSdMode = false;
+    buildSyntheticFirm(&img, 0x20000, 0x4000, 0x10000);
+
+    u8 *k11 = img.regions[SIM_REGION_KERNEL11];
+    u32 k11Size = img.sizes[SIM_REGION_KERNEL11],
+        rodataVA = SIM_K11_BASE_VA + k11Size - 0x3000,
+        interruptManager = rodataVA + 0x234,
+        baseK11VA,
+        *arm11SvcHandler,
+        *arm11ExceptionsPage;
+    u8 *freeK11Space;
+    Kernel11SymbolHints hints;
+    bool usedHints;
+
+    getKernel11Info(k11, k11Size, &baseK11VA, &freeK11Space, &arm11SvcHandler, &arm11ExceptionsPage);
+    resolveKernel11SymbolHints(&hints, k11, k11Size, arm11ExceptionsPage);
+
+    CHECK(compareKernel11Resolvers(k11, SIM_K11_BASE_VA, rodataVA, interruptManager, &hints, &usedHints));
+    CHECK(usedHints);
+
+    Kernel11Text text = {(const u32 *)k11, SIM_K11_BASE_VA, rodataVA};
+    SchedulerSymbols symbols;
+    const u32 *fcramDescriptorLoad;
+
+    CHECK(findFcramDescriptorLoad(&fcramDescriptorLoad, &text, &hints) && fcramDescriptorLoad == (u32 *)(k11 + 0x6000));
+    CHECK(findSchedulerSymbols(&symbols, &text, &hints, interruptManager, SIM_K11_OBJECT_CONTEXT));
+    CHECK(symbols.adjustThread == (u32 *)(k11 + 0x7100) && symbols.attemptSwitchingThreadContext == (u32 *)(k11 + 0x8100) - 2);
+    CHECK(symbols.invalidateInstructionCacheRange == (u32 *)(k11 + 0x8F00));
+
+    //Hints that don't point at what they should, or out of .text, are scanned for
+    Kernel11SymbolHints staleHints = hints;
+    staleHints.fcramDescriptorLoad += 4;
+    staleHints.invalidateInstructionCacheRangeBody = rodataVA;
+    CHECK(compareKernel11Resolvers(k11, SIM_K11_BASE_VA, rodataVA, interruptManager, &staleHints, &usedHints));
+    CHECK(!usedHints);
+    CHECK(!findSchedulerSymbols(&symbols, &text, &staleHints, interruptManager, SIM_K11_OBJECT_CONTEXT));
+    CHECK(symbols.invalidateInstructionCacheRange == (u32 *)(k11 + 0x8F00));
+
+    simFirmFree(&img.sim);
+}
+
+static void testPatchNativeFirm(void)
+{
+    SimImage img;
+
+    isSdMode = true;
+    sdClear();
+    loadVram();
+    buildPatchableFirm(&img, NATIVE_FIRM, 0x20000, 0x2000, 0x4000);
+
+    u8 *k11 = img.regions[SIM_REGION_KERNEL11],
+       *k9 = img.regions[SIM_REGION_KERNEL9],
+       *p9 = img.regions[SIM_REGION_PROCESS9],
+       *vram = mapVram(),
+       nintendoModules[SIM_NB_MODULES * SIM_MODULE_SIZE];
+    u32 *k11Words = (u32 *)k11,
+        *k11Sites = (u32 *)(k11 + SIM_K11_PATCH_SITES),
+        *k9Sites = (u32 *)(k9 + SIM_K9_PATCH_SITES),
+        page = img.sizes[SIM_REGION_KERNEL11] / 4 - 0x800;
+
+    memcpy(nintendoModules, img.sim.image, sizeof(nintendoModules));
+
+    bootProfStart();
+    CHECK(simPatchFirm(&img.sim, NATIVE_FIRM) == 0);
+
+    //installK11Extension(): the hooks, the exception handlers and the parameters, with the symbol hints of the unpatched kernel
+    CHECK(k11Sites[0x100 / 4] >> 24 == 0xEB && k11Sites[0x208 / 4] >> 24 == 0xEB);
+    CHECK(k11Sites[0x2F8 / 4] >> 24 == 0xEB && k11Sites[0x318 / 4] >> 24 == 0xEB);
+    for(u32 id = 1; id <= 4; id++)
+        CHECK(*getKernel11HandlerVAPos(k11, &k11Words[page], SIM_K11_BASE_VA, id) == K11EXT_VA + 0x10 + 4 * (id - 1));
+    CHECK(memsearch(vram + SIM_KEXT_PARAMS, "LUMA", 0x1000, 4) != NULL);
+    CHECK(memsearch(vram + SIM_KEXT_PARAMS, &img.hints, 0x1000, sizeof(img.hints)) != NULL);
+
+    //patchKernel11()
+    CHECK(k11Sites[2] == 0xE59D1040);
+    CHECK(k11Words[(SIM_K11_SVCS + 0x20 * 0x60) / 4 + 1] == 0xE3B01001);
+    CHECK(k11Words[(SIM_K11_SVCS + 0x20 * 0x7C) / 4 + 2] == 0xE1A00000);
+    CHECK(k11Sites[0x3E8 / 4] == 0xE12FFF7E && k11Words[page + 0x21] == K11EXT_VA + 0x28);
+    CHECK(k11Sites[0x4EC / 4] == 0xE51FF004 && k11Sites[0x4F0 / 4] == K11EXT_VA + 0x2C);
+
+    //Kernel9 and Process9
+    CHECK(*(u16 *)(p9 + 0x100) == 0x2000 && *(u16 *)(p9 + 0x202) == 0x2000);
+    CHECK(*(u16 *)(p9 + 0xF80) == 0x2000);
+    CHECK(memcmp(p9 + 0x2000, rebootPatch, rebootPatchSize) == 0);
+    CHECK(*(u16 *)(p9 + 0x3100) == 0x2001 && *(u16 *)(p9 + 0x3200) == 0x2001 && *(u16 *)(p9 + 0x3300) == 0x2001);
+    CHECK(k9Sites[0x400 / 4] == 0xE1A0800D && arm9ExceptionHandlerSvcBreakAddress == SIM_K9_ADDRESS + SIM_K9_PATCH_SITES + 0x400);
+    CHECK(k9Sites[0x4CC / 4] == 0xE12FFF7E);
+
+    //mergeSection0(): Nintendo's sysmodules with our loader instead of theirs, then ours
+    u32 modulesSize = (SIM_NB_MODULES - 1) * SIM_MODULE_SIZE + SIM_LOADER_SIZE + SIM_ROSALINA_SIZE;
+
+    CHECK(memcmp(simSection0, nintendoModules, 3 * SIM_MODULE_SIZE) == 0);
+    CHECK(memcmp(simSection0 + 3 * SIM_MODULE_SIZE, vram + SIM_SYSMODULES, SIM_LOADER_SIZE) == 0);
+    CHECK(memcmp(simSection0 + 3 * SIM_MODULE_SIZE + SIM_LOADER_SIZE, nintendoModules + 4 * SIM_MODULE_SIZE, SIM_MODULE_SIZE) == 0);
+    CHECK(memcmp(simSection0 + 4 * SIM_MODULE_SIZE + SIM_LOADER_SIZE, vram + SIM_SYSMODULES + SIM_LOADER_SIZE, SIM_ROSALINA_SIZE) == 0);
+    CHECK(img.sim.firm->section[0].size == 0);
+
+    //And patchK11ModuleLoading(), as there's one more module
+    CHECK(k11[SIM_K11_PATCH_SITES + 0x604] == 6 && k11[SIM_K11_PATCH_SITES + 0x70B] == 6);
+    CHECK(k11Sites[0x61C / 4] == SIM_K11_MODULES_VA + modulesSize && k11Sites[0x620 / 4] == modulesSize);
+
+    simFirmFree(&img.sim);
+    sdClear();
+}
+
+static void testPatchLgyFirms(void)
+{
+    SimImage img;
+    u8 module[2 * SIM_MODULE_SIZE];
+
+    isSdMode = true;
+    sdClear();
+    loadVram();
+
+    //TWL_FIRM, with one of the sysmodules from the SD
+    buildPatchableFirm(&img, TWL_FIRM, 0, 0x2000, 0x4000);
+    buildModule(module, "pm", sizeof(module));
+    fileWrite(module, "sysmodules/pm.cxi", sizeof(module));
+
+    u8 *p9 = img.regions[SIM_REGION_PROCESS9];
+
+    bootProfStart();
+    CHECK(simPatchFirm(&img.sim, TWL_FIRM) == 0);
+    CHECK(*(u16 *)(p9 + 0x3402) == 0x2000 && *(u16 *)(p9 + 0x3500) == 0x2001 && *(u16 *)(p9 + 0x3602) == 0x2000);
+    CHECK(*(u16 *)(p9 + 0x3704) == 0x2000 && *(u16 *)(p9 + 0x381C) == 0x2001 && *(u16 *)(p9 + 0x3900) == 0x2001);
+    CHECK(memcmp(simSection0, img.sim.image, 2 * SIM_MODULE_SIZE) == 0);
+    CHECK(memcmp(simSection0 + 2 * SIM_MODULE_SIZE, module, sizeof(module)) == 0);
+    CHECK(memcmp(simSection0 + 2 * SIM_MODULE_SIZE + sizeof(module), img.sim.image + 3 * SIM_MODULE_SIZE, 2 * SIM_MODULE_SIZE) == 0);
+    CHECK(img.sim.firm->section[0].size == 0);
+    simFirmFree(&img.sim);
+
+    //AGB_FIRM, showing the boot splash
+    configData.config = 1 << SHOWGBABOOT;
+    buildPatchableFirm(&img, AGB_FIRM, 0, 0x2000, 0x4000);
+    p9 = img.regions[SIM_REGION_PROCESS9];
+
+    CHECK(simPatchFirm(&img.sim, AGB_FIRM) == 0);
+    CHECK(*(u16 *)(p9 + 0x3402) == 0x2000 && p9[0x3A02] == 0x26);
+    CHECK(memcmp(simSection0 + 2 * SIM_MODULE_SIZE, module, sizeof(module)) == 0);
+
+    configData.config = 0;
+    simFirmFree(&img.sim);
+    sdClear();
+}
+
+//Patching a FIRM from the signature cache has to give the very same result as patching it without: the image, section 0
+//and what's handed over to k11_extension
+static void testCachedPatchingMatches(void)
+{
+    static const FirmwareType firmTypes[] = {NATIVE_FIRM, TWL_FIRM, AGB_FIRM};
+
+    for(u32 round = 0; round < 3 * 4; round++)
+    {
+        SimImage img;
+        FirmwareType firmType = firmTypes[round % 3];
+
+        isSdMode = true;
+        sdClear();
+        buildPatchableFirm(&img, firmType, 0x20000 + 0x1000 * (testRand() % 0x20), 0x2000 + 4 * (testRand() % 0x400), 0x4000 + testRand() % 0x4000);
+
+        u32 firmSize = FIRM_HEADER_SPACE + img.sim.size,
+            section0Size = firmType == NATIVE_FIRM ? (SIM_NB_MODULES - 1) * SIM_MODULE_SIZE + SIM_LOADER_SIZE + SIM_ROSALINA_SIZE :
+                                                     img.sim.firm->section[0].size;
+        u8 *original = malloc(firmSize),
+           *cold = malloc(firmSize),
+           *coldSection0 = malloc(section0Size),
+           coldParams[0x1000];
+        memcpy(original, img.sim.firm, firmSize);
+
+        //Cold: every site is searched for, then cached
+        arm9ExceptionHandlerSvcBreakAddress = rebootPatchFopenPtr = 0;
+        loadVram();
+        bootProfStart();
+        CHECK(simPatchFirm(&img.sim, firmType) == 0);
+        CHECK(sdWrites == 1);
+        memcpy(cold, img.sim.firm, firmSize);
+        memcpy(coldSection0, simSection0, section0Size);
+        memcpy(coldParams, mapVram() + SIM_KEXT_PARAMS, sizeof(coldParams));
+        u32 coldSvcBreakAddress = arm9ExceptionHandlerSvcBreakAddress,
+            coldFopenPtr = rebootPatchFopenPtr;
+
+        //Warm: the same FIRM, everything from the cache
+        memcpy(img.sim.firm, original, firmSize);
+        memset(simSection0, 0, section0Size);
+        arm9ExceptionHandlerSvcBreakAddress = rebootPatchFopenPtr = 0;
+        loadVram();
+        bootProfStart();
+        CHECK(simPatchFirm(&img.sim, firmType) == 0);
+        CHECK(signatureCache.nbCachedLookups != 0 && signatureCache.nbCachedLookups == signatureCache.nbLookups);
+        CHECK(sdWrites == 1);
+        CHECK(memcmp(cold, img.sim.firm, firmSize) == 0);
+        CHECK(memcmp(coldSection0, simSection0, section0Size) == 0);
+        CHECK(memcmp(coldParams, mapVram() + SIM_KEXT_PARAMS, sizeof(coldParams)) == 0);
+        CHECK(arm9ExceptionHandlerSvcBreakAddress == coldSvcBreakAddress && rebootPatchFopenPtr == coldFopenPtr);
+
+        free(original);
+        free(cold);
+        free(coldSection0);
+        simFirmFree(&img.sim);
+    }
+
+    sdClear();
+}
+
+//FCRAM, where loadNintendoFirm() reads FIRMs to. The other tests point firm.c's firm at their images
+#define FCRAM_ADDR      0x20000000
+#define FCRAM_SIZE      0x500000
+
+static void mapFcram(void)
+{
+    static u8 *fcram = NULL;
+
+    if(fcram == NULL)
+    {
+        fcram = mmap((void *)FCRAM_ADDR, FCRAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(fcram != (u8 *)FCRAM_ADDR) error("Couldn't map FCRAM at 0x%08X.", FCRAM_ADDR);
+    }
+
+    firm = (Firm *)(FCRAM_ADDR + 0x1000);
+}
+
+//An old3DS NATIVE_FIRM with an Arm11 kernel section and an Arm9 section, laid out for this host's Firm
+#define SIM_NAND_K11_SIZE   0x2000
+#define SIM_NAND_ARM9_SIZE  0x4000
+#define SIM_NAND_FIRM_SIZE  (0x200 + SIM_NAND_K11_SIZE + SIM_NAND_ARM9_SIZE)
+
+static u8 simNandFirm[SIM_NAND_FIRM_SIZE];
+
+static void buildNandFirm(void)
+{
+    Firm *nandFirm = (Firm *)simNandFirm;
+
+    testFillRandom(simNandFirm, sizeof(simNandFirm), 256);
+    memset(nandFirm, 0, 0x200);
+    memcpy(nandFirm->magic, "FIRM", 4);
+    nandFirm->arm11Entry = (u8 *)0x1FF80000;
+    nandFirm->arm9Entry = (u8 *)0x08006800;
+    nandFirm->section[1] = (FirmSection){.offset = 0x200, .address = (u8 *)0x1FF80000, .size = SIM_NAND_K11_SIZE, .procType = 1};
+    nandFirm->section[2] = (FirmSection){.offset = 0x200 + SIM_NAND_K11_SIZE, .address = (u8 *)0x08006800, .size = SIM_NAND_ARM9_SIZE};
+
+    for(u32 i = 1; i < 3; i++)
+        swSha256(nandFirm->section[i].hash, simNandFirm + nandFirm->section[i].offset, nandFirm->section[i].size);
+}
+
+//Encrypts the FIRM into the ExeFS of a CXI, as the NATIVE_FIRM content with this ID and title version
+static void writeNandContent(u32 contentId, u16 titleVersion)
+{
+    u32 cxiSize = 6 * 0x200 + SIM_NAND_FIRM_SIZE;
+    u8 *cxi = calloc(1, cxiSize),
+        ncchCtr[AES_BLOCK_SIZE];
+    Ncch *ncch = (Ncch *)cxi;
+    SwAesContext aes;
+
+    memcpy(ncch->magic, "NCCH", 4);
+    testFillRandom(ncch->partitionId, sizeof(ncch->partitionId), 256);
+    ncch->contentSize = cxiSize / 0x200;
+    ncch->exeFsOffset = 5;
+    ncch->exeFsSize = SIM_NAND_FIRM_SIZE / 0x200 + 1;
+
+    simExeFsCtr(ncchCtr, (Cxi *)cxi);
+    swAesSetKey(&aes, simKey0x2C);
+    swAesCtr(&aes, cxi + 6 * 0x200, simNandFirm, SIM_NAND_FIRM_SIZE, ncchCtr);
+
+    char path[64];
+
+    if(simNand.contentId != contentId)
+    {
+        u32 i;
+
+        sprintf(path, "1:/title/00040138/00000002/content/%08lx.app", (unsigned long)simNand.contentId);
+        if((i = sdFind(path)) != SD_MAX_FILES)
+        {
+            free(sdFiles[i].data);
+            memset(&sdFiles[i], 0, sizeof(sdFiles[i]));
+        }
+    }
+
+    simNand.contentId = contentId;
+    simNand.titleVersion = titleVersion;
+    sprintf(path, "1:/title/00040138/00000002/content/%08lx.app", (unsigned long)contentId);
+    fileWrite(cxi, path, cxiSize);
+    free(cxi);
+}
+
+//Boots CTRNAND's NATIVE_FIRM and checks it's the one that's there, whether it came from the cache or not
+static void bootNandFirm(void)
+{
+    FirmwareType firmType = NATIVE_FIRM;
+
+    nandReads = sdWrites = simDecryptions = simLocates = 0;
+    memset(firm, 0, 0x400000);
+
+    bootProfStart();
+    CHECK(loadNintendoFirm(&firmType, FIRMWARE_SYSNAND, false, false) == simNand.contentId);
+    CHECK(firmType == NATIVE_FIRM);
+    CHECK(memcmp(firm, simNandFirm, SIM_NAND_FIRM_SIZE) == 0);
+    CHECK(simLocates == 1);
+}
+
+static u8 *cachedFirmSection(u32 i)
+{
+    u32 cache = sdFind("cache/native.firm");
+
+    return cache == SD_MAX_FILES ? NULL : sdFiles[cache].data + ((Firm *)simNandFirm)->section[i].offset;
+}
+
+//The decrypted FIRM cache: misses read and decrypt the content and rewrite the cache, hits don't touch CTRNAND past the
+//directory lookup. A title update, another content or a corrupted cache make it miss
+static void testFirmCache(void)
+{
+    isSdMode = true;
+    sdClear();
+    mapFcram();
+    buildNandFirm();
+    memset(&simNand, 0, sizeof(simNand));
+    writeNandContent(0x16, 0x2C10);
+
+    //Without the option
+    configData.config = 0;
+    bootNandFirm();
+    CHECK(nandReads == 1 && simDecryptions == 1 && sdWrites == 0);
+    CHECK(sdFind("cache/native.firm") == SD_MAX_FILES);
+
+    //First boot with it, then the next one
+    configData.config = 1 << CACHEDECRYPTEDFIRM;
+    bootNandFirm();
+    CHECK(nandReads == 1 && simDecryptions == 1 && sdWrites == 1);
+    CHECK(sdFind("cache/native.firm") != SD_MAX_FILES);
+
+    bootNandFirm();
+    CHECK(nandReads == 0 && simDecryptions == 0 && sdWrites == 0);
+
+    //A title update with the same content ID, then one with a new content
+    writeNandContent(0x16, 0x2C20);
+    bootNandFirm();
+    CHECK(nandReads == 1 && simDecryptions == 1 && sdWrites == 1);
+    bootNandFirm();
+    CHECK(nandReads == 0 && simDecryptions == 0);
+
+    buildNandFirm();
+    writeNandContent(0x17, 0x3000);
+    bootNandFirm();
+    CHECK(nandReads == 1 && simDecryptions == 1 && sdWrites == 1);
+    bootNandFirm();
+    CHECK(nandReads == 0 && simDecryptions == 0);
+
+    //A flipped bit in a section fails checkFirm()
+    cachedFirmSection(2)[0x123] ^= 0x10;
+    bootNandFirm();
+    CHECK(nandReads == 1 && simDecryptions == 1 && sdWrites == 1);
+    bootNandFirm();
+    CHECK(nandReads == 0 && simDecryptions == 0);
+
+    //A consistently modified FIRM passes it, but not the hashes the cache was saved with
+    Firm *cachedFirm = (Firm *)sdFiles[sdFind("cache/native.firm")].data;
+
+    cachedFirmSection(1)[0x40] ^= 0x10;
+    swSha256(cachedFirm->section[1].hash, cachedFirmSection(1), SIM_NAND_K11_SIZE);
+    bootNandFirm();
+    CHECK(nandReads == 1 && simDecryptions == 1 && sdWrites == 1);
+    bootNandFirm();
+    CHECK(nandReads == 0 && simDecryptions == 0);
+
+    configData.config = 0;
+    sdClear();
+}
+
+//Each signature once, in one of the regions
+static double timeLookups(SimImage *img, u32 iterations)
+{
+    volatile uintptr_t sink = 0;
+    double start = testNow();
+
+    for(u32 n = 0; n < iterations; n++)
+    {
+        loadSignatureCache(img->sim.firm, NATIVE_FIRM);
+
+        for(u32 i = 0; i < SIM_REGION_COUNT; i++)
+            for(u32 j = 0; i + j < NB_SIGNATURES && img->regions[i] != NULL; j += SIM_REGION_COUNT)
+                sink += (uintptr_t)findSignature(img->regions[i], signatures[i + j].pattern, img->sizes[i], signatures[i + j].size);
+
+        saveSignatureCache();
+    }
+
+    (void)sink;
+
+    return (testNow() - start) / iterations;
+}
+
+static double timeKernel11SymbolHints(SimImage *img, u32 iterations)
+{
+    u8 *k11 = img->regions[SIM_REGION_KERNEL11];
+    u32 k11Size = img->sizes[SIM_REGION_KERNEL11],
+        baseK11VA,
+        *arm11SvcHandler,
+        *arm11ExceptionsPage;
+    u8 *freeK11Space;
+    Kernel11SymbolHints hints;
+
+    getKernel11Info(k11, k11Size, &baseK11VA, &freeK11Space, &arm11SvcHandler, &arm11ExceptionsPage);
+
+    double start = testNow();
+
+    for(u32 i = 0; i < iterations; i++) resolveKernel11SymbolHints(&hints, k11, k11Size, arm11ExceptionsPage);
+
+    return (testNow() - start) / iterations;
+}
+
+static void benchLookups(void)
+{
+    SimImage img;
+    const u32 iterations = 200;
+
+    //About the size of a native FIRM
+    armLikeFiller = true;
+    buildSyntheticFirm(&img, 0x60000, 0x10000, 0x80000);
+
+    isSdMode = false;
+    double plain = timeLookups(&img, iterations),
+           hints = timeKernel11SymbolHints(&img, iterations);
+
+    isSdMode = true;
+    sdClear();
+    timeLookups(&img, 1);
+    double warm = timeLookups(&img, iterations);
+
+    printf("firmsim: looking for the patch sites of a synthetic %lu KiB FIRM\n", (unsigned long)(img.sim.size >> 10));
+    printf("  one search per lookup:          %8.1f us\n", plain * 1e6);
+    printf("  Kernel11 symbol hints:          %8.1f us\n", hints * 1e6);
+    printf("  cache hit:                      %8.1f us\n", warm * 1e6);
+
+    armLikeFiller = false;
+    simFirmFree(&img.sim);
+    sdClear();
+}
+
+//patchNativeFirm() on a fresh copy of the FIRM each time
+static double timePatchNativeFirm(SimImage *img, const u8 *original, u32 iterations)
+{
+    double total = 0;
+
+    for(u32 i = 0; i < iterations; i++)
+    {
+        memcpy(img->sim.firm, original, FIRM_HEADER_SPACE + img->sim.size);
+        loadVram();
+        bootProfStart();
+
+        double start = testNow();
+        simPatchFirm(&img->sim, NATIVE_FIRM);
+        total += testNow() - start;
+    }
+
+    return total / iterations;
+}
+
+static void benchPatchNativeFirm(void)
+{
+    SimImage img;
+    const u32 iterations = 50;
+
+    buildPatchableFirm(&img, NATIVE_FIRM, 0x60000, 0x10000, 0x80000);
+
+    u8 *original = malloc(FIRM_HEADER_SPACE + img.sim.size);
+    memcpy(original, img.sim.firm, FIRM_HEADER_SPACE + img.sim.size);
+
+    isSdMode = false;
+    double plain = timePatchNativeFirm(&img, original, iterations);
+
+    isSdMode = true;
+    sdClear();
+    timePatchNativeFirm(&img, original, 1);
+    double warm = timePatchNativeFirm(&img, original, iterations);
+
+    printf("firmsim: patchNativeFirm() on a synthetic %lu KiB FIRM\n", (unsigned long)(img.sim.size >> 10));
+    printf("  without the cache:              %8.1f us\n", plain * 1e6);
+    printf("  cache hit:                      %8.1f us\n", warm * 1e6);
+
+    free(original);
+    simFirmFree(&img.sim);
+    sdClear();
+}
+
+static bool readFile(const char *path, SimFirm *sim)
+{
+    FILE *f = fopen(path, "rb");
+
+    if(f == NULL) return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    bool ok = size > 0 && size < 0x8000000;
+    if(ok)
+    {
+        simFirmAlloc(sim, (u32)size);
+        ok = fread(sim->image, 1, size, f) == (size_t)size;
+    }
+
+    fclose(f);
+
+    return ok;
+}
+
+static int simulateFirm(const char *firmPath, const char *typeName, const char *outPath)
+{
+    SimFirm sim;
+    FirmwareType firmType = NATIVE_FIRM;
+
+    if(strcmp(typeName, "native") == 0) firmType = NATIVE_FIRM;
+    else if(strcmp(typeName, "twl") == 0) firmType = TWL_FIRM;
+    else if(strcmp(typeName, "agb") == 0) firmType = AGB_FIRM;
+    else error("Unknown FIRM type %s, expected native, twl or agb.", typeName);
+
+    if(!readFile(firmPath, &sim)) error("Couldn't read %s.", firmPath);
+    if(!simFirmParseHeader(&sim)) error("%s isn't a valid FIRM.", firmPath);
+
+    //Only Process9 comes from a section other than the Arm9 binary one on native FIRM
+    u32 arm9SectionIndex = firmType == NATIVE_FIRM ? 2 : 3;
+    u8 *arm9Section = (u8 *)sim.firm + sim.firm->section[arm9SectionIndex].offset;
+
+    //Fails on N3DS FIRMs whose Arm9 binary is still encrypted
+    u32 process9Size,
+        process9MemAddr;
+    u8 *process9Offset = getProcess9Info(arm9Section, sim.firm->section[arm9SectionIndex].size, &process9Size, &process9MemAddr);
+
+    if(process9Offset + process9Size > sim.image + sim.size) error("Process9 goes past the end of %s.", firmPath);
+
+    //What installK11Extension() hands over to the kernel
+    if(firmType == NATIVE_FIRM)
+    {
+        u8 *arm11Section1 = (u8 *)sim.firm + sim.firm->section[1].offset,
+           *freeK11Space;
+        u32 baseK11VA,
+            *arm11SvcHandler,
+            *arm11ExceptionsPage;
+        Kernel11SymbolHints hints;
+
+        getKernel11Info(arm11Section1, sim.firm->section[1].size, &baseK11VA, &freeK11Space, &arm11SvcHandler, &arm11ExceptionsPage);
+        resolveKernel11SymbolHints(&hints, arm11Section1, sim.firm->section[1].size, arm11ExceptionsPage);
+        printf("kernel11 symbol hints: %08lX %08lX %08lX %08lX\n", (unsigned long)hints.fcramDescriptorLoad, (unsigned long)hints.schedulerAdjustThread,
+               (unsigned long)hints.attemptSwitchingThreadContextLiterals, (unsigned long)hints.invalidateInstructionCacheRangeBody);
+
+        //And what k11_extension makes of them. .text is assumed to end at the page of the InterruptManager, as in arm9
+        u32 textSize = (u32)((u8 *)arm11ExceptionsPage - arm11Section1),
+            interruptManager = hints.attemptSwitchingThreadContextLiterals == 0 ? 0 :
+                               *(u32 *)(arm11Section1 + hints.attemptSwitchingThreadContextLiterals - baseK11VA);
+        if(interruptManager > baseK11VA && interruptManager - baseK11VA < textSize) textSize = (interruptManager - baseK11VA) & ~0xFFF;
+
+        bool usedHints,
+             sameSymbols = compareKernel11Resolvers(arm11Section1, baseK11VA, baseK11VA + textSize, interruptManager, &hints, &usedHints);
+        printf("k11_extension: hints %s, %s its scans\n", usedHints ? "used" : "not used", sameSymbols ? "same symbols as" : "symbols differ from");
+    }
+
+    //First boot with this FIRM
+    isSdMode = true;
+    sdClear();
+    loadVram();
+    bootProfStart();
+    bootProfMark(BOOTSTAGE_FIRM_LOAD);
+
+    u32 failures = simPatchFirm(&sim, firmType);
+
+    bootProfMark(BOOTSTAGE_PATCH);
+
+    //The boot log, as written to the SD with the option enabled
+    configData.config = 1 << WRITEBOOTTIMELOG;
+    bootProfFinish();
+    u32 log = sdFind(BOOT_TIMELINE_FILE);
+    printf("%s:\n%s", BOOT_TIMELINE_FILE, log == SD_MAX_FILES ? "" : (const char *)sdFiles[log].data);
+
+    //The header is left as it was, section 0 with the merged sysmodules isn't written back
+    if(outPath != NULL)
+    {
+        FILE *f = fopen(outPath, "wb");
+        if(f == NULL || fwrite(sim.image, 1, sim.size, f) != sim.size) error("Couldn't write %s.", outPath);
+        fclose(f);
+    }
+
+    simFirmFree(&sim);
+    sdClear();
+
+    if(failures != 0) printf("%lu patch(es) failed\n", (unsigned long)failures);
+
+    return failures != 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(testIsBench(argc, argv))
+    {
+        benchLookups();
+        benchPatchNativeFirm();
+        return 0;
+    }
+
+    if(argc > 1) return simulateFirm(argv[1], argc > 2 ? argv[2] : "native", argc > 3 ? argv[3] : NULL);
+
+    testLookupsMatchPlainSearches();
+    testSignatureCache();
+    testKernel11SymbolHints();
+    testKernel11Resolvers();
+    testPatchNativeFirm();
+    testPatchLgyFirms();
+    testCachedPatchingMatches();
+    testFirmCache();
+
+    return testResult("firmsim");
+}
@@ -0,0 +1,368 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Reads files of various layouts with fileRead() from arm9/source/fs.c, over FatFs, the disk layer and an in-memory
+*   SD card, recording every command sent to the card and how many sectors it asks for
+*/
+
+#include <sys/mman.h>
+
+#include "test.h"
+#include "fatimage.h"
+#include "fatfs/ff.h"
+#include "fs.h"
+
+//Included rather than linked, as diskio.h needs ff.h first
+#include "fatfs/diskio.c"
+
+//Same as in fs.c
+#define EXTENT_READ_MIN_SIZE    0x10000
+#define EXTENT_MAX_SECTORS      0xFFFF
+
+static TestMedium sdCard;
+
+//Commands reading straight into the destination buffer, as opposed to cache line fills
+#define MAX_DIRECT_COMMANDS 64
+
+static const u8 *destStart, *destEnd;
+static u32 nbDirectCommands, directCommands[MAX_DIRECT_COMMANDS];
+
+u32 sdmmc_sdcard_init(void)
+{
+    return 0;
+}
+
+int sdmmc_sdcard_readsectors(u32 sector_no, u32 numsectors, u8 *out)
+{
+    if(out >= destStart && out < destEnd)
+    {
+        if(nbDirectCommands < MAX_DIRECT_COMMANDS) directCommands[nbDirectCommands] = numsectors;
+        nbDirectCommands++;
+    }
+
+    return testMediumRead(&sdCard, sector_no, numsectors, out);
+}
+
+int sdmmc_sdcard_writesectors(u32 sector_no, u32 numsectors, const u8 *in)
+{
+    return testMediumWrite(&sdCard, sector_no, numsectors, in);
+}
+
+int ctrNandInit(void)
+{
+    return 1;
+}
+
+int ctrNandRead(u32 sector, u32 sectorCount, u8 *outbuf)
+{
+    (void)sector;
+    (void)sectorCount;
+    (void)outbuf;
+    return 1;
+}
+
+int ctrNandWrite(u32 sector, u32 sectorCount, const u8 *inbuf)
+{
+    (void)sector;
+    (void)sectorCount;
+    (void)inbuf;
+    return 1;
+}
+
+bool I2C_readRegBuf(I2cDevice devId, u8 regAddr, u8 *out, u32 size)
+{
+    (void)devId;
+    (void)regAddr;
+    memset(out, 0x21, size);
+    return true;
+}
+
+//The rest of fs.c (menus, firmLocate()) isn't exercised here
+u32 drawString(bool isTopScreen, u32 posX, u32 posY, u32 color, const char *string)
+{
+    (void)isTopScreen;
+    (void)posX;
+    (void)color;
+    (void)string;
+    return posY;
+}
+
+void initScreens(void)
+{
+}
+
+void wait(u64 amount)
+{
+    (void)amount;
+}
+
+u32 waitInput(bool isMenu)
+{
+    (void)isMenu;
+    return 0;
+}
+
+u32 hexAtoi(const char *in, u32 digits)
+{
+    (void)in;
+    (void)digits;
+    return 0;
+}
+
+//The SD write protect switch, which disk_write() reads from the SDMMC registers
+static void mapSdmmcRegisters(void)
+{
+    void *regs = mmap((void *)SDMMC_BASE, 0x1000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(regs != (void *)SDMMC_BASE)
+    {
+        fprintf(stderr, "fsread: couldn't map the SDMMC registers\n");
+        exit(1);
+    }
+
+    *(vu16 *)(SDMMC_BASE + REG_SDSTATUS0) = TMIO_STAT0_WRPROTECT;
+}
+
+//FatFs R0.13c reads the character after the terminating null of a path, literals get a second one
+#define FF_PATH(path) (path "\0")
+
+static FATFS sdFs;
+
+//As mountVolume() in fs.c
+static void mountSd(void)
+{
+    CHECK(disk_initialize(SDCARD) == 0);
+    CHECK(f_mount(&sdFs, FF_PATH("0:"), 1) == FR_OK);
+    disk_setlayout(sdFs.pdrv, sdFs.win, sdFs.fatbase, sdFs.n_fats * sdFs.fsize);
+}
+
+//Big enough for a file with an extent longer than a command can read
+#define MAX_FILE_SIZE ((EXTENT_MAX_SECTORS + 0x200) * 512)
+
+static u8 *contents, *dest;
+
+/*
+*   Writes a file made of the given extents, in sectors (and clusters), the last one possibly ending with a partial
+*   sector. A spacer file is grown between two extents, so that FatFs can't allocate them next to each other
+*/
+static u32 writeFragmentedFile(const char *path, const u32 *extents, u32 nbExtents, u32 tailBytes)
+{
+    FIL file, spacer;
+    UINT written;
+    u32 size = 0;
+    u8 gap[512] = {0};
+
+    CHECK(f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+    CHECK(f_open(&spacer, FF_PATH("0:/spacer.bin"), FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+
+    for(u32 i = 0; i < nbExtents; i++)
+    {
+        u32 extentSize = extents[i] * 512 + (i == nbExtents - 1 ? tailBytes : 0);
+
+        testFillRandom(contents + size, extentSize, 256);
+        CHECK(f_write(&file, contents + size, extentSize, &written) == FR_OK && written == extentSize);
+        CHECK(f_write(&spacer, gap, sizeof(gap), &written) == FR_OK && written == sizeof(gap));
+        size += extentSize;
+    }
+
+    CHECK(f_close(&file) == FR_OK);
+    CHECK(f_close(&spacer) == FR_OK);
+    CHECK(f_unlink(FF_PATH("0:/spacer.bin")) == FR_OK);
+
+    return size;
+}
+
+static void resetCommands(void)
+{
+    nbDirectCommands = 0;
+    memset(directCommands, 0, sizeof(directCommands));
+    sdCard.nbReads = sdCard.nbSectorsRead = 0;
+}
+
+//Starts from an empty cache, so that every layout is measured the same way
+static u32 readFile(const char *path, u32 maxSize)
+{
+    mountSd();
+    memset(dest, 0, MAX_FILE_SIZE);
+    resetCommands();
+
+    return fileRead(dest, path, maxSize);
+}
+
+//The same read through FatFs alone, for comparison
+static void readFileWithFatFs(const char *path, u32 size)
+{
+    FIL file;
+    UINT read;
+
+    mountSd();
+    resetCommands();
+
+    CHECK(f_open(&file, path, FA_READ) == FR_OK);
+    CHECK(f_read(&file, dest, size, &read) == FR_OK && read == size);
+    CHECK(f_close(&file) == FR_OK);
+}
+
+static void printCommands(const char *layout, u32 size)
+{
+    u32 extentCommands = sdCard.nbReads, extentBytes = sdCard.nbSectorsRead * 512;
+
+    readFileWithFatFs(FF_PATH("0:/test.bin"), size);
+    printf("fsread: %s, %lu KiB: %lu commands, %lu bytes each on average (FatFs alone: %lu commands, %lu bytes each)\n",
+           layout, (unsigned long)size / 1024, (unsigned long)extentCommands, (unsigned long)(extentBytes / extentCommands),
+           (unsigned long)sdCard.nbReads, (unsigned long)(sdCard.nbSectorsRead * 512 / sdCard.nbReads));
+}
+
+static void testContiguous(bool verbose)
+{
+    static const u32 extents[] = {300};
+    u32 size = writeFragmentedFile(FF_PATH("0:/test.bin"), extents, 1, 123);
+
+    //One command for the whole sectors, the partial one goes through FatFs
+    CHECK(readFile(FF_PATH("0:/test.bin"), MAX_FILE_SIZE) == size);
+    CHECK(memcmp(dest, contents, size) == 0);
+    CHECK(nbDirectCommands == 1 && directCommands[0] == 300);
+
+    if(verbose) printCommands("contiguous", size);
+}
+
+static void testFragmented(bool verbose)
+{
+    //Extents shorter than a cache line go through the cache when FatFs reads them, as do FatFs' own reads
+    static const u32 extents[] = {40, 8, 17, 3, 64, 9, 1, 33, 12, 20, 50, 8, 16, 2, 24, 31, 10, 45, 11, 19};
+    u32 nbExtents = sizeof(extents) / sizeof(extents[0]),
+        size = writeFragmentedFile(FF_PATH("0:/test.bin"), extents, nbExtents, 0);
+
+    CHECK(size >= EXTENT_READ_MIN_SIZE);
+    CHECK(readFile(FF_PATH("0:/test.bin"), MAX_FILE_SIZE) == size);
+    CHECK(memcmp(dest, contents, size) == 0);
+
+    //One command per extent, of the extent's size
+    u32 nbLongExtents = 0;
+    for(u32 i = 0; i < nbExtents; i++)
+        if(extents[i] >= CACHE_LINE_SECTORS) CHECK(directCommands[nbLongExtents++] == extents[i]);
+    CHECK(nbDirectCommands == nbLongExtents);
+
+    if(verbose) printCommands("20 extents", size);
+}
+
+//The link map holds 31 extents, FatFs reads files with more on its own
+static void testTooFragmented(void)
+{
+    u32 extents[40];
+
+    for(u32 i = 0; i < 40; i++) extents[i] = CACHE_LINE_SECTORS + i % 5;
+    u32 size = writeFragmentedFile(FF_PATH("0:/test.bin"), extents, 40, 7);
+
+    CHECK(readFile(FF_PATH("0:/test.bin"), MAX_FILE_SIZE) == size);
+    CHECK(memcmp(dest, contents, size) == 0);
+    CHECK(nbDirectCommands == 0);
+}
+
+//Under EXTENT_READ_MIN_SIZE, FatFs reads the file on its own
+static void testSmallFile(void)
+{
+    static const u32 extents[] = {EXTENT_READ_MIN_SIZE / 512 - 1};
+    u32 size = writeFragmentedFile(FF_PATH("0:/test.bin"), extents, 1, 511);
+
+    CHECK(size < EXTENT_READ_MIN_SIZE);
+    CHECK(readFile(FF_PATH("0:/test.bin"), MAX_FILE_SIZE) == size);
+    CHECK(memcmp(dest, contents, size) == 0);
+    CHECK(nbDirectCommands == 0);
+
+    //Files that don't fit aren't read
+    CHECK(readFile(FF_PATH("0:/test.bin"), size - 1) == 0);
+}
+
+//The SDMMC block count register is 16-bit, longer extents take several commands
+static void testLongExtent(void)
+{
+    static const u32 extents[] = {EXTENT_MAX_SECTORS + 0x101, 16};
+    u32 size = writeFragmentedFile(FF_PATH("0:/test.bin"), extents, 2, 300);
+
+    CHECK(readFile(FF_PATH("0:/test.bin"), MAX_FILE_SIZE) == size);
+    CHECK(memcmp(dest, contents, size) == 0);
+    CHECK(nbDirectCommands == 3);
+    CHECK(directCommands[0] == EXTENT_MAX_SECTORS && directCommands[1] == 0x101 && directCommands[2] == 16);
+}
+
+//A read error fails the whole read, even if FatFs is then asked to do it
+static void testReadError(void)
+{
+    static const u32 extents[] = {100, 60, 70};
+    u32 size = writeFragmentedFile(FF_PATH("0:/test.bin"), extents, 3, 0);
+    FIL file;
+    u8 byte;
+    UINT read;
+
+    //Somewhere in the second extent, FatFs reading single bytes through the file's buffer
+    CHECK(f_open(&file, FF_PATH("0:/test.bin"), FA_READ) == FR_OK);
+    CHECK(f_lseek(&file, 120 * 512) == FR_OK);
+    CHECK(f_read(&file, &byte, 1, &read) == FR_OK && read == 1);
+    sdCard.failingSector = file.sect;
+    CHECK(f_close(&file) == FR_OK);
+
+    CHECK(readFile(FF_PATH("0:/test.bin"), MAX_FILE_SIZE) == 0);
+    sdCard.failingSector = 0xFFFFFFFF;
+
+    CHECK(readFile(FF_PATH("0:/test.bin"), MAX_FILE_SIZE) == size);
+    CHECK(memcmp(dest, contents, size) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    bool bench = testIsBench(argc, argv);
+
+    mapSdmmcRegisters();
+
+    //Room for the longest file, FAT32 with one sector per cluster
+    testMediumInit(&sdCard, 140000);
+    testFormatFat32(&sdCard, 0);
+
+    contents = malloc(MAX_FILE_SIZE);
+    dest = malloc(MAX_FILE_SIZE);
+    destStart = dest;
+    destEnd = dest + MAX_FILE_SIZE;
+
+    mountSd();
+
+    testContiguous(bench);
+    testFragmented(bench);
+    if(!bench)
+    {
+        testTooFragmented();
+        testSmallFile();
+        testLongExtent();
+        testReadError();
+    }
+
+    free(contents);
+    free(dest);
+    testMediumFree(&sdCard);
+
+    return bench ? 0 : testResult("fsread");
+}
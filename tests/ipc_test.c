@@ -0,0 +1,604 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Checks the session classification and the session info table of k11_extension/source/ipc.c against mocked kernel
+*   objects, single-threaded and with one thread per simulated core churning the table, and times the classification
+*   against the class name comparisons it replaced
+*/
+
+#include <pthread.h>
+
+#include "test.h"
+
+//Included rather than linked, to get at the table and the service IDs
+#include "ipc.c"
+
+u32 kernelVersion;
+bool isN3DS;
+CfwInfo cfwInfo;
+
+//The critical section and the session info lock each get a host mutex, lock acquisitions are counted
+static KRecursiveLock criticalSection;
+KRecursiveLock *criticalSectionLock = &criticalSection;
+
+static pthread_mutex_t criticalSectionMutex, sessionInfosMutex;
+static u32 nbLocks;
+
+static void initLocks(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&criticalSectionMutex, &attr);
+    pthread_mutex_init(&sessionInfosMutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static pthread_mutex_t *hostMutex(KRecursiveLock *this)
+{
+    CHECK(this == criticalSectionLock || this == &sessionInfosLock);
+    return this == criticalSectionLock ? &criticalSectionMutex : &sessionInfosMutex;
+}
+
+static void lock(KRecursiveLock *this)
+{
+    pthread_mutex_lock(hostMutex(this));
+    __atomic_add_fetch(&nbLocks, 1, __ATOMIC_RELAXED);
+}
+
+static void unlock(KRecursiveLock *this)
+{
+    pthread_mutex_unlock(hostMutex(this));
+}
+
+void (*KRecursiveLock__Lock)(KRecursiveLock *this) = lock;
+void (*KRecursiveLock__Unlock)(KRecursiveLock *this) = unlock;
+
+static void addReference(KAutoObject *this)
+{
+    __atomic_add_fetch(&this->refCount, 1, __ATOMIC_RELAXED);
+}
+
+void (*KAutoObject__AddReference)(KAutoObject *this) = addReference;
+
+bool getProcessLangemuAttributes(LangemuAttributes *out, KProcess *process)
+{
+    (void)out;
+    (void)process;
+    return false;
+}
+
+//Each mocked class has its own vtable, answering with its name through both kernel interfaces
+#define MOCK_CLASS(cls) \
+    static __attribute__((noinline)) const char *cls##_GetClassName(KAutoObject *this) \
+    { \
+        (void)this; \
+        return #cls; \
+    } \
+    static __attribute__((noinline)) KClassToken *cls##_GetClassToken(KClassToken *out, KAutoObject *this) \
+    { \
+        (void)this; \
+        out->name = #cls; \
+        out->flags = 0; \
+        return out; \
+    } \
+    Vtable__KAutoObject cls##_vtable = { .GetClassToken = cls##_GetClassToken, .GetClassName = cls##_GetClassName };
+
+MOCK_CLASS(KClientSession)
+MOCK_CLASS(KServerSession)
+MOCK_CLASS(KClientPort)
+MOCK_CLASS(KEvent)
+
+static KAutoObject *decrementReferenceCount(KAutoObject *this)
+{
+    __atomic_sub_fetch(&this->refCount, 1, __ATOMIC_RELAXED);
+    return this;
+}
+
+static u32 nbDestroyedSessions;
+
+static void sessionDtor(KAutoObject *this)
+{
+    (void)this;
+    __atomic_add_fetch(&nbDestroyedSessions, 1, __ATOMIC_RELAXED);
+}
+
+Vtable__KAutoObject KSession_vtable = {
+    .dtor = sessionDtor,
+    .DecrementReferenceCount = decrementReferenceCount,
+    .GetClassName = KClientSession_GetClassName,
+};
+
+static void setKernelVersion(bool hasClassTokens)
+{
+    kernelVersion = hasClassTokens ? SYSTEM_VERSION(2, 46, 0) : SYSTEM_VERSION(2, 44, 6);
+}
+
+static void initSession(KSession *session)
+{
+    memset(session, 0, sizeof(KSession));
+    session->autoObject.vtable = &KSession_vtable;
+    session->autoObject.refCount = 1;
+    session->serverSession.syncObject.autoObject.vtable = &KServerSession_vtable;
+    session->clientSession.syncObject.autoObject.vtable = &KClientSession_vtable;
+    session->clientSession.parentSession = session;
+}
+
+static void testClassification(void)
+{
+    KSession session;
+    KAutoObject port = { &KClientPort_vtable, 1 };
+
+    initSession(&session);
+
+    for(u32 hasClassTokens = 0; hasClassTokens < 2; hasClassTokens++)
+    {
+        setKernelVersion(hasClassTokens);
+        clientSessionVtable = NULL;
+
+        //Nothing is cached until a client session is seen
+        CHECK(!isClientSession(&port));
+        CHECK(!isClientSession(&session.serverSession.syncObject.autoObject));
+        CHECK(clientSessionVtable == NULL);
+
+        CHECK(isClientSession(&session.clientSession.syncObject.autoObject));
+        CHECK(clientSessionVtable == &KClientSession_vtable);
+
+        //Then only that vtable matches without asking for the class name
+        CHECK(isClientSession(&session.clientSession.syncObject.autoObject));
+        CHECK(!isClientSession(&port));
+        CHECK(!isClientSession(&session.serverSession.syncObject.autoObject));
+    }
+
+    //Another vtable reporting the same class still matches, and becomes the cached one
+    Vtable__KAutoObject otherVtable = KClientSession_vtable;
+    KAutoObject otherClientSession = { &otherVtable, 1 };
+    CHECK(isClientSession(&otherClientSession));
+    CHECK(clientSessionVtable == &otherVtable);
+}
+
+static void testServiceIds(void)
+{
+    static const struct
+    {
+        const char *name;
+        u32 id;
+    } names[] = {
+        { "srv:",           SERVICE_SRV },
+        { "srv:pm",         SERVICE_SRV_PM },
+        { "cfg:u",          SERVICE_CFG_U },
+        { "cfg:s",          SERVICE_CFG_S },
+        { "cfg:i",          SERVICE_CFG_I },
+        { "ndm:u",          SERVICE_NDM_U },
+        { "err:f",          SERVICE_ERR_F },
+        { "APT:U",          SERVICE_APT },
+        { "APT:A",          SERVICE_APT },
+        { "fs:USER",        SERVICE_FS_USER },
+        { "fs:LDR",         SERVICE_OTHER },
+        { "cfg:nor",        SERVICE_OTHER },
+        { "srv:p",          SERVICE_OTHER },
+        { "ndm:u0123456",   SERVICE_OTHER },
+    };
+    static KSession sessions[sizeof(names) / sizeof(names[0])];
+
+    for(u32 i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        initSession(&sessions[i]);
+        SessionInfo_Add(&sessions[i], names[i].name);
+        CHECK(sessions[i].autoObject.refCount == 1);
+    }
+
+    //Resolved once, when the session is registered
+    for(u32 i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        SessionInfo *info = SessionInfo_Lookup(&sessions[i]);
+        CHECK(info != NULL && info->session == &sessions[i] && info->serviceId == names[i].id);
+        CHECK(info != NULL && strncmp(info->name, names[i].name, 12) == 0);
+    }
+
+    for(u32 i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        SessionInfo_Remove(&sessions[i]);
+        CHECK(SessionInfo_Lookup(&sessions[i]) == NULL);
+    }
+}
+
+//Checks the whole table against the sessions that should be registered, with their names
+static void checkTable(KSession *const *registered, const char (*names)[12], u32 nbRegistered)
+{
+    u32 nbSlotsUsed = 0;
+
+    //Every session is reachable from its home slot without crossing an empty slot
+    for(u32 slot = 0; slot < SESSION_HASH_SIZE; slot++)
+    {
+        u16 id = sessionInfoSlots[slot];
+        if(id == 0) continue;
+
+        nbSlotsUsed++;
+        u32 home = SessionInfo_HashSession(sessionInfos[id - 1].session);
+        for(u32 s = home; s != slot; s = (s + 1) & (SESSION_HASH_SIZE - 1))
+            CHECK(sessionInfoSlots[s] != 0);
+    }
+    CHECK(nbSlotsUsed == nbRegistered && nbActiveSessions == nbRegistered);
+
+    for(u32 i = 0; i < nbRegistered; i++)
+    {
+        SessionInfo *info = SessionInfo_Lookup(registered[i]);
+        CHECK(info != NULL && info->session == registered[i] && strncmp(info->name, names[i], 12) == 0);
+    }
+
+    //Each name chain is doubly linked and holds the sessions with names hashing to it
+    u32 nbChained = 0;
+    for(u32 bucket = 0; bucket < SESSION_NAME_BUCKETS; bucket++)
+    {
+        u16 prev = 0;
+        for(u16 id = sessionNameBuckets[bucket]; id != 0 && nbChained <= MAX_SESSION; id = sessionInfos[id - 1].nextByName)
+        {
+            CHECK(sessionInfos[id - 1].prevByName == prev && SessionInfo_HashName(sessionInfos[id - 1].name) == bucket);
+            prev = id;
+            nbChained++;
+        }
+    }
+    CHECK(nbChained == nbRegistered);
+
+    //And the free list holds the rest of the allocated infos
+    u32 nbFree = 0;
+    for(u16 id = freeSessionInfos; id != 0 && nbFree <= MAX_SESSION; id = sessionInfos[id - 1].nextByName)
+    {
+        CHECK(sessionInfos[id - 1].session == NULL);
+        nbFree++;
+    }
+    CHECK(nbFree + nbRegistered == nbAllocatedSessions);
+}
+
+//As the kernel does when the last reference goes away, the hooked destructor unregisters the session
+static void destroySession(KSession *session)
+{
+    session->autoObject.vtable->dtor(&session->autoObject);
+}
+
+#define CHURN_SESSIONS  (2 * MAX_SESSION)
+
+static void churnName(char *name, u32 i)
+{
+    static const char *prefixes[] = { "cfg:u", "fs:USER", "APT:U", "srv:", "hid:" };
+
+    memset(name, 0, 12);
+    snprintf(name, 12, "%s%lu", prefixes[i % 5], (unsigned long)(i / 5 % 100));
+}
+
+//Random registrations and destructions against a model of the table, checked after every change
+static void testChurn(void)
+{
+    static KSession sessions[CHURN_SESSIONS];
+    static KSession *registered[MAX_SESSION];
+    static char names[MAX_SESSION][12];
+    static bool isRegistered[CHURN_SESSIONS];
+    u32 nbRegistered = 0;
+
+    for(u32 i = 0; i < CHURN_SESSIONS; i++)
+        initSession(&sessions[i]);
+
+    //Never registered, no lock is taken to find that out
+    nbLocks = 0;
+    CHECK(SessionInfo_Lookup(&sessions[0]) == NULL && nbLocks == 0);
+
+    for(u32 op = 0; op < 20000; op++)
+    {
+        u32 i = testRand() % CHURN_SESSIONS;
+
+        if(!isRegistered[i] && nbRegistered < MAX_SESSION)
+        {
+            churnName(names[nbRegistered], i);
+            SessionInfo_Add(&sessions[i], names[nbRegistered]);
+            registered[nbRegistered++] = &sessions[i];
+            isRegistered[i] = true;
+
+            //Registering twice changes nothing
+            if(testRand() % 8 == 0) SessionInfo_Add(&sessions[i], "twice");
+        }
+        else if(isRegistered[i])
+        {
+            u32 index = 0;
+            while(registered[index] != &sessions[i]) index++;
+
+            destroySession(&sessions[i]);
+            CHECK(SessionInfo_Lookup(&sessions[i]) == NULL);
+
+            //The slab reuses the memory for a new session
+            initSession(&sessions[i]);
+            isRegistered[i] = false;
+            registered[index] = registered[--nbRegistered];
+            memcpy(names[index], names[nbRegistered], 12);
+        }
+
+        checkTable(registered, (const char (*)[12])names, nbRegistered);
+        if(testFailures != 0) break;
+    }
+
+    //A full table turns new sessions away
+    for(u32 i = 0; i < CHURN_SESSIONS && nbRegistered < MAX_SESSION; i++)
+        if(!isRegistered[i])
+        {
+            churnName(names[nbRegistered], i);
+            SessionInfo_Add(&sessions[i], names[nbRegistered]);
+            registered[nbRegistered++] = &sessions[i];
+            isRegistered[i] = true;
+        }
+    for(u32 i = 0; i < CHURN_SESSIONS; i++)
+        if(!isRegistered[i])
+        {
+            SessionInfo_Add(&sessions[i], "full");
+            CHECK(SessionInfo_Lookup(&sessions[i]) == NULL);
+            break;
+        }
+    checkTable(registered, (const char (*)[12])names, nbRegistered);
+
+    for(u32 i = 0; i < CHURN_SESSIONS; i++)
+        if(isRegistered[i]) destroySession(&sessions[i]);
+    checkTable(NULL, NULL, 0);
+}
+
+/*
+*   One thread per core registers and destroys its own sessions, and looks them up, while sessions registered
+*   beforehand, whose probe runs cross the churned entries, are looked up by everyone
+*/
+#define NB_CORES                4
+#define STABLE_SESSIONS         100
+#define SESSIONS_PER_CORE       60
+#define CONCURRENT_OPERATIONS   100000
+
+static KSession stableSessions[STABLE_SESSIONS];
+static KSession coreSessions[NB_CORES][SESSIONS_PER_CORE];
+
+static void stableName(char *name, u32 i)
+{
+    memset(name, 0, 12);
+    snprintf(name, 12, "stbl:%lu", (unsigned long)i);
+}
+
+static void *churnThread(void *arg)
+{
+    u32 core = (u32)(uintptr_t)arg, rand = 0x9E3779B9 * (core + 1);
+    KSession *sessions = coreSessions[core];
+    bool isRegistered[SESSIONS_PER_CORE] = { false };
+    char name[12], ownName[12];
+    u32 failures = 0;
+
+    memset(ownName, 0, sizeof(ownName));
+    memcpy(ownName, "core", 4);
+    ownName[4] = '0' + core;
+
+    for(u32 op = 0; op < CONCURRENT_OPERATIONS; op++)
+    {
+        rand ^= rand << 13;
+        rand ^= rand >> 17;
+        rand ^= rand << 5;
+
+        u32 i = rand % SESSIONS_PER_CORE;
+        switch((rand >> 8) % 4)
+        {
+            case 0:
+                if(isRegistered[i])
+                {
+                    destroySession(&sessions[i]);
+                    initSession(&sessions[i]);
+                }
+                else SessionInfo_Add(&sessions[i], ownName);
+
+                isRegistered[i] = !isRegistered[i];
+                break;
+            case 1:
+            {
+                SessionInfo *info = SessionInfo_Lookup(&sessions[i]);
+                failures += isRegistered[i] ? info == NULL || info->session != &sessions[i] : info != NULL;
+                break;
+            }
+            case 2:
+            {
+                u32 stable = (rand >> 12) % STABLE_SESSIONS;
+                SessionInfo *info = SessionInfo_Lookup(&stableSessions[stable]);
+
+                stableName(name, stable);
+                failures += info == NULL || info->session != &stableSessions[stable] || strncmp(info->name, name, 12) != 0;
+                break;
+            }
+            default:
+            {
+                u32 stable = (rand >> 12) % STABLE_SESSIONS;
+                SessionInfo *info;
+
+                stableName(name, stable);
+                info = SessionInfo_FindFirst(name);
+                failures += info == NULL || info->session != &stableSessions[stable];
+                break;
+            }
+        }
+    }
+
+    for(u32 i = 0; i < SESSIONS_PER_CORE; i++)
+        if(isRegistered[i]) destroySession(&sessions[i]);
+
+    return (void *)(uintptr_t)failures;
+}
+
+static void testConcurrentChurn(void)
+{
+    static KSession *registered[STABLE_SESSIONS];
+    static char names[STABLE_SESSIONS][12];
+    pthread_t threads[NB_CORES];
+
+    for(u32 i = 0; i < STABLE_SESSIONS; i++)
+    {
+        initSession(&stableSessions[i]);
+        stableName(names[i], i);
+        SessionInfo_Add(&stableSessions[i], names[i]);
+        registered[i] = &stableSessions[i];
+    }
+    for(u32 core = 0; core < NB_CORES; core++)
+        for(u32 i = 0; i < SESSIONS_PER_CORE; i++)
+            initSession(&coreSessions[core][i]);
+
+    u32 generation = sessionInfosGeneration;
+    for(u32 core = 0; core < NB_CORES; core++)
+        CHECK(pthread_create(&threads[core], NULL, churnThread, (void *)(uintptr_t)core) == 0);
+
+    for(u32 core = 0; core < NB_CORES; core++)
+    {
+        void *failures;
+        CHECK(pthread_join(threads[core], &failures) == 0);
+        CHECK(failures == NULL);
+    }
+
+    //Every thread destroyed what it registered
+    CHECK(sessionInfosGeneration != generation);
+    checkTable(registered, (const char (*)[12])names, STABLE_SESSIONS);
+
+    for(u32 i = 0; i < STABLE_SESSIONS; i++)
+        destroySession(&stableSessions[i]);
+    checkTable(NULL, NULL, 0);
+}
+
+//What SendSyncRequestHook did before the vtable was cached
+static __attribute__((noinline)) bool isClientSessionByName(KAutoObject *obj)
+{
+    return strcmp(classNameOfAutoObject(obj), "KClientSession") == 0;
+}
+
+#define BENCH_OBJECTS   1024
+#define BENCH_ROUNDS    20000
+
+static void benchClassification(void)
+{
+    static KSession sessions[BENCH_OBJECTS];
+    static KAutoObject ports[BENCH_OBJECTS / 16];
+    static KAutoObject *objects[BENCH_OBJECTS];
+
+    //Requests are sent on client sessions, the rest are the odd bad handles
+    for(u32 i = 0; i < BENCH_OBJECTS; i++)
+    {
+        initSession(&sessions[i]);
+        objects[i] = &sessions[i].clientSession.syncObject.autoObject;
+    }
+    for(u32 i = 0; i < BENCH_OBJECTS / 16; i++)
+    {
+        ports[i] = (KAutoObject){ &KClientPort_vtable, 1 };
+        objects[testRand() % BENCH_OBJECTS] = &ports[i];
+    }
+
+    for(u32 hasClassTokens = 0; hasClassTokens < 2; hasClassTokens++)
+    {
+        u32 nbByName = 0, nbCached = 0;
+
+        setKernelVersion(hasClassTokens);
+        clientSessionVtable = NULL;
+
+        double start = testNow();
+        for(u32 round = 0; round < BENCH_ROUNDS; round++)
+            for(u32 i = 0; i < BENCH_OBJECTS; i++)
+                nbByName += isClientSessionByName(objects[i]);
+        double byName = testNow() - start;
+
+        start = testNow();
+        for(u32 round = 0; round < BENCH_ROUNDS; round++)
+            for(u32 i = 0; i < BENCH_OBJECTS; i++)
+                nbCached += isClientSession(objects[i]);
+        double cached = testNow() - start;
+
+        CHECK(nbByName == nbCached);
+        printf("ipc: classifying %u objects (%s), class name comparison %.2f ns each, cached vtable %.2f ns each\n",
+               BENCH_OBJECTS, hasClassTokens ? "class tokens" : "class names",
+               byName * 1e9 / ((double)BENCH_ROUNDS * BENCH_OBJECTS), cached * 1e9 / ((double)BENCH_ROUNDS * BENCH_OBJECTS));
+    }
+}
+
+//What the hook did before service IDs, for cfg:u, cfg:s and cfg:i
+static __attribute__((noinline)) bool isCfgByName(const SessionInfo *info)
+{
+    return info != NULL && (strcmp(info->name, "cfg:u") == 0 || strcmp(info->name, "cfg:s") == 0 || strcmp(info->name, "cfg:i") == 0);
+}
+
+static __attribute__((noinline)) bool isCfg(const SessionInfo *info)
+{
+    return info != NULL && (info->serviceId == SERVICE_CFG_U || info->serviceId == SERVICE_CFG_S || info->serviceId == SERVICE_CFG_I);
+}
+
+static void benchServiceIds(void)
+{
+    static const char *names[] = { "fs:USER", "cfg:u", "APT:U", "srv:", "cfg:i", "gsp::Gpu", "hid:USER", "cfg:s", "ndm:u", "err:f" };
+    static KSession sessions[BENCH_OBJECTS];
+    static SessionInfo *infos[BENCH_OBJECTS];
+    u32 nbByName = 0, nbById = 0;
+
+    //The table holds MAX_SESSION sessions, the others share their infos
+    for(u32 i = 0; i < MAX_SESSION; i++)
+    {
+        initSession(&sessions[i]);
+        SessionInfo_Add(&sessions[i], names[testRand() % (sizeof(names) / sizeof(names[0]))]);
+    }
+    for(u32 i = 0; i < BENCH_OBJECTS; i++)
+        infos[i] = SessionInfo_Lookup(&sessions[i % MAX_SESSION]);
+
+    double start = testNow();
+    for(u32 round = 0; round < BENCH_ROUNDS; round++)
+        for(u32 i = 0; i < BENCH_OBJECTS; i++)
+            nbByName += isCfgByName(infos[i]);
+    double byName = testNow() - start;
+
+    start = testNow();
+    for(u32 round = 0; round < BENCH_ROUNDS; round++)
+        for(u32 i = 0; i < BENCH_OBJECTS; i++)
+            nbById += isCfg(infos[i]);
+    double byId = testNow() - start;
+
+    CHECK(nbByName == nbById);
+    printf("ipc: matching cfg sessions, name comparisons %.2f ns each, service IDs %.2f ns each\n",
+           byName * 1e9 / ((double)BENCH_ROUNDS * BENCH_OBJECTS), byId * 1e9 / ((double)BENCH_ROUNDS * BENCH_OBJECTS));
+
+    for(u32 i = 0; i < MAX_SESSION; i++)
+        SessionInfo_Remove(&sessions[i]);
+}
+
+int main(int argc, char **argv)
+{
+    initLocks();
+
+    if(testIsBench(argc, argv))
+    {
+        benchClassification();
+        benchServiceIds();
+        return 0;
+    }
+
+    testClassification();
+    testServiceIds();
+    testChurn();
+    testConcurrentChurn();
+
+    return testResult("ipc");
+}
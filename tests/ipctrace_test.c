@@ -0,0 +1,276 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Drives the IPC trace rings of k11_extension/source/ipcTrace.c, single-threaded and with one
+*   producer thread per simulated core racing a reader
+*/
+
+#include <pthread.h>
+
+#include "test.h"
+
+//Included rather than linked, to get at the rings
+#include "ipcTrace.c"
+
+__thread u32 testCoreId;
+
+static bool hostMemcpy(void *dst, const void *src, u32 len)
+{
+    memcpy(dst, src, len);
+    return true;
+}
+
+bool (*kernelToUsrMemcpy8)(void *dst, const void *src, u32 len) = hostMemcpy;
+
+//Session infos
+u32 sessionInfosGeneration;
+
+static KSession sessionPool[1 << IPC_TRACE_NAME_CACHE_BITS];
+static KSession *sessions[3];
+static SessionInfo sessionInfos[2] = {
+    { NULL, "fs:USER" },
+    { NULL, "cfg:u" },
+};
+static u32 nbLookups;
+
+SessionInfo *SessionInfo_Lookup(KSession *session)
+{
+    nbLookups++;
+
+    for(u32 i = 0; i < sizeof(sessionInfos) / sizeof(sessionInfos[0]); i++)
+        if(sessionInfos[i].session == session) return &sessionInfos[i];
+
+    return NULL;
+}
+
+//Every field of an event can be derived from its command header (the producer's counter) and PID (its core)
+static void eventName(char *name, u32 pid, u32 counter)
+{
+    memset(name, 0, 8);
+    name[0] = 's';
+    name[1] = '0' + pid % 10;
+    name[2] = ':';
+    name[3] = '0' + counter / 10 % 10;
+    name[4] = '0' + counter % 10;
+}
+
+static void recordEvent(u32 counter)
+{
+    char name[8];
+    u64 sendTick = ((u64)counter << 8) | testCoreId;
+
+    eventName(name, testCoreId, counter);
+    ipcTraceRecord(testCoreId, name, counter, sendTick, sendTick + counter % 1000);
+}
+
+static bool isValidEvent(const IpcTraceEvent *event)
+{
+    char name[8];
+
+    eventName(name, event->pid, event->cmdHeader);
+
+    return event->pid < 4 && event->seq == event->cmdHeader + 1 && event->sendTick == (((u64)event->cmdHeader << 8) | event->pid) &&
+           event->duration == event->cmdHeader % 1000 && memcmp(event->name, name, 8) == 0;
+}
+
+static IpcTraceEvent readEvents[4 * IPC_TRACE_EVENTS_PER_CORE];
+
+static u32 readTrace(void)
+{
+    u32 nbEvents = 0xFFFFFFFF;
+
+    memset(readEvents, 0, sizeof(readEvents));
+    CHECK(ipcTraceRead(readEvents, sizeof(readEvents) / sizeof(readEvents[0]), &nbEvents) == 0);
+    CHECK(nbEvents <= sizeof(readEvents) / sizeof(readEvents[0]));
+
+    //Nothing is written past the reported count
+    for(u32 i = nbEvents; i < sizeof(readEvents) / sizeof(readEvents[0]); i++)
+        CHECK(readEvents[i].seq == 0);
+
+    return nbEvents;
+}
+
+static void testWrapAround(void)
+{
+    ipcTraceSetEnabled(false);
+    ipcTraceSetEnabled(true);
+
+    testCoreId = 0;
+    for(u32 i = 0; i < 300; i++) recordEvent(i);
+    testCoreId = 2;
+    for(u32 i = 0; i < 5; i++) recordEvent(i);
+
+    //Oldest to newest, core by core
+    CHECK(readTrace() == IPC_TRACE_EVENTS_PER_CORE + 5);
+    for(u32 i = 0; i < IPC_TRACE_EVENTS_PER_CORE + 5; i++)
+    {
+        CHECK(isValidEvent(&readEvents[i]));
+        CHECK(readEvents[i].cmdHeader == (i < IPC_TRACE_EVENTS_PER_CORE ? 300 - IPC_TRACE_EVENTS_PER_CORE + i : i - IPC_TRACE_EVENTS_PER_CORE));
+    }
+
+    //A smaller buffer only gets the oldest events of the first core
+    u32 nbEvents = 0;
+    CHECK(ipcTraceRead(readEvents, 10, &nbEvents) == 0 && nbEvents == 10);
+    CHECK(readEvents[9].cmdHeader == 300 - IPC_TRACE_EVENTS_PER_CORE + 9);
+
+    //Enabling again clears the rings
+    ipcTraceSetEnabled(false);
+    ipcTraceSetEnabled(true);
+    CHECK(readTrace() == 0);
+}
+
+static void testSlotsBeingWrittenAreSkipped(void)
+{
+    ipcTraceSetEnabled(false);
+    ipcTraceSetEnabled(true);
+
+    testCoreId = 1;
+    for(u32 i = 0; i < 200; i++) recordEvent(i);
+
+    //A producer reserved ticket 200 but hasn't started writing: its slot still holds ticket 72
+    ipcTraceHeads[1]++;
+    u32 nbEvents = readTrace();
+    CHECK(nbEvents == IPC_TRACE_EVENTS_PER_CORE - 1);
+    for(u32 i = 0; i < nbEvents; i++)
+        CHECK(isValidEvent(&readEvents[i]) && readEvents[i].cmdHeader == 73 + i);
+
+    //Now it's being written
+    ipcTraceEvents[1][200 % IPC_TRACE_EVENTS_PER_CORE].seq = 0;
+    CHECK(readTrace() == IPC_TRACE_EVENTS_PER_CORE - 1);
+
+    ipcTraceEnabled = false;
+}
+
+static void testServiceNameCache(void)
+{
+    char name[8];
+
+    //Three sessions which don't share a cache entry (the hash depends on where the pool was loaded)
+    for(u32 i = 0, n = 0; n < 3; i++)
+    {
+        bool collides = false;
+        for(u32 j = 0; j < n; j++)
+            collides = collides || ipcTraceNameCacheEntry(&sessionPool[i]) == ipcTraceNameCacheEntry(sessions[j]);
+        if(!collides) sessions[n++] = &sessionPool[i];
+    }
+    sessionInfos[0].session = sessions[0];
+    sessionInfos[1].session = sessions[1];
+
+    testCoreId = 3;
+    nbLookups = 0;
+
+    for(u32 i = 0; i < 3; i++)
+    {
+        ipcTraceGetServiceName(name, sessions[0]);
+        CHECK(strncmp(name, "fs:USER", 8) == 0);
+        ipcTraceGetServiceName(name, sessions[1]);
+        CHECK(strncmp(name, "cfg:u", 8) == 0);
+        ipcTraceGetServiceName(name, sessions[2]);
+        CHECK(memcmp(name, "\0\0\0\0\0\0\0\0", 8) == 0);
+    }
+    CHECK(nbLookups == 3);
+
+    //Each core has its own cache
+    testCoreId = 0;
+    ipcTraceGetServiceName(name, sessions[0]);
+    CHECK(nbLookups == 4);
+
+    //A session was registered or unregistered
+    sessionInfosGeneration++;
+    strcpy(sessionInfos[0].name, "fs:LDR");
+    testCoreId = 3;
+    ipcTraceGetServiceName(name, sessions[0]);
+    CHECK(strncmp(name, "fs:LDR", 8) == 0 && nbLookups == 5);
+    ipcTraceGetServiceName(name, sessions[0]);
+    CHECK(nbLookups == 5);
+}
+
+#define PRODUCER_EVENTS 200000
+
+static volatile u32 nbRunningProducers;
+
+static void *producer(void *arg)
+{
+    testCoreId = (u32)(uintptr_t)arg;
+
+    for(u32 i = 0; i < PRODUCER_EVENTS; i++) recordEvent(i);
+
+    __atomic_fetch_sub(&nbRunningProducers, 1, __ATOMIC_SEQ_CST);
+
+    return NULL;
+}
+
+static void testConcurrentReader(void)
+{
+    pthread_t threads[4];
+    u32 nbReads = 0, nbReadEvents = 0;
+
+    ipcTraceSetEnabled(false);
+    ipcTraceSetEnabled(true);
+
+    nbRunningProducers = 4;
+    for(u32 i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, producer, (void *)(uintptr_t)i);
+
+    while(nbRunningProducers != 0 || nbReads == 0)
+    {
+        u32 nbEvents = readTrace();
+
+        //No torn nor stale event, and each core's events in order
+        for(u32 i = 0; i < nbEvents; i++)
+        {
+            CHECK(isValidEvent(&readEvents[i]));
+            if(i > 0 && readEvents[i].pid == readEvents[i - 1].pid)
+                CHECK(readEvents[i].seq > readEvents[i - 1].seq);
+            else if(i > 0)
+                CHECK(readEvents[i].pid > readEvents[i - 1].pid);
+        }
+
+        nbReads++;
+        nbReadEvents += nbEvents;
+    }
+
+    for(u32 i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    //Everything is there once the producers are done
+    CHECK(readTrace() == 4 * IPC_TRACE_EVENTS_PER_CORE);
+    for(u32 i = 0; i < 4 * IPC_TRACE_EVENTS_PER_CORE; i++)
+        CHECK(isValidEvent(&readEvents[i]) && readEvents[i].cmdHeader == PRODUCER_EVENTS - IPC_TRACE_EVENTS_PER_CORE + i % IPC_TRACE_EVENTS_PER_CORE);
+
+    CHECK(nbReadEvents != 0);
+}
+
+int main(void)
+{
+    testWrapAround();
+    testSlotsBeingWrittenAreSkipped();
+    testServiceNameCache();
+    testConcurrentReader();
+
+    return testResult("ipctrace");
+}
@@ -0,0 +1,394 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Conformance and differential tests of the IPS/IPS32 applier of sysmodules/loader/source/ips_patcher.c,
+*   and of how many reads its buffering saves
+*/
+
+#include "test.h"
+#include "ips_patcher.h"
+
+//The patch file, read through IFile_Read only
+static const u8 *fileData;
+static u32 fileSize,
+           nbReads;
+
+Result IFile_Read(IFile *file, u64 *total, void *buffer, u32 len)
+{
+    u64 left = file->pos < fileSize ? fileSize - file->pos : 0;
+    u32 n = len < left ? len : (u32)left;
+
+    nbReads++;
+    memcpy(buffer, fileData + file->pos, n);
+    file->pos += n;
+    *total = n;
+
+    return 0;
+}
+
+static bool applyPatch(const u8 *patch, u32 patchSize, u8 *code, u32 size)
+{
+    IFile file = { 0 };
+
+    fileData = patch;
+    fileSize = patchSize;
+    nbReads = 0;
+
+    return patcherApplyIpsPatch(&file, code, size);
+}
+
+//The loader's previous applier (IPS only), one read per field
+static bool referenceApplyPatch(const u8 *patch, u32 patchSize, u8 *code, u32 size)
+{
+    IFile file = { 0 };
+    u8 buffer[5];
+    u64 total;
+
+    fileData = patch;
+    fileSize = patchSize;
+    nbReads = 0;
+
+    if(R_FAILED(IFile_Read(&file, &total, buffer, 5)) || total != 5 || memcmp(buffer, "PATCH", 5) != 0) return false;
+
+    while(R_SUCCEEDED(IFile_Read(&file, &total, buffer, 3)) && total == 3)
+    {
+        if(memcmp(buffer, "EOF", 3) == 0) return true;
+
+        u32 offset = (buffer[0] << 16) | (buffer[1] << 8) | buffer[2];
+
+        if(R_FAILED(IFile_Read(&file, &total, buffer, 2)) || total != 2) break;
+
+        u32 patchSize = (buffer[0] << 8) | buffer[1];
+
+        if(!patchSize)
+        {
+            if(R_FAILED(IFile_Read(&file, &total, buffer, 2)) || total != 2) break;
+
+            u32 rleSize = (buffer[0] << 8) | buffer[1];
+
+            if(offset + rleSize > size) break;
+
+            if(R_FAILED(IFile_Read(&file, &total, buffer, 1)) || total != 1) break;
+
+            for(u32 i = 0; i < rleSize; i++)
+                code[offset + i] = buffer[0];
+
+            continue;
+        }
+
+        if(offset + patchSize > size) break;
+
+        if(R_FAILED(IFile_Read(&file, &total, code + offset, patchSize)) || total != patchSize) break;
+    }
+
+    return false;
+}
+
+//Patch building
+static u8 patch[1 << 22];
+static u32 patchLen;
+
+static void put(const void *data, u32 len)
+{
+    memcpy(patch + patchLen, data, len);
+    patchLen += len;
+}
+
+static void putHeader(bool isIps32)
+{
+    patchLen = 0;
+    put(isIps32 ? "IPS32" : "PATCH", 5);
+}
+
+static void putOffset(bool isIps32, u32 offset)
+{
+    u8 bytes[4] = { offset >> 24, offset >> 16, offset >> 8, offset };
+    put(isIps32 ? bytes : bytes + 1, isIps32 ? 4 : 3);
+}
+
+static void putRecord(bool isIps32, u32 offset, const void *data, u32 len)
+{
+    u8 header[2] = { len >> 8, len };
+
+    putOffset(isIps32, offset);
+    put(header, 2);
+    put(data, len);
+}
+
+static void putRle(bool isIps32, u32 offset, u32 len, u8 value)
+{
+    u8 header[5] = { 0, 0, len >> 8, len, value };
+
+    putOffset(isIps32, offset);
+    put(header, 5);
+}
+
+static void putEof(bool isIps32)
+{
+    put(isIps32 ? "EEOF" : "EOF", isIps32 ? 4 : 3);
+}
+
+static void fillCode(u8 *code, u32 size)
+{
+    for(u32 i = 0; i < size; i++) code[i] = (u8)(i * 7);
+}
+
+static void testConformance(void)
+{
+    static u8 code[0x10000], expected[0x10000], big[0x3000];
+    const u32 size = sizeof(code);
+
+    for(u32 i = 0; i < 2; i++)
+    {
+        bool isIps32 = i == 1;
+
+        //Records and RLE records are applied in order
+        fillCode(code, size);
+        fillCode(expected, size);
+        putHeader(isIps32);
+        putRecord(isIps32, 0x10, "abc", 3);
+        putRle(isIps32, 0x20, 5, 0x7A);
+        putRecord(isIps32, 0x21, "Z", 1);
+        putEof(isIps32);
+        memcpy(expected + 0x10, "abc", 3);
+        memset(expected + 0x20, 0x7A, 5);
+        expected[0x21] = 'Z';
+        CHECK(applyPatch(patch, patchLen, code, size));
+        CHECK(memcmp(code, expected, size) == 0);
+
+        //Up to the end of the code, not past it
+        putHeader(isIps32);
+        putRecord(isIps32, size - 3, "xyz", 3);
+        putRle(isIps32, size - 4, 4, 0);
+        putEof(isIps32);
+        CHECK(applyPatch(patch, patchLen, code, size));
+        putHeader(isIps32);
+        putRecord(isIps32, size - 2, "xyz", 3);
+        putEof(isIps32);
+        CHECK(!applyPatch(patch, patchLen, code, size));
+        putHeader(isIps32);
+        putRle(isIps32, size - 1, 2, 0);
+        putEof(isIps32);
+        CHECK(!applyPatch(patch, patchLen, code, size));
+
+        //Records larger than the buffer, read straight into the code
+        testFillRandom(big, sizeof(big), 256);
+        fillCode(code, size);
+        putHeader(isIps32);
+        putRecord(isIps32, 1, "q", 1);
+        putRecord(isIps32, 0x1003, big, sizeof(big));
+        putEof(isIps32);
+        CHECK(applyPatch(patch, patchLen, code, size));
+        CHECK(code[1] == 'q' && memcmp(code + 0x1003, big, sizeof(big)) == 0);
+
+        //Truncated anywhere, or without end marker
+        putHeader(isIps32);
+        putRecord(isIps32, 0x10, "abcdef", 6);
+        putRle(isIps32, 0x20, 5, 0x7A);
+        putEof(isIps32);
+        for(u32 len = 0; len < patchLen; len++)
+            CHECK(!applyPatch(patch, len, code, size));
+    }
+
+    //Bad header, or the other format's end marker
+    CHECK(!applyPatch((const u8 *)"PATCI", 5, code, size));
+    CHECK(!applyPatch((const u8 *)"IPS32EOF", 8, code, size));
+
+    //In IPS, an offset of 0x454F46 reads as the end marker; in IPS32 it's an ordinary offset
+    putHeader(false);
+    putRecord(false, 0x454F46, "abc", 3);
+    CHECK(applyPatch(patch, patchLen, code, size));
+
+    static u8 largeCode[0x1000010];
+    putHeader(true);
+    putRecord(true, 0x454F46, "abc", 3);
+    putRecord(true, 0x1000000, "def", 3);
+    putEof(true);
+    CHECK(applyPatch(patch, patchLen, largeCode, sizeof(largeCode)));
+    CHECK(memcmp(largeCode + 0x454F46, "abc", 3) == 0 && memcmp(largeCode + 0x1000000, "def", 3) == 0);
+
+    //Offsets so large that adding the size overflows
+    putHeader(true);
+    putRle(true, 0xFFFFFFF0, 0x20, 0);
+    putEof(true);
+    CHECK(!applyPatch(patch, patchLen, code, size));
+}
+
+//Random records, a few of them out of bounds; mostly terminated
+static void putRandomPatch(bool isIps32, u32 size, u32 nbRecords)
+{
+    putHeader(isIps32);
+
+    for(u32 i = 0; i < nbRecords; i++)
+    {
+        u32 offset = testRand() % size,
+            len = 1 + testRand() % (testRand() % 8 != 0 ? 16 : 0x3000);
+
+        if((!isIps32 && offset == 0x454F46) || (isIps32 && offset == 0x45454F46)) continue;
+        if(testRand() % 50 == 0) len = 0xFFFF;
+
+        if(testRand() % 3 == 0)
+            putRle(isIps32, offset, len, (u8)testRand());
+        else
+        {
+            u8 header[2] = { len >> 8, len };
+
+            putOffset(isIps32, offset);
+            put(header, 2);
+            testFillRandom(patch + patchLen, len, 256);
+            patchLen += len;
+        }
+    }
+
+    if(testRand() % 20 != 0)
+        putEof(isIps32);
+    else
+        patchLen -= testRand() % 3;
+}
+
+//The same patch in IPS32: each offset gets a leading zero byte
+static u32 convertToIps32(u8 *out, const u8 *in, u32 len)
+{
+    u32 i = 5, j = 5;
+
+    memcpy(out, "IPS32", 5);
+
+    while(i + 3 <= len)
+    {
+        if(memcmp(in + i, "EOF", 3) == 0)
+        {
+            memcpy(out + j, "EEOF", 4);
+            return j + 4;
+        }
+
+        out[j++] = 0;
+        memcpy(out + j, in + i, 3);
+        i += 3;
+        j += 3;
+
+        if(i + 2 > len) break;
+
+        u32 patchSize = (in[i] << 8) | in[i + 1],
+            recordSize = patchSize != 0 ? 2 + patchSize : 5;
+
+        if(i + recordSize > len) recordSize = len - i;
+        memcpy(out + j, in + i, recordSize);
+        i += recordSize;
+        j += recordSize;
+    }
+
+    if(i >= len) return j;
+
+    memcpy(out + j, in + i, len - i);
+
+    return j + len - i;
+}
+
+static void testDifferential(void)
+{
+    const u32 size = 0x40000;
+    static u8 ips32[1 << 22];
+    u8 *original = malloc(size),
+       *code = malloc(size),
+       *expected = malloc(size);
+    u32 nbApplied = 0;
+
+    fillCode(original, size);
+
+    for(u32 iteration = 0; iteration < 2000; iteration++)
+    {
+        putRandomPatch(false, size, testRand() % 100);
+
+        memcpy(code, original, size);
+        memcpy(expected, original, size);
+        bool ret = applyPatch(patch, patchLen, code, size);
+        CHECK(ret == referenceApplyPatch(patch, patchLen, expected, size));
+        //What was applied before an error doesn't matter, the loader stops there
+        CHECK(!ret || memcmp(code, expected, size) == 0);
+
+        //The same patch as IPS32 gives the same result
+        u32 ips32Len = convertToIps32(ips32, patch, patchLen);
+        memcpy(expected, original, size);
+        CHECK(applyPatch(ips32, ips32Len, expected, size) == ret);
+        CHECK(!ret || memcmp(code, expected, size) == 0);
+
+        nbApplied += ret;
+    }
+
+    CHECK(nbApplied > 500);
+
+    free(original);
+    free(code);
+    free(expected);
+}
+
+static void testReadCount(void)
+{
+    const u32 size = 0x100000;
+    u8 *code = malloc(size);
+    static u8 payload[0x2000];
+    u32 nbLargeRecords = 0;
+
+    testFillRandom(payload, sizeof(payload), 256);
+
+    //Typical patch: many small records
+    putHeader(false);
+    for(u32 i = 0; i < 500; i++)
+    {
+        u32 len = 1 + testRand() % 16;
+        if(i % 100 == 99) len = 0x2000;
+        nbLargeRecords += len >= 0x1000;
+
+        if(i % 4 == 0)
+            putRle(false, testRand() % (size - len), len, 0);
+        else
+            putRecord(false, testRand() % (size - len), payload, len);
+    }
+    putEof(false);
+
+    fillCode(code, size);
+    CHECK(referenceApplyPatch(patch, patchLen, code, size));
+    u32 referenceReads = nbReads;
+
+    fillCode(code, size);
+    CHECK(applyPatch(patch, patchLen, code, size));
+
+    //One read per buffer refill, plus one per large record
+    CHECK(nbReads <= patchLen / 0x1000 + 1 + nbLargeRecords);
+    CHECK(referenceReads >= 3 * 500);
+
+    free(code);
+}
+
+int main(void)
+{
+    testConformance();
+    testDifferential();
+    testReadCount();
+
+    return testResult("ips");
+}
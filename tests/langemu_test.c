@@ -0,0 +1,178 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Registers language emulation settings and looks them up the way the cfg hooks do, through the state functions of
+*   k11_extension/source/langemu.c
+*/
+
+#include "test.h"
+#include "langemu.h"
+
+static void hostLock(KRecursiveLock *lock)
+{
+    (void)lock;
+}
+
+bool isN3DS;
+u32 kernelVersion;
+
+static KRecursiveLock hostCriticalSectionLock;
+
+KRecursiveLock *criticalSectionLock = &hostCriticalSectionLock;
+void (*KRecursiveLock__Lock)(KRecursiveLock *this) = hostLock;
+void (*KRecursiveLock__Unlock)(KRecursiveLock *this) = hostLock;
+
+static LangemuAttributes attributes(u64 titleId, u8 language)
+{
+    return (LangemuAttributes){ .titleId = titleId, .mask = 0xF, .region = 1, .language = language, .country = 2, .state = 3 };
+}
+
+static bool isLanguage(const LangemuAttributes *attribs, u64 titleId, u8 language)
+{
+    return attribs != NULL && attribs->titleId == titleId && attribs->language == language;
+}
+
+#define TITLE_A 0x0004000000055D00ULL
+#define TITLE_B 0x0004000000164800ULL
+#define TITLE_C 0x0004000000086300ULL
+
+static void testRegistration(void)
+{
+    LangemuState state = { 0 };
+    LangemuAttributes a = attributes(TITLE_A, 1);
+
+    //The empty slots don't match title ID 0
+    CHECK(langemuStateGet(&state, 20, 0) == NULL);
+
+    //Settings registered after a process missed are still found
+    CHECK(langemuStateGet(&state, 21, TITLE_A) == NULL);
+    CHECK(langemuStateAddTitle(&state, &a));
+    CHECK(isLanguage(langemuStateGet(&state, 21, TITLE_A), TITLE_A, 1));
+    CHECK(langemuStateGet(&state, 22, TITLE_B) == NULL);
+
+    //Registering a title again, as when it's relaunched with other settings, updates it in place
+    a.language = 5;
+    CHECK(langemuStateAddTitle(&state, &a));
+    CHECK(state.nbTitles == 1);
+    CHECK(isLanguage(langemuStateGet(&state, 21, TITLE_A), TITLE_A, 5));
+
+    //Every title has its own slot
+    LangemuState full = { 0 };
+    for(u32 i = 0; i < LANGEMU_NB_TITLES; i++)
+    {
+        LangemuAttributes t = attributes(TITLE_C + (i << 8), (u8)i);
+        CHECK(langemuStateAddTitle(&full, &t));
+    }
+    for(u32 i = 0; i < LANGEMU_NB_TITLES; i++)
+        CHECK(isLanguage(langemuStateGet(&full, 100 + i, TITLE_C + (i << 8)), TITLE_C + (i << 8), (u8)i));
+
+    //When they're all used, only known titles can be registered
+    LangemuAttributes b = attributes(TITLE_B, 2), known = attributes(TITLE_C, 9);
+    CHECK(!langemuStateAddTitle(&full, &b));
+    CHECK(langemuStateAddTitle(&full, &known));
+    CHECK(full.nbTitles == LANGEMU_NB_TITLES);
+    CHECK(isLanguage(langemuStateGet(&full, 200, TITLE_C), TITLE_C, 9));
+    CHECK(langemuStateGet(&full, 201, TITLE_B) == NULL);
+}
+
+//A process resolves its title on its first lookup, then the result is reused until the process exits
+static void testLookupCache(void)
+{
+    LangemuState state = { 0 };
+    LangemuAttributes a = attributes(TITLE_A, 1), b = attributes(TITLE_B, 2);
+
+    CHECK(langemuStateAddTitle(&state, &a));
+    CHECK(langemuStateAddTitle(&state, &b));
+
+    //The title ID only matters for the first lookup, it can't change for a given PID
+    CHECK(isLanguage(langemuStateGet(&state, 30, TITLE_A), TITLE_A, 1));
+    CHECK(isLanguage(langemuStateGet(&state, 30, TITLE_B), TITLE_A, 1));
+    CHECK(langemuStateGet(&state, 31, TITLE_C) == NULL);
+    CHECK(langemuStateGet(&state, 31, TITLE_A) == NULL);
+
+    //Misses are remembered too, until a title is registered
+    LangemuAttributes c = attributes(TITLE_C, 3);
+    CHECK(langemuStateAddTitle(&state, &c));
+    CHECK(isLanguage(langemuStateGet(&state, 31, TITLE_C), TITLE_C, 3));
+
+    //PIDs sharing an entry evict each other, and look their title up again
+    u32 pid = 40, other = pid + LANGEMU_NB_PROCESSES;
+    CHECK(isLanguage(langemuStateGet(&state, pid, TITLE_A), TITLE_A, 1));
+    CHECK(isLanguage(langemuStateGet(&state, other, TITLE_B), TITLE_B, 2));
+    CHECK(isLanguage(langemuStateGet(&state, pid, TITLE_A), TITLE_A, 1));
+    CHECK(isLanguage(langemuStateGet(&state, other, TITLE_B), TITLE_B, 2));
+}
+
+static void testProcessExit(void)
+{
+    LangemuState state = { 0 };
+    LangemuAttributes a = attributes(TITLE_A, 1), b = attributes(TITLE_B, 2);
+
+    CHECK(langemuStateAddTitle(&state, &a));
+    CHECK(langemuStateAddTitle(&state, &b));
+
+    //The entry is dropped, the next lookup for that PID resolves its title again
+    CHECK(isLanguage(langemuStateGet(&state, 50, TITLE_A), TITLE_A, 1));
+    langemuStateForgetProcess(&state, 50);
+    CHECK(state.processes[50 & (LANGEMU_NB_PROCESSES - 1)].key == 0);
+    CHECK(isLanguage(langemuStateGet(&state, 50, TITLE_B), TITLE_B, 2));
+
+    //An exiting process that was evicted leaves the entry of the one that evicted it alone
+    u32 pid = 51, other = pid + LANGEMU_NB_PROCESSES;
+    CHECK(isLanguage(langemuStateGet(&state, pid, TITLE_A), TITLE_A, 1));
+    CHECK(isLanguage(langemuStateGet(&state, other, TITLE_B), TITLE_B, 2));
+    langemuStateForgetProcess(&state, pid);
+    CHECK(isLanguage(langemuStateGet(&state, other, TITLE_A), TITLE_B, 2));
+
+    //Processes without settings exit too
+    langemuStateForgetProcess(&state, 52);
+    CHECK(state.processes[52 & (LANGEMU_NB_PROCESSES - 1)].key == 0);
+}
+
+//The SVC reports a full table with the same error as before
+static void testSetLangemuAttributes(void)
+{
+    for(u32 i = 0; i < LANGEMU_NB_TITLES; i++)
+    {
+        LangemuAttributes t = attributes(TITLE_C + (i << 8), (u8)i);
+        CHECK(SetLangemuAttributes(&t) == 0);
+    }
+
+    LangemuAttributes t = attributes(TITLE_B, 0), known = attributes(TITLE_C, 1);
+    CHECK(SetLangemuAttributes(&t) == (Result)0xD8609013);
+    CHECK(SetLangemuAttributes(&known) == 0);
+}
+
+int main(void)
+{
+    testRegistration();
+    testLookupCache();
+    testProcessExit();
+    testSetLangemuAttributes();
+
+    return testResult("langemu");
+}
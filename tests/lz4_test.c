@@ -0,0 +1,324 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Round-trip, conformance and robustness tests of arm9/source/lz4.c, and a benchmark against a plain copy
+*/
+
+#include "test.h"
+#include "lz4.h"
+
+//Produced by the reference lz4 tool (v1.9.4) from kat input below: "lz4 -9", then "lz4 -9 -BD --content-size -BX"
+static const u8 referenceFrame[] = {
+    0x04, 0x22, 0x4D, 0x18, 0x64, 0x40, 0xA7, 0x41, 0x00, 0x00, 0x00, 0xFF, 0x07, 0x4C, 0x75, 0x6D,
+    0x61, 0x33, 0x44, 0x53, 0x20, 0x73, 0x70, 0x6C, 0x61, 0x73, 0x68, 0x20, 0x73, 0x63, 0x72, 0x65,
+    0x65, 0x6E, 0x20, 0x16, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0x27, 0xF0, 0x11, 0x00, 0x01, 0x02, 0x03,
+    0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13,
+    0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x00, 0x00, 0x00, 0x00,
+    0xC4, 0x4C, 0x18, 0x33
+},
+                referenceFrameLinked[] = {
+    0x04, 0x22, 0x4D, 0x18, 0x7C, 0x40, 0x6C, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xA4, 0x41,
+    0x00, 0x00, 0x00, 0xFF, 0x07, 0x4C, 0x75, 0x6D, 0x61, 0x33, 0x44, 0x53, 0x20, 0x73, 0x70, 0x6C,
+    0x61, 0x73, 0x68, 0x20, 0x73, 0x63, 0x72, 0x65, 0x65, 0x6E, 0x20, 0x16, 0x00, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x27, 0xF0, 0x11, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+    0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B,
+    0x1C, 0x1D, 0x1E, 0x1F, 0x23, 0x24, 0xBA, 0x3E, 0x00, 0x00, 0x00, 0x00, 0xC4, 0x4C, 0x18, 0x33
+};
+
+static u32 makeKatInput(u8 *out)
+{
+    u32 size = 0;
+
+    for(u32 i = 0; i < 50; i++, size += 22)
+        memcpy(out + size, "Luma3DS splash screen ", 22);
+    for(u32 i = 0; i < 32; i++)
+        out[size++] = i;
+
+    return size;
+}
+
+static inline u32 read32(const u8 *src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((u32)src[3] << 24);
+}
+
+static inline void write32(u8 *dst, u32 value)
+{
+    for(u32 i = 0; i < 4; i++)
+        dst[i] = (u8)(value >> (8 * i));
+}
+
+static u8 *writeLength(u8 *out, u32 length)
+{
+    for(length -= 15; length >= 255; length -= 255)
+        *out++ = 255;
+    *out++ = (u8)length;
+    return out;
+}
+
+static u8 *writeSequence(u8 *out, const u8 *literals, u32 literalLength, u32 offset, u32 matchLength)
+{
+    u8 *token = out++;
+
+    *token = (literalLength < 15 ? literalLength : 15) << 4;
+    if(literalLength >= 15) out = writeLength(out, literalLength);
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+
+    //The last sequence only has literals
+    if(matchLength == 0) return out;
+
+    out[0] = (u8)offset;
+    out[1] = (u8)(offset >> 8);
+    out += 2;
+
+    matchLength -= 4;
+    *token |= matchLength < 15 ? matchLength : 15;
+    if(matchLength >= 15) out = writeLength(out, matchLength);
+
+    return out;
+}
+
+//Greedy compressor, only there to produce test frames. Matches can reach back into the previous blocks.
+static u32 hashTable[1 << 12];
+
+static u32 compressBlock(u8 *out, const u8 *base, u32 start, u32 end)
+{
+    u8 *pos = out;
+    u32 anchor = start;
+
+    //The last match has to start 12 bytes before the end of the block and leave 5 literals
+    for(u32 i = start; i + 12 <= end;)
+    {
+        u32 sequence = read32(base + i),
+            hash = (sequence * 2654435761u) >> 20,
+            candidate = hashTable[hash];
+
+        hashTable[hash] = i + 1;
+
+        if(candidate == 0 || i - (candidate - 1) > 0xFFFF || read32(base + candidate - 1) != sequence)
+        {
+            i++;
+            continue;
+        }
+
+        u32 match = candidate - 1, length = 4;
+        while(i + length < end - 5 && base[match + length] == base[i + length]) length++;
+
+        pos = writeSequence(pos, base + anchor, i - anchor, i - match, length);
+        i += length;
+        anchor = i;
+    }
+
+    pos = writeSequence(pos, base + anchor, end - anchor, 0, 0);
+
+    return pos - out;
+}
+
+//Flags are the FLG bits to set: 0x08 content size, 0x10 block checksums
+static u32 compressFrame(u8 *out, const u8 *src, u32 size, u8 flags, u32 blockSize)
+{
+    u8 *pos = out;
+
+    memset(hashTable, 0, sizeof(hashTable));
+
+    write32(pos, 0x184D2204);
+    pos[4] = 0x40 | flags;
+    pos[5] = 0x40;
+    pos += 6;
+    if(flags & 0x08)
+    {
+        write32(pos, size);
+        write32(pos + 4, 0);
+        pos += 8;
+    }
+    *pos++ = 0; //Header checksum, not checked
+
+    for(u32 start = 0; start < size; start += blockSize)
+    {
+        u32 end = size - start < blockSize ? size : start + blockSize,
+            compressedSize = compressBlock(pos + 4, src, start, end);
+
+        //Incompressible blocks are stored as is
+        if(compressedSize >= end - start)
+        {
+            memcpy(pos + 4, src + start, end - start);
+            write32(pos, 0x80000000 | (end - start));
+            pos += 4 + end - start;
+        }
+        else
+        {
+            write32(pos, compressedSize);
+            pos += 4 + compressedSize;
+        }
+
+        if(flags & 0x10)
+        {
+            write32(pos, 0xDEADBEEF);
+            pos += 4;
+        }
+    }
+
+    write32(pos, 0);
+
+    return pos + 4 - out;
+}
+
+static void makeSplashLike(u8 *out, u32 size)
+{
+    //Flat areas and gradients with a bit of noise, like the usual splash screens
+    for(u32 i = 0; i < size; i++)
+    {
+        u32 pixel = i / 3, x = pixel / 240, y = pixel % 240;
+        out[i] = (x / 40 + y / 30) % 3 == 0 ? (u8)(x + y + (i % 3) * 40) : (u8)((i % 3) * 85);
+        if(testRand() % 64 == 0) out[i] ^= testRand() & 7;
+    }
+}
+
+static void testReferenceFrames(void)
+{
+    u8 expected[2048], out[2048];
+    u32 size = makeKatInput(expected);
+
+    memset(out, 0, sizeof(out));
+    CHECK(lz4DecompressFrame(out, sizeof(out), referenceFrame, sizeof(referenceFrame)) == size);
+    CHECK(memcmp(out, expected, size) == 0);
+
+    memset(out, 0, sizeof(out));
+    CHECK(lz4DecompressFrame(out, sizeof(out), referenceFrameLinked, sizeof(referenceFrameLinked)) == size);
+    CHECK(memcmp(out, expected, size) == 0);
+
+    //Output that doesn't fit is an error, not a partial result
+    CHECK(lz4DecompressFrame(out, size - 1, referenceFrame, sizeof(referenceFrame)) == 0);
+
+    //Not a frame, legacy frame, dictionary
+    u8 frame[sizeof(referenceFrame)];
+    memcpy(frame, referenceFrame, sizeof(frame));
+    frame[0] ^= 1;
+    CHECK(lz4DecompressFrame(out, sizeof(out), frame, sizeof(frame)) == 0);
+    frame[0] ^= 1;
+    frame[4] = 0x00;
+    CHECK(lz4DecompressFrame(out, sizeof(out), frame, sizeof(frame)) == 0);
+    frame[4] = 0x41;
+    CHECK(lz4DecompressFrame(out, sizeof(out), frame, sizeof(frame)) == 0);
+}
+
+static void testRoundTrip(void)
+{
+    const u32 maxSize = 400 * 240 * 3;
+    u8 *src = (u8 *)malloc(maxSize), *dst = (u8 *)malloc(maxSize), *frame = (u8 *)malloc(maxSize * 2);
+
+    for(u32 iteration = 0; iteration < 300; iteration++)
+    {
+        u32 size = iteration % 10 == 0 ? maxSize : testRand() % (iteration < 100 ? 64 : maxSize);
+
+        switch(iteration % 3)
+        {
+            case 0:
+                makeSplashLike(src, size);
+                break;
+            case 1:
+                testFillRandom(src, size, 2 + testRand() % 8);
+                break;
+            default:
+                testFillRandom(src, size, 256);
+                break;
+        }
+
+        u8 flags = (testRand() % 2 ? 0x08 : 0) | (testRand() % 2 ? 0x10 : 0);
+        u32 frameSize = compressFrame(frame, src, size, flags, testRand() % 2 ? 0x10000 : 0x1000 + testRand() % 0x1000);
+
+        memset(dst, 0xAA, maxSize);
+        CHECK(lz4DecompressFrame(dst, maxSize, frame, frameSize) == size);
+        CHECK(memcmp(dst, src, size) == 0);
+
+        //Corrupted or truncated frames must not make the decoder go out of bounds
+        for(u32 i = 0; i < 8 && frameSize > 0; i++)
+        {
+            u32 corruptedSize = frameSize;
+
+            if(i % 2 == 0)
+                corruptedSize = testRand() % frameSize;
+            else
+                frame[testRand() % frameSize] ^= 1 << (testRand() % 8);
+
+            //Exact-size copy, so that ASan catches reads past the end
+            u8 *copy = (u8 *)malloc(corruptedSize + 1);
+            memcpy(copy, frame, corruptedSize);
+            u8 *out = (u8 *)malloc(size + 1);
+            CHECK(lz4DecompressFrame(out, size, copy, corruptedSize) <= size);
+            free(out);
+            free(copy);
+        }
+    }
+
+    free(frame);
+    free(dst);
+    free(src);
+}
+
+static void benchmark(void)
+{
+    const u32 size = 400 * 240 * 3, rounds = 200;
+    u8 *src = (u8 *)malloc(size), *dst = (u8 *)malloc(size), *frame = (u8 *)malloc(size * 2);
+
+    makeSplashLike(src, size);
+    u32 frameSize = compressFrame(frame, src, size, 0, 0x10000);
+
+    double start = testNow();
+    for(u32 round = 0; round < rounds; round++)
+        CHECK(lz4DecompressFrame(dst, size, frame, frameSize) == size);
+    double decode = testNow() - start;
+
+    start = testNow();
+    for(u32 round = 0; round < rounds; round++)
+    {
+        memcpy(dst, src, size);
+        __asm__ volatile("" ::: "memory");
+    }
+    double copy = testNow() - start;
+
+    printf("lz4: top screen splash %lu -> %lu bytes, decode %.1f MiB/s, raw copy %.1f MiB/s\n", (unsigned long)size,
+           (unsigned long)frameSize, rounds * (size / 1048576.0) / decode, rounds * (size / 1048576.0) / copy);
+
+    free(frame);
+    free(dst);
+    free(src);
+}
+
+int main(int argc, char **argv)
+{
+    if(testIsBench(argc, argv))
+        benchmark();
+    else
+    {
+        testReferenceFrames();
+        testRoundTrip();
+    }
+
+    return testResult("lz4");
+}
@@ -0,0 +1,673 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Round trips, fuzzing and a benchmark of the ExeFS code decompressor of sysmodules/loader/source/lzss.c,
+*   against the byte-wise decompressor it replaced, and the load time of code read from throttled media
+*/
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "test.h"
+#include "lzss.h"
+
+//The loader's previous decompressor, tidied up: the reference for the output
+static void referenceDecompress(u8 *end)
+{
+    u32 footer,
+        extraSize;
+
+    memcpy(&footer, end - 8, 4);
+    memcpy(&extraSize, end - 4, 4);
+
+    const u8 *inStart = end - (footer & 0xFFFFFF),
+             *in = end - (footer >> 24);
+    u8 *out = end + extraSize;
+
+    while(in > inStart)
+    {
+        u8 flags = *--in;
+
+        for(u32 i = 0; i < 8 && in > inStart; i++, flags <<= 1)
+        {
+            if(flags & 0x80)
+            {
+                u32 hi = *--in;
+                u32 lo = *--in;
+                u32 len = (hi >> 4) + 3;
+                u32 dist = (((hi & 0xF) << 8) | lo) + 3;
+
+                for(; len > 0; len--, out--)
+                    out[-1] = out[dist - 1];
+            }
+            else
+                *--out = *--in;
+        }
+    }
+}
+
+#define HASH_BITS   12
+#define MAX_CHAIN   32
+
+static u32 hash3(const u8 *p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+//Tokenizes data[rawSize, dataSize) from the end, in decoding order. Returns the size of the token stream
+static u32 tokenize(u8 *stream, const u8 *data, u32 dataSize, u32 rawSize)
+{
+    static s32 head[1 << HASH_BITS];
+    s32 *prev = malloc(sizeof(s32) * (dataSize + 1));
+    u32 streamSize = 0,
+        flagPos = 0,
+        nbTokens = 0,
+        inserted = dataSize + 1;
+
+    for(u32 i = 0; i < 1 << HASH_BITS; i++) head[i] = -1;
+
+    for(u32 pos = dataSize; pos > rawSize; nbTokens++)
+    {
+        //Sequences ending at pos + 3 or above can be referred to
+        for(; inserted > pos + 3; inserted--)
+        {
+            u32 end = inserted - 1;
+            if(end < 3) break;
+            u32 h = hash3(data + end - 3);
+            prev[end] = head[h];
+            head[h] = (s32)end;
+        }
+
+        u32 bestLen = 0,
+            bestDist = 0,
+            maxLen = pos - rawSize < 18 ? pos - rawSize : 18;
+
+        if(maxLen >= 3)
+        {
+            u32 chain = 0;
+            for(s32 end = head[hash3(data + pos - 3)]; end >= 0 && chain < MAX_CHAIN && (u32)end - pos <= 4098; end = prev[end], chain++)
+            {
+                u32 len = 0;
+                while(len < maxLen && data[pos - 1 - len] == data[end - 1 - len]) len++;
+                if(len > bestLen)
+                {
+                    bestLen = len;
+                    bestDist = end - pos;
+                }
+            }
+        }
+
+        if(nbTokens % 8 == 0)
+        {
+            flagPos = streamSize++;
+            stream[flagPos] = 0;
+        }
+
+        if(bestLen >= 3)
+        {
+            stream[flagPos] |= 0x80 >> (nbTokens % 8);
+            stream[streamSize++] = (u8)((bestLen - 3) << 4 | (bestDist - 3) >> 8);
+            stream[streamSize++] = (u8)(bestDist - 3);
+            pos -= bestLen;
+        }
+        else
+        {
+            stream[streamSize++] = data[pos - 1];
+            pos--;
+        }
+    }
+
+    free(prev);
+
+    return streamSize;
+}
+
+//How many more raw bytes decoding in place would need, so that no output overwrites input that hasn't been read yet
+static u32 inPlaceDeficit(const u8 *stream, u32 streamSize, u32 dataSize, u32 rawSize)
+{
+    u32 consumed = 0,
+        produced = 0;
+    s64 deficit = 0;
+
+    while(consumed < streamSize)
+    {
+        u8 flags = stream[consumed++];
+
+        for(u32 i = 0; i < 8 && consumed < streamSize; i++, flags <<= 1)
+        {
+            if(flags & 0x80)
+            {
+                produced += (stream[consumed] >> 4) + 3;
+                consumed += 2;
+            }
+            else
+            {
+                produced++;
+                consumed++;
+            }
+
+            s64 d = (s64)(rawSize + streamSize - consumed) - (s64)(dataSize - produced);
+            if(d > deficit) deficit = d;
+        }
+    }
+
+    return (u32)deficit;
+}
+
+//Lays out compressed code as found in the ExeFS: raw bytes, tokens (read backwards), padding and footer.
+//Returns the compressed size, or 0 if the data doesn't compress
+static u32 compress(u8 *out, const u8 *data, u32 dataSize)
+{
+    u8 *stream = malloc(dataSize + dataSize / 8 + 16);
+    u32 rawSize = 0,
+        streamSize;
+
+    for(u32 i = 0; ; i++)
+    {
+        streamSize = tokenize(stream, data, dataSize, rawSize);
+        u32 deficit = inPlaceDeficit(stream, streamSize, dataSize, rawSize);
+        if(deficit == 0) break;
+        rawSize = i < 16 ? rawSize + deficit : dataSize;
+    }
+
+    u32 headerSize = 8 + (4 - (rawSize + streamSize) % 4) % 4,
+        size = rawSize + streamSize + headerSize;
+
+    if(streamSize == 0 || size > dataSize)
+    {
+        free(stream);
+        return 0;
+    }
+
+    memcpy(out, data, rawSize);
+    for(u32 i = 0; i < streamSize; i++)
+        out[rawSize + streamSize - 1 - i] = stream[i];
+    memset(out + rawSize + streamSize, 0xFF, headerSize - 8);
+
+    u32 footer = headerSize << 24 | (streamSize + headerSize),
+        extraSize = dataSize - size;
+
+    memcpy(out + size - 8, &footer, 4);
+    memcpy(out + size - 4, &extraSize, 4);
+
+    free(stream);
+
+    return size;
+}
+
+static void initReader(CodeReader *reader, u8 *buf, u32 size, bool loaded)
+{
+    memset(reader, 0, sizeof(CodeReader));
+    reader->buf = buf;
+    reader->size = size;
+    reader->loaded = loaded ? buf : buf + size;
+    LightEvent_Init(&reader->progress, RESET_ONESHOT);
+}
+
+//Code-like data: words from a small set of instructions with varying registers and immediates, literal pools and zeroes
+static void fillCode(u8 *data, u32 size)
+{
+    static const u32 opcodes[] = {0xE5900000, 0xE5800000, 0xE1A00000, 0xE3A00000, 0xEB000000, 0xE12FFF1E, 0xE92D4000, 0xE8BD8000};
+    u32 i = 0;
+
+    for(; i + 4 <= size; i += 4)
+    {
+        u32 r = testRand(), word;
+
+        switch(r % 16)
+        {
+            case 0: case 1:
+                word = 0;
+                break;
+            case 2:
+                word = testRand();
+                break;
+            case 3: case 4: case 5:
+                //Repeated sequences
+                word = i >= 64 ? *(u32 *)(data + i - 4 * (1 + (r >> 8) % 16)) : 0;
+                break;
+            default:
+                word = opcodes[(r >> 4) % 8] | ((r >> 8) & 0x7) << 12 | ((r >> 12) & 0x7) << 16 | ((r >> 16) % 8) * 4;
+                break;
+        }
+
+        memcpy(data + i, &word, 4);
+    }
+
+    for(; i < size; i++) data[i] = (u8)testRand();
+}
+
+static void fillData(u8 *data, u32 size, u32 kind)
+{
+    switch(kind % 4)
+    {
+        case 0:
+            fillCode(data, size);
+            break;
+        case 1:
+            testFillRandom(data, size, 2 + testRand() % 4);
+            break;
+        case 2:
+            memset(data, (u8)testRand(), size);
+            break;
+        default:
+            //Short period, for overlapping back-references
+            for(u32 i = 0, period = 1 + testRand() % 5; i < size; i++) data[i] = i < period ? (u8)testRand() : data[i - period];
+            break;
+    }
+}
+
+static void testRoundTrip(void)
+{
+    u32 nbCompressed = 0;
+
+    for(u32 iteration = 0; iteration < 3000; iteration++)
+    {
+        u32 dataSize = 16 + testRand() % (iteration % 50 == 0 ? 0x40000 : 0x2000),
+            slack = testRand() % 2 ? 0 : testRand() % 64;
+        u8 *data = malloc(dataSize),
+           *buf = malloc(dataSize + slack),
+           *ref = malloc(dataSize + slack);
+
+        fillData(data, dataSize, iteration);
+
+        u32 size = compress(buf, data, dataSize);
+        if(size != 0)
+        {
+            CodeReader reader;
+
+            nbCompressed++;
+            memcpy(ref, buf, size);
+            initReader(&reader, buf, size, true);
+            CHECK(lzss_decompress(buf, size, dataSize + slack, &reader));
+            CHECK(memcmp(buf, data, dataSize) == 0);
+
+            referenceDecompress(ref + size);
+            CHECK(memcmp(ref, data, dataSize) == 0);
+        }
+
+        free(data);
+        free(buf);
+        free(ref);
+    }
+
+    CHECK(nbCompressed > 2000);
+}
+
+static void testRejected(void)
+{
+    static u8 data[0x1000], buf[0x1000];
+    CodeReader reader;
+    u32 footer;
+
+    fillCode(data, sizeof(data));
+    u32 size = compress(buf, data, sizeof(data));
+    CHECK(size != 0);
+
+    //No room for the footer
+    initReader(&reader, buf, 7, true);
+    CHECK(!lzss_decompress(buf, 7, sizeof(buf), &reader));
+
+    //Not enough room for the decompressed data
+    initReader(&reader, buf, size, true);
+    CHECK(!lzss_decompress(buf, size, sizeof(buf) - 1, &reader));
+
+    //Header smaller than the footer, or larger than the compressed data
+    memcpy(&footer, buf + size - 8, 4);
+    u32 badFooters[] = {(footer & 0xFFFFFF) | 7 << 24, (footer & 0xFF000000) | ((footer >> 24) - 1), (footer & 0xFF000000) | (size + 1)};
+    for(u32 i = 0; i < sizeof(badFooters) / sizeof(badFooters[0]); i++)
+    {
+        memcpy(buf + size - 8, &badFooters[i], 4);
+        initReader(&reader, buf, size, true);
+        CHECK(!lzss_decompress(buf, size, sizeof(buf), &reader));
+        memcpy(buf + size - 8, &footer, 4);
+    }
+
+    //Decompressed data not ending where the compressed data starts
+    u32 extraSize;
+    memcpy(&extraSize, buf + size - 4, 4);
+    extraSize--;
+    memcpy(buf + size - 4, &extraSize, 4);
+    initReader(&reader, buf, size, true);
+    CHECK(!lzss_decompress(buf, size, sizeof(buf), &reader));
+}
+
+//Random footers and corrupted streams, in buffers of the exact size so that ASan catches any access outside of them
+static void testFuzz(void)
+{
+    u32 nbAccepted = 0;
+
+    for(u32 iteration = 0; iteration < 100000; iteration++)
+    {
+        u32 size = 8 + testRand() % 2000,
+            bufSize = size + testRand() % 4000;
+        u8 *buf = malloc(bufSize);
+        CodeReader reader;
+
+        testFillRandom(buf, bufSize, 256);
+
+        u32 footer = (8 + testRand() % 8) << 24 | testRand() % (size + 1),
+            extraSize = testRand() % (bufSize - size + 1);
+
+        memcpy(buf + size - 8, &footer, 4);
+        memcpy(buf + size - 4, &extraSize, 4);
+
+        initReader(&reader, buf, size, true);
+        nbAccepted += lzss_decompress(buf, size, bufSize, &reader);
+        free(buf);
+    }
+
+    for(u32 iteration = 0; iteration < 3000; iteration++)
+    {
+        u32 dataSize = 64 + testRand() % 0x2000;
+        u8 *data = malloc(dataSize),
+           *buf = malloc(dataSize);
+        CodeReader reader;
+
+        fillData(data, dataSize, iteration);
+        u32 size = compress(buf, data, dataSize);
+
+        for(u32 i = 0, n = 1 + testRand() % 4; size != 0 && i < n; i++)
+            buf[testRand() % size] ^= 1 << testRand() % 8;
+
+        if(size != 0)
+        {
+            initReader(&reader, buf, size, true);
+            nbAccepted += lzss_decompress(buf, size, dataSize, &reader);
+        }
+
+        free(data);
+        free(buf);
+    }
+
+    CHECK(nbAccepted != 0);
+}
+
+//Same as the loader's reader thread, with chunks of any size and a read failure to inject
+typedef struct StreamedRead
+{
+    CodeReader *reader;
+    const u8 *src;
+    u32 chunkSize;
+    u32 failAt;
+} StreamedRead;
+
+static void *streamedReadMain(void *arg)
+{
+    StreamedRead *read = (StreamedRead *)arg;
+    CodeReader *reader = read->reader;
+
+    for(u32 end = reader->size, n = 0; end > 0; n++)
+    {
+        u32 start = end > read->chunkSize ? end - read->chunkSize : 0;
+
+        if(n == read->failAt)
+        {
+            __atomic_store_n(&reader->res, (Result)0xC900464F, __ATOMIC_RELEASE);
+            LightEvent_Signal(&reader->progress);
+            break;
+        }
+
+        memcpy(reader->buf + start, read->src + start, end - start);
+        __atomic_store_n(&reader->loaded, reader->buf + start, __ATOMIC_RELEASE);
+        LightEvent_Signal(&reader->progress);
+        end = start;
+
+        if(testRand() % 4 == 0) sched_yield();
+    }
+
+    return NULL;
+}
+
+static void testStreamed(void)
+{
+    for(u32 iteration = 0; iteration < 400; iteration++)
+    {
+        u32 dataSize = 0x100 + testRand() % 0x10000;
+        u8 *data = malloc(dataSize),
+           *src = malloc(dataSize),
+           *buf = malloc(dataSize);
+        bool fail = iteration % 4 == 3;
+
+        fillData(data, dataSize, iteration);
+        u32 size = compress(src, data, dataSize);
+        if(size != 0)
+        {
+            CodeReader reader;
+            StreamedRead read = { &reader, src, 1 + testRand() % 0x2000, 0xFFFFFFFF };
+            pthread_t thread;
+
+            if(fail) read.failAt = testRand() % ((size + read.chunkSize - 1) / read.chunkSize);
+
+            memset(buf, 0, dataSize);
+            initReader(&reader, buf, size, false);
+            pthread_create(&thread, NULL, streamedReadMain, &read);
+            bool ret = lzss_decompress(buf, size, dataSize, &reader);
+            pthread_join(thread, NULL);
+
+            CHECK(ret == !fail);
+            if(!fail) CHECK(memcmp(buf, data, dataSize) == 0);
+        }
+
+        free(data);
+        free(src);
+        free(buf);
+    }
+}
+
+static void benchmark(void)
+{
+    const u32 dataSize = 4 << 20;
+    u8 *data = malloc(dataSize),
+       *compressed = malloc(dataSize),
+       *buf = malloc(dataSize);
+    double reference = 1e9, current = 1e9;
+
+    fillCode(data, dataSize);
+    u32 size = compress(compressed, data, dataSize);
+
+    for(u32 i = 0; i < 10; i++)
+    {
+        CodeReader reader;
+
+        memcpy(buf, compressed, size);
+        double start = testNow();
+        referenceDecompress(buf + size);
+        double t = testNow() - start;
+        if(t < reference) reference = t;
+
+        memcpy(buf, compressed, size);
+        initReader(&reader, buf, size, true);
+        start = testNow();
+        bool ret = lzss_decompress(buf, size, dataSize, &reader);
+        t = testNow() - start;
+        if(t < current) current = t;
+
+        if(!ret || memcmp(buf, data, dataSize) != 0) testFailures++;
+    }
+
+    printf("lzss: %u KiB of code-like data (ratio %.2f), byte-wise %.1f MiB/s, current %.1f MiB/s\n", dataSize >> 10, (double)size / dataSize,
+           dataSize / reference / (1 << 20), dataSize / current / (1 << 20));
+
+    free(data);
+    free(compressed);
+    free(buf);
+}
+
+/*
+*   Load times: a mock FS throttled by bandwidth and per-request latency, read either all at once before decompressing
+*   (as the loader used to, and still does if it can't create its reader thread) or in the loader's chunks while
+*   decompressing. Host times are scaled so that the host decodes as fast as the console is assumed to
+*/
+#define CODE_READ_CHUNK_SIZE    0x10000             //Same as in loader.c
+#define CONSOLE_DECODE_SPEED    (20.0 * (1 << 20))  //Bytes of output per second, assumed for the ARM11
+#define MEDIA_LATENCY           0.0005              //Per request, in seconds on the console
+
+typedef struct ThrottledMedia
+{
+    const u8 *data;
+    double bandwidth, latency;  //Scaled to the host
+    double busyUntil;
+} ThrottledMedia;
+
+//Requests are served one after the other, the caller sleeping until its own is done
+static void throttledRead(ThrottledMedia *media, u8 *dst, u32 offset, u32 size)
+{
+    double now = testNow();
+    media->busyUntil = (now > media->busyUntil ? now : media->busyUntil) + media->latency + size / media->bandwidth;
+
+    struct timespec until = { (time_t)media->busyUntil, (long)((media->busyUntil - (time_t)media->busyUntil) * 1e9) };
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0);
+
+    memcpy(dst, media->data + offset, size);
+}
+
+typedef struct ThrottledReader
+{
+    CodeReader *reader;
+    ThrottledMedia *media;
+} ThrottledReader;
+
+//Same as the loader's reader thread
+static void *throttledReaderMain(void *arg)
+{
+    ThrottledReader *throttled = (ThrottledReader *)arg;
+    CodeReader *reader = throttled->reader;
+
+    for(u32 end = reader->size; end > 0; )
+    {
+        u32 start = end > CODE_READ_CHUNK_SIZE ? (end - 1) & ~(CODE_READ_CHUNK_SIZE - 1) : 0;
+
+        throttledRead(throttled->media, reader->buf + start, start, end - start);
+        __atomic_store_n(&reader->loaded, reader->buf + start, __ATOMIC_RELEASE);
+        LightEvent_Signal(&reader->progress);
+        end = start;
+    }
+
+    return NULL;
+}
+
+static double loadCode(u8 *buf, const u8 *compressed, u32 size, u32 dataSize, double bandwidth, double latency, bool streamed)
+{
+    ThrottledMedia media = { compressed, bandwidth, latency, 0 };
+    CodeReader reader;
+    bool ret;
+
+    double start = testNow();
+    if(streamed)
+    {
+        ThrottledReader throttled = { &reader, &media };
+        pthread_t thread;
+
+        initReader(&reader, buf, size, false);
+        pthread_create(&thread, NULL, throttledReaderMain, &throttled);
+        ret = lzss_decompress(buf, size, dataSize, &reader);
+        pthread_join(thread, NULL);
+    }
+    else
+    {
+        throttledRead(&media, buf, 0, size);
+        initReader(&reader, buf, size, true);
+        ret = lzss_decompress(buf, size, dataSize, &reader);
+    }
+    double t = testNow() - start;
+
+    if(!ret) testFailures++;
+
+    return t;
+}
+
+static void benchmarkLoadTime(void)
+{
+    static const double mediaSpeeds[] = {2, 10, 20, 40, 100}; //MiB/s
+    const u32 dataSize = 4 << 20;
+    u8 *data = malloc(dataSize),
+       *compressed = malloc(dataSize),
+       *buf = malloc(dataSize);
+    double decode = 1e9;
+
+    fillCode(data, dataSize);
+    u32 size = compress(compressed, data, dataSize);
+
+    //How much faster than the console the host is
+    for(u32 i = 0; i < 5; i++)
+    {
+        CodeReader reader;
+
+        memcpy(buf, compressed, size);
+        initReader(&reader, buf, size, true);
+        double start = testNow();
+        lzss_decompress(buf, size, dataSize, &reader);
+        double t = testNow() - start;
+        if(t < decode) decode = t;
+    }
+    double scale = dataSize / decode / CONSOLE_DECODE_SPEED;
+
+    for(u32 i = 0; i < sizeof(mediaSpeeds) / sizeof(mediaSpeeds[0]); i++)
+    {
+        double bandwidth = mediaSpeeds[i] * (1 << 20) * scale,
+               latency = MEDIA_LATENCY / scale,
+               whole = 1e9,
+               streamed = 1e9;
+
+        for(u32 run = 0; run < 5; run++)
+        {
+            double t = loadCode(buf, compressed, size, dataSize, bandwidth, latency, false);
+            if(t < whole) whole = t;
+            if(memcmp(buf, data, dataSize) != 0) testFailures++;
+
+            t = loadCode(buf, compressed, size, dataSize, bandwidth, latency, true);
+            if(t < streamed) streamed = t;
+            if(memcmp(buf, data, dataSize) != 0) testFailures++;
+        }
+
+        printf("lzss: loading %u KiB of code (%u KiB compressed) at %g MiB/s, read then decompress %.0f ms, streamed %.0f ms (%.2fx)\n",
+               dataSize >> 10, size >> 10, mediaSpeeds[i], whole * scale * 1e3, streamed * scale * 1e3, whole / streamed);
+    }
+
+    free(data);
+    free(compressed);
+    free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    if(testIsBench(argc, argv))
+    {
+        benchmark();
+        benchmarkLoadTime();
+    }
+    else
+    {
+        testRoundTrip();
+        testRejected();
+        testFuzz();
+        testStreamed();
+    }
+
+    return testResult("lzss");
+}
@@ -0,0 +1,421 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Checks k11_extension/source/svc/MapProcessMemoryBatch.c: descriptor validation, the sort and overlap check,
+*   coalescing, and what the SVC ends up asking of the kernel for a batch
+*/
+
+#include "test.h"
+#include "kernel.h"
+
+//MapProcessMemoryBatch.c reads the context of the core it runs on at the same address on every core
+static KCoreContext testCoreContexts[4];
+#define currentCoreContext (&testCoreContexts[testCoreId])
+
+//Included rather than linked, to get at the sort and coalescing helpers
+#include "svc/MapProcessMemoryBatch.c"
+
+__thread u32 testCoreId;
+u32 testUserModeLr[4];
+
+bool isN3DS = true;
+u32 kernelVersion;
+
+//Processes, with a reference count each, handles 0x100 + i being processes[i]
+#define NB_PROCESSES    4
+#define PROCESS_HANDLE  0x100
+
+static KProcess processes[NB_PROCESSES];
+static s32 refCounts[NB_PROCESSES];
+
+static KAutoObject *hostDecrementReferenceCount(KAutoObject *this)
+{
+    refCounts[(KProcess *)this - processes]--;
+    return this;
+}
+
+static Vtable__KAutoObject hostProcessVtable = { .DecrementReferenceCount = hostDecrementReferenceCount };
+
+static void hostAddReference(KAutoObject *this)
+{
+    refCounts[(KProcess *)this - processes]++;
+}
+
+static KProcess *hostToKProcess(KProcessHandleTable *this, Handle processHandle)
+{
+    (void)this;
+    if(processHandle < PROCESS_HANDLE || processHandle >= PROCESS_HANDLE + NB_PROCESSES)
+        return NULL;
+
+    refCounts[processHandle - PROCESS_HANDLE]++;
+    return &processes[processHandle - PROCESS_HANDLE];
+}
+
+//What was asked of the kernel, in order
+#define MAX_CALLS 32
+
+typedef struct KernelCall
+{
+    s32 dstProcess, srcProcess;     //-1 when not known
+    u32 dstVa, srcVa, size;
+} KernelCall;
+
+static KernelCall calls[MAX_CALLS];
+static u32 nbCalls, nbCacheFlushes;
+static u32 failingVa;               //Mapping or unmapping it fails
+
+static Result recordCall(s32 dstProcess, u32 dstVa, s32 srcProcess, u32 srcVa, u32 size)
+{
+    CHECK(nbCalls < MAX_CALLS);
+    if(nbCalls < MAX_CALLS)
+        calls[nbCalls++] = (KernelCall){ dstProcess, srcProcess, dstVa, srcVa, size };
+
+    return failingVa - dstVa < size ? 0xD900060C : 0;
+}
+
+Result doMapProcessMemory(KProcess *dstProcess, u32 vaDst, KProcess *srcProcess, u32 vaSrc, u32 size)
+{
+    CHECK(refCounts[dstProcess - processes] > 0 && refCounts[srcProcess - processes] > 0);
+    return recordCall(dstProcess - processes, vaDst, srcProcess - processes, vaSrc, size);
+}
+
+static Result hostUnmapProcessMemory(Handle processHandle, void *dst, u32 size)
+{
+    return recordCall(processHandle - PROCESS_HANDLE, (u32)(uintptr_t)dst, -1, 0, size);
+}
+
+static Result hostKProcessHwInfoUnmapProcessMemory(KProcessHwInfo *this, void *addr, u32 nbPages)
+{
+    s32 process = -1;
+    for(s32 i = 0; i < NB_PROCESSES; i++)
+        if(this == hwInfoOfProcess(&processes[i])) process = i;
+
+    return recordCall(process, (u32)(uintptr_t)addr, -1, 0, nbPages << 12);
+}
+
+void flushEntireDataCache(void)
+{
+    nbCacheFlushes++;
+}
+
+void invalidateEntireInstructionCache(void)
+{
+}
+
+static bool copyFails;
+
+static bool hostMemcpy8(void *dst, const void *src, u32 len)
+{
+    if(copyFails) return false;
+    memcpy(dst, src, len);
+    return true;
+}
+
+void (*KAutoObject__AddReference)(KAutoObject *this) = hostAddReference;
+KProcess * (*KProcessHandleTable__ToKProcess)(KProcessHandleTable *this, Handle processHandle) = hostToKProcess;
+Result (*KProcessHwInfo__UnmapProcessMemory)(KProcessHwInfo *this, void *addr, u32 nbPages) = hostKProcessHwInfoUnmapProcessMemory;
+Result (*UnmapProcessMemory)(Handle processHandle, void *dst, u32 size) = hostUnmapProcessMemory;
+bool (*usrToKernelMemcpy8)(void *dst, const void *src, u32 len) = hostMemcpy8;
+bool (*kernelToUsrMemcpy8)(void *dst, const void *src, u32 len) = hostMemcpy8;
+
+static void reset(u32 kernelMinor)
+{
+    kernelVersion = SYSTEM_VERSION(2, kernelMinor, 0);
+    nbCalls = nbCacheFlushes = 0;
+    failingVa = 0xFFFFFFFF;
+    copyFails = false;
+
+    for(u32 i = 0; i < NB_PROCESSES; i++)
+    {
+        ((KAutoObject *)&processes[i])->vtable = &hostProcessVtable;
+        refCounts[i] = 0;
+    }
+
+    //The caller is process 0
+    testCoreContexts[testCoreId].objectContext.currentProcess = &processes[0];
+}
+
+static ProcessMemoryMapping mapping(Handle srcProcess, u32 srcVa, u32 dstVa, u32 size)
+{
+    return (ProcessMemoryMapping){ srcProcess, srcVa, dstVa, size, 0x12345678 };
+}
+
+static bool sameCall(const KernelCall *call, s32 dstProcess, u32 dstVa, s32 srcProcess, u32 srcVa, u32 size)
+{
+    return call->dstProcess == dstProcess && call->dstVa == dstVa && call->srcProcess == srcProcess &&
+           call->srcVa == srcVa && call->size == size;
+}
+
+static void testValidation(void)
+{
+    ProcessMemoryMapping mappings[] = {
+        mapping(PROCESS_HANDLE, 0x100000, 0x200000, 0x1000),
+        mapping(PROCESS_HANDLE, 0x100800, 0x201000, 0x1000),
+        mapping(PROCESS_HANDLE, 0x100000, 0x202800, 0x1000),
+        mapping(PROCESS_HANDLE, 0x100000, 0x203000, 0x800),
+        mapping(PROCESS_HANDLE, 0x100000, 0x204000, 0),
+        mapping(PROCESS_HANDLE, 0x100000, 0xFFFFF000, 0x2000),
+        mapping(PROCESS_HANDLE, 0xFFFFF000, 0x206000, 0x2000),
+        mapping(PROCESS_HANDLE, 0xFFFFE000, 0x207000, 0x1000),
+    };
+    static const Result expected[] = { 0, 0xE0E01BF1, 0xE0E01BF1, 0xE0E01BF2, 0xE0E01BF2, 0xE0E01BFD, 0xE0E01BFD, 0 };
+    u8 order[MAX_PROCESS_MEMORY_MAPPINGS];
+    u32 nbValid = 0;
+
+    CHECK(sortProcessMemoryMappings(order, &nbValid, mappings, 8) == 0);
+    CHECK(nbValid == 2 && order[0] == 0 && order[1] == 7);
+    for(u32 i = 0; i < 8; i++)
+        CHECK(mappings[i].result == expected[i]);
+}
+
+//Random batches of disjoint mappings come out sorted, whatever the order they were given in
+static void testSort(void)
+{
+    for(u32 round = 0; round < 2000; round++)
+    {
+        ProcessMemoryMapping mappings[MAX_PROCESS_MEMORY_MAPPINGS];
+        u8 order[MAX_PROCESS_MEMORY_MAPPINGS];
+        u32 count = 1 + testRand() % MAX_PROCESS_MEMORY_MAPPINGS, nbValid = 0, expectedValid = 0;
+        u32 dstVa = 0x10000000;
+
+        //Increasing, some adjacent, then shuffled
+        for(u32 i = 0; i < count; i++)
+        {
+            u32 size = (1 + testRand() % 4) << 12;
+
+            dstVa += (testRand() % 3) << 12;
+            mappings[i] = mapping(PROCESS_HANDLE, 0x08000000 + (testRand() % 0x100) * 0x1000, dstVa, size);
+            dstVa += size;
+            if(testRand() % 5 == 0)
+                mappings[i].size = 0;
+            else
+                expectedValid++;
+        }
+
+        for(u32 i = count - 1; i > 0; i--)
+        {
+            u32 j = testRand() % (i + 1);
+            ProcessMemoryMapping tmp = mappings[i];
+            mappings[i] = mappings[j];
+            mappings[j] = tmp;
+        }
+
+        CHECK(sortProcessMemoryMappings(order, &nbValid, mappings, count) == 0);
+        CHECK(nbValid == expectedValid);
+
+        bool seen[MAX_PROCESS_MEMORY_MAPPINGS] = { false };
+        for(u32 i = 0; i < nbValid; i++)
+        {
+            CHECK(order[i] < count && !seen[order[i]] && mappings[order[i]].result == 0);
+            seen[order[i]] = true;
+            if(i > 0)
+                CHECK(mappings[order[i - 1]].dstVa + mappings[order[i - 1]].size <= mappings[order[i]].dstVa);
+        }
+
+        for(u32 i = 0; i < count; i++)
+            CHECK(seen[i] == (mappings[i].size != 0));
+
+        //Then make two of them overlap by a page
+        if(nbValid >= 2)
+        {
+            u32 i = testRand() % (nbValid - 1);
+            ProcessMemoryMapping *next = &mappings[order[i + 1]];
+
+            next->dstVa = mappings[order[i]].dstVa + mappings[order[i]].size - 0x1000;
+            CHECK(sortProcessMemoryMappings(order, &nbValid, mappings, count) == (Result)0xE0E01BFD);
+        }
+    }
+
+    //Invalid mappings don't count as overlapping
+    ProcessMemoryMapping mappings[] = {
+        mapping(PROCESS_HANDLE, 0x100000, 0x200000, 0x2000),
+        mapping(PROCESS_HANDLE, 0x100001, 0x201000, 0x1000),
+        mapping(PROCESS_HANDLE, 0x100000, 0x202000, 0x1000),
+    };
+    u8 order[3];
+    u32 nbValid = 0;
+
+    CHECK(sortProcessMemoryMappings(order, &nbValid, mappings, 3) == 0);
+    CHECK(nbValid == 2 && order[0] == 0 && order[1] == 2);
+}
+
+static void testCoalescing(void)
+{
+    ProcessMemoryMapping mappings[] = {
+        mapping(PROCESS_HANDLE, 0x100000, 0x200000, 0x1000),
+        mapping(PROCESS_HANDLE, 0x101000, 0x201000, 0x2000),
+        mapping(PROCESS_HANDLE, 0x103000, 0x203000, 0x1000),
+        mapping(PROCESS_HANDLE + 1, 0x104000, 0x204000, 0x1000),    //Another source process
+        mapping(PROCESS_HANDLE + 1, 0x105000, 0x205000, 0x1000),
+        mapping(PROCESS_HANDLE + 1, 0x107000, 0x206000, 0x1000),    //Source not contiguous
+        mapping(PROCESS_HANDLE + 1, 0x108000, 0x208000, 0x1000),    //Destination not contiguous
+    };
+    u8 order[7];
+    u32 nbValid = 0;
+
+    CHECK(sortProcessMemoryMappings(order, &nbValid, mappings, 7) == 0);
+    CHECK(nbValid == 7);
+
+    CHECK(getNbCoalescableProcessMemoryMappings(order, mappings, 0, nbValid, false) == 3);
+    CHECK(getNbCoalescableProcessMemoryMappings(order, mappings, 1, nbValid, false) == 2);
+    CHECK(getNbCoalescableProcessMemoryMappings(order, mappings, 3, nbValid, false) == 2);
+    CHECK(getNbCoalescableProcessMemoryMappings(order, mappings, 5, nbValid, false) == 1);
+    CHECK(getNbCoalescableProcessMemoryMappings(order, mappings, 6, nbValid, false) == 1);
+
+    //Only the destination matters when unmapping
+    CHECK(getNbCoalescableProcessMemoryMappings(order, mappings, 0, nbValid, true) == 6);
+    CHECK(getNbCoalescableProcessMemoryMappings(order, mappings, 0, 4, true) == 4);
+}
+
+static void testMapBatch(void)
+{
+    //Given out of order: three runs, the last one from another process
+    ProcessMemoryMapping mappings[] = {
+        mapping(PROCESS_HANDLE + 1, 0x101000, 0x201000, 0x2000),
+        mapping(PROCESS_HANDLE + 1, 0x200000, 0x300000, 0x1000),
+        mapping(PROCESS_HANDLE + 1, 0x100000, 0x200000, 0x1000),
+        mapping(PROCESS_HANDLE + 1, 0x100000, 0x280000, 0x1001),
+        mapping(PROCESS_HANDLE + 2, 0x201000, 0x301000, 0x3000),
+    };
+
+    reset(50);
+    CHECK(MapProcessMemoryBatch(CUR_PROCESS_HANDLE, mappings, 5, false) == (Result)0xE0E01BF2);
+    CHECK(nbCalls == 3);
+    CHECK(sameCall(&calls[0], 0, 0x200000, 1, 0x100000, 0x3000));
+    CHECK(sameCall(&calls[1], 0, 0x300000, 1, 0x200000, 0x1000));
+    CHECK(sameCall(&calls[2], 0, 0x301000, 2, 0x201000, 0x3000));
+    CHECK(mappings[0].result == 0 && mappings[1].result == 0 && mappings[2].result == 0 && mappings[4].result == 0);
+    CHECK(mappings[3].result == (Result)0xE0E01BF2);
+    CHECK(nbCacheFlushes == 1);
+    for(u32 i = 0; i < NB_PROCESSES; i++)
+        CHECK(refCounts[i] == 0);
+
+    //A failure is reported for every descriptor of its run only, the source being closed too
+    reset(50);
+    failingVa = 0x202000;
+    mappings[3].size = 0x1000;
+    mappings[4].srcProcess = 0x1234;
+    CHECK(MapProcessMemoryBatch(PROCESS_HANDLE + 3, mappings, 5, false) == (Result)0xD900060C);
+    CHECK(nbCalls == 3);
+    CHECK(sameCall(&calls[0], 3, 0x200000, 1, 0x100000, 0x3000));
+    CHECK(sameCall(&calls[1], 3, 0x280000, 1, 0x100000, 0x1000));
+    CHECK(sameCall(&calls[2], 3, 0x300000, 1, 0x200000, 0x1000));
+    CHECK(mappings[0].result == (Result)0xD900060C && mappings[2].result == (Result)0xD900060C);
+    CHECK(mappings[1].result == 0 && mappings[3].result == 0);
+    CHECK(mappings[4].result == (Result)0xD8E007F7);
+    for(u32 i = 0; i < NB_PROCESSES; i++)
+        CHECK(refCounts[i] == 0);
+
+    //Overlapping or going to an invalid process, nothing is done
+    reset(50);
+    mappings[4].srcProcess = PROCESS_HANDLE + 2;
+    mappings[3].dstVa = 0x2FF000;
+    mappings[3].size = 0x2000;
+    CHECK(MapProcessMemoryBatch(CUR_PROCESS_HANDLE, mappings, 5, false) == (Result)0xE0E01BFD);
+    CHECK(nbCalls == 0 && nbCacheFlushes == 0);
+    for(u32 i = 0; i < 5; i++)
+        CHECK(mappings[i].result == (Result)0xE0E01BFD);
+
+    reset(50);
+    mappings[3].dstVa = 0x280000;
+    mappings[3].size = 0x1000;
+    CHECK(MapProcessMemoryBatch(0x1234, mappings, 5, false) == (Result)0xD8E007F7);
+    CHECK(nbCalls == 0);
+    for(u32 i = 0; i < 5; i++)
+        CHECK(mappings[i].result == (Result)0xD8E007F7);
+}
+
+static void testUnmapBatch(void)
+{
+    ProcessMemoryMapping mappings[] = {
+        mapping(0, 0, 0x201000, 0x2000),
+        mapping(0, 0, 0x200000, 0x1000),
+        mapping(0, 0, 0x203000, 0x1000),
+        mapping(0, 0, 0x300000, 0x1000),
+    };
+
+    //6.x and later kernels unmap contiguous ranges at once
+    reset(50);
+    CHECK(MapProcessMemoryBatch(PROCESS_HANDLE + 2, mappings, 4, true) == 0);
+    CHECK(nbCalls == 2);
+    CHECK(sameCall(&calls[0], 2, 0x200000, -1, 0, 0x4000));
+    CHECK(sameCall(&calls[1], 2, 0x300000, -1, 0, 0x1000));
+    for(u32 i = 0; i < 4; i++)
+        CHECK(mappings[i].result == 0);
+    CHECK(refCounts[2] == 0);
+
+    //Older ones, one descriptor at a time
+    reset(30);
+    failingVa = 0x203000;
+    CHECK(MapProcessMemoryBatch(PROCESS_HANDLE + 2, mappings, 4, true) == (Result)0xD900060C);
+    CHECK(nbCalls == 4);
+    CHECK(sameCall(&calls[0], 2, 0x200000, -1, 0, 0x1000));
+    CHECK(sameCall(&calls[1], 2, 0x201000, -1, 0, 0x2000));
+    CHECK(sameCall(&calls[2], 2, 0x203000, -1, 0, 0x1000));
+    CHECK(sameCall(&calls[3], 2, 0x300000, -1, 0, 0x1000));
+    CHECK(mappings[0].result == 0 && mappings[1].result == 0 && mappings[3].result == 0);
+    CHECK(mappings[2].result == (Result)0xD900060C);
+}
+
+//Every descriptor gets a result, even when they can't be read
+static void testBadCalls(void)
+{
+    ProcessMemoryMapping mappings[MAX_PROCESS_MEMORY_MAPPINGS + 1];
+
+    for(u32 i = 0; i <= MAX_PROCESS_MEMORY_MAPPINGS; i++)
+        mappings[i] = mapping(PROCESS_HANDLE, 0x100000 + 0x1000 * i, 0x200000 + 0x1000 * i, 0x1000);
+
+    reset(50);
+    CHECK(MapProcessMemoryBatch(CUR_PROCESS_HANDLE, mappings, MAX_PROCESS_MEMORY_MAPPINGS + 1, false) == (Result)0xE0E01BFD);
+    CHECK(nbCalls == 0);
+    for(u32 i = 0; i < MAX_PROCESS_MEMORY_MAPPINGS; i++)
+        CHECK(mappings[i].result == (Result)0xE0E01BFD);
+    CHECK(mappings[MAX_PROCESS_MEMORY_MAPPINGS].result == 0x12345678);
+
+    reset(50);
+    copyFails = true;
+    mappings[0].result = 0x12345678;
+    CHECK(MapProcessMemoryBatch(CUR_PROCESS_HANDLE, mappings, 4, false) == (Result)0xE0E01BF5);
+    CHECK(nbCalls == 0 && mappings[0].result == 0x12345678);
+
+    //A full batch of contiguous mappings is a single call
+    reset(50);
+    CHECK(MapProcessMemoryBatch(CUR_PROCESS_HANDLE, mappings, MAX_PROCESS_MEMORY_MAPPINGS, false) == 0);
+    CHECK(nbCalls == 1 && sameCall(&calls[0], 0, 0x200000, 0, 0x100000, MAX_PROCESS_MEMORY_MAPPINGS * 0x1000));
+}
+
+int main(void)
+{
+    testValidation();
+    testSort();
+    testCoalescing();
+    testMapBatch();
+    testUnmapBatch();
+    testBadCalls();
+
+    return testResult("mapbatch");
+}
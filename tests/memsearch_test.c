@@ -0,0 +1,175 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Differential test and benchmark of common/memsearch.c against the memsearch() it replaced
+*/
+
+#include "test.h"
+#include "memsearch.h"
+
+//The Boyer-Moore-Horspool memsearch() that arm9, loader and rosalina used to carry, only valid for patternSize <= size
+static uint8_t *referenceMemsearch(uint8_t *startPos, const void *pattern, uint32_t size, uint32_t patternSize)
+{
+    const uint8_t *patternc = (const uint8_t *)pattern;
+    uint32_t table[256];
+
+    for(uint32_t i = 0; i < 256; i++)
+        table[i] = patternSize;
+    for(uint32_t i = 0; i < patternSize - 1; i++)
+        table[patternc[i]] = patternSize - i - 1;
+
+    uint32_t j = 0;
+    while(j <= size - patternSize)
+    {
+        uint8_t c = startPos[j + patternSize - 1];
+        if(patternc[patternSize - 1] == c && memcmp(pattern, startPos + j, patternSize - 1) == 0)
+            return startPos + j;
+        j += table[c];
+    }
+
+    return NULL;
+}
+
+static uint32_t *naiveMemsearchAligned(uint32_t *startPos, const uint32_t *pattern, uint32_t size, uint32_t patternSize)
+{
+    for(uint32_t i = 0; i + patternSize <= size; i += 4)
+        if(memcmp(startPos + i / 4, pattern, patternSize) == 0) return startPos + i / 4;
+
+    return NULL;
+}
+
+static void testDifferential(void)
+{
+    static uint32_t bufWords[0x1000 / 4];
+    uint8_t *buf = (uint8_t *)bufWords;
+    uint32_t patternWords[64 / 4];
+    uint8_t *pattern = (uint8_t *)patternWords;
+
+    for(uint32_t iteration = 0; iteration < 200000; iteration++)
+    {
+        //Small alphabets so that partial and full matches are frequent, mostly 0x00/0xFF for the short pattern anchor
+        uint32_t alphabetSize = 2 + testRand() % 6,
+                 size = testRand() % (iteration < 1000 ? 16 : sizeof(bufWords)),
+                 patternSize = 1 + testRand() % (iteration % 4 == 0 ? 64 : 8);
+
+        testFillRandom(buf, size, alphabetSize);
+        if(testRand() % 4 == 0)
+            for(uint32_t i = 0; i < size; i++) buf[i] = buf[i] == 1 ? 0xFF : buf[i];
+
+        //Half of the time, take the pattern from the buffer itself
+        if(size >= patternSize && testRand() % 2 == 0)
+            memcpy(pattern, buf + testRand() % (size - patternSize + 1), patternSize);
+        else
+            testFillRandom(pattern, patternSize, alphabetSize);
+
+        uint8_t *expected = patternSize <= size ? referenceMemsearch(buf, pattern, size, patternSize) : NULL;
+
+        CHECK(memsearch(buf, pattern, size, patternSize) == expected);
+
+        MemsearchPattern compiled;
+        memsearchCompile(&compiled, pattern, patternSize);
+        CHECK(memsearchCompiled(buf, size, &compiled) == expected);
+
+        if(patternSize % 4 == 0)
+        {
+            uint32_t alignedSize = size & ~3;
+            CHECK(memsearchAligned(bufWords, patternWords, alignedSize, patternSize) ==
+                  naiveMemsearchAligned(bufWords, patternWords, alignedSize, patternSize));
+        }
+    }
+
+    //Edge cases
+    CHECK(memsearch(buf, pattern, 0, 1) == NULL);
+    CHECK(memsearch(buf, pattern, 16, 0) == NULL);
+    CHECK(memsearchAligned(bufWords, patternWords, 16, 2) == NULL);
+}
+
+typedef uint8_t *(*SearchFunc)(uint8_t *startPos, const void *pattern, uint32_t size, uint32_t patternSize);
+
+static uint8_t *compiledSearch(uint8_t *startPos, const void *pattern, uint32_t size, uint32_t patternSize)
+{
+    MemsearchPattern compiled;
+    memsearchCompile(&compiled, pattern, patternSize);
+    return memsearchCompiled(startPos, size, &compiled);
+}
+
+static uint8_t *alignedSearch(uint8_t *startPos, const void *pattern, uint32_t size, uint32_t patternSize)
+{
+    return (uint8_t *)memsearchAligned((uint32_t *)startPos, (const uint32_t *)pattern, size, patternSize);
+}
+
+static void benchmark(void)
+{
+    //Looks a bit like ARM code: random words with a common condition code nibble
+    const uint32_t size = 4 << 20, rounds = 20;
+    uint32_t *code = (uint32_t *)malloc(size);
+    for(uint32_t i = 0; i < size / 4; i++)
+        code[i] = 0xE0000000 | (testRand() & 0x0FFFFFFF);
+
+    static const struct
+    {
+        const char *name;
+        SearchFunc func;
+    } searches[] = {
+        {"reference", referenceMemsearch},
+        {"memsearch", memsearch},
+        {"compiled ", compiledSearch},
+        {"aligned  ", alignedSearch},
+    };
+
+    for(uint32_t patternSize = 4; patternSize <= 16; patternSize += 4)
+    {
+        //Planted close to the end
+        uint32_t pattern[4];
+        for(uint32_t i = 0; i < 4; i++)
+            pattern[i] = 0xE0000000 | (testRand() & 0x0FFFFFFF);
+        memcpy((uint8_t *)code + size - 64, pattern, patternSize);
+
+        for(uint32_t i = 0; i < sizeof(searches) / sizeof(searches[0]); i++)
+        {
+            double start = testNow();
+            for(uint32_t round = 0; round < rounds; round++)
+                CHECK(searches[i].func((uint8_t *)code, pattern, size, patternSize) == (uint8_t *)code + size - 64);
+            double elapsed = testNow() - start;
+
+            printf("memsearch: %2lu-byte pattern, %s %7.1f MiB/s\n", (unsigned long)patternSize, searches[i].name,
+                   rounds * (size / 1048576.0) / elapsed);
+        }
+    }
+
+    free(code);
+}
+
+int main(int argc, char **argv)
+{
+    if(testIsBench(argc, argv))
+        benchmark();
+    else
+        testDifferential();
+
+    return testResult("memsearch");
+}
@@ -0,0 +1,412 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Runs k11_extension/source/profiler.c and rosalina's gdb/profiler.c together: rosalina's profiler thread asks the
+*   kernel for samples on scripted cores, and the histogram it exports is checked, as well as the kernel rings
+*/
+
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "test.h"
+#include "kernel.h"
+
+//profiler.c reads the context of the core it runs on at the same address on every core
+static KCoreContext testCoreContexts[4];
+#define currentCoreContext (&testCoreContexts[testCoreId])
+
+//Included rather than linked, to get at the rings and profilerPushSample
+#include "profiler.c"
+
+//From sysmodules/rosalina/include/gdb/profiler.h, which can't be included next to k11_extension's profiler.h
+#define PROFILER_HISTOGRAM_SIZE 2048
+#define PROFILER_MAX_RATE       10000
+int GDB_StartProfiler(u32 pid, u32 rate, bool callers);
+void GDB_StopProfiler(u32 pid);
+int GDB_DumpProfiler(char *out, u32 outSize);
+
+__thread u32 testCoreId;
+u32 testUserModeLr[4];
+
+static void hostLock(KRecursiveLock *lock)
+{
+    (void)lock;
+}
+
+static bool hostKernelToUsrMemcpy8(void *dst, const void *src, u32 len)
+{
+    memcpy(dst, src, len);
+    return true;
+}
+
+bool isN3DS = true;
+u32 kernelVersion;
+
+static KRecursiveLock hostCriticalSectionLock;
+static KObjectList hostThreadList;
+
+KRecursiveLock *criticalSectionLock = &hostCriticalSectionLock;
+KObjectList *threadList = &hostThreadList;
+void (*KRecursiveLock__Lock)(KRecursiveLock *this) = hostLock;
+void (*KRecursiveLock__Unlock)(KRecursiveLock *this) = hostLock;
+bool (*kernelToUsrMemcpy8)(void *dst, const void *src, u32 len) = hostKernelToUsrMemcpy8;
+
+KRecursiveLock dbgParamsLock;
+
+//Runs the handler on each targeted core in turn, as the SGI would
+void executeFunctionOnCoresAndWait(SGI0Handler_t func, u8 targetList)
+{
+    u32 coreId = testCoreId;
+
+    for(u32 core = 0; core < getNumberOfCores(); core++)
+    {
+        testCoreId = core;
+        if((targetList & (1 << core)) != 0)
+            func(NULL, 0);
+    }
+
+    testCoreId = coreId;
+}
+
+//Rosalina's profiler thread runs on core 1, where it preempts the thread it samples in its place
+#define ROSALINA_CORE   1
+#define TARGET_PID      0x30
+#define OTHER_PID       0x31
+#define ROSALINA_PID    0x32
+
+enum
+{
+    THREAD_CORE0,               //always running on core 0, in user mode
+    THREAD_CORE2,               //running on core 2 on even ticks, in a SVC
+    THREAD_CORE2_OTHER,         //on core 2 on odd ticks, another process
+    THREAD_CORE3_KERNEL,        //always on core 3, stopped by an interrupt in kernel mode
+    THREAD_ROSALINA,            //the profiler thread
+    THREAD_PREEMPTED,           //ready on core 1 every fourth tick, highest priority then
+    THREAD_PREEMPTED_OTHER,     //always ready on core 1, another process
+    THREAD_PREEMPTED_LOW,       //always ready on core 1, lowest priority
+    THREAD_PAUSED,              //highest priority on core 1, but never ready
+    NB_THREADS
+};
+
+static KProcess processes[3];
+static KThread threads[NB_THREADS];
+static KLinkedListNode threadNodes[NB_THREADS];
+static u8 threadContexts[NB_THREADS][0x1000];
+
+//What svcHandler.s and the interrupt entry leave at the top of the kernel stack of a thread
+static void setThreadContext(u32 i, u32 pc, u32 lr, bool inSvc, u32 mode)
+{
+    u8 *pageEnd = (u8 *)threads[i].endOfThreadContext;
+
+    *(u32 *)(pageEnd - 0xCC) = mode;
+    *(u32 *)(pageEnd - 0xD0) = pc;
+    *(u32 *)(pageEnd - 0xD4) = lr;
+    pageEnd[-0xB8 + 3] = inSvc;
+}
+
+static void createThread(u32 i, u32 pid, u32 core, s32 priority)
+{
+    KLinkedListNode *head = (KLinkedListNode *)&hostThreadList.list.nodes;
+
+    threads[i].threadId = 0x100 + i;
+    threads[i].ownerProcess = &processes[pid - TARGET_PID];
+    threads[i].coreId = core;
+    threads[i].dynamicPriority = priority;
+    threads[i].schedulingMask = 0;
+    threads[i].endOfThreadContext = threadContexts[i] + sizeof(threadContexts[i]);
+
+    threadNodes[i].key = &threads[i];
+    threadNodes[i].prev = head->prev;
+    threadNodes[i].next = head;
+    head->prev->next = &threadNodes[i];
+    head->prev = &threadNodes[i];
+}
+
+static void setCurrentThread(u32 core, u32 i)
+{
+    testCoreContexts[core].objectContext.currentThread = &threads[i];
+}
+
+static void setup(void)
+{
+    KLinkedListNode *head = (KLinkedListNode *)&hostThreadList.list.nodes;
+
+    head->next = head->prev = head;
+    memset(threads, 0, sizeof(threads));
+    memset(threadContexts, 0, sizeof(threadContexts));
+    for(u32 i = 0; i < 3; i++)
+        processes[i].N3DS.processId = TARGET_PID + i;
+
+    createThread(THREAD_CORE0, TARGET_PID, 0, 0x30);
+    createThread(THREAD_CORE2, TARGET_PID, 2, 0x30);
+    createThread(THREAD_CORE2_OTHER, OTHER_PID, 2, 0x30);
+    createThread(THREAD_CORE3_KERNEL, TARGET_PID, 3, 0x30);
+    createThread(THREAD_ROSALINA, ROSALINA_PID, ROSALINA_CORE, 0x18);
+    createThread(THREAD_PREEMPTED, TARGET_PID, ROSALINA_CORE, 0x30);
+    createThread(THREAD_PREEMPTED_OTHER, OTHER_PID, ROSALINA_CORE, 0x35);
+    createThread(THREAD_PREEMPTED_LOW, TARGET_PID, ROSALINA_CORE, 0x3F);
+    createThread(THREAD_PAUSED, TARGET_PID, ROSALINA_CORE, 0x20);
+
+    //The banked lr is only read for threads that were running in user mode when interrupted
+    setThreadContext(THREAD_CORE0, 0x00100100, 0xDEADBEEF, false, 0x10);
+    testUserModeLr[0] = 0x00100500;
+    setThreadContext(THREAD_CORE2, 0x00100200, 0x00100600, true, 0x10);
+    testUserModeLr[2] = 0xDEADBEEF;
+    setThreadContext(THREAD_CORE2_OTHER, 0x00100800, 0x00100800, false, 0x10);
+    setThreadContext(THREAD_CORE3_KERNEL, 0x00100900, 0x00100900, false, 0x13);
+    testUserModeLr[3] = 0x00100900;
+    setThreadContext(THREAD_PREEMPTED, 0x00100300, 0xDEADBEEF, false, 0x10);
+    testUserModeLr[ROSALINA_CORE] = 0xDEADBEEF;
+    setThreadContext(THREAD_PREEMPTED_OTHER, 0x00100A00, 0x00100A00, false, 0x10);
+    setThreadContext(THREAD_PREEMPTED_LOW, 0x00100B00, 0x00100B00, false, 0x10);
+    setThreadContext(THREAD_PAUSED, 0x00100C00, 0x00100C00, false, 0x10);
+
+    threads[THREAD_PREEMPTED_OTHER].schedulingMask = 1;
+    threads[THREAD_PREEMPTED_LOW].schedulingMask = 1;
+    threads[THREAD_PAUSED].schedulingMask = 2;
+
+    setCurrentThread(0, THREAD_CORE0);
+    setCurrentThread(ROSALINA_CORE, THREAD_ROSALINA);
+    setCurrentThread(2, THREAD_CORE2);
+    setCurrentThread(3, THREAD_CORE3_KERNEL);
+}
+
+//Tick i of a scripted run, set up by the profiler thread right before it asks for samples
+static void (*testScenario)(u32 tick);
+static u32 testNbTicks;
+static u32 testTick;
+static bool testDone;
+static pthread_mutex_t testMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t testCond = PTHREAD_COND_INITIALIZER;
+
+//Nothing of the target process runs once the script is over, so that the ticks until the thread stops add nothing
+static void idleCores(void)
+{
+    setCurrentThread(0, THREAD_CORE2_OTHER);
+    setCurrentThread(2, THREAD_CORE2_OTHER);
+    setCurrentThread(3, THREAD_CORE2_OTHER);
+    threads[THREAD_PREEMPTED].schedulingMask = 0;
+}
+
+void svcSleepThread(s64 ns)
+{
+    (void)ns;
+
+    pthread_mutex_lock(&testMutex);
+    if(testTick < testNbTicks)
+        testScenario(testTick);
+    else if(testTick == testNbTicks)
+    {
+        idleCores();
+        testDone = true;
+        pthread_cond_broadcast(&testCond);
+    }
+    testTick++;
+    pthread_mutex_unlock(&testMutex);
+
+    if(testDone)
+        usleep(100);
+}
+
+Result svcKernelSetState(u32 type, ...)
+{
+    Result res = 0;
+    va_list args;
+    u32 coreId = testCoreId;
+
+    testCoreId = ROSALINA_CORE;
+    va_start(args, type);
+
+    switch(type)
+    {
+        case 0x1000C:
+        {
+            u32 pid = va_arg(args, u32);
+            res = profilerSetTarget(pid, (bool)va_arg(args, int));
+            break;
+        }
+        case 0x1000D:
+            profilerRequestSamples();
+            break;
+        case 0x1000E:
+        {
+            ProfilerSample *out = va_arg(args, ProfilerSample *);
+            u32 maxSamples = va_arg(args, u32);
+            res = profilerRead(out, maxSamples, va_arg(args, u32 *));
+            break;
+        }
+        default:
+            res = 0xF8C007F4;
+            break;
+    }
+
+    va_end(args);
+    testCoreId = coreId;
+    return res;
+}
+
+//Runs the script through rosalina's profiler thread, then returns what "monitor profile" would print
+static int profile(void (*scenario)(u32 tick), u32 nbTicks, bool callers, char *out, u32 outSize)
+{
+    setup();
+    testScenario = scenario;
+    testNbTicks = nbTicks;
+    testTick = 0;
+    testDone = false;
+
+    CHECK(GDB_StartProfiler(TARGET_PID, PROFILER_MAX_RATE, callers) == 0);
+
+    pthread_mutex_lock(&testMutex);
+    while(!testDone)
+        pthread_cond_wait(&testCond, &testMutex);
+    pthread_mutex_unlock(&testMutex);
+
+    GDB_StopProfiler(TARGET_PID);
+    CHECK(!profilerEnabled);
+
+    return GDB_DumpProfiler(out, outSize);
+}
+
+static void scenarioCores(u32 tick)
+{
+    setCurrentThread(2, tick % 2 == 0 ? THREAD_CORE2 : THREAD_CORE2_OTHER);
+    threads[THREAD_PREEMPTED].schedulingMask = tick % 4 == 0 ? 1 : 0;
+}
+
+static void testHistogram(void)
+{
+    char out[0x400];
+
+    //pc: the running threads, the SVC call site of the one in a SVC, and where the preempted one stopped
+    int n = profile(scenarioCores, 1000, false, out, sizeof(out));
+    CHECK(n == (int)strlen(out));
+    CHECK(strcmp(out, "1750 samples, 0 dropped\n"
+                      "0x00100100 1000\n"
+                      "0x00100200 500\n"
+                      "0x00100300 250\n") == 0);
+
+    //lr: the banked one, the one saved by the SVC, and none for the preempted thread
+    n = profile(scenarioCores, 1000, true, out, sizeof(out));
+    CHECK(n == (int)strlen(out));
+    CHECK(strcmp(out, "1500 samples, 250 dropped\n"
+                      "0x00100500 1000\n"
+                      "0x00100600 500\n") == 0);
+
+    //Only whole lines are exported
+    n = GDB_DumpProfiler(out, 0x30);
+    CHECK(n == (int)strlen(out) && n < 0x30);
+    CHECK(strcmp(out, "1500 samples, 250 dropped\n"
+                      "0x00100500 1000\n") == 0);
+}
+
+//A new address on core 0 each tick, 7 times out of 8
+static void scenarioManyAddresses(u32 tick)
+{
+    u32 pc = tick % 8 == 0 ? 0x00100100 : 0x00200000 + 2 * tick;
+
+    setThreadContext(THREAD_CORE0, pc, 0, false, 0x10);
+    setCurrentThread(2, THREAD_CORE2_OTHER);
+}
+
+static void testFullHistogram(void)
+{
+    static char out[0x10000];
+    const u32 nbTicks = 2 * PROFILER_HISTOGRAM_SIZE;
+
+    //Once the histogram is full, samples of the addresses it already has are still counted
+    profile(scenarioManyAddresses, nbTicks, false, out, sizeof(out));
+
+    u32 nbSamples, nbDropped, address, count, nbLines = 0, total = 0, prevCount = 0xFFFFFFFF;
+    char *line = strchr(out, '\n') + 1;
+
+    CHECK(sscanf(out, "%u samples, %u dropped", &nbSamples, &nbDropped) == 2);
+    CHECK(nbSamples + nbDropped == nbTicks);
+    CHECK(strncmp(line, "0x00100100 512\n", 15) == 0);
+
+    for(; sscanf(line, "0x%x %u\n", &address, &count) == 2; line = strchr(line, '\n') + 1)
+    {
+        CHECK(count <= prevCount);
+        prevCount = count;
+        nbLines++;
+        total += count;
+    }
+
+    CHECK(*line == 0);
+    CHECK(nbLines == PROFILER_HISTOGRAM_SIZE && total == nbSamples);
+    CHECK(nbDropped == nbTicks - 512 - (PROFILER_HISTOGRAM_SIZE - 1));
+}
+
+//The kernel rings on their own: per-core FIFO order, batched reads, and what doesn't fit is counted as dropped
+static void testRings(void)
+{
+    ProfilerSample samples[PROFILER_SAMPLES_PER_CORE];
+    u32 counts[2];
+
+    setup();
+    testCoreId = ROSALINA_CORE;
+    CHECK(profilerSetTarget(TARGET_PID, true) == 0);
+
+    for(u32 i = 0; i < PROFILER_SAMPLES_PER_CORE + 10; i++)
+    {
+        setThreadContext(THREAD_CORE0, 0x00100000 + 4 * i, 0, false, 0x10);
+        profilerRequestSamples();
+    }
+
+    //Core 0, then core 2 (core 1 has nothing ready of the target, core 3 is in kernel mode)
+    CHECK(profilerRead(samples, 100, counts) == 0);
+    CHECK(counts[0] == 100 && counts[1] == 20);
+    for(u32 i = 0; i < 100; i++)
+        CHECK(samples[i].pc == 0x00100000 + 4 * i && samples[i].lr == 0x00100500);
+
+    CHECK(profilerRead(samples, PROFILER_SAMPLES_PER_CORE, counts) == 0);
+    CHECK(counts[0] == PROFILER_SAMPLES_PER_CORE && counts[1] == 0);
+    CHECK(samples[155].pc == 0x00100000 + 4 * 255);
+    CHECK(samples[156].pc == 0x00100200 && samples[156].lr == 0x00100600);
+
+    CHECK(profilerRead(samples, PROFILER_SAMPLES_PER_CORE, counts) == 0);
+    CHECK(counts[0] == 2 * PROFILER_SAMPLES_PER_CORE - 100 - PROFILER_SAMPLES_PER_CORE && counts[1] == 0);
+
+    //Changing the target empties the rings
+    profilerRequestSamples();
+    CHECK(profilerSetTarget(OTHER_PID, true) == 0);
+    CHECK(profilerRead(samples, PROFILER_SAMPLES_PER_CORE, counts) == 0);
+    CHECK(counts[0] == 0 && counts[1] == 0);
+
+    CHECK(profilerSetTarget(0, false) == 0);
+    profilerRequestSamples();
+    CHECK(profilerRead(samples, PROFILER_SAMPLES_PER_CORE, counts) == 0);
+    CHECK(counts[0] == 0);
+}
+
+int main(void)
+{
+    testRings();
+    testHistogram();
+    testFullHistogram();
+
+    return testResult("profiler");
+}
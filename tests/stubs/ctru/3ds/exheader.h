@@ -0,0 +1,62 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host stand-in for libctru's <3ds/exheader.h>: only the code set info is used, the rest is only passed around
+*/
+
+#pragma once
+
+#include "types.h"
+
+typedef struct ExHeader_Info ExHeader_Info;
+
+typedef struct
+{
+    u8 reserved[5];
+    bool compress_exefs_code : 1;
+    bool is_sd_application : 1;
+    u16 remaster_version;
+} ExHeader_SystemInfoFlags;
+
+typedef struct
+{
+    u32 address;
+    u32 num_pages;
+    u32 size;
+} ExHeader_CodeSectionInfo;
+
+typedef struct
+{
+    char name[8];
+    ExHeader_SystemInfoFlags flags;
+    ExHeader_CodeSectionInfo text;
+    u32 stack_size;
+    ExHeader_CodeSectionInfo rodata;
+    u32 reserved;
+    ExHeader_CodeSectionInfo data;
+    u32 bss_size;
+} ExHeader_CodeSetInfo;
@@ -0,0 +1,88 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host stand-in for the part of libctru's <3ds/services/fs.h> used by the loader, implemented by the tests that need it
+*/
+
+#pragma once
+
+#include "../types.h"
+
+typedef u32 FS_ArchiveID;
+typedef u64 FS_Archive;
+
+enum
+{
+    ARCHIVE_SDMC = 9,
+};
+
+enum
+{
+    FS_OPEN_READ = 1,
+    FS_OPEN_WRITE = 2,
+    FS_OPEN_CREATE = 4,
+};
+
+enum
+{
+    FS_WRITE_FLUSH = 1,
+};
+
+typedef enum
+{
+    ARCHIVE_ACTION_COMMIT_SAVE_DATA = 0,
+    ARCHIVE_ACTION_GET_TIMESTAMP = 1,
+} FS_ArchiveAction;
+
+typedef enum
+{
+    PATH_INVALID = 0,
+    PATH_EMPTY = 1,
+    PATH_BINARY = 2,
+    PATH_ASCII = 3,
+    PATH_UTF16 = 4,
+} FS_PathType;
+
+typedef struct
+{
+    FS_PathType type;
+    u32 size;
+    const void *data;
+} FS_Path;
+
+FS_Path fsMakePath(FS_PathType type, const void *path);
+
+Result FSUSER_OpenArchive(FS_Archive *archive, FS_ArchiveID id, FS_Path path);
+Result FSUSER_CloseArchive(FS_Archive archive);
+Result FSUSER_ControlArchive(FS_Archive archive, FS_ArchiveAction action, void *input, u32 inputSize, void *output, u32 outputSize);
+Result FSUSER_OpenFile(Handle *out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes);
+Result FSUSER_OpenDirectory(Handle *out, FS_Archive archive, FS_Path path);
+Result FSDIR_Close(Handle handle);
+Result FSUSER_OpenFileDirectly(Handle *out, FS_ArchiveID archiveId, FS_Path archivePath, FS_Path filePath, u32 openFlags, u32 attributes);
+Result FSFILE_Read(Handle handle, u32 *bytesRead, u64 offset, void *buffer, u32 size);
+Result FSFILE_GetSize(Handle handle, u64 *size);
+Result FSFILE_Close(Handle handle);
@@ -0,0 +1,57 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host stand-in for the part of libctru's <3ds/svc.h> used by the loader, implemented by the tests that need it
+*/
+
+#pragma once
+
+#include "types.h"
+
+typedef enum
+{
+    MEMOP_FREE = 1,
+    MEMOP_ALLOC = 3,
+    MEMOP_REGION_APP = 0x100,
+} MemOp;
+
+typedef enum
+{
+    MEMPERM_READ = 1,
+    MEMPERM_WRITE = 2,
+} MemPerm;
+
+typedef enum
+{
+    USERBREAK_PANIC = 0,
+} UserBreakType;
+
+Result svcControlMemory(u32 *addr_out, u32 addr0, u32 addr1, u32 size, MemOp op, MemPerm perm);
+Result svcGetSystemInfo(s64 *out, u32 type, s32 param);
+void svcBreak(UserBreakType breakReason);
+void svcSleepThread(s64 ns);
+Result svcKernelSetState(u32 type, ...);
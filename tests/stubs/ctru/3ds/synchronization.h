@@ -0,0 +1,97 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host stand-in for the light events of libctru's <3ds/synchronization.h>, on top of pthreads
+*/
+
+#pragma once
+
+#include <pthread.h>
+
+#include "types.h"
+
+typedef enum
+{
+    RESET_ONESHOT = 0,
+    RESET_STICKY = 1,
+} ResetType;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool signaled;
+    ResetType resetType;
+} LightEvent;
+
+static inline void LightEvent_Init(LightEvent *event, ResetType resetType)
+{
+    pthread_mutex_init(&event->mutex, NULL);
+    pthread_cond_init(&event->cond, NULL);
+    event->signaled = false;
+    event->resetType = resetType;
+}
+
+static inline void LightEvent_Signal(LightEvent *event)
+{
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = true;
+    pthread_cond_broadcast(&event->cond);
+    pthread_mutex_unlock(&event->mutex);
+}
+
+static inline void LightEvent_Wait(LightEvent *event)
+{
+    pthread_mutex_lock(&event->mutex);
+    while(!event->signaled)
+        pthread_cond_wait(&event->cond, &event->mutex);
+    if(event->resetType == RESET_ONESHOT)
+        event->signaled = false;
+    pthread_mutex_unlock(&event->mutex);
+}
+
+typedef pthread_mutex_t RecursiveLock;
+
+static inline void RecursiveLock_Init(RecursiveLock *lock)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static inline void RecursiveLock_Lock(RecursiveLock *lock)
+{
+    pthread_mutex_lock(lock);
+}
+
+static inline void RecursiveLock_Unlock(RecursiveLock *lock)
+{
+    pthread_mutex_unlock(lock);
+}
@@ -0,0 +1,54 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host stand-in for k11_extension/include/globals.h
+*/
+
+#pragma once
+
+#include "types.h"
+#include "kernel.h"
+
+extern KRecursiveLock *criticalSectionLock;
+extern KObjectList *threadList;
+
+extern void (*KRecursiveLock__Lock)(KRecursiveLock *this);
+extern void (*KRecursiveLock__Unlock)(KRecursiveLock *this);
+
+extern void (*KAutoObject__AddReference)(KAutoObject *this);
+extern KProcess * (*KProcessHandleTable__ToKProcess)(KProcessHandleTable *this, Handle processHandle);
+extern Result (*KProcessHwInfo__UnmapProcessMemory)(KProcessHwInfo *this, void *addr, u32 nbPages);
+
+extern u64 (*GetSystemTick)(void);
+
+extern Result (*UnmapProcessMemory)(Handle processHandle, void *dst, u32 size);
+
+extern Result (*ReadProcessMemory)(void *buffer, Handle debug, u32 addr, u32 size);
+extern Result (*WriteProcessMemory)(Handle debug, const void *buffer, u32 addr, u32 size);
+
+extern bool (*usrToKernelMemcpy8)(void *dst, const void *src, u32 len);
+extern bool (*kernelToUsrMemcpy8)(void *dst, const void *src, u32 len);
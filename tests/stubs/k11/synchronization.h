@@ -0,0 +1,71 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host stand-in for k11_extension/include/synchronization.h, exclusive accesses emulated with compare-and-swap
+*/
+
+#pragma once
+
+#include "types.h"
+#include "kernel.h"
+
+typedef KSchedulableInterruptEvent* (*SGI0Handler_t)(KBaseInterruptEvent *this, u32 interruptID);
+
+//Defined by the tests that need it
+void executeFunctionOnCoresAndWait(SGI0Handler_t func, u8 targetList);
+
+static __thread s32 testExclusiveValue;
+
+static inline void __dmb(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline s32 __ldrex(s32 *addr)
+{
+    return testExclusiveValue = __atomic_load_n(addr, __ATOMIC_SEQ_CST);
+}
+
+static inline bool __strex(s32 *addr, s32 val)
+{
+    s32 expected = testExclusiveValue;
+    return !__atomic_compare_exchange_n(addr, &expected, val, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline u32 __get_cpsr(void)
+{
+    return 0;
+}
+
+static inline void __set_cpsr_cx(u32 cpsr)
+{
+    (void)cpsr;
+}
+
+static inline void __disable_irq(void)
+{
+}
@@ -0,0 +1,57 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host stand-in for k11_extension/include/utils.h: the core is whatever the test thread says it is
+*/
+
+#pragma once
+
+#include "types.h"
+
+extern __thread u32 testCoreId;
+
+static inline u32 getNumberOfCores(void)
+{
+    return 4;
+}
+
+static inline u32 getCurrentCoreID(void)
+{
+    return testCoreId;
+}
+
+//The banked user lr of each core, set by the tests that need it
+extern u32 testUserModeLr[4];
+
+static inline u32 getUserModeLr(void)
+{
+    return testUserModeLr[testCoreId];
+}
+
+//Defined by the tests that need them
+void flushEntireDataCache(void);
+void invalidateEntireInstructionCache(void);
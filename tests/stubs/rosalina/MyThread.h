@@ -0,0 +1,63 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Host stand-in for sysmodules/rosalina/include/MyThread.h, on top of pthreads
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <3ds/types.h>
+
+typedef struct MyThread
+{
+    pthread_t thread;
+    void (*ep)(void);
+} MyThread;
+
+static void *MyThread_Run(void *arg)
+{
+    ((MyThread *)arg)->ep();
+    return NULL;
+}
+
+static inline Result MyThread_Create(MyThread *t, void (*entrypoint)(void), void *stack, u32 stackSize, int prio, int affinity)
+{
+    (void)stack;
+    (void)stackSize;
+    (void)prio;
+    (void)affinity;
+
+    t->ep = entrypoint;
+    return pthread_create(&t->thread, NULL, MyThread_Run, t) == 0 ? 0 : -1;
+}
+
+static inline Result MyThread_Join(MyThread *thread, s64 timeout_ns)
+{
+    (void)timeout_ns;
+    return pthread_join(thread->thread, NULL) == 0 ? 0 : -1;
+}
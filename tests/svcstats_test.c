@@ -0,0 +1,251 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Drives the SVC statistics of k11_extension/source/svcStats.c: bucketing, per-core counters, slot
+*   reuse, and one thread per simulated core making SVCs concurrently
+*/
+
+#include <pthread.h>
+
+#include "test.h"
+
+//Included rather than linked, to get at the slots
+#include "svcStats.c"
+
+__thread u32 testCoreId;
+static __thread u64 testTick;
+static u32 nbLocks;
+
+static u64 hostGetSystemTick(void)
+{
+    return testTick;
+}
+
+static void hostLock(KRecursiveLock *lock)
+{
+    (void)lock;
+    nbLocks++;
+}
+
+static void hostUnlock(KRecursiveLock *lock)
+{
+    (void)lock;
+}
+
+bool isN3DS = true;
+u32 kernelVersion;
+
+static KRecursiveLock hostCriticalSectionLock;
+static KObjectList hostThreadList;
+
+KRecursiveLock *criticalSectionLock = &hostCriticalSectionLock;
+KObjectList *threadList = &hostThreadList;
+void (*KRecursiveLock__Lock)(KRecursiveLock *this) = hostLock;
+void (*KRecursiveLock__Unlock)(KRecursiveLock *this) = hostUnlock;
+u64 (*GetSystemTick)(void) = hostGetSystemTick;
+
+//Four threads per process, the first of which is in the thread list until killProcess
+#define NB_PROCESSES 6
+
+static KProcess processes[NB_PROCESSES];
+static KThread threads[NB_PROCESSES][4];
+static KLinkedListNode threadNodes[NB_PROCESSES];
+
+static void setupProcesses(void)
+{
+    KLinkedListNode *head = (KLinkedListNode *)&hostThreadList.list.nodes;
+
+    head->next = head->prev = head;
+    for(u32 i = 0; i < NB_PROCESSES; i++)
+    {
+        processes[i].N3DS.processId = 0x20 + i;
+        for(u32 j = 0; j < 4; j++)
+        {
+            threads[i][j].threadId = 0x100 + 4 * i + j;
+            threads[i][j].ownerProcess = &processes[i];
+        }
+
+        threadNodes[i].key = &threads[i][0];
+        threadNodes[i].prev = head->prev;
+        threadNodes[i].next = head;
+        head->prev->next = &threadNodes[i];
+        head->prev = &threadNodes[i];
+    }
+}
+
+static void killProcess(u32 i)
+{
+    threadNodes[i].prev->next = threadNodes[i].next;
+    threadNodes[i].next->prev = threadNodes[i].prev;
+}
+
+static void callSvc(KThread *thread, u32 svcId, u64 entryTick, u32 returnCore, u64 returnTick)
+{
+    u32 entryCore = testCoreId;
+
+    testTick = entryTick;
+    signalSvcStatsEntry(thread->ownerProcess, thread, svcId);
+    testCoreId = returnCore;
+    testTick = returnTick;
+    signalSvcStatsReturn(thread->ownerProcess, thread, svcId);
+    testCoreId = entryCore;
+}
+
+static s64 getInfo(u32 process, u32 type)
+{
+    s64 out = -1;
+    CHECK(GetSvcStatsInfo(&out, &processes[process], type) == 0);
+    return out;
+}
+
+static void testBuckets(void)
+{
+    static const struct { u64 ticks; u32 bucket; } cases[] = {
+        { 0, 0 }, { 1023, 0 }, { 1024, 1 }, { 4095, 1 }, { 4096, 2 }, { 1 << 20, 6 },
+        { (1 << 22) - 1, 6 }, { 1 << 22, 7 }, { 1ULL << 40, 7 },
+    };
+
+    for(u32 i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        CHECK(svcStatsGetBucket(cases[i].ticks) == cases[i].bucket);
+}
+
+static void testPerCoreCounters(void)
+{
+    s64 out;
+
+    CHECK(SetSvcStatsEnabled(processes[0].N3DS.processId, true) == 0);
+    CHECK(getInfo(0, 0x10010) == 1);
+    CHECK(getInfo(1, 0x10010) == 0);
+    CHECK(GetSvcStatsInfo(&out, &processes[1], 0x10100 + 0x0A) == (Result)0xD8E007F7);
+    CHECK(GetSvcStatsInfo(&out, &processes[0], 0x10300) == (Result)0xD8E007ED);
+
+    //SVCs don't take any lock
+    nbLocks = 0;
+    testCoreId = 0;
+    callSvc(&threads[0][0], 0x0A, 0, 0, 2000);
+    testCoreId = 1;
+    callSvc(&threads[0][1], 0x0A, 100, 1, 200);
+    callSvc(&threads[0][1], 0x32, 300, 1, 300 + (1 << 23));
+    callSvc(&threads[1][0], 0x0A, 0, 1, 50);
+    testCoreId = 2;
+    callSvc(&threads[0][2], 0xFF, 0, 2, 50);
+    CHECK(nbLocks == 0);
+
+    CHECK(getInfo(0, 0x10100 + 0x0A) == 2);
+    CHECK(getInfo(0, 0x10180 + 0x0A) == 2100);
+    CHECK(getInfo(0, 0x10200 + 0x0A) == (1 | (1 << 16)));
+    CHECK(getInfo(0, 0x10280 + 0x0A) == 0);
+    CHECK(getInfo(0, 0x10100 + 0x32) == 1);
+    CHECK(getInfo(0, 0x10280 + 0x32) == (s64)1 << 48);
+
+    //A thread that returns on another core is counted but gives no latency sample
+    testCoreId = 0;
+    callSvc(&threads[0][3], 0x0A, 0, 3, 5000);
+    CHECK(getInfo(0, 0x10100 + 0x0A) == 3);
+    CHECK(getInfo(0, 0x10180 + 0x0A) == 2100);
+
+    //Buckets saturate once summed
+    svcStats[0].cores[0].buckets[0x0B][0] = 0xFFF0;
+    svcStats[0].cores[3].buckets[0x0B][0] = 0x20;
+    svcStats[0].cores[3].buckets[0x0B][3] = 7;
+    CHECK(getInfo(0, 0x10200 + 0x0B) == (s64)(0xFFFF | (7ULL << 48)));
+
+    CHECK(SetSvcStatsEnabled(processes[0].N3DS.processId, false) == 0);
+    CHECK(SetSvcStatsEnabled(processes[0].N3DS.processId, false) == (Result)0xE0E01BFD);
+    CHECK(getInfo(0, 0x10010) == 0);
+}
+
+static void testSlots(void)
+{
+    for(u32 i = 0; i < MAX_SVC_STATS; i++)
+        CHECK(SetSvcStatsEnabled(processes[i].N3DS.processId, true) == 0);
+    CHECK(SetSvcStatsEnabled(processes[0].N3DS.processId, true) == 0);
+    CHECK(SetSvcStatsEnabled(processes[MAX_SVC_STATS].N3DS.processId, true) == (Result)0xC86018FF);
+
+    //svcExitProcess frees the slot, and the next process starts from zero
+    testCoreId = 0;
+    callSvc(&threads[1][0], 0x0A, 0, 0, 10);
+    signalSvcStatsProcessExit(&processes[1]);
+    CHECK(getInfo(1, 0x10010) == 0);
+    CHECK(SetSvcStatsEnabled(processes[MAX_SVC_STATS].N3DS.processId, true) == 0);
+    CHECK(getInfo(MAX_SVC_STATS, 0x10100 + 0x0A) == 0);
+    CHECK(getInfo(MAX_SVC_STATS, 0x10180 + 0x0A) == 0);
+
+    //Processes terminated by another one are forgotten once the slots are needed
+    killProcess(2);
+    CHECK(getInfo(2, 0x10010) == 1);
+    CHECK(SetSvcStatsEnabled(processes[MAX_SVC_STATS + 1].N3DS.processId, true) == 0);
+    CHECK(getInfo(2, 0x10010) == 0);
+    CHECK(SetSvcStatsEnabled(processes[1].N3DS.processId, true) == (Result)0xC86018FF);
+
+    for(u32 i = 0; i < NB_PROCESSES; i++)
+        SetSvcStatsEnabled(processes[i].N3DS.processId, false);
+    CHECK(nbSvcStatsEnabled == 0);
+}
+
+#define CALLS_PER_CORE 200000
+
+static void *core(void *arg)
+{
+    testCoreId = (u32)(uintptr_t)arg;
+
+    for(u32 i = 0; i < CALLS_PER_CORE; i++)
+        callSvc(&threads[0][testCoreId], 0x0A, 2 * i, testCoreId, 2 * i + 1 + (i & 1) * 1024);
+
+    return NULL;
+}
+
+static void testConcurrentCores(void)
+{
+    pthread_t coreThreads[4];
+
+    CHECK(SetSvcStatsEnabled(processes[0].N3DS.processId, true) == 0);
+
+    for(u32 i = 0; i < 4; i++)
+        pthread_create(&coreThreads[i], NULL, core, (void *)(uintptr_t)i);
+    for(u32 i = 0; i < 4; i++)
+        pthread_join(coreThreads[i], NULL);
+
+    //No update lost
+    CHECK(getInfo(0, 0x10100 + 0x0A) == 4 * CALLS_PER_CORE);
+    CHECK(getInfo(0, 0x10180 + 0x0A) == 4 * (CALLS_PER_CORE + (CALLS_PER_CORE / 2) * 1024));
+    CHECK(getInfo(0, 0x10200 + 0x0A) == (0xFFFF | (0xFFFFLL << 16)));
+
+    CHECK(SetSvcStatsEnabled(processes[0].N3DS.processId, false) == 0);
+}
+
+int main(void)
+{
+    setupProcesses();
+
+    testBuckets();
+    testPerCoreCounters();
+    testSlots();
+    testConcurrentCores();
+
+    return testResult("svcstats");
+}
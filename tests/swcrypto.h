@@ -0,0 +1,215 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Software AES-128 and SHA-256, standing in for the Arm9 crypto engines in the host tests
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+static const uint8_t swAesSbox[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+typedef struct SwAesContext
+{
+    uint8_t roundKeys[11][16];
+} SwAesContext;
+
+static inline uint8_t swAesXtime(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ ((x >> 7) * 0x1B));
+}
+
+static inline void swAesSetKey(SwAesContext *ctx, const uint8_t key[16])
+{
+    uint8_t rcon = 1;
+
+    memcpy(ctx->roundKeys[0], key, 16);
+    for(int round = 1; round <= 10; round++)
+    {
+        const uint8_t *prev = ctx->roundKeys[round - 1];
+        uint8_t *cur = ctx->roundKeys[round];
+
+        cur[0] = prev[0] ^ swAesSbox[prev[13]] ^ rcon;
+        cur[1] = prev[1] ^ swAesSbox[prev[14]];
+        cur[2] = prev[2] ^ swAesSbox[prev[15]];
+        cur[3] = prev[3] ^ swAesSbox[prev[12]];
+        for(int i = 4; i < 16; i++)
+            cur[i] = prev[i] ^ cur[i - 4];
+
+        rcon = swAesXtime(rcon);
+    }
+}
+
+static inline void swAesEncryptBlock(const SwAesContext *ctx, uint8_t out[16], const uint8_t in[16])
+{
+    uint8_t s[16], t[16];
+
+    for(int i = 0; i < 16; i++)
+        s[i] = in[i] ^ ctx->roundKeys[0][i];
+
+    for(int round = 1; round <= 10; round++)
+    {
+        //SubBytes and ShiftRows, the state being column-major
+        for(int c = 0; c < 4; c++)
+            for(int r = 0; r < 4; r++)
+                t[4 * c + r] = swAesSbox[s[4 * ((c + r) & 3) + r]];
+
+        //MixColumns, except in the last round
+        if(round != 10)
+        {
+            for(int c = 0; c < 4; c++)
+            {
+                uint8_t *col = &t[4 * c],
+                        a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3],
+                        all = a0 ^ a1 ^ a2 ^ a3;
+
+                col[0] ^= all ^ swAesXtime(a0 ^ a1);
+                col[1] ^= all ^ swAesXtime(a1 ^ a2);
+                col[2] ^= all ^ swAesXtime(a2 ^ a3);
+                col[3] ^= all ^ swAesXtime(a3 ^ a0);
+            }
+        }
+
+        for(int i = 0; i < 16; i++)
+            s[i] = t[i] ^ ctx->roundKeys[round][i];
+    }
+
+    memcpy(out, s, 16);
+}
+
+//CTR mode with a big-endian 128-bit counter, as the AES engine does with AES_INPUT_BE; ctr is advanced past the data
+static inline void swAesCtr(const SwAesContext *ctx, uint8_t *out, const uint8_t *in, size_t size, uint8_t ctr[16])
+{
+    uint8_t keyStream[16];
+
+    for(size_t pos = 0; pos < size; pos += 16)
+    {
+        swAesEncryptBlock(ctx, keyStream, ctr);
+        for(size_t i = 0; i < 16 && pos + i < size; i++)
+            out[pos + i] = in[pos + i] ^ keyStream[i];
+
+        for(int i = 15; i >= 0 && ++ctr[i] == 0; i--);
+    }
+}
+
+static const uint32_t swSha256K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static inline uint32_t swSha256Rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline void swSha256Block(uint32_t h[8], const uint8_t *block)
+{
+    uint32_t w[64], v[8];
+
+    for(int i = 0; i < 16; i++)
+        w[i] = ((uint32_t)block[4 * i] << 24) | (block[4 * i + 1] << 16) | (block[4 * i + 2] << 8) | block[4 * i + 3];
+    for(int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = swSha256Rotr(w[i - 15], 7) ^ swSha256Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3),
+                 s1 = swSha256Rotr(w[i - 2], 17) ^ swSha256Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    memcpy(v, h, sizeof(v));
+    for(int i = 0; i < 64; i++)
+    {
+        uint32_t s1 = swSha256Rotr(v[4], 6) ^ swSha256Rotr(v[4], 11) ^ swSha256Rotr(v[4], 25),
+                 ch = (v[4] & v[5]) ^ (~v[4] & v[6]),
+                 t1 = v[7] + s1 + ch + swSha256K[i] + w[i],
+                 s0 = swSha256Rotr(v[0], 2) ^ swSha256Rotr(v[0], 13) ^ swSha256Rotr(v[0], 22),
+                 maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+
+        memmove(&v[1], &v[0], 7 * sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + s0 + maj;
+    }
+
+    for(int i = 0; i < 8; i++)
+        h[i] += v[i];
+}
+
+static inline void swSha256(uint8_t out[32], const void *data, size_t size)
+{
+    uint32_t h[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t last[128] = {0};
+    size_t pos;
+
+    for(pos = 0; pos + 64 <= size; pos += 64)
+        swSha256Block(h, p + pos);
+
+    //Padding: 0x80, zeroes, then the size in bits, big-endian
+    size_t rest = size - pos,
+           lastSize = rest < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)size * 8;
+
+    memcpy(last, p + pos, rest);
+    last[rest] = 0x80;
+    for(int i = 0; i < 8; i++)
+        last[lastSize - 1 - i] = (uint8_t)(bits >> (8 * i));
+
+    for(size_t i = 0; i < lastSize; i += 64)
+        swSha256Block(h, last + i);
+
+    for(int i = 0; i < 8; i++)
+    {
+        out[4 * i] = (uint8_t)(h[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(h[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(h[i] >> 8);
+        out[4 * i + 3] = (uint8_t)h[i];
+    }
+}
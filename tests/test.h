@@ -0,0 +1,98 @@
+/*
+*   This file is part of Luma3DS
+*   Copyright (C) 2016-2021 Aurora Wright, TuxSH
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+*       * Requiring preservation of specified reasonable legal notices or
+*         author attributions in that material or in the Appropriate Legal
+*         Notices displayed by works containing it.
+*       * Prohibiting misrepresentation of the origin of that material,
+*         or requiring that modified versions of such material be marked in
+*         reasonable ways as different from the original version.
+*/
+
+/*
+*   Minimal helpers shared by the host tests
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int testFailures;
+
+#define CHECK(cond) do \
+{ \
+    if(!(cond)) \
+    { \
+        testFailures++; \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+} while(0)
+
+//Benchmarks are only run with "<test> bench", see the Makefile
+static inline bool testIsBench(int argc, char **argv)
+{
+    return argc > 1 && strcmp(argv[1], "bench") == 0;
+}
+
+static inline double testNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//xorshift32, so that every run sees the same inputs
+static uint32_t testRandState = 0x12345678;
+
+static inline void testSeed(uint32_t seed)
+{
+    testRandState = seed != 0 ? seed : 1;
+}
+
+static inline uint32_t testRand(void)
+{
+    uint32_t x = testRandState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return testRandState = x;
+}
+
+static inline void testFillRandom(void *buf, size_t size, uint32_t alphabetSize)
+{
+    uint8_t *p = (uint8_t *)buf;
+    for(size_t i = 0; i < size; i++)
+        p[i] = alphabetSize >= 256 ? (uint8_t)testRand() : (uint8_t)(testRand() % alphabetSize);
+}
+
+static inline int testResult(const char *name)
+{
+    if(testFailures != 0)
+    {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, testFailures);
+        return 1;
+    }
+
+    printf("%s: OK\n", name);
+    return 0;
+}